@@ -28,6 +28,10 @@ RV_ENABLE_EXT_C := yes
 # so only set to "no" if SBI timers should be enforced for testing
 RV_ENABLE_EXT_SSTC := yes
 
+# compile the vector extension versions of memcpy, memmove and memset, only
+# used if the support is detected at runtime
+RV_ENABLE_EXT_V := yes
+
 # for emulation only
 CPUS := 4
 
@@ -140,6 +144,14 @@ ifeq ($(RV_ENABLE_EXT_SSTC), yes)
 EXT_DEFINES += -D__RISCV_EXT_SSTC
 endif
 
+# optional: vector extension, only enabled per function via ".option arch, +v"
+# so the compiler does not emit vector instructions elsewhere, needs gcc 14
+ifeq "$(TARGET_GCC_VERSION_AT_LEAST_14)" "1"
+ifeq ($(RV_ENABLE_EXT_V), yes)
+EXT_DEFINES += -D__RISCV_EXT_V
+endif
+endif
+
 # calling convention
 ifeq ($(BITWIDTH), 32)
 MABI := ilp32
@@ -175,6 +187,7 @@ OBJS_ARCH := arch/riscv/asm/entry.o \
 	arch/riscv/timer.o \
 	arch/riscv/scause.o \
 	arch/riscv/sbi.o \
+	arch/riscv/vector.o \
 	drivers/jh7110_temp.o \
 	drivers/jh7110_syscrg.o
 
@@ -12,6 +12,7 @@ typedef uint32_t CPU_Features;
 #define RV_EXT_FLOAT 0x10
 #define RV_EXT_DOUBLE 0x20
 #define RV_EXT_SSTC 0x40
+#define RV_EXT_VECTOR 0x80
 
 /// read and write tp, the thread pointer, which VIMIX uses to hold
 /// this core's hartid (core number), the index into g_cpus[].
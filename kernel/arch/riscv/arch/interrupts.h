@@ -65,6 +65,14 @@ static inline bool int_ctx_source_is_device(struct Interrupt_Context *ctx)
 }
 
 static inline bool int_ctx_source_is_page_fault(struct Interrupt_Context *ctx)
+{
+    return (ctx->scause == SCAUSE_STORE_AMO_PAGE_FAULT) ||
+           (ctx->scause == SCAUSE_LOAD_PAGE_FAULT) ||
+           (ctx->scause == SCAUSE_INSTRUCTION_PAGE_FAULT);
+}
+
+/// @brief Only valid if int_ctx_source_is_page_fault() is true.
+static inline bool int_ctx_page_fault_is_store(struct Interrupt_Context *ctx)
 {
     return (ctx->scause == SCAUSE_STORE_AMO_PAGE_FAULT);
 }
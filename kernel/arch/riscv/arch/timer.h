@@ -18,3 +18,6 @@ extern timer_schedule_interrupt_p *timer_schedule_interrupt;
 void timer_init(void *dtb, CPU_Features features);
 
 static inline uint64_t get_time() { return rv_get_time(); }
+
+/// @brief CPU cycle counter, readable in S-mode if the SBI allows it.
+static inline uint64_t get_cycles() { return rv_get_cycles(); }
@@ -3,6 +3,7 @@
 #include <kernel/pgtable.h>
 #include <kernel/proc.h>
 #include <mm/arch_early_pgtable.h>
+#include <mm/arch_vm.h>
 #include <mm/vm.h>
 #include "asm/satp.h"
 #include "riscv.h"
@@ -36,3 +37,16 @@ size_t mmu_get_page_table_asid(size_t reg_value)
     reg_value = reg_value & SATP_ASID_MASK;
     return reg_value >> SATP_ASID_POS;
 }
+
+uint32_t mmu_get_max_asid()
+{
+    // The ASID field is WARL: write all ones and read back which bits stuck
+    // (the spec calls their number ASIDLEN, it can be 0).
+    xlen_t satp = rv_read_csr_satp();
+    rv_write_csr_satp(satp | SATP_ASID_MASK);
+    xlen_t probed = rv_read_csr_satp();
+    rv_write_csr_satp(satp);
+    mmu_flush_tlb();
+
+    return (uint32_t)mmu_get_page_table_asid(probed);
+}
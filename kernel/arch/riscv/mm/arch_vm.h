@@ -4,6 +4,7 @@
 #include <kernel/kernel.h>
 #include <mm/pte.h>
 #include "asm/satp.h"
+#include "riscv.h"
 
 #define DEBUG_VM_PRINT_ARCH_PTE_FLAGS(pte) \
     printk("%c", PTE_IS_DIRTY(flags) ? 'd' : '_');
@@ -13,7 +14,7 @@ static inline void mmu_flush_tlb()
 // flush TLB if zifencei extension is supported, noop otherwise
 #if defined(__RISCV_EXT_ZIFENCEI)
     // the zero, zero means flush all TLB entries.
-    asm volatile("sfence.vma zero, zero");
+    asm volatile("sfence.vma zero, zero" ::: "memory");
 #endif
 }
 
@@ -21,7 +22,25 @@ static inline void mmu_flush_tlb_asid(uint32_t asid)
 {
 // flush TLB if zifencei extension is supported, noop otherwise
 #if defined(__RISCV_EXT_ZIFENCEI)
-    // the zero, zero means flush all TLB entries.
-    asm volatile("sfence.vma zero, %0" ::"r"(asid));
+    // the zero, asid means flush all non-global entries of that ASID.
+    asm volatile("sfence.vma zero, %0" ::"r"(asid) : "memory");
+#endif
+}
+
+static inline void mmu_flush_tlb_page(size_t va)
+{
+// flush TLB if zifencei extension is supported, noop otherwise
+#if defined(__RISCV_EXT_ZIFENCEI)
+    // the va, zero means flush the entries of va in all address spaces.
+    asm volatile("sfence.vma %0, zero" ::"r"(va) : "memory");
+#endif
+}
+
+static inline void mmu_flush_tlb_page_asid(size_t va, uint32_t asid)
+{
+// flush TLB if zifencei extension is supported, noop otherwise
+#if defined(__RISCV_EXT_ZIFENCEI)
+    // the va, asid means flush the non-global entry of va in that ASID.
+    asm volatile("sfence.vma %0, %1" ::"r"(va), "r"(asid) : "memory");
 #endif
 }
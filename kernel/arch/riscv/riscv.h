@@ -26,6 +26,8 @@ typedef size_t xlen_t;
 #define __RISCV_EXT_ZIFENCEI
 
 // Supervisor Status Register, sstatus
+#define SSTATUS_VS (3L << 9)    // Vector unit state, 0=Off (illegal instr.)
+#define SSTATUS_VS_INIT (1L << 9)  // Vector unit state Initial
 #define SSTATUS_SPP (1L << 8)   // Previous mode, 1=Supervisor, 0=User
 #define SSTATUS_SPIE (1L << 5)  // Supervisor Previous Interrupt Enable
 #define SSTATUS_UPIE (1L << 4)  // User Previous Interrupt Enable
@@ -14,10 +14,12 @@
 #include <kernel/kernel.h>
 #include <kernel/kticks.h>
 #include <kernel/proc.h>
+#include <kernel/scheduler.h>
 #include <kernel/smp.h>
 #include <kernel/spinlock.h>
 #include <kernel/trap.h>
 #include <lib/panic.h>
+#include <mm/asid.h>
 #include <mm/memlayout.h>
 #include <mm/vm.h>
 #include <syscalls/syscall.h>
@@ -147,15 +149,17 @@ void return_to_user_mode()
     // set S Exception Program Counter to the saved user pc.
     rv_write_csr_sepc(trapframe_get_program_counter(proc->trapframe));
 
-    // tell u_mode_trap_vector.S the user page table to switch to.
-    size_t satp = mmu_make_page_table_reg((size_t)proc->pagetable->root, 0);
+    // tell u_mode_trap_vector.S the user page table to switch to. The ASID
+    // tags its TLB entries, so no flush is needed when switching.
+    uint32_t asid = asid_activate(proc->pagetable);
+    size_t satp = mmu_make_page_table_reg((size_t)proc->pagetable->root, asid);
 
     // jump to return_to_user_mode_asm in u_mode_trap_vector.S at the top of
     // memory, which switches to the user page table, restores user registers,
     // and switches to user mode with sret.
     size_t return_to_user_mode_asm_ptr =
         TRAMPOLINE + ((size_t)return_to_user_mode_asm - (size_t)trampoline);
-    ((void (*)(size_t, size_t))return_to_user_mode_asm_ptr)(satp, 0);
+    ((void (*)(size_t))return_to_user_mode_asm_ptr)(satp);
 }
 
 void handle_device_interrupt()
@@ -189,14 +193,14 @@ void handle_device_interrupt()
 
 void handle_timer_interrupt()
 {
-    uint64_t timer_interrupt_interval =
-        g_timebase_frequency / TIMER_INTERRUPTS_PER_SECOND;
     uint64_t now = rv_get_time();
-    timer_schedule_interrupt(now + timer_interrupt_interval);
 
-    // will only update on the CPU that booted first
+    // expires sleepers and arms the next timer interrupt
+    scheduler_timer_interrupt(now);
+
+    // only on the CPU that booted first
     if (smp_processor_id() == g_boot_hart)
     {
-        kticks_inc_ticks();
+        kticks_tick();
     }
 }
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <arch/riscv/vector.h>
+#include <kernel/cpu.h>
+#include <kernel/proc.h>
+#include <kernel/smp.h>
+
+#if defined(__RISCV_EXT_V)
+
+// The vector unit is only switched on while the kernel uses it with
+// interrupts disabled: no other process can see or clobber the vector
+// registers, so they don't need to be saved on context switches and user
+// space still traps on vector instructions.
+static inline bool vector_begin()
+{
+    cpu_push_disable_device_interrupt_stack();
+    if ((g_cpus[smp_processor_id()].features & RV_EXT_VECTOR) == 0)
+    {
+        cpu_pop_disable_device_interrupt_stack();
+        return false;
+    }
+    rv_set_csr_sstatus(SSTATUS_VS_INIT);
+    return true;
+}
+
+static inline void vector_end()
+{
+    rv_clear_csr_sstatus(SSTATUS_VS);
+    cpu_pop_disable_device_interrupt_stack();
+}
+
+bool vector_memcpy(void *dst, const void *src, size_t n)
+{
+    if (!vector_begin()) return false;
+
+    // vsetvli picks the chunk size, 8 registers grouped (m8) per load
+    asm volatile(
+        ".option push\n"
+        ".option arch, +v\n"
+        "1:\n"
+        "vsetvli t0, %[n], e8, m8, ta, ma\n"
+        "vle8.v v0, (%[src])\n"
+        "vse8.v v0, (%[dst])\n"
+        "add %[src], %[src], t0\n"
+        "add %[dst], %[dst], t0\n"
+        "sub %[n], %[n], t0\n"
+        "bnez %[n], 1b\n"
+        ".option pop\n"
+        : [dst] "+r"(dst), [src] "+r"(src), [n] "+r"(n)
+        :
+        : "t0", "memory");
+
+    vector_end();
+    return true;
+}
+
+bool vector_memset(void *dst, uint8_t c, size_t n)
+{
+    if (!vector_begin()) return false;
+
+    size_t value = c;
+    asm volatile(
+        ".option push\n"
+        ".option arch, +v\n"
+        "1:\n"
+        "vsetvli t0, %[n], e8, m8, ta, ma\n"
+        "vmv.v.x v0, %[value]\n"
+        "vse8.v v0, (%[dst])\n"
+        "add %[dst], %[dst], t0\n"
+        "sub %[n], %[n], t0\n"
+        "bnez %[n], 1b\n"
+        ".option pop\n"
+        : [dst] "+r"(dst), [n] "+r"(n)
+        : [value] "r"(value)
+        : "t0", "memory");
+
+    vector_end();
+    return true;
+}
+
+#endif  // __RISCV_EXT_V
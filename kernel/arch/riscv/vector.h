@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: MIT */
+#pragma once
+
+#include <kernel/kernel.h>
+
+/// Smaller copies don't make up for enabling the vector unit.
+#define VECTOR_STRING_MIN_SIZE 256
+
+/// @brief memcpy() with the vector extension. Copies forward in chunks which
+/// are loaded completely before they are stored, so dst may overlap src if
+/// dst < src.
+/// @param dst destination address
+/// @param src source address
+/// @param n bytes to copy, > 0
+/// @return False if this CPU has no vector unit, nothing was copied.
+bool vector_memcpy(void *dst, const void *src, size_t n);
+
+/// @brief memset() with the vector extension.
+/// @param dst Memory to set
+/// @param c Value of each byte
+/// @param n Number of bytes to set, > 0
+/// @return False if this CPU has no vector unit, nothing was set.
+bool vector_memset(void *dst, uint8_t c, size_t n);
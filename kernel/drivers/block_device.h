@@ -17,10 +17,20 @@ struct Block_Device;
 struct block_device_ops
 {
     /// read one block of data from the buffer.
+    /// Synchronous, only used if submit_buf is NULL.
     void (*read_buf)(struct Block_Device *bd, struct buf *b);
 
     /// write one block of data into the buffer.
+    /// Synchronous, only used if submit_buf is NULL.
     void (*write_buf)(struct Block_Device *bd, struct buf *b);
+
+    /// Optional: queue a read or write of count buffers of consecutive
+    /// blocks and return without waiting. The driver calls bio_end_io() for
+    /// each buffer once its request finished. Drivers should transfer the
+    /// blocks with as few device requests as possible.
+    /// May sleep till the device has room for the request.
+    void (*submit_bufs)(struct Block_Device *bd, struct buf **bufs,
+                        size_t count, bool write);
 };
 
 /// @brief Represents one block device.
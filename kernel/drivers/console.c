@@ -122,9 +122,9 @@ ssize_t console_read(struct Device *dev, bool addr_is_userspace, size_t dst,
     spin_lock(&g_console.lock);
     while (n > 0)
     {
-        size_t timeout = g_console.termios.c_cc[VTIME];  // 1/10s
-        timeout = timeout * TIMER_INTERRUPTS_PER_SECOND / 10;
-        timeout += kticks_get_ticks();
+        uint64_t timeout = g_console.termios.c_cc[VTIME];  // 1/10s
+        timeout = timeout * g_timebase_frequency / 10;
+        timeout += get_time();
 
         // wait until interrupt handler has put some
         // input into g_console.buffer.
@@ -141,17 +141,15 @@ ssize_t console_read(struct Device *dev, bool addr_is_userspace, size_t dst,
             }
             else
             {
-                size_t now = kticks_get_ticks();
+                uint64_t now = get_time();
                 if (now >= timeout)
                 {
                     // timeout expired
                     spin_unlock(&g_console.lock);
                     return 0;
                 }
-                // wake up eack kernel tick to check for input
-                // if we wait here for a console interrupt, we miss the
-                // timeout
-                sleep(&g_ticks, &g_console.lock);
+                // wait for a console interrupt or the timeout
+                sleep_until(&g_console.r, &g_console.lock, timeout);
             }
         }
 
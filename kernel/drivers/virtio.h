@@ -80,7 +80,9 @@ struct virtio_blk_config
 
 /// this many virtio descriptors.
 /// must be a power of two.
-#define VIRTIO_DESCRIPTORS 8
+/// A single block disk request uses three, so up to 21 requests can be in
+/// flight.
+#define VIRTIO_DESCRIPTORS 64
 
 /// a single descriptor, from the spec.
 struct virtq_desc
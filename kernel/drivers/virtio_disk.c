@@ -9,6 +9,7 @@
 #include <drivers/mmio_access.h>
 #include <drivers/virtio.h>
 #include <drivers/virtio_disk.h>
+#include <kernel/bio.h>
 #include <kernel/buf.h>
 #include <kernel/fs.h>
 #include <kernel/kernel.h>
@@ -17,12 +18,13 @@
 #include <kernel/sleeplock.h>
 #include <kernel/spinlock.h>
 #include <kernel/string.h>
+#include <lib/minmax.h>
 #include <mm/kalloc.h>
 
 atomic_size_t g_virtio_next_minor = 0;
 
-void virtio_block_device_read(struct Block_Device *bd, struct buf *b);
-void virtio_block_device_write(struct Block_Device *bd, struct buf *b);
+void virtio_block_device_submit(struct Block_Device *bd, struct buf **bufs,
+                                size_t count, bool write);
 void virtio_block_device_interrupt(dev_t dev);
 
 dev_t virtio_disk_init_internal(size_t disk_index,
@@ -170,8 +172,7 @@ dev_t virtio_disk_init_internal(size_t disk_index,
              MKDEV(QEMU_VIRT_IO_DISK_MAJOR, disk_index), device_name,
              mapping->interrupt, virtio_block_device_interrupt);
     disk->disk.bdev.size = config->capacity * 512;
-    disk->disk.bdev.ops.read_buf = virtio_block_device_read;
-    disk->disk.bdev.ops.write_buf = virtio_block_device_write;
+    disk->disk.bdev.ops.submit_bufs = virtio_block_device_submit;
     disk->disk.bdev.dev.mode = 0600;
 
     register_device(&disk->disk.bdev.dev);
@@ -249,11 +250,12 @@ static void free_chain(struct virtio_disk *disk, int32_t i)
     }
 }
 
-/// allocate three descriptors (they need not be contiguous).
-/// disk transfers always use three descriptors.
-static int32_t alloc3_desc(struct virtio_disk *disk, int32_t *idx)
+/// allocate count descriptors (they need not be contiguous).
+/// a disk transfer uses one descriptor per buffer plus two.
+static int32_t alloc_descs(struct virtio_disk *disk, int32_t *idx,
+                           size_t count)
 {
-    for (size_t i = 0; i < 3; i++)
+    for (size_t i = 0; i < count; i++)
     {
         idx[i] = alloc_desc(disk);
         if (idx[i] < 0)
@@ -268,40 +270,40 @@ static int32_t alloc3_desc(struct virtio_disk *disk, int32_t *idx)
     return 0;
 }
 
-void virtio_disk_rw(struct virtio_disk *disk, struct buf *b, bool write)
+/// Queue one request for count buffers of consecutive blocks and return,
+/// virtio_block_device_interrupt() completes it. Only sleeps if not enough
+/// descriptors are free.
+static void virtio_disk_rw(struct virtio_disk *disk, struct buf **bufs,
+                           size_t count, bool write)
 {
-    uint64_t sector = b->blockno * (BLOCK_SIZE / 512);
+    const size_t sectors_per_block = BLOCK_SIZE / 512;
+    uint64_t sector = bufs[0]->blockno * sectors_per_block;
     uint64_t sector_count = disk->disk.bdev.size / 512;
-    if (sector >= sector_count)
+    if (count > VIRTIO_DISK_MAX_SEGMENTS ||
+        sector + (count - 1) * sectors_per_block >= sector_count)
     {
         panic("virtio_disk_rw: invalid sector");
     }
-    size_t read_amount = BLOCK_SIZE;
-    if (sector == sector_count - 1)
-    {
-        // A disk with an uneven number of sectors can't read two
-        // sectors ( == 1 block )
-        read_amount = 512;
-    }
 
     spin_lock(&disk->vdisk_lock);
 
-    // the spec's Section 5.2 says that legacy block operations use
-    // three descriptors: one for type/reserved/sector, one for the
-    // data, one for a 1-byte status result.
+    // the spec's Section 5.2 says that block operations use one
+    // descriptor for type/reserved/sector, one per data buffer and
+    // one for a 1-byte status result.
 
-    // allocate the three descriptors.
-    int32_t idx[3];
+    // allocate the descriptors.
+    int32_t idx[VIRTIO_DISK_MAX_SEGMENTS + 2];
+    size_t status_desc = count + 1;
     while (true)
     {
-        if (alloc3_desc(disk, idx) == 0)
+        if (alloc_descs(disk, idx, count + 2) == 0)
         {
             break;
         }
         sleep(&disk->free[0], &disk->vdisk_lock);
     }
 
-    // format the three descriptors.
+    // format the descriptors.
     // qemu's virtio-blk.c reads them.
 
     struct virtio_blk_req *buf0 = &disk->ops[idx[0]];
@@ -321,30 +323,44 @@ void virtio_disk_rw(struct virtio_disk *disk, struct buf *b, bool write)
     disk->desc[idx[0]].len = sizeof(struct virtio_blk_req);
     disk->desc[idx[0]].flags = VRING_DESC_F_NEXT;
     disk->desc[idx[0]].next = idx[1];
+    disk->info[idx[0]].b = NULL;
 
-    disk->desc[idx[1]].addr = virt_to_phys((size_t)b->data);
-    disk->desc[idx[1]].len = read_amount;
-    if (write)
+    for (size_t i = 0; i < count; i++)
     {
-        disk->desc[idx[1]].flags = 0;  // device reads b->data
-    }
-    else
-    {
-        disk->desc[idx[1]].flags = VRING_DESC_F_WRITE;  // device writes b->data
+        size_t read_amount = BLOCK_SIZE;
+        if (sector + i * sectors_per_block == sector_count - 1)
+        {
+            // A disk with an uneven number of sectors can't read two
+            // sectors ( == 1 block )
+            read_amount = 512;
+        }
+
+        struct virtq_desc *desc = &disk->desc[idx[i + 1]];
+        desc->addr = virt_to_phys((size_t)bufs[i]->data);
+        desc->len = read_amount;
+        if (write)
+        {
+            desc->flags = 0;  // device reads b->data
+        }
+        else
+        {
+            desc->flags = VRING_DESC_F_WRITE;  // device writes b->data
+        }
+        desc->flags |= VRING_DESC_F_NEXT;
+        desc->next = idx[i + 2];
+
+        // record struct buf for virtio_block_device_interrupt().
+        disk->info[idx[i + 1]].b = bufs[i];
     }
-    disk->desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-    disk->desc[idx[1]].next = idx[2];
 
     disk->info[idx[0]].status = 0xff;  // device writes 0 on success
-    disk->desc[idx[2]].addr = virt_to_phys((size_t)&disk->info[idx[0]].status);
-    disk->desc[idx[2]].len = 1;
+    disk->desc[idx[status_desc]].addr =
+        virt_to_phys((size_t)&disk->info[idx[0]].status);
+    disk->desc[idx[status_desc]].len = 1;
     // device writes the status:
-    disk->desc[idx[2]].flags = VRING_DESC_F_WRITE;
-    disk->desc[idx[2]].next = 0;
-
-    // record struct buf for virtio_block_device_interrupt().
-    b->owned_by_driver = true;
-    disk->info[idx[0]].b = b;
+    disk->desc[idx[status_desc]].flags = VRING_DESC_F_WRITE;
+    disk->desc[idx[status_desc]].next = 0;
+    disk->info[idx[status_desc]].b = NULL;
 
     // tell the device the first index in our chain of descriptors.
     disk->avail->ring[disk->avail->idx % VIRTIO_DESCRIPTORS] = idx[0];
@@ -359,38 +375,26 @@ void virtio_disk_rw(struct virtio_disk *disk, struct buf *b, bool write)
     uint32_t queue_number = 0;
     MMIO_WRITE_UINT_32(disk->mmio_base, VIRTIO_MMIO_QUEUE_NOTIFY, queue_number);
 
-    // Wait for virtio_block_device_interrupt() to say request has finished.
-    while (b->owned_by_driver == true)
-    {
-        sleep(b, &disk->vdisk_lock);
-    }
-
-    disk->info[idx[0]].b = 0;
-    free_chain(disk, idx[0]);
-
     spin_unlock(&disk->vdisk_lock);
 }
 
-/// @brief Read function as mandated for a Block_Device
-/// @param bd Pointer to the device
-/// @param b The buffer to fill.
-void virtio_block_device_read(struct Block_Device *bd, struct buf *b)
-{
-    struct Generic_Disc *gdisk = generic_disk_from_block_device(bd);
-    struct virtio_disk *vdisk = virtio_from_generic_disk(gdisk);
-
-    virtio_disk_rw(vdisk, b, false);
-}
-
-/// @brief Write function as mandated for a Block_Device
+/// @brief Submit function as mandated for a Block_Device
 /// @param bd Pointer to the device
-/// @param b The buffer to write out to disk.
-void virtio_block_device_write(struct Block_Device *bd, struct buf *b)
+/// @param bufs Buffers of consecutive blocks to fill or to write out to disk.
+/// @param count Number of buffers.
+/// @param write true to write the buffers, false to read them.
+void virtio_block_device_submit(struct Block_Device *bd, struct buf **bufs,
+                                size_t count, bool write)
 {
     struct Generic_Disc *gdisk = generic_disk_from_block_device(bd);
     struct virtio_disk *vdisk = virtio_from_generic_disk(gdisk);
 
-    virtio_disk_rw(vdisk, b, true);
+    // one request per VIRTIO_DISK_MAX_SEGMENTS blocks
+    for (size_t i = 0; i < count; i += VIRTIO_DISK_MAX_SEGMENTS)
+    {
+        virtio_disk_rw(vdisk, &bufs[i],
+                       min(count - i, VIRTIO_DISK_MAX_SEGMENTS), write);
+    }
 }
 
 /// @brief The interrupt handler for the Block_Device
@@ -428,9 +432,23 @@ void virtio_block_device_interrupt(dev_t dev)
             panic("virtio_block_device_interrupt status");
         }
 
-        struct buf *b = disk->info[id].b;
-        b->owned_by_driver = false;  // disk is done with buf
-        wakeup(b);
+        // the data descriptors of the chain record their struct buf
+        int32_t i = id;
+        while (true)
+        {
+            struct buf *b = disk->info[i].b;
+            if (b != NULL)
+            {
+                disk->info[i].b = NULL;
+                bio_end_io(b);  // disk is done with buf
+            }
+            if ((disk->desc[i].flags & VRING_DESC_F_NEXT) == 0)
+            {
+                break;
+            }
+            i = disk->desc[i].next;
+        }
+        free_chain(disk, id);
 
         disk->used_idx += 1;
     }
@@ -10,6 +10,9 @@
 #include <kernel/kernel.h>
 #include <kernel/spinlock.h>
 
+/// Maximal number of blocks in one request, each needs a descriptor.
+#define VIRTIO_DISK_MAX_SEGMENTS 16
+
 struct virtio_disk
 {
     struct Generic_Disc disk;  ///< derived from a generic disk
@@ -38,7 +41,8 @@ struct virtio_disk
 
     /// track info about in-flight operations,
     /// for use when completion interrupt arrives.
-    /// indexed by first descriptor index of chain.
+    /// status is indexed by first descriptor index of chain,
+    /// b by the index of the data descriptor of the buffer.
     struct
     {
         struct buf *b;
@@ -4,6 +4,7 @@
 #include <fs/dentry_cache.h>
 #include <kernel/spinlock.h>
 #include <kernel/string.h>
+#include <mm/cache.h>
 #include <mm/kalloc.h>
 
 //
@@ -13,15 +14,13 @@
 // from dentry_cache (only needed here)
 void dentry_cache_move_to_lru(struct dentry *dp);
 
-struct dentry *dentry_alloc()
-{
-    struct dentry *new_dentry = kmalloc(sizeof(struct dentry), 0);
-    if (new_dentry == NULL)
-    {
-        return NULL;
-    }
+// allocations of struct dentry
+static struct kmem_cache *g_dentry_obj_cache = NULL;
 
-    // init fields
+// constructor of g_dentry_obj_cache
+static void dentry_ctor(void *object)
+{
+    struct dentry *new_dentry = (struct dentry *)object;
     kref_init(&new_dentry->ref);
     spin_lock_init(&new_dentry->lock, "dentry_lock");
     new_dentry->ip = NULL;
@@ -30,8 +29,22 @@ struct dentry *dentry_alloc()
     list_init(&new_dentry->child_list);
     list_init(&new_dentry->sibling_list);
     list_init(&new_dentry->lru_list);
+}
 
-    return new_dentry;
+void dentry_init()
+{
+    g_dentry_obj_cache =
+        kmem_cache_create("dentry", sizeof(struct dentry), 0, dentry_ctor);
+    if (g_dentry_obj_cache == NULL)
+    {
+        panic("dentry_init: out of memory");
+    }
+}
+
+struct dentry *dentry_alloc()
+{
+    // fields get initialized by dentry_ctor()
+    return kmem_cache_alloc(g_dentry_obj_cache, ALLOC_FLAG_NONE);
 }
 
 struct dentry *dentry_alloc_init_orphan(const char *name, struct inode *ip)
@@ -50,7 +63,7 @@ struct dentry *dentry_alloc_init_orphan(const char *name, struct inode *ip)
     new_dentry->name = kmalloc(str_len + 1, 0);
     if (new_dentry->name == NULL)
     {
-        kfree(new_dentry);
+        kmem_cache_free(g_dentry_obj_cache, new_dentry);
         return NULL;
     }
     memcpy((char *)new_dentry->name, name, str_len + 1);
@@ -154,7 +167,7 @@ void dentry_free(struct dentry *dp)
     }
 
     // free dentry itself
-    kfree(dp);
+    kmem_cache_free(g_dentry_obj_cache, dp);
 }
 
 struct dentry *dentry_get(struct dentry *dp)
@@ -34,6 +34,10 @@ struct dentry
 
 #define dentry_from_lru_list(ptr) container_of((ptr), struct dentry, lru_list)
 
+/// @brief Creates the cache all dentries get allocated from. Called once
+/// during boot before the first dentry gets allocated.
+void dentry_init();
+
 /// @brief Allocates an invalid dentry (no name, no inode).
 /// The reference count is initialized to 1.
 /// @return A fresh dentry or NULL on error.
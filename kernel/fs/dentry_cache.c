@@ -8,9 +8,22 @@
 #include <kernel/string.h>
 #include <lib/minmax.h>
 #include <mm/kernel_memory.h>
+#include <mm/shrinker.h>
 
 struct dentry_cache g_dentry_cache = {0};
 
+static size_t dentry_cache_shrink(size_t bytes)
+{
+    size_t count = (bytes + sizeof(struct dentry) - 1) / sizeof(struct dentry);
+    return dentry_cache_shrink_lru(&g_dentry_cache, count) *
+           sizeof(struct dentry);
+}
+
+// unused inodes are only kept by the dentries in the LRU list, so this also
+// frees the inodes
+static struct shrinker g_dentry_shrinker = {.name = "dcache",
+                                            .shrink = dentry_cache_shrink};
+
 //
 // dentry cache
 //
@@ -44,6 +57,8 @@ struct dentry *dentry_cache_init(struct inode *root_ip)
     kobject_init(&g_dentry_cache.kobj, &dentry_cache_kobj_ktype);
     kobject_add(&g_dentry_cache.kobj, &g_kernel_memory.kobj, "dcache");
 
+    register_shrinker(&g_dentry_shrinker);
+
     return root_dentry;
 }
 
@@ -116,6 +131,75 @@ void dentry_cache_drain_lru(struct dentry_cache *cache, size_t target)
     }
 }
 
+size_t dentry_cache_shrink_lru(struct dentry_cache *cache, size_t count)
+{
+    enum
+    {
+        DRAIN_BATCH_SIZE = 32
+    };
+    struct dentry *to_free[DRAIN_BATCH_SIZE];
+    struct dentry *parents_to_put[DRAIN_BATCH_SIZE];
+    size_t freed = 0;
+
+    while (freed < count)
+    {
+        size_t drained = 0;
+
+        // detach a bounded batch under locks, oldest first
+        dcache_write_lock();
+        spin_lock(&cache->list_lock);
+        struct list_head *lru_pos = cache->lru_list.prev;
+        while (lru_pos != &cache->lru_list && drained < DRAIN_BATCH_SIZE &&
+               freed + drained < count)
+        {
+            struct dentry *lru_dp = dentry_from_lru_list(lru_pos);
+            lru_pos = lru_pos->prev;
+
+            // dropping the last reference to an inode without links deletes
+            // the file on disk, which sleeps
+            if ((kref_read(&lru_dp->ref) != 0) ||
+                (lru_dp->ip != NULL && lru_dp->ip->nlink == 0))
+            {
+                continue;
+            }
+
+            list_del(&lru_dp->lru_list);
+            cache->lru_size--;
+
+            struct dentry *parent = lru_dp->parent;
+            if (parent != NULL)
+            {
+                list_del(&lru_dp->sibling_list);
+                lru_dp->parent = NULL;
+            }
+
+            to_free[drained] = lru_dp;
+            parents_to_put[drained] = parent;
+            drained++;
+        }
+        spin_unlock(&cache->list_lock);
+        dcache_write_unlock();
+
+        if (drained == 0)
+        {
+            // nothing left to evict
+            break;
+        }
+
+        // drop parent refs and free dentries outside locks
+        for (size_t i = 0; i < drained; ++i)
+        {
+            if (parents_to_put[i] != NULL)
+            {
+                dentry_put(parents_to_put[i]);
+            }
+            dentry_free(to_free[i]);
+        }
+        freed += drained;
+    }
+    return freed;
+}
+
 void dentry_cache_move_to_lru(struct dentry *dp)
 {
     spin_lock(&g_dentry_cache.list_lock);
@@ -102,6 +102,14 @@ syserr_t dentry_cache_set_max_lru(struct dentry_cache *dcache,
 
 syserr_t dentry_cache_clear_lru(struct dentry_cache *dcache);
 
+/// @brief Free unreferenced dentries of the LRU list, oldest first. Unlike
+/// dentry_cache_clear_lru() it skips dentries which are in use and the ones
+/// of inodes without links, so it never sleeps. Used by the shrinker.
+/// @param dcache The dentry cache.
+/// @param count Max number of dentries to free.
+/// @return Number of freed dentries.
+size_t dentry_cache_shrink_lru(struct dentry_cache *dcache, size_t count);
+
 static inline bool dentry_is_unlinked(struct dentry *dp)
 {
     return dp->parent == g_dentry_cache.unlinked_root;
@@ -132,6 +132,7 @@ syserr_t devfs_fops_write(struct file *f, size_t addr, size_t n)
 
 struct file_operations devfs_f_op = {
     fops_open : fops_open_default,
+    fops_read : fops_read_default,
     fops_write : devfs_fops_write
 };
 
@@ -25,6 +25,7 @@
 #include <kernel/spinlock.h>
 #include <kernel/string.h>
 #include <mm/kalloc.h>
+#include <mm/page_cache.h>
 
 struct super_block *sb_alloc_init()
 {
@@ -51,12 +52,14 @@ void inode_init(struct inode *ip, struct super_block *sb, ino_t inum)
     ip->dev = sb->dev;
     ip->inum = inum;
     kref_init(&ip->ref);
+    atomic_init(&ip->i_file_mappings, 0);
     sleep_lock_init(&ip->lock, "inode sleeplock");
     sleep_lock_init(&ip->write_exclusive_lock, "inode ex-w lock");
 
     // don't add to super block inode list yet, that is done when the inode
     // is fully initialized (might need to read data from disk first)
     list_init(&ip->fs_inode_list);
+    list_init(&ip->i_page_cache);
 }
 
 void inode_del(struct inode *ip)
@@ -77,6 +80,9 @@ void inode_del(struct inode *ip)
 
     // remove from super block inode list
     list_del(&ip->fs_inode_list);
+
+    // the cached pages are found by the inode address, which can get reused
+    page_cache_drop_inode(ip);
 }
 
 void inode_lock(struct inode *ip)
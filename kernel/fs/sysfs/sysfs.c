@@ -44,6 +44,7 @@ struct inode_operations sysfs_i_op = {
 
 struct file_operations sysfs_f_op = {
     fops_open : fops_open_default,
+    fops_read : fops_read_default,
     fops_write : sysfs_fops_write
 };
 
@@ -1,10 +1,12 @@
 /* SPDX-License-Identifier: MIT */
 
+#include <fs/dentry.h>
 #include <fs/devfs/devfs.h>
 #include <fs/sysfs/sysfs.h>
 #include <fs/vfs.h>
 #include <fs/vimixfs/vimixfs.h>
 #include <kernel/errno.h>
+#include <kernel/file.h>
 #include <kernel/statvfs.h>
 #include <kernel/string.h>
 
@@ -15,6 +17,7 @@ void init_virtual_file_system()
 {
     g_file_systems = NULL;
     sleep_lock_init(&g_mount_lock, "mount");
+    dentry_init();
 
     // init all file system implementations
     devfs_init();
@@ -143,3 +146,9 @@ syserr_t iops_chown_default_ro(struct dentry *dp, uid_t uid, gid_t gid)
 }
 
 syserr_t fops_open_default(struct inode *ip, struct file *f) { return 0; }
+
+syserr_t fops_read_default(struct file *f, size_t addr, size_t n)
+{
+    struct inode *ip = f->dp->ip;
+    return ip->i_sb->i_op->iops_read(ip, f->off, addr, n, true);
+}
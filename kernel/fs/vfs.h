@@ -94,3 +94,10 @@ syserr_t iops_chmod_default_ro(struct dentry *dp, mode_t mode);
 syserr_t iops_chown_default_ro(struct dentry *dp, uid_t uid, gid_t gid);
 
 syserr_t fops_open_default(struct inode *ip, struct file *f);
+
+/// @brief Default implementation of fops_read: iops_read() at f->off.
+/// @param f File to read from.
+/// @param addr User space destination address.
+/// @param n Number of bytes to read.
+/// @return Number of bytes read or -ERRNO.
+syserr_t fops_read_default(struct file *f, size_t addr, size_t n);
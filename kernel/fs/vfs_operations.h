@@ -139,6 +139,7 @@ struct inode_operations
 struct file_operations
 {
     syserr_t (*fops_open)(struct inode *ip, struct file *f);
+    syserr_t (*fops_read)(struct file *f, size_t addr, size_t n);
     syserr_t (*fops_write)(struct file *f, size_t addr, size_t n);
 };
 
@@ -152,6 +153,10 @@ struct file_operations
 #define VFS_FILE_WRITE(f, addr, n) \
     (f)->dp->ip->i_sb->f_op->fops_write((f), (addr), (n))
 
-#define VFS_FILE_READ(file, dst, n)                                          \
-    (file)->dp->ip->i_sb->i_op->iops_read((f->dp->ip), (f->off), (dst), (n), \
-                                          (true))
+/// @brief Read n bytes at f->off into the user space buffer at dst.
+/// @param file File to read from, the caller advances f->off.
+/// @param dst User space destination address.
+/// @param n Number of bytes to read.
+/// @return Number of bytes read or -ERRNO.
+#define VFS_FILE_READ(file, dst, n) \
+    (file)->dp->ip->i_sb->f_op->fops_read((file), (dst), (n))
@@ -158,3 +158,45 @@ size_t bmap_get_block_address(struct inode *ip, uint32_t block_number)
     panic("bmap_get_block_address: out of range");
     return 0;
 }
+
+/// Entry of an indirect block, 0 if the indirect block is not mapped.
+static uint32_t bmap_lookup_in_block(struct inode *ip, uint32_t ib_addr,
+                                     uint32_t block_number)
+{
+    if (ib_addr == 0)
+    {
+        return 0;
+    }
+
+    struct buf *bp = bio_read(ip->dev, ib_addr);
+    uint32_t addr = ((uint32_t *)bp->data)[block_number];
+    bio_release(bp);
+    return addr;
+}
+
+size_t bmap_lookup_block_address(struct inode *ip, uint32_t block_number)
+{
+    struct vimixfs_inode *xv_ip = vimixfs_inode_from_inode(ip);
+    if (block_number < VIMIXFS_N_DIRECT_BLOCKS)
+    {
+        return xv_ip->addrs[block_number];
+    }
+    block_number -= VIMIXFS_N_DIRECT_BLOCKS;
+
+    if (block_number < VIMIXFS_N_INDIRECT_BLOCKS)
+    {
+        return bmap_lookup_in_block(
+            ip, xv_ip->addrs[VIMIXFS_INDIRECT_BLOCK_IDX], block_number);
+    }
+    block_number -= VIMIXFS_N_INDIRECT_BLOCKS;
+
+    if (block_number < VIMIXFS_N_INDIRECT_BLOCKS * VIMIXFS_N_INDIRECT_BLOCKS)
+    {
+        size_t index_0 = block_number / VIMIXFS_N_INDIRECT_BLOCKS;
+        size_t index_1 = block_number % VIMIXFS_N_INDIRECT_BLOCKS;
+        uint32_t indirect_block = bmap_lookup_in_block(
+            ip, xv_ip->addrs[VIMIXFS_DOUBLE_INDIRECT_BLOCK_IDX], index_0);
+        return bmap_lookup_in_block(ip, indirect_block, index_1);
+    }
+    return 0;
+}
@@ -9,6 +9,12 @@
 /// returns 0 if out of disk space.
 size_t bmap_get_block_address(struct inode *ip, uint32_t block_number);
 
+/// @brief Like bmap_get_block_address() but never allocates, so it needs
+/// neither the inode lock nor a log transaction. Without the lock the result
+/// might be stale, only use it for hints like readahead.
+/// @return Disk block address or 0 if the block is not mapped.
+size_t bmap_lookup_block_address(struct inode *ip, uint32_t block_number);
+
 /// @brief Allocates and inits (zeroes) a block and marks it used in the block
 /// bitmap.
 /// @param sb Super block to allocate from.
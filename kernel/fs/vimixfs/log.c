@@ -16,6 +16,10 @@
 #include <lib/minmax.h>
 #include <mm/kalloc.h>
 
+/// Number of log blocks read or written with one bio_batch. Keeps that many
+/// requests in the disk queue, bounded by the buffer pointers on the stack.
+#define LOG_IO_BATCH 16
+
 static void recover_from_log(struct log *log);
 static void commit(struct log *log);
 
@@ -80,23 +84,44 @@ static void install_trans(struct log *log, bool recovering)
             "(%d,%d)\n",
             log->lh_n, minor, major);
     }
-    for (int32_t tail = 0; tail < log->lh_n; tail++)
+    uint32_t blocknos[LOG_IO_BATCH];
+    struct buf *bufs[LOG_IO_BATCH];
+    for (size_t first = 0; first < log->lh_n; first += LOG_IO_BATCH)
     {
-        struct buf *lbuf =
-            bio_read(log->dev, log->start + tail + 1);  // read log block
+        size_t count = min(log->lh_n - first, LOG_IO_BATCH);
+
+        // read the log blocks with one request, only needed when recovering
+        // as the blocks are usually still cached
+        for (size_t i = 0; i < count; i++)
+        {
+            blocknos[i] = log->start + first + i + 1;
+        }
+        bio_read_blocks(log->dev, blocknos, bufs, count);
 
-        struct buf *dbuf =
-            bio_get_from_cache(log->dev, log->lh_block[tail]);  // get dst
-        dbuf->valid = true;
+        // copy to the destinations and write them all at once
+        struct bio_batch batch;
+        bio_batch_init(&batch);
+        for (size_t i = 0; i < count; i++)
+        {
+            struct buf *lbuf = bufs[i];
+            bio_lock(lbuf);
+            bufs[i] = bio_get_from_cache(log->dev, log->lh_block[first + i]);
+            bufs[i]->valid = true;
+
+            memmove(bufs[i]->data, lbuf->data, BLOCK_SIZE);
+            bio_release(lbuf);
+        }
+        bio_batch_submit_bufs(&batch, bufs, count, true);
+        bio_batch_wait(&batch);
 
-        memmove(dbuf->data, lbuf->data, BLOCK_SIZE);  // copy block to dst
-        bio_write(dbuf);                              // write dst to disk
-        if (recovering == false)
+        for (size_t i = 0; i < count; i++)
         {
-            bio_put(dbuf);
+            if (recovering == false)
+            {
+                bio_put(bufs[i]);
+            }
+            bio_release(bufs[i]);
         }
-        bio_release(lbuf);
-        bio_release(dbuf);
     }
 }
 
@@ -262,20 +287,32 @@ void log_end_fs_transaction(struct super_block *sb)
 /// Copy modified blocks from cache to log.
 static void write_log(struct log *log)
 {
-    for (int32_t tail = 0; tail < log->lh_n; tail++)
+    struct buf *to[LOG_IO_BATCH];
+    for (size_t first = 0; first < log->lh_n; first += LOG_IO_BATCH)
     {
-        // use bio_get() instead of bio_read() to avoid reading
-        // log block from disk -- we don't need to read the old
-        // contents, we're going to overwrite it.
-        struct buf *to = bio_get_from_cache(log->dev, log->start + tail + 1);
-        to->valid = true;
-
-        struct buf *from =
-            bio_read(log->dev, log->lh_block[tail]);  // cache block
-        memmove(to->data, from->data, BLOCK_SIZE);
-        bio_write(to);  // write the log
-        bio_release(from);
-        bio_release(to);
+        size_t count = min(log->lh_n - first, LOG_IO_BATCH);
+        struct bio_batch batch;
+        bio_batch_init(&batch);
+        for (size_t i = 0; i < count; i++)
+        {
+            // use bio_get() instead of bio_read() to avoid reading
+            // log block from disk -- we don't need to read the old
+            // contents, we're going to overwrite it.
+            to[i] = bio_get_from_cache(log->dev, log->start + first + i + 1);
+            to[i]->valid = true;
+
+            struct buf *from =
+                bio_read(log->dev, log->lh_block[first + i]);  // cache block
+            memmove(to[i]->data, from->data, BLOCK_SIZE);
+            bio_release(from);
+        }
+        bio_batch_submit_bufs(&batch, to, count, true);  // write the log
+        bio_batch_wait(&batch);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            bio_release(to[i]);
+        }
     }
 }
 
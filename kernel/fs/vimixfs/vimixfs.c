@@ -20,7 +20,9 @@
 #include <kernel/string.h>
 #include <kernel/vimixfs.h>
 #include <lib/minmax.h>
+#include <mm/cache.h>
 #include <mm/kalloc.h>
+#include <mm/page_cache.h>
 
 /// @brief Truncate inode (discard contents), does not call
 /// vimixfs_sops_write_inode() and does not start a FS log!
@@ -59,6 +61,7 @@ struct inode_operations vimixfs_i_op = {
 
 struct file_operations vimixfs_f_op = {
     fops_open : vimixfs_fops_open,
+    fops_read : vimixfs_fops_read,
     fops_write : vimixfs_fops_write
 };
 
@@ -69,8 +72,18 @@ void vimixfs_kill_sb(struct super_block *sb_in);
 /// Free a disk block.
 void block_free(struct super_block *sb, uint32_t b);
 
+// allocations of struct vimixfs_inode
+static struct kmem_cache *g_vimixfs_inode_cache = NULL;
+
 void vimixfs_init()
 {
+    g_vimixfs_inode_cache = kmem_cache_create(
+        "vimixfs_inode", sizeof(struct vimixfs_inode), 0, NULL);
+    if (g_vimixfs_inode_cache == NULL)
+    {
+        panic("vimixfs_init: out of memory");
+    }
+
     vimixfs_file_system_type.name = VIMIXFS_FS_NAME;
 
     vimixfs_file_system_type.next = NULL;
@@ -105,6 +118,7 @@ syserr_t vimixfs_init_fs_super_block(struct super_block *sb_in,
         return -ENOMEM;
     }
     sb_in->s_fs_info = (void *)priv;
+    priv->readahead_max = VIMIXFS_READAHEAD_DEFAULT;
 
     memmove(&(priv->sb), vx6_sb, sizeof(struct vimixfs_superblock));
     ssize_t log_ok = log_init(&(priv->log), dev, &(priv->sb));
@@ -212,6 +226,15 @@ fail:
     return NULL;
 }
 
+/// @brief Running programs map their text and read-only data from the page
+/// cache (see page_table_add_file_mapping()), so their files must not change.
+/// @param ip Locked inode: exec adds the first mapping with the lock held.
+/// @return true if writes and truncates have to fail with -ETXTBSY.
+static bool vimixfs_is_text_busy(struct inode *ip)
+{
+    return atomic_load(&ip->i_file_mappings) != 0;
+}
+
 syserr_t vimixfs_fops_open(struct inode *ip, struct file *f)
 {
     if (S_ISREG(ip->i_mode) && (f->flags & O_TRUNC))
@@ -221,6 +244,12 @@ syserr_t vimixfs_fops_open(struct inode *ip, struct file *f)
         // lock after starting FS transaction to avoid deadlock
         // test above only read static data of the inode
         inode_lock(ip);
+        if (vimixfs_is_text_busy(ip))
+        {
+            inode_unlock(ip);
+            log_end_fs_transaction(ip->i_sb);
+            return -ETXTBSY;
+        }
         vimixfs_trunc(ip, 0);
         vimixfs_sops_write_inode(ip);
         inode_unlock(ip);
@@ -529,6 +558,7 @@ static inline size_t sub_clamped(size_t val, size_t sub)
 void vimixfs_trunc(struct inode *ip, size_t first_trunc_block)
 {
     struct vimixfs_inode *xv_ip = vimixfs_inode_from_inode(ip);
+    page_cache_drop_inode(ip);
 
     // truncate direct blocks
     vimixfs_trunc_block_range(ip, xv_ip->addrs, VIMIXFS_N_DIRECT_BLOCKS,
@@ -623,7 +653,7 @@ struct inode *vimixfs_iget(struct super_block *sb, ino_t inum)
     // Reading the metadata from disk will sleep, so we cannot hold any locks
     // here.
     struct vimixfs_inode *xv_ip =
-        kmalloc(sizeof(struct vimixfs_inode), ALLOC_FLAG_ZERO_MEMORY);
+        kmem_cache_alloc(g_vimixfs_inode_cache, ALLOC_FLAG_ZERO_MEMORY);
     if (xv_ip == NULL)
     {
         return NULL;  // out of memory
@@ -641,8 +671,9 @@ struct inode *vimixfs_iget(struct super_block *sb, ino_t inum)
     {
         // another thread created it in the meantime
         rwspin_write_unlock(&sb->fs_inode_list_lock);
-        kfree(xv_ip);  // kfree is enough, inode was not fully initialized
-                       // before adding to the list
+        // freeing is enough, inode was not fully initialized before adding
+        // to the list
+        kmem_cache_free(g_vimixfs_inode_cache, xv_ip);
         return ip_check;
     }
     list_add_tail(&ip->fs_inode_list, &sb->fs_inode_list);
@@ -710,7 +741,7 @@ void vimixfs_iops_put(struct inode *ip)
         }
     }
 
-    kfree(vimixfs_inode_from_inode(ip));
+    kmem_cache_free(g_vimixfs_inode_cache, vimixfs_inode_from_inode(ip));
 }
 
 bool inode_is_mounted_fs_root(struct inode *dir)
@@ -960,6 +991,30 @@ syserr_t vimixfs_iops_get_dirent(struct inode *dir, struct dirent *dir_entry,
     return (syserr_t)new_seek_pos;
 }
 
+/// @brief Map the next blocks of a read of n bytes at off and read the ones
+/// not cached at once, see bio_read_blocks().
+/// @param addrs Returns the block addresses, VIMIXFS_READ_BATCH entries.
+/// @param bufs Returns the referenced, unlocked buffers of the blocks.
+/// @return Number of mapped blocks.
+static size_t vimixfs_read_blocks(struct inode *ip, size_t off, size_t n,
+                                  uint32_t *addrs, struct buf **bufs)
+{
+    size_t first = off / BLOCK_SIZE;
+    size_t last = (off + n - 1) / BLOCK_SIZE;
+    size_t count = min(last - first + 1, VIMIXFS_READ_BATCH);
+    for (size_t i = 0; i < count; i++)
+    {
+        addrs[i] = bmap_get_block_address(ip, first + i);
+        if (addrs[i] == 0)
+        {
+            count = i;
+            break;
+        }
+    }
+    bio_read_blocks(ip->dev, addrs, bufs, count);
+    return count;
+}
+
 syserr_t vimixfs_iops_read(struct inode *ip, size_t off, size_t dst, size_t n,
                            bool addr_is_userspace)
 {
@@ -972,16 +1027,27 @@ syserr_t vimixfs_iops_read(struct inode *ip, size_t off, size_t dst, size_t n,
         n = ip->size - off;
     }
 
+    uint32_t addrs[VIMIXFS_READ_BATCH];
+    struct buf *bufs[VIMIXFS_READ_BATCH];
+    size_t mapped = 0;  // blocks in addrs and bufs
+    size_t next = 0;    // next block of addrs and bufs to copy
+
     ssize_t m = 0;
     ssize_t tot = 0;
     for (tot = 0; tot < n; tot += m, off += m, dst += m)
     {
-        size_t addr = bmap_get_block_address(ip, off / BLOCK_SIZE);
-        if (addr == 0)
+        if (next == mapped)
         {
-            break;
+            mapped = vimixfs_read_blocks(ip, off, n - tot, addrs, bufs);
+            next = 0;
+            if (mapped == 0)
+            {
+                break;
+            }
         }
-        struct buf *bp = bio_read(ip->dev, addr);
+        struct buf *bp = bufs[next];
+        bio_lock(bp);
+        next++;
         m = min(n - tot, BLOCK_SIZE - off % BLOCK_SIZE);
 
         if (either_copyout(addr_is_userspace, dst,
@@ -993,9 +1059,77 @@ syserr_t vimixfs_iops_read(struct inode *ip, size_t off, size_t dst, size_t n,
         }
         bio_release(bp);
     }
+
+    // buffers read for the request which did not get copied after an error
+    for (; next < mapped; next++)
+    {
+        bio_put(bufs[next]);
+    }
     return tot;
 }
 
+/// @brief Update the readahead state of f after a read of n bytes at off and
+/// start reading the blocks of the window which were not requested yet.
+static void vimixfs_readahead(struct file *f, size_t off, size_t n)
+{
+    struct inode *ip = f->dp->ip;
+    struct vimixfs_sb_private *priv =
+        (struct vimixfs_sb_private *)ip->i_sb->s_fs_info;
+    struct file_readahead *ra = &f->ra;
+    size_t max_window = priv->readahead_max;
+
+    bool sequential = (off == ra->next_off);
+    ra->next_off = off + n;
+    if (!sequential || max_window == 0)
+    {
+        // random access: start over with the next sequential read
+        ra->window = 0;
+        ra->end = 0;
+        return;
+    }
+    ra->window = (ra->window == 0) ? VIMIXFS_READAHEAD_MIN : ra->window * 2;
+    ra->window = min(ra->window, max_window);
+
+    size_t next_block = (off + n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (ra->end > next_block + ra->window / 2)
+    {
+        // enough in flight or cached, read ahead in larger steps
+        return;
+    }
+    size_t file_blocks = (ip->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    size_t first = max(next_block, ra->end);
+    size_t last = min(next_block + ra->window, file_blocks);
+
+    uint32_t addrs[VIMIXFS_READ_BATCH];
+    for (size_t block = first; block < last; block += VIMIXFS_READ_BATCH)
+    {
+        size_t count = min(last - block, VIMIXFS_READ_BATCH);
+        for (size_t i = 0; i < count; i++)
+        {
+            // no inode lock or log transaction here: stop at a hole
+            addrs[i] = bmap_lookup_block_address(ip, block + i);
+            if (addrs[i] == 0)
+            {
+                last = block + i;
+                count = i;
+                break;
+            }
+        }
+        bio_readahead(ip->dev, addrs, count);
+    }
+    if (last > ra->end) ra->end = last;
+}
+
+syserr_t vimixfs_fops_read(struct file *f, size_t addr, size_t n)
+{
+    syserr_t read_bytes = vimixfs_iops_read(f->dp->ip, f->off, addr, n, true);
+    if (read_bytes > 0)
+    {
+        vimixfs_readahead(f, f->off, read_bytes);
+    }
+    return read_bytes;
+}
+
 syserr_t vimixfs_write(struct inode *ip, bool src_addr_is_userspace, size_t src,
                        size_t off, size_t n)
 {
@@ -1009,6 +1143,11 @@ syserr_t vimixfs_write(struct inode *ip, bool src_addr_is_userspace, size_t src,
         return -EINVAL;
     }
 
+    if (vimixfs_is_text_busy(ip))
+    {
+        return -ETXTBSY;
+    }
+
     ssize_t m = 0;
     syserr_t tot;
     for (tot = 0; tot < n; tot += m, off += m, src += m)
@@ -1039,6 +1178,13 @@ syserr_t vimixfs_write(struct inode *ip, bool src_addr_is_userspace, size_t src,
         ip->size = off;
     }
 
+    // cached pages are stale now, only future execs read them again (running
+    // programs can't be written to, see vimixfs_is_text_busy())
+    if (tot != 0)
+    {
+        page_cache_drop_inode(ip);
+    }
+
     // write the i-node back to disk even if the size didn't change
     // because the loop above might have called bmap_get_block_address() and
     // added a new block to ip->addrs[].
@@ -1405,7 +1551,11 @@ syserr_t vimixfs_iops_truncate(struct dentry *dp, off_t new_size)
         inode_lock(ip);
 
         syserr_t ret = 0;
-        if (new_size < ip->size)
+        if (vimixfs_is_text_busy(ip))
+        {
+            ret = -ETXTBSY;
+        }
+        else if (new_size < ip->size)
         {
             ret = trunc_shrink(ip, new_size, client, MIN_BLOCKS_FOR_TRUNCATE);
         }
@@ -9,10 +9,28 @@
 
 extern const char *VIMIXFS_FS_NAME;
 
+/// Blocks of one read which get read from disk together, consecutive blocks
+/// with one request.
+#define VIMIXFS_READ_BATCH 16
+
+/// Readahead window of the first sequential read of a file in blocks, it
+/// doubles with each further sequential read.
+#define VIMIXFS_READAHEAD_MIN 4
+
+/// Default of the readahead limit in blocks, see vimixfs_sb_private.
+#define VIMIXFS_READAHEAD_DEFAULT 32
+
+/// Upper bound for the readahead limit in blocks.
+#define VIMIXFS_READAHEAD_MAX 256
+
 struct vimixfs_sb_private
 {
     struct vimixfs_superblock sb;
     struct log log;
+
+    /// Maximal readahead window in blocks, 0 disables readahead.
+    /// Set via /sys/fs/.../readahead.
+    size_t readahead_max;
 };
 
 struct vimixfs_inode
@@ -166,6 +184,14 @@ syserr_t vimixfs_iops_truncate(struct dentry *dp, off_t new_size);
 
 struct file;
 
+/// @brief Read from the file at f->off and read ahead the following blocks
+/// if the file gets read sequentially. The caller advances f->off.
+/// @param f The file.
+/// @param addr User space destination address.
+/// @param n Maximum number of bytes to read.
+/// @return Number of bytes read or -ERRNO.
+syserr_t vimixfs_fops_read(struct file *f, size_t addr, size_t n);
+
 syserr_t vimixfs_fops_write(struct file *f, size_t addr, size_t n);
 
 syserr_t vimixfs_iops_chmod(struct dentry *dp, mode_t mode);
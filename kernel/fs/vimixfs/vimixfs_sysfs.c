@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: MIT */
 
+#include <fs/sysfs/sysfs_helper.h>
 #include <fs/vimixfs/vimixfs.h>
 #include <fs/vimixfs/vimixfs_sysfs.h>
 #include <kernel/errno.h>
@@ -13,7 +14,8 @@ enum VIMIXFS_ATTRIBUTE_INDEX
     VIMIXFS_INODES,
     VIMIXFS_LOG_BLOCKS,
     VIMIXFS_DEV,
-    VIMIXFS_MOUNT_FLAGS
+    VIMIXFS_MOUNT_FLAGS,
+    VIMIXFS_READAHEAD
 };
 
 struct sysfs_attribute vimixfs_attributes[] = {
@@ -21,7 +23,8 @@ struct sysfs_attribute vimixfs_attributes[] = {
     [VIMIXFS_INODES] = {.name = "inodes", .mode = 0444},
     [VIMIXFS_LOG_BLOCKS] = {.name = "log_blocks", .mode = 0444},
     [VIMIXFS_DEV] = {.name = "dev", .mode = 0444},
-    [VIMIXFS_MOUNT_FLAGS] = {.name = "mount_flags", .mode = 0444}};
+    [VIMIXFS_MOUNT_FLAGS] = {.name = "mount_flags", .mode = 0444},
+    [VIMIXFS_READAHEAD] = {.name = "readahead", .mode = 0644}};
 
 syserr_t vimixfs_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx,
                                 char *buf, size_t n)
@@ -47,6 +50,9 @@ syserr_t vimixfs_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx,
         case VIMIXFS_MOUNT_FLAGS:
             ret = snprintf(buf, n, "%ld\n", sb->s_mountflags);
             break;
+        case VIMIXFS_READAHEAD:
+            ret = snprintf(buf, n, "%zu\n", priv->readahead_max);
+            break;
         default: ret = -ENOENT; break;
     }
 
@@ -62,7 +68,44 @@ syserr_t vimixfs_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx,
 syserr_t vimixfs_sysfs_ops_store(struct kobject *kobj, size_t attribute_idx,
                                  const char *buf, size_t n)
 {
-    return -EINVAL;
+    struct super_block *sb = super_block_from_kobj(kobj);
+    struct vimixfs_sb_private *priv =
+        (struct vimixfs_sb_private *)sb->s_fs_info;
+
+    bool ok;
+    int32_t value = store_param_to_int(buf, n, &ok);
+    if (!ok)
+    {
+        return -EINVAL;
+    }
+
+    syserr_t ret = 0;
+    switch (attribute_idx)
+    {
+        case VIMIXFS_BLOCKS: ret = -EINVAL; break;
+        case VIMIXFS_INODES: ret = -EINVAL; break;
+        case VIMIXFS_LOG_BLOCKS: ret = -EINVAL; break;
+        case VIMIXFS_DEV: ret = -EINVAL; break;
+        case VIMIXFS_MOUNT_FLAGS: ret = -EINVAL; break;
+        case VIMIXFS_READAHEAD:
+            if (value < 0 || value > VIMIXFS_READAHEAD_MAX)
+            {
+                ret = -EINVAL;
+                break;
+            }
+            // readers pick the new limit up with their next read
+            priv->readahead_max = (size_t)value;
+            break;
+        default: ret = -ENOENT; break;
+    }
+
+    if (ret == 0)
+    {
+        // no error, signal all bytes have been written
+        return n;
+    }
+
+    return ret;
 }
 
 struct sysfs_ops vimixfs_sysfs_ops = {
@@ -4,7 +4,7 @@
 #define EPERM 1   ///< Operation not permitted
 #define ENOENT 2  ///< No such file or directory
 #define ESRCH 3   ///< No such process
-// #define EINTR 4     ///< Interrupted system call
+#define EINTR 4  ///< Interrupted system call
 #define EIO 5  ///< I/O error
 // #define ENXIO 6     ///< No such device or address
 #define E2BIG 7    ///< Argument list too long
@@ -28,10 +28,10 @@
 #define ENOTTY \
     25  ///< Not a typewriter, e.g. returned by ioctl on char devices that don't
         ///< support ioctl
-// #define ETXTBSY 26  ///< Text file busy
-#define EFBIG 27   ///< File too large
-#define ENOSPC 28  ///< No space left on device
-#define ESPIPE 29  ///< Illegal seek, fd is a pipe
+#define ETXTBSY 26  ///< Text file busy
+#define EFBIG 27    ///< File too large
+#define ENOSPC 28   ///< No space left on device
+#define ESPIPE 29   ///< Illegal seek, fd is a pipe
 // #define EROFS 30    ///< Read-only file system
 // #define EMLINK 31   ///< Too many links
 // #define EPIPE 32    ///< Broken pipe
@@ -89,6 +89,11 @@ struct inode
     /// inode table is free. Access via inode_get()/inode_put().
     struct kref ref;
 
+    /// @brief Number of file mappings of page tables (running programs), see
+    /// page_table_add_file_mapping(). Writes and truncates fail with -ETXTBSY
+    /// while not 0, mapped pages must never see new content.
+    atomic_size_t i_file_mappings;
+
     /// @brief Exclusive write access holder.
     struct sleeplock write_exclusive_lock;
 
@@ -113,6 +118,9 @@ struct inode
 
     /// list of all inodes on the FS the inode belongs to.
     struct list_head fs_inode_list;
+
+    /// pages of this file in the page cache, see mm/page_cache.h
+    struct list_head i_page_cache;
 };
 
 #define inode_from_list(ptr) container_of(ptr, struct inode, fs_inode_list)
@@ -44,6 +44,9 @@
 
 #endif  // CONFIG_DEBUG
 
+/// print the throughput of memcpy, memmove, memset and memcmp during boot
+// #define CONFIG_STRING_BENCHMARK
+
 #if defined(CONFIG_DEBUG_EXTRA_RUNTIME_TESTS)
 // DEBUG_EXTRA_ASSERT(expected_to_be_true, "message is expectation is broken")
 #define DEBUG_EXTRA_ASSERT(test, msg) \
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: MIT */
+#pragma once
+
+#include <kernel/types.h>
+
+/// close fd in the child, ignored if fd is not open
+#define SPAWN_ACTION_CLOSE 1
+
+/// duplicate fd to new_fd in the child (like dup2())
+#define SPAWN_ACTION_DUP2 2
+
+/// open path with flags and mode as fd in the child
+#define SPAWN_ACTION_OPEN 3
+
+/// max number of file actions per spawn call
+#define SPAWN_MAX_ACTIONS 16
+
+/// @brief One file descriptor action of the spawn system call. The actions are
+/// applied in order to a copy of the callers file descriptor table before the
+/// child starts.
+struct spawn_action
+{
+    int32_t type;      ///< SPAWN_ACTION_*
+    int32_t fd;        ///< fd to close / dup / open as
+    int32_t new_fd;    ///< target fd of SPAWN_ACTION_DUP2
+    int32_t flags;     ///< open flags of SPAWN_ACTION_OPEN
+    mode_t mode;       ///< file mode of SPAWN_ACTION_OPEN
+    const char *path;  ///< file to open for SPAWN_ACTION_OPEN
+};
@@ -50,6 +50,9 @@ typedef int32_t clockid_t;
 /// undefined.
 #define CLOCK_MONOTONIC 1
 
+/// @brief Flag for clock_nanosleep(): the requested time is absolute.
+#define TIMER_ABSTIME 1
+
 /// @brief Type of the syscalls return value. >= 0 means success (> 0 has
 /// syscall specific meaning), negative values are errors from errno.h.
 typedef ssize_t syserr_t;
@@ -49,6 +49,8 @@
 #define SYS_setgroups 45
 #define SYS_getgroups 46
 #define SYS_umask 47
+#define SYS_clock_nanosleep 48
+#define SYS_spawn 49
 
 #define SEEK_SET 0  //< Seek from beginning of file
 #define SEEK_CUR 1  //< Seek from current position
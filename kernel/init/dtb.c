@@ -495,6 +495,12 @@ CPU_Features dtb_get_cpu_features(void *dtb, size_t cpu_id)
         {
             featues |= RV_EXT_DOUBLE;
         }
+#if defined(__RISCV_EXT_V)
+        if (extension_is_supported(riscv_isa, "v"))
+        {
+            featues |= RV_EXT_VECTOR;
+        }
+#endif
     }
 
     int riscv_isa_ext_len;
@@ -505,19 +511,25 @@ CPU_Features dtb_get_cpu_features(void *dtb, size_t cpu_id)
         while (true)
         {
 #if defined(__RISCV_EXT_SSTC)
-            if (strcmp(riscv_isa_ext, "sstc"))
+            if (strcmp(riscv_isa_ext, "sstc") == 0)
             {
                 featues |= RV_EXT_SSTC;
             }
 #endif
-            if (strcmp(riscv_isa_ext, "f"))
+            if (strcmp(riscv_isa_ext, "f") == 0)
             {
                 featues |= RV_EXT_FLOAT;
             }
-            if (strcmp(riscv_isa_ext, "d"))
+            if (strcmp(riscv_isa_ext, "d") == 0)
             {
                 featues |= RV_EXT_DOUBLE;
             }
+#if defined(__RISCV_EXT_V)
+            if (strcmp(riscv_isa_ext, "v") == 0)
+            {
+                featues |= RV_EXT_VECTOR;
+            }
+#endif
 
             riscv_isa_ext += strlen(riscv_isa_ext) + 1;
             if (riscv_isa_ext[0] == 0) break;
@@ -22,10 +22,13 @@
 #include <kernel/proc.h>
 #include <kernel/scheduler.h>
 #include <kernel/smp.h>
+#include <lib/string_benchmark.h>
+#include <mm/asid.h>
 #include <mm/kalloc.h>
 #include <mm/kernel_memory.h>
 #include <mm/memlayout.h>
 #include <mm/memory_map.h>
+#include <mm/page_cache.h>
 #include <mm/vm.h>
 
 #if defined(__CONFIG_RAMDISK_EMBEDDED)
@@ -127,6 +130,7 @@ void init_memory_management(void *dtb)
     kalloc_init(early_ram);  // physical page allocator
 
     // from now on kmalloc() can be used, but available memory is limited
+    memory_map_init_cache();
 
     printk("init new page table...\n");
     g_kernel_pagetable = page_table_alloc_init();
@@ -158,6 +162,7 @@ void init_memory_management(void *dtb)
     }
 
     kvm_apply_mapping(g_kernel_pagetable);
+    asid_init();
 
     // make all additional memory available for kmalloc()
     kalloc_init_memory(&g_kernel_pagetable->memory_map, MM_REGION_USABLE_RAM);
@@ -167,7 +172,8 @@ void init_filesystem(struct Devices_List *dev_list)
 {
     // init filesystem:
     printk("init filesystem...\n");
-    bio_init();  // buffer cache
+    bio_init();         // buffer cache
+    page_cache_init();  // file pages of executables
     init_virtual_file_system();
     file_init();  // file table
 
@@ -224,7 +230,6 @@ void main(void *dtb, bool is_boot_hart)
         print_timer_source(dtb);
 
         init_kobject_root();
-        kticks_init();
         init_platform();
 
         // after this kmalloc() is allowed
@@ -252,6 +257,9 @@ void main(void *dtb, bool is_boot_hart)
     timer_init(dtb, g_cpus[cpu_id].features);
     init_interrupt_controller_per_hart();
 
+    // the string functions use the vector unit once the features are known
+    if (g_boot_hart == cpu_id) string_benchmark();
+
     g_cpus[cpu_id].state = CPU_STARTED;
 
     printk("CPU %zd entering scheduler %s\n", cpu_id,
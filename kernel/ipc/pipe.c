@@ -8,6 +8,7 @@
 #include <kernel/proc.h>
 #include <kernel/stat.h>
 #include <mm/kalloc.h>
+#include <mm/vm.h>
 
 static inline bool pipe_is_empty(struct pipe *pipe)
 {
@@ -90,6 +91,9 @@ ssize_t pipe_write(struct pipe *pipe, size_t src_user_addr, size_t n)
     size_t i = 0;
     struct process *proc = get_current();
 
+    // the data might be in not yet loaded read-only data of the program
+    uvm_prefault(proc->pagetable, src_user_addr, n);
+
     spin_lock(&pipe->lock);
     while (i < n)
     {
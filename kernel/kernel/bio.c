@@ -7,82 +7,214 @@
 #include <kernel/errno.h>
 #include <kernel/fs.h>
 #include <kernel/kernel.h>
+#include <kernel/proc.h>
 #include <kernel/sleeplock.h>
+#include <lib/minmax.h>
+#include <mm/cache.h>
 #include <mm/kalloc.h>
 #include <mm/kernel_memory.h>
+#include <mm/shrinker.h>
 
 struct bio_cache g_buf_cache;
 
+static inline size_t bio_hash(dev_t dev, uint32_t blockno)
+{
+    // same multiplicative hash as the page cache, consecutive blocks of one
+    // device end up in consecutive buckets and shards
+    size_t hash = ((size_t)dev * 0x9E3779B1u) + blockno;
+    return hash % BIO_HASH_BUCKETS;
+}
+
+static inline struct bio_shard *bio_shard_of_bucket(size_t bucket)
+{
+    return &g_buf_cache.shards[bucket % BIO_LOCK_SHARDS];
+}
+
+/// Shard of a buffer with a block assigned (refcnt > 0 or in a hash bucket)
+static inline struct bio_shard *bio_shard_of_buf(struct buf *b)
+{
+    return bio_shard_of_bucket(bio_hash(b->dev, b->blockno));
+}
+
+// shard lock must be held, removes b from the caches lists and frees it
+static void bio_free_buffer(struct buf *b)
+{
+    buf_deinit(b);
+    kmem_cache_free(g_buf_cache.obj_cache, b);
+}
+
+// Unused buffers are clean (the log holds a reference to changed buffers till
+// they are written), so they can be freed without IO.
+static size_t bio_cache_shrink(size_t bytes)
+{
+    size_t freed = 0;
+    for (size_t i = 0; i < BIO_LOCK_SHARDS; i++)
+    {
+        struct bio_shard *shard = &g_buf_cache.shards[i];
+        spin_lock(&shard->lock);
+        while (!list_empty(&shard->lru_list))
+        {
+            if ((freed >= bytes) ||
+                (atomic_load(&g_buf_cache.num_buffers) <=
+                 g_buf_cache.min_buffers))
+            {
+                break;
+            }
+
+            struct buf *b = buf_from_lru_list(shard->lru_list.next);
+            atomic_fetch_sub(&g_buf_cache.free_buffers, 1);
+            bio_free_buffer(b);
+            freed += sizeof(struct buf);
+        }
+        spin_unlock(&shard->lock);
+    }
+    return freed;
+}
+
+static struct shrinker g_bio_shrinker = {.name = "bio",
+                                         .shrink = bio_cache_shrink};
+
+// shard lock must be held
+static struct buf *bio_cache_find(size_t bucket, dev_t dev, uint32_t blockno)
+{
+    struct list_head *pos;
+    list_for_each(pos, &g_buf_cache.hash_table[bucket])
+    {
+        struct buf *b = buf_from_hash_list(pos);
+        if (b->dev == dev && b->blockno == blockno)
+        {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+// Lock of shard own must be held. Takes the least recently used free buffer
+// of another shard, skips shards locked by other CPUs.
+static struct buf *bio_steal_free_buffer(struct bio_shard *own)
+{
+    if (atomic_load(&g_buf_cache.free_buffers) == 0) return NULL;
+
+    size_t own_idx = own - g_buf_cache.shards;
+    for (size_t i = 1; i < BIO_LOCK_SHARDS; i++)
+    {
+        struct bio_shard *shard =
+            &g_buf_cache.shards[(own_idx + i) % BIO_LOCK_SHARDS];
+        // trylock: the order of two shard locks is not defined
+        if (list_empty(&shard->lru_list) || !spin_trylock(&shard->lock))
+        {
+            continue;
+        }
+
+        struct buf *b = NULL;
+        if (!list_empty(&shard->lru_list))
+        {
+            b = buf_from_lru_list(shard->lru_list.next);
+            list_del(&b->lru_list);
+            list_del(&b->hash_list);
+            atomic_fetch_sub(&g_buf_cache.free_buffers, 1);
+        }
+        spin_unlock(&shard->lock);
+        if (b != NULL) return b;
+    }
+    return NULL;
+}
+
 void bio_init()
 {
     spin_lock_init(&g_buf_cache.lock, "g_buf_cache");
     kobject_init(&g_buf_cache.kobj, &bio_kobj_ktype);
     kobject_add(&g_buf_cache.kobj, &g_kernel_memory.kobj, "bio");
 
-    list_init(&g_buf_cache.buf_list);
+    for (size_t i = 0; i < BIO_HASH_BUCKETS; i++)
+    {
+        list_init(&g_buf_cache.hash_table[i]);
+    }
+    for (size_t i = 0; i < BIO_LOCK_SHARDS; i++)
+    {
+        struct bio_shard *shard = &g_buf_cache.shards[i];
+        spin_lock_init(&shard->lock, "bio_shard");
+        list_init(&shard->lru_list);
+        shard->hits = 0;
+        shard->misses = 0;
+        shard->evictions = 0;
+        shard->readaheads = 0;
+    }
+    g_buf_cache.obj_cache =
+        kmem_cache_create("buf", sizeof(struct buf), 0, NULL);
+    if (g_buf_cache.obj_cache == NULL)
+    {
+        panic("bio_init: out of memory");
+    }
 
-    g_buf_cache.num_buffers = 0;
-    g_buf_cache.free_buffers = 0;
+    atomic_init(&g_buf_cache.num_buffers, 0);
+    atomic_init(&g_buf_cache.free_buffers, 0);
     g_buf_cache.max_free_buffers = 16;  // arbitrary default
     spin_lock(&g_buf_cache.lock);       // the setter tests for the lock
     bio_cache_set_min_buffers(&g_buf_cache, 16);  // arbitrary default
     spin_unlock(&g_buf_cache.lock);
+
+    register_shrinker(&g_bio_shrinker);
 }
 
-/// Look through buffer cache for the requested block on device dev.
+/// Look up the requested block on device dev in the buffer cache.
 /// If the block was cached, increase the ref count and return.
-/// If not found, allocate a buffer.
+/// If not found, reuse the least recently used free buffer of the blocks
+/// shard (or of another shard) or allocate one.
 /// In either case, return a locked buffer.
 /// Buffer content is not zeroed.
 struct buf *bio_get_from_cache(dev_t dev, uint32_t blockno)
 {
-    spin_lock(&g_buf_cache.lock);
-
-    struct buf *free_buffer = NULL;
-    struct buf *buffer = NULL;
+    size_t bucket = bio_hash(dev, blockno);
+    struct bio_shard *shard = bio_shard_of_bucket(bucket);
+    spin_lock(&shard->lock);
 
-    // Is the block already cached?
-    // While looking, remember the first unused buffer.
-    struct list_head *pos;
-    list_for_each(pos, &g_buf_cache.buf_list)
+    struct buf *buffer = bio_cache_find(bucket, dev, blockno);
+    if (buffer != NULL)
     {
-        struct buf *b = buf_from_list(pos);
-
-        if (b->dev == dev && b->blockno == blockno)
-        {
-            if (b->refcnt == 0)
-            {
-                g_buf_cache.free_buffers--;
-            }
-            b->refcnt++;
-            buffer = b;
-            break;
-        }
-        else if ((free_buffer == NULL) && (b->refcnt == 0))
+        shard->hits++;
+        if (buffer->refcnt == 0)
         {
-            // first unused buffer in the list is the oldest one
-            free_buffer = b;
+            // in use again
+            list_del(&buffer->lru_list);
+            atomic_fetch_sub(&g_buf_cache.free_buffers, 1);
         }
+        buffer->refcnt++;
     }
-
-    if (buffer == NULL)
+    else
     {
-        // Not cached...
-        if (free_buffer == NULL)
+        shard->misses++;
+        if (!list_empty(&shard->lru_list))
         {
-            // ...and no free buffer found, allocate a new one
-            buffer = buf_alloc_init(dev, blockno);
+            // reuse the least recently used free buffer
+            buffer = buf_from_lru_list(shard->lru_list.next);
+            list_del(&buffer->lru_list);
+            list_del(&buffer->hash_list);
+            atomic_fetch_sub(&g_buf_cache.free_buffers, 1);
         }
         else
         {
-            // ...but we found a free buffer, reuse it
-            buffer = free_buffer;
+            buffer = bio_steal_free_buffer(shard);
+        }
+
+        if (buffer != NULL)
+        {
+            if (buffer->valid) shard->evictions++;
             buf_reinit(buffer, dev, blockno);
-            g_buf_cache.free_buffers--;
         }
+        else
+        {
+            // no free buffer, allocate a new one
+            buffer = buf_alloc_init(dev, blockno);
+            if (buffer == NULL)
+            {
+                panic("bio_get_from_cache: out of memory");
+            }
+        }
+        list_add(&buffer->hash_list, &g_buf_cache.hash_table[bucket]);
     }
 
-    spin_unlock(&g_buf_cache.lock);
+    spin_unlock(&shard->lock);
     sleep_lock(&buffer->lock);
 
     return buffer;
@@ -95,15 +227,8 @@ struct buf *bio_read(dev_t dev, uint32_t blockno)
 
     if (b->valid == false)
     {
-        struct Block_Device *bdevice = get_block_device(dev);
-        if (!bdevice)
-        {
-            panic("bio_read called for non block device!");
-        }
-
-        bdevice->ops.read_buf(bdevice, b);
-
-        b->valid = true;
+        bio_submit(b, false);
+        bio_wait(b);
     }
     return b;
 }
@@ -117,23 +242,244 @@ void bio_write(struct buf *b)
     }
 #endif  // CONFIG_DEBUG_SLEEPLOCK
 
-    struct Block_Device *bdevice = get_block_device(b->dev);
+    bio_submit(b, true);
+    bio_wait(b);
+}
+
+void bio_submit(struct buf *b, bool write)
+{
+    bio_submit_bufs(&b, 1, write);
+}
+
+void bio_submit_bufs(struct buf **bufs, size_t count, bool write)
+{
+    struct Block_Device *bdevice = get_block_device(bufs[0]->dev);
     if (!bdevice)
     {
-        panic("bio_write called for non block device!");
+        panic("bio_submit called for non block device!");
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        DEBUG_EXTRA_PANIC(bufs[i]->dev == bufs[0]->dev &&
+                              bufs[i]->blockno == bufs[0]->blockno + i,
+                          "bio_submit_bufs: blocks are not consecutive");
+        // no lock needed: the buffer is locked and not in flight
+        bufs[i]->owned_by_driver = true;
+    }
+    if (bdevice->ops.submit_bufs != NULL)
+    {
+        bdevice->ops.submit_bufs(bdevice, bufs, count, write);
+        return;
+    }
+
+    // synchronous driver
+    for (size_t i = 0; i < count; i++)
+    {
+        if (write)
+        {
+            bdevice->ops.write_buf(bdevice, bufs[i]);
+        }
+        else
+        {
+            bdevice->ops.read_buf(bdevice, bufs[i]);
+        }
+        bio_end_io(bufs[i]);
+    }
+}
+
+void bio_end_io(struct buf *b)
+{
+    // read before the waiter can reuse the buffer
+    void (*end_io)(struct buf *b, void *data) = b->end_io;
+    void *end_io_data = b->end_io_data;
+
+    struct bio_shard *shard = bio_shard_of_buf(b);
+    spin_lock(&shard->lock);
+    b->valid = true;
+    b->owned_by_driver = false;
+    b->end_io = NULL;
+    b->end_io_data = NULL;
+    wakeup(b);
+    spin_unlock(&shard->lock);
+
+    if (end_io != NULL)
+    {
+        end_io(b, end_io_data);
+    }
+}
+
+void bio_wait(struct buf *b)
+{
+    struct bio_shard *shard = bio_shard_of_buf(b);
+    spin_lock(&shard->lock);
+    while (b->owned_by_driver)
+    {
+        sleep(b, &shard->lock);
+    }
+    spin_unlock(&shard->lock);
+}
+
+void bio_batch_init(struct bio_batch *batch)
+{
+    spin_lock_init(&batch->lock, "bio_batch");
+    batch->pending = 0;
+}
+
+static void bio_batch_end_io(struct buf *b, void *data)
+{
+    struct bio_batch *batch = (struct bio_batch *)data;
+    spin_lock(&batch->lock);
+    batch->pending--;
+    if (batch->pending == 0)
+    {
+        wakeup(batch);
+    }
+    spin_unlock(&batch->lock);
+}
+
+void bio_batch_submit(struct bio_batch *batch, struct buf *b, bool write)
+{
+    bio_batch_submit_bufs(batch, &b, 1, write);
+}
+
+// bio_submit_bufs() the runs of consecutive blocks of bufs, skips NULL
+static void bio_submit_runs(struct buf **bufs, size_t count, bool write)
+{
+    size_t run_start = 0;
+    size_t run_length = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        struct buf *b = bufs[i];
+        if (b == NULL) continue;
+
+        // extend the run of consecutive blocks or start a new one
+        if (run_length > 0)
+        {
+            struct buf *last = bufs[run_start + run_length - 1];
+            if (i == run_start + run_length && b->dev == last->dev &&
+                b->blockno == last->blockno + 1)
+            {
+                run_length++;
+                continue;
+            }
+            bio_submit_bufs(&bufs[run_start], run_length, write);
+        }
+        run_start = i;
+        run_length = 1;
+    }
+    if (run_length > 0)
+    {
+        bio_submit_bufs(&bufs[run_start], run_length, write);
+    }
+}
+
+void bio_batch_submit_bufs(struct bio_batch *batch, struct buf **bufs,
+                           size_t count, bool write)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (bufs[i] == NULL) continue;
+
+        spin_lock(&batch->lock);
+        batch->pending++;
+        spin_unlock(&batch->lock);
+        bufs[i]->end_io = bio_batch_end_io;
+        bufs[i]->end_io_data = batch;
+    }
+    bio_submit_runs(bufs, count, write);
+}
+
+void bio_batch_wait(struct bio_batch *batch)
+{
+    spin_lock(&batch->lock);
+    while (batch->pending > 0)
+    {
+        sleep(batch, &batch->lock);
     }
+    spin_unlock(&batch->lock);
+}
+
+void bio_read_blocks(dev_t dev, const uint32_t *blocknos, struct buf **bufs,
+                     size_t count)
+{
+    // locked in index order, the callers never lock a lower index while
+    // holding a higher one
+    for (size_t i = 0; i < count; i++)
+    {
+        bufs[i] = bio_get_from_cache(dev, blocknos[i]);
+    }
+
+    // read each run of uncached buffers, stable as all are locked
+    struct bio_batch batch;
+    bio_batch_init(&batch);
+    for (size_t first = 0; first < count;)
+    {
+        if (bufs[first]->valid)
+        {
+            first++;
+            continue;
+        }
+        size_t end = first + 1;
+        while (end < count && !bufs[end]->valid) end++;
+        bio_batch_submit_bufs(&batch, &bufs[first], end - first, false);
+        first = end;
+    }
+    bio_batch_wait(&batch);
 
-    bdevice->ops.write_buf(bdevice, b);
+    // keep the references so the blocks can't get evicted till used
+    for (size_t i = 0; i < count; i++)
+    {
+        sleep_unlock(&bufs[i]->lock);
+    }
+}
+
+void bio_lock(struct buf *b) { sleep_lock(&b->lock); }
+
+static void bio_unlock_and_put(struct buf *b);
+
+// end_io of bio_readahead(): nobody waits for the buffer, release it here
+static void bio_readahead_end_io(struct buf *b, void *data)
+{
+    struct bio_shard *shard = bio_shard_of_buf(b);
+    spin_lock(&shard->lock);
+    shard->readaheads++;
+    spin_unlock(&shard->lock);
+
+    bio_unlock_and_put(b);
+}
+
+void bio_readahead(dev_t dev, const uint32_t *blocknos, size_t count)
+{
+    struct buf *bufs[BIO_READAHEAD_CHUNK];
+    for (size_t first = 0; first < count; first += BIO_READAHEAD_CHUNK)
+    {
+        size_t chunk = min(count - first, BIO_READAHEAD_CHUNK);
+        for (size_t i = 0; i < chunk; i++)
+        {
+            // only uncached buffers stay locked till their read finished
+            bufs[i] = bio_get_from_cache(dev, blocknos[first + i]);
+            if (bufs[i]->valid)
+            {
+                bio_release(bufs[i]);
+                bufs[i] = NULL;
+                continue;
+            }
+            bufs[i]->end_io = bio_readahead_end_io;
+        }
+        bio_submit_runs(bufs, chunk, false);
+    }
 }
 
 bool bio_has_too_many_buffers()
 {
-    if (g_buf_cache.num_buffers <= g_buf_cache.min_buffers)
+    if (atomic_load(&g_buf_cache.num_buffers) <= g_buf_cache.min_buffers)
     {
         // keep a minimum amount of buffers
         return false;
     }
-    else if (g_buf_cache.free_buffers <= g_buf_cache.max_free_buffers)
+    else if (atomic_load(&g_buf_cache.free_buffers) <=
+             g_buf_cache.max_free_buffers)
     {
         // keep a few free buffers to reduce kmalloc/free calls
         return false;
@@ -141,21 +487,32 @@ bool bio_has_too_many_buffers()
     return true;
 }
 
-void bio_might_free(struct buf *b)
+// shard lock must be held, b is unused now
+static void bio_might_free(struct bio_shard *shard, struct buf *b)
 {
-    if (bio_has_too_many_buffers())
-    {
-        // free buffer
-        buf_deinit(b);
-        kfree(b);
-    }
-    else
+    bool too_many = bio_has_too_many_buffers();
+
+    // most recently used: stays cached the longest
+    list_add_tail(&b->lru_list, &shard->lru_list);
+    atomic_fetch_add(&g_buf_cache.free_buffers, 1);
+
+    if (!too_many) return;
+
+    // drop a least recently used block instead of b, which might be read
+    // ahead and needed soon. Consecutive blocks hash to different shards, so b
+    // is often the only free buffer of its shard: take one of another shard.
+    struct buf *oldest = buf_from_lru_list(shard->lru_list.next);
+    if (oldest == b)
     {
-        // move to the end of the list, so it can be reused later
-        list_del(&b->buf_list);
-        list_add_tail(&b->buf_list, &g_buf_cache.buf_list);
-        g_buf_cache.free_buffers++;
+        struct buf *stolen = bio_steal_free_buffer(shard);
+        if (stolen != NULL)
+        {
+            bio_free_buffer(stolen);  // already off the lists and counted
+            return;
+        }
     }
+    atomic_fetch_sub(&g_buf_cache.free_buffers, 1);
+    bio_free_buffer(oldest);
 }
 
 void bio_release(struct buf *b)
@@ -167,30 +524,42 @@ void bio_release(struct buf *b)
     }
 #endif  // CONFIG_DEBUG_SLEEPLOCK
 
+    bio_unlock_and_put(b);
+}
+
+// bio_release() without the check of the lock owner, for end_io callbacks
+static void bio_unlock_and_put(struct buf *b)
+{
     sleep_unlock(&b->lock);
 
-    spin_lock(&g_buf_cache.lock);
+    struct bio_shard *shard = bio_shard_of_buf(b);
+    spin_lock(&shard->lock);
     b->refcnt--;
     if (b->refcnt == 0)
     {
-        bio_might_free(b);
+        bio_might_free(shard, b);
     }
-
-    spin_unlock(&g_buf_cache.lock);
+    spin_unlock(&shard->lock);
 }
 
 void bio_get(struct buf *b)
 {
-    spin_lock(&g_buf_cache.lock);
+    struct bio_shard *shard = bio_shard_of_buf(b);
+    spin_lock(&shard->lock);
     b->refcnt++;
-    spin_unlock(&g_buf_cache.lock);
+    spin_unlock(&shard->lock);
 }
 
 void bio_put(struct buf *b)
 {
-    spin_lock(&g_buf_cache.lock);
+    struct bio_shard *shard = bio_shard_of_buf(b);
+    spin_lock(&shard->lock);
     b->refcnt--;
-    spin_unlock(&g_buf_cache.lock);
+    if (b->refcnt == 0)
+    {
+        bio_might_free(shard, b);
+    }
+    spin_unlock(&shard->lock);
 }
 
 void bio_cache_free_extra_buffers(struct bio_cache *cache)
@@ -198,16 +567,18 @@ void bio_cache_free_extra_buffers(struct bio_cache *cache)
     DEBUG_EXTRA_PANIC(spin_lock_is_held_by_this_cpu(&cache->lock),
                       "bio_cache_free_extra_buffers: lock not held");
 
-    struct list_head *pos, *n;
-    list_for_each_safe(pos, n, &cache->buf_list)
+    for (size_t i = 0; i < BIO_LOCK_SHARDS && bio_has_too_many_buffers(); i++)
     {
-        struct buf *b = buf_from_list(pos);
-        if ((b->refcnt == 0) && (bio_has_too_many_buffers()))
+        struct bio_shard *shard = &cache->shards[i];
+        spin_lock(&shard->lock);
+        // free the least recently used buffers first
+        while (!list_empty(&shard->lru_list) && bio_has_too_many_buffers())
         {
-            g_buf_cache.free_buffers--;
-            buf_deinit(b);
-            kfree(b);
+            struct buf *b = buf_from_lru_list(shard->lru_list.next);
+            atomic_fetch_sub(&cache->free_buffers, 1);
+            bio_free_buffer(b);
         }
+        spin_unlock(&shard->lock);
     }
 }
 
@@ -219,8 +590,9 @@ syserr_t bio_cache_set_min_buffers(struct bio_cache *cache, ssize_t min_buffers)
 
     cache->min_buffers = (size_t)min_buffers;
 
-    // allocate new buffers if needed
-    for (size_t i = cache->num_buffers; i < g_buf_cache.min_buffers; i++)
+    // allocate new buffers if needed, spread over the shards
+    for (size_t i = atomic_load(&cache->num_buffers); i < cache->min_buffers;
+         i++)
     {
         struct buf *b = buf_alloc_init(0, 0);
         if (b == NULL)
@@ -228,7 +600,13 @@ syserr_t bio_cache_set_min_buffers(struct bio_cache *cache, ssize_t min_buffers)
             panic("bio_init: buf_alloc_init failed");
         }
         b->refcnt = 0;  // drop the implicit reference from buf_alloc_init()
-        g_buf_cache.free_buffers++;
+
+        // no block assigned: not hashed and the first to get reused
+        struct bio_shard *shard = &cache->shards[i % BIO_LOCK_SHARDS];
+        spin_lock(&shard->lock);
+        list_add(&b->lru_list, &shard->lru_list);
+        atomic_fetch_add(&cache->free_buffers, 1);
+        spin_unlock(&shard->lock);
     }
     bio_cache_free_extra_buffers(cache);
 
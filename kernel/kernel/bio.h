@@ -7,8 +7,36 @@
 #include <kernel/kobject.h>
 #include <kernel/list.h>
 #include <kernel/sleeplock.h>
+#include <kernel/spinlock.h>
+#include <kernel/stdatomic.h>
 
-/// @brief The block IO cache is a linked list of buf structures holding
+/// Number of hash buckets for the block lookup, a power of 2.
+#define BIO_HASH_BUCKETS 2048
+
+/// Blocks bio_readahead() gets and submits at once.
+#define BIO_READAHEAD_CHUNK 16
+
+/// Number of locks of the hash table, bucket i is protected by lock
+/// i % BIO_LOCK_SHARDS. A power of 2 smaller than BIO_HASH_BUCKETS.
+#define BIO_LOCK_SHARDS 64
+
+/// @brief One lock stripe of the buffer cache: protects its hash buckets,
+/// the buffers in them (refcnt, list links) and its list of free buffers.
+struct bio_shard
+{
+    struct spinlock lock;
+
+    /// Buffers NOT in use (refcnt==0) of this shard, least recently used
+    /// first. These get reused for other blocks or freed.
+    struct list_head lru_list;
+
+    size_t hits;       ///< Lookups which found the block in the cache.
+    size_t misses;     ///< Lookups which had to assign a buffer.
+    size_t evictions;  ///< Cached blocks dropped to reuse their buffer.
+    size_t readaheads;  ///< Blocks read by bio_readahead().
+};
+
+/// @brief The block IO cache is a hash table of buf structures holding
 /// cached copies of disk block contents. Caching disk blocks
 /// in memory reduces the number of disk reads and also provides
 /// a synchronization point for disk blocks used by multiple processes.
@@ -19,19 +47,24 @@
 /// * Do not use the buffer after calling bio_release().
 /// * Only one process at a time can use a buffer, so do not keep them longer
 /// than necessary.
+/// Lookups of blocks in different shards don't share a lock.
 struct bio_cache
 {
     struct kobject kobj;  ///< The kobject for sysfs integration.
-    struct spinlock lock;
+    struct spinlock lock;  ///< Serializes changes of the limits.
+
+    /// Buffers with a block assigned, hashed by (dev, blockno).
+    struct list_head hash_table[BIO_HASH_BUCKETS];
 
-    // Linked list of all buffers.
-    // Sorted by how recently the buffer was used.
-    struct list_head buf_list;
+    /// Locks and free buffers of the hash table.
+    struct bio_shard shards[BIO_LOCK_SHARDS];
 
-    size_t num_buffers;  ///< Total number of buffers.
+    atomic_size_t num_buffers;  ///< Total number of buffers.
     size_t min_buffers;  ///< Minimum number of buffers to keep in the cache.
     size_t max_free_buffers;  ///< Try to keep at least this many free buffers.
-    size_t free_buffers;      ///< Number of buffers NOT in use (refcnt==0).
+    atomic_size_t free_buffers;  ///< Number of buffers NOT in use (refcnt==0).
+
+    struct kmem_cache *obj_cache;  ///< allocations of struct buf
 };
 
 #define bio_cache_from_kobj(ptr) container_of(ptr, struct bio_cache, kobj)
@@ -59,10 +92,92 @@ void bio_release(struct buf *b);
 /// Wont release/free the buffer, call bio_release for that explicitly.
 void bio_write(struct buf *b);
 
+/// @brief Start reading or writing the buffer and return without waiting for
+/// the device. The buffer must be locked and stays owned by the driver till
+/// bio_end_io() was called, wait for that with bio_wait() or a bio_batch.
+/// @param b Locked buffer, for writes with valid data.
+/// @param write true to write the buffer to disk, false to read it.
+void bio_submit(struct buf *b, bool write);
+
+/// @brief bio_submit() for buffers of consecutive blocks of one device,
+/// drivers with submit_bufs transfer them with one request.
+/// @param bufs count locked buffers, bufs[i + 1] holds the block after bufs[i].
+/// @param count Number of buffers.
+/// @param write true to write the buffers to disk, false to read them.
+void bio_submit_bufs(struct buf **bufs, size_t count, bool write);
+
+/// @brief Called by the block device driver when a request of bio_submit()
+/// finished. Marks the buffer as valid, wakes up waiters and calls
+/// b->end_io if set. May be called from an interrupt handler.
+/// @param b The buffer of the finished request.
+void bio_end_io(struct buf *b);
+
+/// @brief Sleep till a request of bio_submit() for this buffer finished.
+/// @param b The locked buffer.
+void bio_wait(struct buf *b);
+
+/// @brief A group of asynchronous requests the caller waits for together,
+/// e.g. to keep the device busy with all blocks of a log commit.
+/// Usage:
+/// * bio_batch_init() the batch (e.g. on the stack).
+/// * bio_batch_submit() any number of locked buffers.
+/// * bio_batch_wait() for all of them, then release the buffers.
+struct bio_batch
+{
+    struct spinlock lock;
+    size_t pending;  ///< Submitted requests which did not finish yet.
+};
+
+/// @brief Initialize an empty batch.
+void bio_batch_init(struct bio_batch *batch);
+
+/// @brief bio_submit() the buffer as part of the batch.
+/// @param batch The batch to wait on with bio_batch_wait().
+/// @param b Locked buffer, for writes with valid data.
+/// @param write true to write the buffer to disk, false to read it.
+void bio_batch_submit(struct bio_batch *batch, struct buf *b, bool write);
+
+/// @brief bio_submit() the buffers as part of the batch. Buffers of
+/// consecutive blocks get merged into one request.
+/// @param batch The batch to wait on with bio_batch_wait().
+/// @param bufs Locked buffers of one device or NULL entries which get skipped.
+/// @param count Number of entries in bufs.
+/// @param write true to write the buffers to disk, false to read them.
+void bio_batch_submit_bufs(struct bio_batch *batch, struct buf **bufs,
+                           size_t count, bool write);
+
+/// @brief Sleep till all requests of the batch finished.
+void bio_batch_wait(struct bio_batch *batch);
+
+/// @brief Read the blocks which are not cached, consecutive blocks with one
+/// request, and wait for them.
+/// Returns the valid buffers of all blocks unlocked but referenced, so they
+/// stay cached. Use them one at a time with bio_lock() and bio_release() to
+/// never wait for a buffer while holding another one.
+/// @param dev The device.
+/// @param blocknos count distinct block numbers.
+/// @param bufs Returns count referenced, unlocked buffers.
+/// @param count Number of blocks.
+void bio_read_blocks(dev_t dev, const uint32_t *blocknos, struct buf **bufs,
+                     size_t count);
+
+/// @brief Lock a buffer the caller holds a reference to, e.g. from
+/// bio_read_blocks(). Release it with bio_release().
+void bio_lock(struct buf *b);
+
+/// @brief Start reading the blocks which are not cached and return without
+/// waiting, e.g. for blocks a sequential reader will need soon. The buffers
+/// stay locked till their read finished and get released on completion.
+/// @param dev The device.
+/// @param blocknos count distinct block numbers.
+/// @param count Number of blocks.
+void bio_readahead(dev_t dev, const uint32_t *blocknos, size_t count);
+
 /// @brief Increase the buffers reference count.
 void bio_get(struct buf *b);
 
-/// @brief Decrease the buffers reference count.
+/// @brief Decrease the buffers reference count, of an unlocked buffer it
+/// might be the last one.
 void bio_put(struct buf *b);
 
 struct buf *bio_get_from_cache(dev_t dev, uint32_t blockno);
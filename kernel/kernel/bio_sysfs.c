@@ -14,14 +14,48 @@ enum BIO_ATTRIBUTE_INDEX
     BIO_NUM = 0,
     BIO_FREE,
     BIO_MIN,
-    BIO_MAX_FREE
+    BIO_MAX_FREE,
+    BIO_HITS,
+    BIO_MISSES,
+    BIO_EVICTIONS,
+    BIO_READAHEAD
 };
 
 struct sysfs_attribute bio_attributes[] = {
     [BIO_NUM] = {.name = "num", .mode = 0444},
     [BIO_FREE] = {.name = "free", .mode = 0444},
     [BIO_MIN] = {.name = "min", .mode = 0644},
-    [BIO_MAX_FREE] = {.name = "max_free", .mode = 0644}};
+    [BIO_MAX_FREE] = {.name = "max_free", .mode = 0644},
+    [BIO_HITS] = {.name = "hits", .mode = 0444},
+    [BIO_MISSES] = {.name = "misses", .mode = 0444},
+    [BIO_EVICTIONS] = {.name = "evictions", .mode = 0444},
+    [BIO_READAHEAD] = {.name = "readahead", .mode = 0444}};
+
+enum BIO_STATISTIC
+{
+    BIO_STAT_HITS,
+    BIO_STAT_MISSES,
+    BIO_STAT_EVICTIONS,
+    BIO_STAT_READAHEADS
+};
+
+// sum of a counter of all shards, without locking the shards
+static size_t bio_sum_shards(struct bio_cache *cache, enum BIO_STATISTIC stat)
+{
+    size_t sum = 0;
+    for (size_t i = 0; i < BIO_LOCK_SHARDS; i++)
+    {
+        struct bio_shard *shard = &cache->shards[i];
+        switch (stat)
+        {
+            case BIO_STAT_HITS: sum += shard->hits; break;
+            case BIO_STAT_MISSES: sum += shard->misses; break;
+            case BIO_STAT_EVICTIONS: sum += shard->evictions; break;
+            case BIO_STAT_READAHEADS: sum += shard->readaheads; break;
+        }
+    }
+    return sum;
+}
 
 syserr_t bio_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx,
                             char *buf, size_t n)
@@ -34,10 +68,11 @@ syserr_t bio_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx,
     switch (attribute_idx)
     {
         case BIO_NUM:
-            ret = snprintf(buf, n, "%zu\n", cache->num_buffers);
+            ret = snprintf(buf, n, "%zu\n", atomic_load(&cache->num_buffers));
             break;
         case BIO_FREE:
-            ret = snprintf(buf, n, "%zu\n", cache->free_buffers);
+            ret =
+                snprintf(buf, n, "%zu\n", atomic_load(&cache->free_buffers));
             break;
         case BIO_MIN:
             ret = snprintf(buf, n, "%zu\n", cache->min_buffers);
@@ -45,6 +80,22 @@ syserr_t bio_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx,
         case BIO_MAX_FREE:
             ret = snprintf(buf, n, "%zu\n", cache->max_free_buffers);
             break;
+        case BIO_HITS:
+            ret = snprintf(buf, n, "%zu\n",
+                           bio_sum_shards(cache, BIO_STAT_HITS));
+            break;
+        case BIO_MISSES:
+            ret = snprintf(buf, n, "%zu\n",
+                           bio_sum_shards(cache, BIO_STAT_MISSES));
+            break;
+        case BIO_EVICTIONS:
+            ret = snprintf(buf, n, "%zu\n",
+                           bio_sum_shards(cache, BIO_STAT_EVICTIONS));
+            break;
+        case BIO_READAHEAD:
+            ret = snprintf(buf, n, "%zu\n",
+                           bio_sum_shards(cache, BIO_STAT_READAHEADS));
+            break;
         default: ret = -ENOENT; break;
     }
     spin_unlock(&cache->lock);
@@ -81,6 +132,10 @@ syserr_t bio_sysfs_ops_store(struct kobject *kobj, size_t attribute_idx,
         case BIO_MAX_FREE:
             ret = bio_cache_set_max_free_buffers(cache, value);
             break;
+        case BIO_HITS: ret = -EINVAL; break;
+        case BIO_MISSES: ret = -EINVAL; break;
+        case BIO_EVICTIONS: ret = -EINVAL; break;
+        case BIO_READAHEAD: ret = -EINVAL; break;
 
         default: ret = -ENOENT; break;
     }
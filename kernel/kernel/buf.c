@@ -2,11 +2,14 @@
 
 #include <kernel/bio.h>
 #include <kernel/buf.h>
+#include <mm/cache.h>
 #include <mm/kalloc.h>
 
 struct buf *buf_alloc_init(dev_t dev, uint32_t blockno)
 {
-    struct buf *b = kmalloc(sizeof(struct buf), ALLOC_FLAG_NONE);
+    // called with a shard lock held, which the bio shrinker takes
+    struct buf *b =
+        kmem_cache_alloc(g_buf_cache.obj_cache, ALLOC_FLAG_NO_RECLAIM);
     if (b == NULL)
     {
         return NULL;
@@ -19,12 +22,12 @@ struct buf *buf_alloc_init(dev_t dev, uint32_t blockno)
 void buf_init(struct buf *b, dev_t dev, uint32_t blockno)
 {
     sleep_lock_init(&b->lock, "buffer");
-    list_init(&b->buf_list);
+    list_init(&b->hash_list);
+    list_init(&b->lru_list);
 
     buf_reinit(b, dev, blockno);
 
-    list_add(&b->buf_list, &g_buf_cache.buf_list);
-    g_buf_cache.num_buffers++;
+    atomic_fetch_add(&g_buf_cache.num_buffers, 1);
 }
 
 void buf_reinit(struct buf *b, dev_t dev, uint32_t blockno)
@@ -34,10 +37,14 @@ void buf_reinit(struct buf *b, dev_t dev, uint32_t blockno)
     b->valid = false;
     b->owned_by_driver = false;
     b->refcnt = 1;
+    b->end_io = NULL;
+    b->end_io_data = NULL;
 }
 
 void buf_deinit(struct buf *b)
 {
-    list_del(&b->buf_list);
-    g_buf_cache.num_buffers--;
+    // list_del() of a buffer not in a list is a no-op
+    list_del(&b->hash_list);
+    list_del(&b->lru_list);
+    atomic_fetch_sub(&g_buf_cache.num_buffers, 1);
 }
\ No newline at end of file
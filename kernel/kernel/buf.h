@@ -21,38 +21,46 @@ struct buf
     struct sleeplock lock;  ///< Access mutex
     uint32_t refcnt;        ///< reference count, 0 == unused
 
-    struct list_head buf_list;  ///< For linking all buffers
+    /// Optional completion callback of an asynchronous request, see
+    /// bio_submit(). Called without the buffer cache locks held, but maybe
+    /// from an interrupt handler, so it must not sleep.
+    void (*end_io)(struct buf *b, void *data);
+    void *end_io_data;  ///< passed to end_io
+
+    struct list_head hash_list;  ///< in g_buf_cache.hash_table if a block
+                                 ///< is assigned
+    struct list_head lru_list;   ///< in g_buf_cache.lru_list if unused
 
     uint8_t data[BLOCK_SIZE];  ///< payload data from the disk
 };
 
-#define buf_from_list(ptr) container_of(ptr, struct buf, buf_list)
+#define buf_from_hash_list(ptr) container_of(ptr, struct buf, hash_list)
+#define buf_from_lru_list(ptr) container_of(ptr, struct buf, lru_list)
 
 /// @brief Allocates and initializes a new buffer for the given device
 /// and block number.
-/// The buffer is added to the global buffer list.
+/// The caller adds the buffer to the hash table of the buffer cache.
 /// The buffer is NOT locked and has a refcnt of 1.
 /// @param dev The device.
 /// @param blockno The block number.
 /// @return The allocated buffer or NULL on error.
 struct buf *buf_alloc_init(dev_t dev, uint32_t blockno);
 
-/// @brief Initialize a buffer struct.
-/// The buffer is added to the global buffer list.
+/// @brief Initialize a buffer struct and count it in the buffer cache.
 /// The buffer is NOT locked and has a refcnt of 1.
 /// @param b The buffer to initialize.
 /// @param dev The device.
 /// @param blockno The block number.
 void buf_init(struct buf *b, dev_t dev, uint32_t blockno);
 
-/// @brief Resets the buffer like after init, but does not add itself to the
-/// buffer list like init.
+/// @brief Resets the buffer like after init, but does not count itself in the
+/// buffer cache like init.
 /// @param b A buffer previously initialized with buf_init().
 /// @param dev The device.
 /// @param blockno The block number.
 void buf_reinit(struct buf *b, dev_t dev, uint32_t blockno);
 
-/// @brief Removes the buffer from the global buffer list.
-/// The buffer must not be in use (refcnt == 0).
+/// @brief Removes the buffer from the hash table and LRU list of the buffer
+/// cache. The buffer must not be in use (refcnt == 0).
 /// @param b The buffer to deinitialize.
 void buf_deinit(struct buf *b);
@@ -59,6 +59,38 @@ enum MM_Region_Type elf_flags_to_map_type(int32_t elf_flags)
     }
 }
 
+/// @brief Text and read-only data get mapped from the page cache on first
+/// access instead of being read at exec. This way processes running the same
+/// binary share these pages and pages never used are never read.
+/// @return true if the segment got added as a file mapping.
+static bool map_segment_lazily(struct inode *ip, struct proghdr *ph,
+                               struct Page_Table *pagetable, size_t last_va)
+{
+    enum MM_Region_Type type = elf_flags_to_map_type(ph->flags);
+    if ((type != MM_REGION_USER_TEXT) && (type != MM_REGION_USER_RO_DATA))
+    {
+        return false;  // writeable pages need a private copy anyway
+    }
+    if ((ph->off % PAGE_SIZE != 0) || (ph->vaddr < PAGE_ROUND_UP(last_va)))
+    {
+        // file pages can't be mapped directly or would overlap the previous
+        // segment
+        return false;
+    }
+
+    struct File_Mapping mapping = {.start_va = ph->vaddr,
+                                   .size = PAGE_ROUND_UP(ph->memsz),
+                                   .file_offset = ph->off,
+                                   .file_size = ph->filesz,
+                                   .type = type,
+                                   .ip = ip};
+    spin_lock(&pagetable->lock);
+    syserr_t err = page_table_add_file_mapping(pagetable, &mapping);
+    spin_unlock(&pagetable->lock);
+
+    return (err == 0);
+}
+
 bool load_program_to_memory(struct inode *ip, struct elfhdr *elf,
                             struct Page_Table *pagetable, size_t *last_va)
 {
@@ -78,11 +110,18 @@ bool load_program_to_memory(struct inode *ip, struct elfhdr *elf,
 
         // error checks
         if ((ph.memsz < ph.filesz) || (ph.vaddr + ph.memsz < ph.vaddr) ||
-            (ph.vaddr % PAGE_SIZE != 0))
+            (ph.vaddr % PAGE_SIZE != 0) || (ph.off + ph.filesz < ph.off) ||
+            (ph.off + ph.filesz > ip->size))
         {
             return false;
         }
 
+        if (map_segment_lazily(ip, &ph, pagetable, *last_va))
+        {
+            *last_va = ph.vaddr + ph.memsz;
+            continue;
+        }
+
         // allocate pages and update last_va
         size_t alloc_size = (ph.vaddr + ph.memsz) - *last_va;
 
@@ -103,7 +142,7 @@ bool load_program_to_memory(struct inode *ip, struct elfhdr *elf,
     return true;
 }
 
-syserr_t do_execv(char *path, char **argv)
+syserr_t exec_load(struct process *proc, char *path, char **argv)
 {
     syserr_t error = 0;
     struct dentry *dp = dentry_from_path(path, &error);
@@ -117,7 +156,6 @@ syserr_t do_execv(char *path, char **argv)
         return -ENOENT;
     }
 
-    struct process *proc = get_current();
     syserr_t perm = check_dentry_permission(proc, dp, MAY_EXEC);
     if (perm < 0)
     {
@@ -164,6 +202,7 @@ syserr_t do_execv(char *path, char **argv)
     // anyways
     if (fatal_error)
     {
+        page_table_put_files(pagetable);
         page_table_free(pagetable);
         return -ENOMEM;
     }
@@ -173,6 +212,7 @@ syserr_t do_execv(char *path, char **argv)
     size_t argc = uvm_create_stack(pagetable, argv, &stack_low, &sp);
     if (argc == -1)
     {
+        page_table_put_files(pagetable);
         page_table_free(pagetable);
         return -ENOMEM;
     }
@@ -206,12 +246,15 @@ syserr_t do_execv(char *path, char **argv)
 
     // Commit to the user image.
     struct Page_Table *oldpagetable = proc->pagetable;
+    page_table_put_files(oldpagetable);  // might sleep
     spin_lock(&oldpagetable->lock);
 
     proc->pagetable = pagetable;
     proc->heap_begin = heap_begin;
     proc->heap_end = proc->heap_begin;
     proc->stack_low = stack_low;
+    pagetable->demand_start = PAGE_ROUND_DOWN(heap_begin);
+    pagetable->demand_end = PAGE_ROUND_UP(heap_begin);
 
     trapframe_set_program_counter(proc->trapframe, elf.entry);
     trapframe_set_stack_pointer(proc->trapframe, sp);
@@ -229,9 +272,14 @@ syserr_t do_execv(char *path, char **argv)
         proc->cred.sgid = new_gid;
     }
 
+    return argc;
+}
+
+syserr_t do_execv(char *path, char **argv)
+{
     // This ends up in a0, the first argument to main(argc, argv)
     // not a return value of the syscall! It does not return!
-    return argc;
+    return exec_load(get_current(), path, argv);
 }
 
 static int32_t loadseg(struct Page_Table *pagetable, size_t va,
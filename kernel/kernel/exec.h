@@ -3,6 +3,18 @@
 
 #include <kernel/types.h>
 
+struct process;
+
+/// @brief Loads the ELF file at pathname into a new page table and replaces
+/// the memory image, registers, name and (setuid/setgid) credentials of proc
+/// with it. The file lookup is relative to the current process.
+/// @param proc Process to load the program into. Must not be running on
+/// another CPU: either the current process or a new one from spawn.
+/// @param pathname Name of ELF file to execute
+/// @param argv Command arguments
+/// @return argc on success, -errno on failure (proc is unchanged then)
+syserr_t exec_load(struct process *proc, char *pathname, char **argv);
+
 /// @brief Implements syscall execv.
 /// @param pathname Name of ELF file to execute
 /// @param argv Command arguments
@@ -22,12 +22,14 @@
 #include <kernel/stat.h>
 #include <kernel/string.h>
 #include <kernel/unistd.h>
+#include <mm/cache.h>
 #include <mm/kalloc.h>
 
 struct
 {
     struct spinlock lock;         ///< global lock for all open files
     struct list_head open_files;  ///< double linked list of open files
+    struct kmem_cache *obj_cache;  ///< allocations of struct file
 } g_file_table;
 
 bool check_and_adjust_mode(mode_t *mode, mode_t default_type)
@@ -57,12 +59,19 @@ void file_init()
 {
     spin_lock_init(&g_file_table.lock, "ftable");
     list_init(&g_file_table.open_files);
+    g_file_table.obj_cache =
+        kmem_cache_create("file", sizeof(struct file), 0, NULL);
+    if (g_file_table.obj_cache == NULL)
+    {
+        panic("file_init: out of memory");
+    }
 }
 
 struct file *file_alloc()
 {
     spin_lock(&g_file_table.lock);
-    struct file *f = kmalloc(sizeof(struct file), ALLOC_FLAG_ZERO_MEMORY);
+    struct file *f =
+        kmem_cache_alloc(g_file_table.obj_cache, ALLOC_FLAG_ZERO_MEMORY);
     if (f)
     {
         kref_init(&f->ref);
@@ -81,6 +90,9 @@ struct file *file_alloc_init(mode_t mode, int32_t flags, struct dentry *dp)
     }
 
     f->off = 0;
+    f->ra.next_off = 0;
+    f->ra.window = 0;
+    f->ra.end = 0;
     f->mode = mode;
     f->dp = dentry_get(dp);
     f->flags = flags;
@@ -96,7 +108,8 @@ struct file *file_get(struct file *f)
     return f;
 }
 
-syserr_t do_open(char *pathname, int32_t flags, mode_t mode)
+syserr_t file_open(char *pathname, int32_t flags, mode_t mode,
+                   struct file **f_out)
 {
     mode = mode & 0777;  // only permission bits
 
@@ -200,6 +213,20 @@ syserr_t do_open(char *pathname, int32_t flags, mode_t mode)
         file_close(f);
         return error;
     }
+
+    *f_out = f;
+    return 0;
+}
+
+syserr_t do_open(char *pathname, int32_t flags, mode_t mode)
+{
+    struct file *f;
+    syserr_t error = file_open(pathname, flags, mode, &f);
+    if (error < 0)
+    {
+        return error;
+    }
+
     FILE_DESCRIPTOR fd = fd_alloc(f);
     if (fd < 0)
     {
@@ -243,7 +270,7 @@ void file_close(struct file *f)
     }
 
     // free memory of file struct
-    kfree((void *)f);
+    kmem_cache_free(g_file_table.obj_cache, f);
 }
 
 syserr_t do_read(struct file *f, size_t addr, size_t n)
@@ -8,6 +8,15 @@
 #include <kernel/list.h>
 #include <kernel/stat.h>
 
+/// @brief Readahead state of an open file, used by file systems which read
+/// ahead (see vimixfs_fops_read()).
+struct file_readahead
+{
+    size_t next_off;  ///< offset after the last read, reads here are sequential
+    size_t window;    ///< blocks to read ahead, grows with sequential reads
+    size_t end;       ///< first block which was not read ahead yet
+};
+
 /// @brief Represents an open file. Each process has an array
 /// of these. The "file descriptor" in C is simply the index into that array.
 struct file
@@ -20,6 +29,9 @@ struct file
     struct pipe *pipe;  ///< used if the file belongs to a pipe
     struct dentry *dp;  ///< dentry of the file
     uint32_t off;       ///< for files
+
+    /// readahead state for files
+    struct file_readahead ra;
 };
 
 /// @brief Common code to check file mode.
@@ -34,6 +46,16 @@ struct file *file_alloc();
 
 struct file *file_alloc_init(mode_t mode, int32_t flags, struct dentry *dp);
 
+/// @brief Open file at pathname with flags and mode without assigning a file
+/// descriptor.
+/// @param pathname Path to file to open.
+/// @param flags Open flags.
+/// @param mode File mode.
+/// @param f_out Returns the opened file with one reference on success.
+/// @return 0 on success or -errno on error.
+syserr_t file_open(char *pathname, int32_t flags, mode_t mode,
+                   struct file **f_out);
+
 /// @brief Open file at pathname with flags and mode.
 /// @param pathname Path to file to open.
 /// @param flags Open flags.
@@ -19,6 +19,7 @@ enum ipi_type
     IPI_KERNEL_PANIC,
     IPI_SHUTDOWN,
     IPI_KERNEL_PAGETABLE_CHANGED,
+    IPI_WAKEUP,  ///< wake an idle CPU, e.g. to run a new process
 };
 
 /// @brief Call from boot CPU.
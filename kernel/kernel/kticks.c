@@ -7,18 +7,13 @@
 #include <kernel/spinlock.h>
 #include <kernel/stdatomic.h>
 
-// each call to the timer interrupt is one tick
-atomic_size_t g_ticks = 0;
-
 /// @brief boot time from rv_get_time()
 uint64_t g_boot_time = 0;
 
-void kticks_init() { atomic_init(&g_ticks, 0); }
+extern size_t g_boot_hart;
 
-void kticks_inc_ticks()
+void kticks_tick()
 {
-    atomic_fetch_add(&g_ticks, 1);
-
     // The htif and SBI consoles can be a fallback for UART,
     // but without IRQs we need to poll the input manually
     if (g_console_poll_callback)
@@ -27,6 +22,39 @@ void kticks_inc_ticks()
     }
 }
 
+bool kticks_periodic_tick_required(size_t cpu_id)
+{
+    return (cpu_id == g_boot_hart) && (g_console_poll_callback != NULL);
+}
+
+size_t kticks_get_ticks()
+{
+    uint64_t ticks_per_second = TIMER_INTERRUPTS_PER_SECOND;
+    if (g_timebase_frequency < ticks_per_second) return 0;  // early boot
+
+    uint64_t delta = get_time() - g_boot_time;
+    return (size_t)(delta / (g_timebase_frequency / ticks_per_second));
+}
+
+#define NS_PER_SECOND 1000000000ull
+
+uint64_t timer_from_timespec(const struct timespec *ts)
+{
+    uint64_t time = (uint64_t)ts->tv_sec * g_timebase_frequency;
+    time += ((uint64_t)ts->tv_nsec * g_timebase_frequency + NS_PER_SECOND - 1) /
+            NS_PER_SECOND;
+    return time;
+}
+
+struct timespec timer_to_timespec(uint64_t time)
+{
+    struct timespec ts;
+    ts.tv_sec = time / g_timebase_frequency;
+    ts.tv_nsec = (int64_t)((time % g_timebase_frequency) * NS_PER_SECOND /
+                           g_timebase_frequency);
+    return ts;
+}
+
 size_t seconds_since_boot()
 {
     uint64_t now = get_time();
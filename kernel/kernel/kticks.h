@@ -3,17 +3,28 @@
 
 #include <kernel/kernel.h>
 #include <kernel/stdatomic.h>
+#include <kernel/time.h>
 
-extern atomic_size_t g_ticks;
+/// @brief Called on every timer interrupt of the boot CPU.
+void kticks_tick();
 
-/// @brief Init the timer g_ticks which will increase
-/// with each timer interrupt.
-void kticks_init();
+/// @brief True if the CPU needs a periodic timer interrupt even when idle.
+/// @param cpu_id The CPU.
+bool kticks_periodic_tick_required(size_t cpu_id);
 
-/// @brief increase timer by one tick
-void kticks_inc_ticks();
-
-/// @brief Get current timer value in ticks since boot
-static inline size_t kticks_get_ticks() { return atomic_load(&g_ticks); }
+/// @brief Get the time since boot in ticks (1/TIMER_INTERRUPTS_PER_SECOND
+/// seconds). Derived from the timer, so it also advances while CPUs are
+/// idle without timer interrupts.
+size_t kticks_get_ticks();
 
 size_t seconds_since_boot();
+
+/// @brief Converts a duration to timer units (see get_time()), rounded up.
+/// @param ts Duration, must be valid (tv_nsec < 1000000000).
+/// @return Duration in timer units
+uint64_t timer_from_timespec(const struct timespec *ts);
+
+/// @brief Converts a duration in timer units to a timespec.
+/// @param time Duration in timer units
+/// @return Duration
+struct timespec timer_to_timespec(uint64_t time);
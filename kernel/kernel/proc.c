@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <arch/cpu.h>
+#include <arch/timer.h>
 #include <arch/trap.h>
 #include <arch/trapframe.h>
 #include <fs/dentry_cache.h>
@@ -18,11 +19,15 @@
 #include <kernel/pgtable.h>
 #include <kernel/proc.h>
 #include <kernel/process.h>
+#include <kernel/scheduler.h>
 #include <kernel/signal.h>
+#include <kernel/sleep_queue.h>
 #include <kernel/smp.h>
+#include <kernel/spawn.h>
 #include <kernel/spinlock.h>
 #include <kernel/string.h>
 #include <lib/panic.h>
+#include <mm/cache.h>
 #include <mm/kalloc.h>
 #include <mm/memlayout.h>
 #include <mm/vm.h>
@@ -38,10 +43,30 @@ struct process_list g_process_list;
 /// Created in init_userspace(), the only process not created by fork()
 struct process *g_initial_user_process;
 
-void wakeup_holding_plist_lock(void *chan);
-
 extern char trampoline[];  // u_mode_trap_vector.S
 
+/// Number of buckets of the wait channel hash table.
+#define WAIT_TABLE_SIZE 64
+
+/// @brief All processes sleeping on channels with the same hash.
+struct wait_bucket
+{
+    struct spinlock lock;       ///< must be acquired before any p->lock
+    struct list_head sleepers;  ///< processes linked via wait_list
+};
+
+/// @brief Sleeping processes hashed by their channel, so wakeup() only has to
+/// look at processes which might wait on the channel.
+struct wait_bucket g_wait_table[WAIT_TABLE_SIZE];
+
+static inline struct wait_bucket *wait_bucket_from_channel(void *channel)
+{
+    // channels are mostly pointers to kernel objects, drop the alignment bits
+    // and mix the rest
+    size_t hash = ((size_t)channel >> 3) * 0x9E3779B1u;
+    return &g_wait_table[(hash >> 8) % WAIT_TABLE_SIZE];
+}
+
 /// helps ensure that wakeups of wait()ing
 /// parents are not lost. helps obey the
 /// memory model when using p->parent.
@@ -69,11 +94,24 @@ size_t proc_get_free_kernel_stack_va()
 void proc_init()
 {
     spin_lock_init(&g_wait_lock, "wait_lock");
+    sleep_queue_init();
+    for (size_t i = 0; i < WAIT_TABLE_SIZE; ++i)
+    {
+        spin_lock_init(&g_wait_table[i].lock, "wait_bucket");
+        list_init(&g_wait_table[i].sleepers);
+    }
+    scheduler_init();
 
     list_init(&g_process_list.plist);
     rwspin_lock_init(&g_process_list.lock, "proc_list_lock");
     g_process_list.kernel_stack_in_use = bitmap_alloc(MAX_PROCESSES);
     spin_lock_init(&g_process_list.kernel_stack_lock, "proc_list_kstack_lock");
+    g_process_list.obj_cache =
+        kmem_cache_create("process", sizeof(struct process), 0, NULL);
+    if (g_process_list.obj_cache == NULL)
+    {
+        panic("proc_init: out of memory");
+    }
 }
 
 /// Return this CPU's cpu struct.
@@ -113,25 +151,23 @@ struct Page_Table *proc_pagetable(struct process *proc)
         return NULL;
     }
 
-    struct MM_Region *trampoline_region =
-        mm_region_alloc_init(virt_to_phys((size_t)trampoline), TRAMPOLINE,
-                             PAGE_SIZE, MM_REGION_USER_TRAMPOLINE);
-    if (trampoline_region == NULL)
+    struct MM_Region trampoline_region;
+    mm_region_init(&trampoline_region, virt_to_phys((size_t)trampoline),
+                   TRAMPOLINE, PAGE_SIZE, MM_REGION_USER_TRAMPOLINE);
+    if (memory_map_add_region(&pagetable->memory_map, &trampoline_region) < 0)
     {
         page_table_free(pagetable);
         return NULL;
     }
-    memory_map_add_single_region(&pagetable->memory_map, trampoline_region);
 
-    struct MM_Region *trapframe_region =
-        mm_region_alloc_init(virt_to_phys((size_t)proc->trapframe), TRAPFRAME,
-                             PAGE_SIZE, MM_REGION_USER_TRAPFRAME);
-    if (trapframe_region == NULL)
+    struct MM_Region trapframe_region;
+    mm_region_init(&trapframe_region, virt_to_phys((size_t)proc->trapframe),
+                   TRAPFRAME, PAGE_SIZE, MM_REGION_USER_TRAPFRAME);
+    if (memory_map_add_region(&pagetable->memory_map, &trapframe_region) < 0)
     {
         page_table_free(pagetable);
         return NULL;
     }
-    memory_map_add_single_region(&pagetable->memory_map, trapframe_region);
 
     if (page_table_apply_mapping(pagetable) < 0)
     {
@@ -155,6 +191,7 @@ void init_userspace()
         panic("init_userspace() already out of memory");
     g_initial_user_process->cred.groups = groups_alloc(0);
     g_initial_user_process->state = RUNNABLE;
+    run_queue_add(g_initial_user_process);
 
     // add to kobject tree
     kobject_add(&g_initial_user_process->kobj, &g_kobjects_proc, "1");
@@ -178,9 +215,8 @@ int32_t proc_grow_memory(ssize_t n)
 
     if (n > 0)
     {
-        // grow
-        if (uvm_alloc_heap(proc->pagetable, proc->heap_end, n,
-                           MM_REGION_USER_DATA) != n)
+        // grow, pages get allocated on first access
+        if (!uvm_reserve_heap(proc->pagetable, proc->heap_end, n))
         {
             return -1;
         }
@@ -232,6 +268,7 @@ syserr_t do_fork()
     if (proc_copy_memory(parent, np) < 0)
     {
         spin_unlock(&np->lock);
+        page_table_put_files(np->pagetable);
         proc_put(np);
         return -ENOMEM;
     }
@@ -259,12 +296,25 @@ syserr_t do_fork()
         kobject_add(&np->kobj, &g_kobjects_proc, "%d", np->pid);
     if (!added_to_tree)
     {
+        page_table_put_files(np->pagetable);
         proc_put(np);
         kobject_del(&np->kobj);  // cleanup partial addition
         return -ENOMEM;
     }
     proc_put(np);  // drop reference now that the kobject tree holds one
 
+    // Publish parent relation and list membership atomically with respect to
+    // exit()/wait() paths. Otherwise a parent exiting concurrently can miss
+    // this child in reparent() and leave a stale parent pointer.
+    // This has to happen before the child is queued: another CPU can run it
+    // (and let it exit) right after run_queue_add().
+    spin_lock(&g_wait_lock);
+    np->parent = parent;
+    rwspin_write_lock(&g_process_list.lock);
+    list_add_tail(&np->plist, &g_process_list.plist);
+    rwspin_write_unlock(&g_process_list.lock);
+    spin_unlock(&g_wait_lock);
+
     spin_lock(&np->lock);
 
     // Copy open files:
@@ -279,12 +329,156 @@ syserr_t do_fork()
     }
     np->cwd_dentry = dentry_get(parent->cwd_dentry);
 
+    // last step, see above
     np->state = RUNNABLE;
+    run_queue_add(np);
     spin_unlock(&np->lock);
 
-    // Publish parent relation and list membership atomically with respect to
-    // exit()/wait() paths. Otherwise a parent exiting concurrently can miss
-    // this child in reparent() and leave a stale parent pointer.
+    return (syserr_t)pid;
+}
+
+/// @brief Drops the references of a file descriptor table.
+static void spawn_close_files(struct file **files)
+{
+    for (size_t i = 0; i < MAX_FILES_PER_PROCESS; i++)
+    {
+        if (files[i])
+        {
+            file_close(files[i]);
+            files[i] = NULL;
+        }
+    }
+}
+
+/// @brief Applies spawn file actions in order to a file descriptor table.
+/// @param files File descriptor table to modify.
+/// @param actions Actions to apply.
+/// @param n_actions Number of actions.
+/// @return 0 on success, -errno on failure.
+static syserr_t spawn_apply_file_actions(struct file **files,
+                                         struct spawn_action *actions,
+                                         size_t n_actions)
+{
+    for (size_t i = 0; i < n_actions; i++)
+    {
+        struct spawn_action *action = &actions[i];
+        if (action->fd < 0 || action->fd >= MAX_FILES_PER_PROCESS)
+        {
+            return -EBADF;
+        }
+
+        struct file *f = NULL;
+        switch (action->type)
+        {
+            case SPAWN_ACTION_CLOSE:
+                if (files[action->fd])
+                {
+                    file_close(files[action->fd]);
+                    files[action->fd] = NULL;
+                }
+                break;
+            case SPAWN_ACTION_DUP2:
+                if (files[action->fd] == NULL || action->new_fd < 0 ||
+                    action->new_fd >= MAX_FILES_PER_PROCESS)
+                {
+                    return -EBADF;
+                }
+                if (action->fd == action->new_fd) break;
+
+                f = file_get(files[action->fd]);
+                if (files[action->new_fd])
+                {
+                    file_close(files[action->new_fd]);
+                }
+                files[action->new_fd] = f;
+                break;
+            case SPAWN_ACTION_OPEN:
+            {
+                // opened with the credentials and umask of the caller which
+                // the child inherits
+                syserr_t error = file_open((char *)action->path, action->flags,
+                                           action->mode, &f);
+                if (error < 0)
+                {
+                    return error;
+                }
+                if (files[action->fd])
+                {
+                    file_close(files[action->fd]);
+                }
+                files[action->fd] = f;
+                break;
+            }
+            default: return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+syserr_t do_spawn(char *path, char **argv, struct spawn_action *actions,
+                  size_t n_actions)
+{
+    struct process *parent = get_current();
+
+    // Build the childs file descriptor table before creating the child, so
+    // errors can be reported without tearing down a process.
+    struct file *files[MAX_FILES_PER_PROCESS];
+    for (size_t i = 0; i < MAX_FILES_PER_PROCESS; i++)
+    {
+        files[i] = parent->files[i] ? file_get(parent->files[i]) : NULL;
+    }
+    syserr_t error = spawn_apply_file_actions(files, actions, n_actions);
+    if (error < 0)
+    {
+        spawn_close_files(files);
+        return error;
+    }
+
+    // Allocate new process, it comes with a page table containing only the
+    // trampoline and trapframe. Nothing of the parents memory gets copied.
+    struct process *np = process_alloc_init();
+    if (np == NULL)
+    {
+        spawn_close_files(files);
+        return -ENOMEM;
+    }
+
+    // copy IDs
+    pid_t pid = np->pid;
+    np->cred = parent->cred;
+    np->cred.groups = get_group_info(parent->cred.groups);
+    np->umask = parent->umask;
+
+    np->debug_log_depth = 0;
+
+    spin_unlock(&np->lock);
+
+    // The child is not visible to anyone else yet, so the program can be
+    // loaded without holding its lock (loading sleeps on disk I/O).
+    syserr_t argc = exec_load(np, path, argv);
+    if (argc < 0)
+    {
+        spawn_close_files(files);
+        proc_put(np);
+        return argc;
+    }
+    // argc is the first argument to main(argc, argv)
+    trapframe_set_return_register(np->trapframe, argc);
+
+    // add to kobject tree
+    bool added_to_tree =
+        kobject_add(&np->kobj, &g_kobjects_proc, "%d", np->pid);
+    if (!added_to_tree)
+    {
+        spawn_close_files(files);
+        page_table_put_files(np->pagetable);
+        proc_put(np);
+        kobject_del(&np->kobj);  // cleanup partial addition
+        return -ENOMEM;
+    }
+    proc_put(np);  // drop reference now that the kobject tree holds one
+
+    // see do_fork(): publish before queuing the child
     spin_lock(&g_wait_lock);
     np->parent = parent;
     rwspin_write_lock(&g_process_list.lock);
@@ -292,6 +486,19 @@ syserr_t do_fork()
     rwspin_write_unlock(&g_process_list.lock);
     spin_unlock(&g_wait_lock);
 
+    spin_lock(&np->lock);
+
+    // hand over the prepared file references
+    for (size_t i = 0; i < MAX_FILES_PER_PROCESS; i++)
+    {
+        np->files[i] = files[i];
+    }
+    np->cwd_dentry = dentry_get(parent->cwd_dentry);
+
+    np->state = RUNNABLE;
+    run_queue_add(np);
+    spin_unlock(&np->lock);
+
     return (syserr_t)pid;
 }
 
@@ -307,7 +514,7 @@ void reparent(struct process *proc)
         if (pp->parent == proc)
         {
             pp->parent = g_initial_user_process;
-            wakeup_holding_plist_lock(g_initial_user_process);
+            wakeup(g_initial_user_process);
         }
     }
     rwspin_read_unlock(&g_process_list.lock);
@@ -343,18 +550,19 @@ void do_exit(int32_t status)
     dentry_put(proc->cwd_dentry);
     proc->cwd_dentry = NULL;
 
+    // might sleep, so not when the process gets freed
+    page_table_put_files(proc->pagetable);
+
     spin_lock(&g_wait_lock);
 
     // Give any children to init.
     reparent(proc);
 
-    rwspin_read_lock(&g_process_list.lock);
     // Parent might be sleeping in wait().
     // Note that the parent can't free the process while we still hold
     // the proc->lock, because it will acquire the lock before the free.
     spin_lock(&proc->lock);
-    wakeup_holding_plist_lock(proc->parent);
-    rwspin_read_unlock(&g_process_list.lock);
+    wakeup(proc->parent);
 
     proc->xstate = status;
     proc->state = ZOMBIE;
@@ -477,7 +685,7 @@ void yield()
 {
     struct process *proc = get_current();
     spin_lock(&proc->lock);
-    proc->state = RUNNABLE;
+    proc->state = RUNNABLE;  // scheduler() re-queues it after the switch
     sched();
     spin_unlock(&proc->lock);
 }
@@ -547,17 +755,21 @@ void forkret()
     return_to_user_mode();
 }
 
-void sleep(void *channel, struct spinlock *lk)
+/// @brief Shared implementation of sleep() and sleep_until().
+static void sleep_internal(void *channel, struct spinlock *lk,
+                           uint64_t deadline)
 {
     struct process *proc = get_current();
+    struct wait_bucket *bucket = wait_bucket_from_channel(channel);
 
-    // Must acquire p->lock in order to
+    // Must acquire the bucket lock and p->lock in order to
     // change p->state and then call sched.
-    // Once we hold p->lock, we can be
+    // Once we hold the bucket lock, we can be
     // guaranteed that we won't miss any wakeup
-    // (wakeup locks p->lock),
+    // (wakeup locks the bucket of the channel),
     // so it's okay to release lk.
 
+    spin_lock(&bucket->lock);
     spin_lock(&proc->lock);
     if (lk != NULL)
     {
@@ -567,6 +779,13 @@ void sleep(void *channel, struct spinlock *lk)
     // Go to sleep.
     proc->chan = channel;
     proc->state = SLEEPING;
+    list_add_tail(&proc->wait_list, &bucket->sleepers);
+    if (deadline != SLEEP_QUEUE_NO_DEADLINE)
+    {
+        // while the bucket is locked, so an expired deadline can't get lost
+        sleep_queue_add(proc, deadline, channel);
+    }
+    spin_unlock(&bucket->lock);
 
     sched();
 
@@ -575,6 +794,21 @@ void sleep(void *channel, struct spinlock *lk)
 
     spin_unlock(&proc->lock);
 
+    // wakeup() removes the process from the bucket, but a signal can also end
+    // the sleep.
+    spin_lock(&bucket->lock);
+    if (!list_empty(&proc->wait_list))
+    {
+        list_del(&proc->wait_list);
+    }
+    spin_unlock(&bucket->lock);
+
+    // woken up before the deadline
+    if (deadline != SLEEP_QUEUE_NO_DEADLINE)
+    {
+        sleep_queue_remove(proc);
+    }
+
     // Reacquire original lock.
     if (lk != NULL)
     {
@@ -582,40 +816,55 @@ void sleep(void *channel, struct spinlock *lk)
     }
 }
 
-void wakeup_holding_plist_lock(void *chan)
+void sleep(void *channel, struct spinlock *lk)
+{
+    sleep_internal(channel, lk, SLEEP_QUEUE_NO_DEADLINE);
+}
+
+void sleep_until(void *channel, struct spinlock *lk, uint64_t deadline)
 {
-    struct process *current_process = get_current();
+    if (channel == NULL)
+    {
+        channel = &get_current()->sleep_queue_idx;
+    }
+    sleep_internal(channel, lk, deadline);
+}
 
-    // if (chan != &g_ticks) printk("wakeup 0x%zx\n", (size_t)chan);
+void wakeup(void *chan)
+{
+    struct wait_bucket *bucket = wait_bucket_from_channel(chan);
 
+    spin_lock(&bucket->lock);
     struct list_head *pos;
-    list_for_each(pos, &g_process_list.plist)
+    struct list_head *tmp;
+    list_for_each_safe(pos, tmp, &bucket->sleepers)
     {
-        struct process *proc = process_from_list(pos);
-        if ((pos->next == pos->prev) && (pos->next != &g_process_list.plist))
-        {
-            printk("wakeup_holding_plist_lock: process list corrupted\n");
-        }
+        struct process *proc = process_from_wait_list(pos);
 
-        if (proc != current_process)
+        spin_lock(&proc->lock);
+        if (proc->state == SLEEPING && proc->chan == chan)
         {
-            spin_lock(&proc->lock);
-            if (proc->state == SLEEPING && proc->chan == chan)
-            {
-                proc->state = RUNNABLE;
-            }
-            spin_unlock(&proc->lock);
+            list_del(pos);
+            proc->state = RUNNABLE;
+            run_queue_add(proc);
         }
+        spin_unlock(&proc->lock);
     }
+    spin_unlock(&bucket->lock);
 }
 
-void wakeup(void *chan)
+syserr_t proc_sleep_until(uint64_t deadline)
 {
-    spin_lock(&g_wait_lock);
-    rwspin_read_lock(&g_process_list.lock);
-    wakeup_holding_plist_lock(chan);
-    rwspin_read_unlock(&g_process_list.lock);
-    spin_unlock(&g_wait_lock);
+    struct process *proc = get_current();
+    while (get_time() < deadline)
+    {
+        if (proc_is_killed(proc))
+        {
+            return -EINTR;
+        }
+        sleep_until(NULL, NULL, deadline);
+    }
+    return 0;
 }
 
 /// Kill the process with the given pid.
@@ -657,6 +906,7 @@ syserr_t proc_send_signal(pid_t pid, int32_t sig)
             {
                 // Wake process from sleep().
                 proc->state = RUNNABLE;
+                run_queue_add(proc);
             }
             spin_unlock(&proc->lock);
 
@@ -720,9 +970,11 @@ void proc_shrink_stack(struct process *proc)
 
     size_t npages = (lowest_stack_page_used - proc->stack_low) / PAGE_SIZE;
 
-    page_table_unmap_range(proc->pagetable, proc->stack_low,
-                           npages * PAGE_SIZE);
-    proc->stack_low = lowest_stack_page_used;
+    if (page_table_unmap_range(proc->pagetable, proc->stack_low,
+                               npages * PAGE_SIZE) == 0)
+    {
+        proc->stack_low = lowest_stack_page_used;
+    }
 }
 
 int either_copyout(bool addr_is_userspace, size_t dst, void *src, size_t len)
@@ -871,7 +1123,7 @@ void debug_print_process(bool print_call_stack_user,
             printk("child");
             found_chan = true;
         }
-        else if (proc->chan == &g_ticks)
+        else if (proc->chan == &proc->sleep_queue_idx)
         {
             printk("timer");
             found_chan = true;
@@ -26,6 +26,7 @@ struct cpu
 
     struct process *proc;    ///< The process running on this cpu, or null.
     struct context context;  ///< context_switch() here to enter scheduler().
+    uint64_t timer_next_event;  ///< Time the timer interrupt is armed for.
     int32_t
         disable_dev_int_stack_depth;  ///< Depth of
                                       ///< cpu_push_disable_device_interrupt_stack()
@@ -55,6 +56,20 @@ void do_exit(int32_t status);
 /// Sets up child kernel stack to return as if from fork() system call.
 syserr_t do_fork();
 
+struct spawn_action;
+
+/// @brief Create a new process running the program at path without copying
+/// the memory of the caller: The child starts with a fresh page table, a copy
+/// of the callers file descriptor table modified by actions, the callers
+/// credentials, umask and working directory.
+/// @param path ELF file to execute.
+/// @param argv Command arguments.
+/// @param actions File descriptor actions, paths must be kernel pointers.
+/// @param n_actions Number of actions.
+/// @return Child PID or -errno on error.
+syserr_t do_spawn(char *path, char **argv, struct spawn_action *actions,
+                  size_t n_actions);
+
 /// @brief Grow or shrink user memory by n bytes.
 /// @param n bytes to grow/shrink
 /// @return 0 on success, -1 on failure.
@@ -96,6 +111,18 @@ void sched();
 /// @param lk Lock to release before sleeping and reacquire after. Can be NULL.
 void sleep(void *channel, struct spinlock *lk);
 
+/// @brief Like sleep() but also wakes up at a deadline. Spurious wakeups are
+/// possible, the caller has to check the deadline and its condition again.
+/// @param chan The channel to sleep on. NULL to only wait for the deadline.
+/// @param lk Lock to release before sleeping and reacquire after. Can be NULL.
+/// @param deadline Absolute time in timer units (see get_time()).
+void sleep_until(void *channel, struct spinlock *lk, uint64_t deadline);
+
+/// @brief Let the current process sleep until a deadline.
+/// @param deadline Absolute time in timer units (see get_time()).
+/// @return 0 when the deadline passed, -EINTR if the process got killed.
+syserr_t proc_sleep_until(uint64_t deadline);
+
 void init_userspace();
 
 /// @brief Wait for a child process to exit and return its pid.
@@ -105,7 +132,8 @@ void init_userspace();
 syserr_t do_wait(int32_t *wstatus);
 
 /// @brief Wake up all processes sleeping on channel chan.
-/// Must be called without any proc->lock.
+/// Only looks at the processes in the wait bucket of chan.
+/// Must be called without the proc->lock of a sleeping process.
 /// @param chan The channel to wake up.
 void wakeup(void *chan);
 
@@ -6,7 +6,10 @@
 #include <kernel/pgtable.h>
 #include <kernel/proc.h>
 #include <kernel/process.h>
+#include <kernel/sleep_queue.h>
+#include <kernel/smp.h>
 #include <kernel/string.h>
+#include <mm/cache.h>
 #include <mm/kalloc.h>
 #include <mm/memlayout.h>
 
@@ -64,7 +67,7 @@ static inline pid_t alloc_pid()
 struct process *process_alloc_init()
 {
     struct process *proc =
-        kmalloc(sizeof(struct process), ALLOC_FLAG_ZERO_MEMORY);
+        kmem_cache_alloc(g_process_list.obj_cache, ALLOC_FLAG_ZERO_MEMORY);
     if (proc == NULL)
     {
         return NULL;
@@ -118,6 +121,10 @@ struct process *process_alloc_init()
 
     // other members and state
     list_init(&proc->plist);
+    list_init(&proc->rq_list);
+    list_init(&proc->wait_list);
+    proc->sleep_queue_idx = SLEEP_QUEUE_NOT_QUEUED;
+    proc->cpu = smp_processor_id();
     proc->pid = alloc_pid();
     proc->state = USED;
 
@@ -156,9 +163,13 @@ void process_free(struct process *proc)
     if (proc->kstack != 0)
     {
         spin_lock(&g_kernel_pagetable->lock);
-        // remove from memory map
-        page_table_unmap_range(g_kernel_pagetable, proc->kstack,
-                               KERNEL_STACK_PAGES * PAGE_SIZE);
+        // remove from memory map, the stack is a region of its own and
+        // never gets split
+        if (page_table_unmap_range(g_kernel_pagetable, proc->kstack,
+                                   KERNEL_STACK_PAGES * PAGE_SIZE) < 0)
+        {
+            panic("process_free: can't unmap kernel stack");
+        }
 
         vm_trim_pagetable(g_kernel_pagetable, proc->kstack);
         // update pagetable, flush cache:
@@ -186,7 +197,7 @@ void process_free(struct process *proc)
         spin_unlock(&proc->lock);
     }
 
-    kfree(proc);
+    kmem_cache_free(g_process_list.obj_cache, proc);
 }
 
 bool proc_init_kernel_stack(struct Page_Table *kpage_table,
@@ -196,7 +207,8 @@ bool proc_init_kernel_stack(struct Page_Table *kpage_table,
 
     bool failure = false;
     spin_lock(&kpage_table->lock);
-    for (size_t i = 0; i < KERNEL_STACK_PAGES; ++i)
+    size_t i = 0;
+    for (; i < KERNEL_STACK_PAGES; ++i)
     {
         char *page_va = alloc_page(ALLOC_FLAG_ZERO_MEMORY);
         if (page_va == NULL)
@@ -204,27 +216,21 @@ bool proc_init_kernel_stack(struct Page_Table *kpage_table,
             failure = true;
             break;
         }
-        size_t page_pa = virt_to_phys((size_t)page_va);
-
-        struct MM_Region *region =
-            mm_region_alloc_init(page_pa, kstack_va + (i * PAGE_SIZE),
-                                 PAGE_SIZE, MM_REGION_USER_KSTACK);
-        if (region == NULL)
+        // all pages of the stack end up in one region
+        if (page_table_map_page(kpage_table, kstack_va + (i * PAGE_SIZE),
+                                page_va, MM_REGION_USER_KSTACK) < 0)
         {
             free_page(page_va);
             failure = true;
             break;
         }
-        memory_map_add_single_region(&kpage_table->memory_map, region);
     }
     if (failure)
     {
-        page_table_unmap_partial_mappings(kpage_table);
-        spin_unlock(&kpage_table->lock);
-        return false;
-    }
-    if (page_table_apply_mapping(kpage_table) < 0)
-    {
+        if (page_table_unmap_range(kpage_table, kstack_va, i * PAGE_SIZE) < 0)
+        {
+            panic("proc_init_kernel_stack: can't unmap kernel stack");
+        }
         spin_unlock(&kpage_table->lock);
         return false;
     }
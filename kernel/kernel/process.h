@@ -37,6 +37,7 @@ struct process_list
                              ///< process linked list.
     bitmap_t kernel_stack_in_use;  ///< keeps track which addresses are in use
     struct spinlock kernel_stack_lock;  ///< lock for kernel_stack_in_use
+    struct kmem_cache *obj_cache;       ///< allocations of struct process
 };
 
 struct group_info
@@ -95,9 +96,15 @@ struct process
     // process->lock must be held when using these:
     enum process_state state;  ///< Process state
     void *chan;                ///< If non-zero, sleeping on chan
+    struct list_head wait_list;  ///< Entry in the wait bucket of chan, the
+                                 ///< bucket lock protects it
+    size_t sleep_queue_idx;  ///< Position in g_sleep_queue, protected by its
+                             ///< lock
     bool killed;               ///< Has been killed?
     int32_t xstate;            ///< Exit status to be returned to parent's wait
     pid_t pid;                 ///< Process ID
+    size_t cpu;  ///< CPU the process ran on last, its run queue when RUNNABLE
+    struct list_head rq_list;  ///< Entry in a run queue while RUNNABLE
 
     // g_wait_lock must be held when using this:
     struct process *parent;  ///< Parent process
@@ -132,6 +139,9 @@ extern struct process_list g_process_list;
 
 #define process_from_list(ptr) container_of(ptr, struct process, plist)
 #define process_from_kobj(ptr) container_of(ptr, struct process, kobj)
+#define process_from_rq_list(ptr) container_of(ptr, struct process, rq_list)
+#define process_from_wait_list(ptr) \
+    container_of(ptr, struct process, wait_list)
 
 struct process *process_alloc_init();
 
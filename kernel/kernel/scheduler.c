@@ -1,61 +1,235 @@
 /* SPDX-License-Identifier: MIT */
 
+#include <arch/timer.h>
 #include <kernel/cpu.h>
+#include <kernel/ipi.h>
 #include <kernel/kernel.h>
 #include <kernel/kticks.h>
 #include <kernel/proc.h>
 #include <kernel/process.h>
 #include <kernel/scheduler.h>
+#include <kernel/scheduler_sysfs.h>
+#include <kernel/sleep_queue.h>
 #include <kernel/spinlock.h>
 #include <kernel/stdatomic.h>
+#include <mm/kalloc.h>
+#include <mm/kernel_memory.h>
 
-/// @brief Gets the next runnable process, locked.
+struct run_queue g_run_queues[MAX_CPUS];
+
+/// Bit set for each CPU waiting in scheduler_idle().
+atomic_size_t g_idle_cpus = 0;
+
+void scheduler_init()
+{
+    struct kobject *sched_kobj = kobject_create_init();
+    if (sched_kobj != NULL)
+    {
+        kobject_add(sched_kobj, &g_kobjects_root, "sched");
+        kobject_put(sched_kobj);
+    }
+
+    for (size_t i = 0; i < MAX_CPUS; ++i)
+    {
+        struct run_queue *rq = &g_run_queues[i];
+        spin_lock_init(&rq->lock, "run_queue");
+        list_init(&rq->list);
+        atomic_init(&rq->nr_running, 0);
+        atomic_init(&rq->steals, 0);
+        atomic_init(&rq->migrations, 0);
+        atomic_init(&rq->switches, 0);
+        atomic_init(&rq->timer_interrupts, 0);
+
+        if (sched_kobj != NULL)
+        {
+            kobject_init(&rq->kobj, &run_queue_kobj_ktype);
+            kobject_add(&rq->kobj, sched_kobj, "cpu%zd", i);
+        }
+    }
+}
+
+/// @brief Idle CPUs don't get periodic timer interrupts. Wake one with an IPI
+/// after a process got queued: the CPU of the queue or any other idle CPU to
+/// steal it.
+/// @param target_cpu CPU of the queue the process was added to.
+static void scheduler_kick_idle_cpu(size_t target_cpu)
+{
+    size_t idle = atomic_load(&g_idle_cpus);
+    if (idle == 0) return;
+
+    size_t self = smp_processor_id();
+    idle &= ~((size_t)1 << self);  // this CPU will look at the queues anyway
+
+    size_t kick = target_cpu;
+    if ((idle & ((size_t)1 << target_cpu)) == 0)
+    {
+        if (target_cpu == self || idle == 0)
+        {
+            // an idle CPU handling an interrupt or nobody to wake
+            return;
+        }
+        kick = __builtin_ctzl(idle);
+    }
+    ipi_send_interrupt((cpu_mask)1 << kick, IPI_WAKEUP, NULL);
+}
+
+void run_queue_add(struct process *proc)
+{
+    DEBUG_ASSERT_CPU_HOLDS_LOCK(&proc->lock);
+    DEBUG_EXTRA_ASSERT(proc->state == RUNNABLE,
+                       "only runnable processes can get queued");
+
+    struct run_queue *rq = &g_run_queues[proc->cpu];
+    spin_lock(&rq->lock);
+    list_add_tail(&proc->rq_list, &rq->list);
+    atomic_fetch_add(&rq->nr_running, 1);
+    spin_unlock(&rq->lock);
+
+    scheduler_kick_idle_cpu(proc->cpu);
+}
+
+/// @brief Removes the oldest process from a run queue.
+/// @return The (unlocked) process or NULL if the queue was empty.
+static struct process *run_queue_pop(struct run_queue *rq)
+{
+    struct process *proc = NULL;
+
+    spin_lock(&rq->lock);
+    if (!list_empty(&rq->list))
+    {
+        struct list_head *first = rq->list.next;
+        list_del(first);
+        atomic_fetch_sub(&rq->nr_running, 1);
+        proc = process_from_rq_list(first);
+    }
+    spin_unlock(&rq->lock);
+
+    return proc;
+}
+
+/// @brief Gets the next runnable process, locked. Prefers the local run queue
+/// and steals from the other CPUs if that one is empty.
+/// @param cpu_id ID of the calling CPU.
 /// @return Locked process or NULL.
-struct process *get_next_runnable_process()
+struct process *get_next_runnable_process(size_t cpu_id)
 {
-    struct list_head *pos;
-    rwspin_write_lock(&g_process_list.lock);
-    list_for_each(pos, &g_process_list.plist)
+    struct process *proc = run_queue_pop(&g_run_queues[cpu_id]);
+
+    // nothing to do locally, try to steal work starting at the next CPU
+    for (size_t i = 1; (proc == NULL) && (i < MAX_CPUS); ++i)
     {
-        struct process *proc = process_from_list(pos);
-        if (spin_trylock(&proc->lock))
+        size_t victim = (cpu_id + i) % MAX_CPUS;
+        struct run_queue *rq = &g_run_queues[victim];
+
+        // unlocked peek, it's only a hint
+        if (g_cpus[victim].state != CPU_STARTED ||
+            atomic_load(&rq->nr_running) == 0)
         {
-            if (proc->state == RUNNABLE)
-            {
-                // move process to end of list so next scheduling will pick
-                // another process (if runnable)
-                list_del(pos);
-                list_add_tail(pos, &g_process_list.plist);
+            continue;
+        }
 
-                rwspin_write_unlock(&g_process_list.lock);
-                return proc;  // return locked process
-            }
-            spin_unlock(&proc->lock);
+        proc = run_queue_pop(rq);
+        if (proc != NULL)
+        {
+            atomic_fetch_add(&g_run_queues[cpu_id].steals, 1);
         }
     }
-    rwspin_write_unlock(&g_process_list.lock);
-    return NULL;
+
+    if (proc == NULL)
+    {
+        return NULL;
+    }
+
+    // A process is only queued while it is RUNNABLE and can only leave that
+    // state by getting scheduled. Its CPU might still hold the lock for a
+    // moment after queueing it from scheduler().
+    spin_lock(&proc->lock);
+    DEBUG_EXTRA_ASSERT(proc->state == RUNNABLE,
+                       "process in run queue is not runnable");
+
+    if (proc->cpu != cpu_id)
+    {
+        atomic_fetch_add(&g_run_queues[cpu_id].migrations, 1);
+        proc->cpu = cpu_id;
+    }
+
+    return proc;  // return locked process
+}
+
+/// @brief Time slice of a process / interval of the periodic timer interrupt
+/// while a CPU is busy.
+static inline uint64_t timer_interval()
+{
+    return g_timebase_frequency / TIMER_INTERRUPTS_PER_SECOND;
 }
 
-atomic_size_t g_last_wakeup_tick = 0;
+static inline void timer_program(struct cpu *cpu, uint64_t when)
+{
+    cpu->timer_next_event = when;
+    timer_schedule_interrupt(when);
+}
+
+/// @brief Next timer event of a busy CPU: end of the time slice or an earlier
+/// sleep deadline.
+static inline uint64_t timer_next_busy_event(uint64_t now)
+{
+    uint64_t next = now + timer_interval();
+    uint64_t deadline = sleep_queue_next_deadline();
+    return (deadline < next) ? deadline : next;
+}
 
-void wakeup_procs_waiting_on_timer()
+void scheduler_timer_interrupt(uint64_t now)
 {
-    size_t now = kticks_get_ticks();
-    size_t last_wakeup = atomic_load(&g_last_wakeup_tick);
+    struct cpu *cpu = get_cpu();
+    atomic_fetch_add(&g_run_queues[smp_processor_id()].timer_interrupts, 1);
 
-    if (now == last_wakeup)
+    sleep_queue_expire(now);
+    timer_program(cpu, timer_next_busy_event(now));
+}
+
+/// @brief Unlocked peek if any run queue has work.
+static bool scheduler_has_work()
+{
+    for (size_t i = 0; i < MAX_CPUS; ++i)
     {
-        // already woke up procs for this tick, no need to do it again
-        return;
+        if (atomic_load(&g_run_queues[i].nr_running) != 0)
+        {
+            return true;
+        }
     }
+    return false;
+}
+
+/// @brief Wait for an interrupt without a periodic timer interrupt. Only the
+/// next sleep deadline is programmed (tickless idle).
+/// @param cpu This CPU.
+/// @param cpu_id ID of this CPU.
+static void scheduler_idle(struct cpu *cpu, size_t cpu_id)
+{
+    size_t self = (size_t)1 << cpu_id;
+
+    // With interrupts disabled, an IPI between the check for work and
+    // wait_for_interrupt() stays pending and ends the wait at once.
+    cpu_disable_interrupts();
+    atomic_fetch_or(&g_idle_cpus, self);
 
-    // test atomically: if g_last_wakeup_tick is still last_wakeup, set it to
-    // now and retrun true otherwise, another cpu already updated it.
-    if (atomic_compare_exchange_weak(&g_last_wakeup_tick, &last_wakeup, now))
+    if (!scheduler_has_work())
     {
-        wakeup(&g_ticks);
+        uint64_t next = sleep_queue_next_deadline();
+        if (kticks_periodic_tick_required(cpu_id))
+        {
+            uint64_t tick = get_time() + timer_interval();
+            if (tick < next) next = tick;
+        }
+        if (next != cpu->timer_next_event)
+        {
+            timer_program(cpu, next);
+        }
+        wait_for_interrupt();
     }
+
+    atomic_fetch_and(&g_idle_cpus, ~self);
+    cpu_enable_interrupts();
 }
 
 void scheduler()
@@ -71,9 +245,10 @@ void scheduler()
 
         if (cpu->state == CPU_STARTED)
         {
-            wakeup_procs_waiting_on_timer();
+            sleep_queue_expire(get_time());
 
-            struct process *proc = get_next_runnable_process();
+            struct process *proc =
+                get_next_runnable_process(smp_processor_id());
             if (proc != NULL)
             {
                 struct cpu *this_cpu = get_cpu();
@@ -83,23 +258,38 @@ void scheduler()
 
                 proc_shrink_stack(proc);
 
+                // The timer might be off (idle before) or armed for a later
+                // time than an earlier sleep deadline.
+                uint64_t next_event = timer_next_busy_event(get_time());
+                if (next_event < this_cpu->timer_next_event)
+                {
+                    timer_program(this_cpu, next_event);
+                }
+
                 // Switch to chosen process.  It is the process's job
                 // to release its lock and then reacquire it
                 // before jumping back to us.
                 proc->state = RUNNING;
                 this_cpu->proc = proc;
+                atomic_fetch_add(&g_run_queues[proc->cpu].switches, 1);
                 context_switch(&this_cpu->context, &proc->context);
 
                 // Process is done running for now.
                 // It should have changed its proc->state before coming
                 // back.
                 this_cpu->proc = NULL;
+                if (proc->state == RUNNABLE)
+                {
+                    // yield(): queue it again now that it is no longer
+                    // running on this CPU
+                    run_queue_add(proc);
+                }
                 spin_unlock(&proc->lock);
             }
-            else
+            else if (!kalloc_zero_pool_refill(ZERO_POOL_BATCH))
             {
-                cpu_enable_interrupts();
-                wait_for_interrupt();
+                // nothing to run and the zero page pool is full
+                scheduler_idle(cpu, smp_processor_id());
             }
         }
     }
@@ -1,6 +1,51 @@
 /* SPDX-License-Identifier: MIT */
 #pragma once
 
+#include <kernel/container_of.h>
+#include <kernel/kernel.h>
+#include <kernel/kobject.h>
+#include <kernel/list.h>
+#include <kernel/spinlock.h>
+#include <kernel/stdatomic.h>
+
+struct process;
+
+/// @brief One run queue per CPU. Holds all RUNNABLE processes which should run
+/// next on that CPU. Idle CPUs steal from the queues of other CPUs.
+struct run_queue
+{
+    struct kobject kobj;  ///< /sys/sched/cpuN
+
+    struct spinlock lock;      ///< Protects list
+    struct list_head list;     ///< RUNNABLE processes, linked via rq_list
+    atomic_size_t nr_running;  ///< Number of processes in list, only changed
+                               ///< with lock held but can be peeked without
+
+    // statistics
+    atomic_size_t steals;  ///< Processes this CPU took from other queues
+    atomic_size_t migrations;  ///< Processes which ran on another CPU before
+    atomic_size_t switches;    ///< Context switches to a process
+    atomic_size_t timer_interrupts;  ///< Timer interrupts on this CPU
+};
+
+#define run_queue_from_kobj(ptr) container_of(ptr, struct run_queue, kobj)
+
+extern struct run_queue g_run_queues[MAX_CPUS];
+
+/// @brief Init the per-CPU run queues and register them in sysfs. Needs
+/// kmalloc().
+void scheduler_init();
+
+/// @brief Add a RUNNABLE process to the run queue of the CPU it ran on last.
+/// Must be called at every transition of the process into the RUNNABLE state.
+/// @param proc The process, lock must be held.
+void run_queue_add(struct process *proc);
+
+/// @brief Called from the timer interrupt. Wakes up expired sleepers and arms
+/// the next timer interrupt.
+/// @param now Current time in timer units.
+void scheduler_timer_interrupt(uint64_t now);
+
 /// Per-CPU process scheduler.
 /// Each CPU calls scheduler() after setting itself up.
 /// Scheduler never returns.  It loops, doing:
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <fs/sysfs/sysfs_data.h>
+#include <kernel/errno.h>
+#include <kernel/kernel.h>
+#include <kernel/kobject.h>
+#include <kernel/scheduler.h>
+#include <kernel/scheduler_sysfs.h>
+
+// /sys/sched/cpuN
+
+enum RUN_QUEUE_ATTRIBUTE_INDEX
+{
+    RQ_NR_RUNNING = 0,
+    RQ_STEALS,
+    RQ_MIGRATIONS,
+    RQ_SWITCHES,
+    RQ_TIMER_INTERRUPTS
+};
+
+struct sysfs_attribute run_queue_attributes[] = {
+    [RQ_NR_RUNNING] = {.name = "nr_running", .mode = 0444},
+    [RQ_STEALS] = {.name = "steals", .mode = 0444},
+    [RQ_MIGRATIONS] = {.name = "migrations", .mode = 0444},
+    [RQ_SWITCHES] = {.name = "switches", .mode = 0444},
+    [RQ_TIMER_INTERRUPTS] = {.name = "timer_irqs", .mode = 0444}};
+
+syserr_t run_queue_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx,
+                                  char *buf, size_t n)
+{
+    struct run_queue *rq = run_queue_from_kobj(kobj);
+
+    syserr_t ret = 0;
+    switch (attribute_idx)
+    {
+        case RQ_NR_RUNNING:
+            ret = snprintf(buf, n, "%zu\n", atomic_load(&rq->nr_running));
+            break;
+        case RQ_STEALS:
+            ret = snprintf(buf, n, "%zu\n", atomic_load(&rq->steals));
+            break;
+        case RQ_MIGRATIONS:
+            ret = snprintf(buf, n, "%zu\n", atomic_load(&rq->migrations));
+            break;
+        case RQ_SWITCHES:
+            ret = snprintf(buf, n, "%zu\n", atomic_load(&rq->switches));
+            break;
+        case RQ_TIMER_INTERRUPTS:
+            ret =
+                snprintf(buf, n, "%zu\n", atomic_load(&rq->timer_interrupts));
+            break;
+        default: ret = -ENOENT; break;
+    }
+
+    if (ret == -1)
+    {
+        // snprintf error
+        ret = -EOTHER;
+    }
+
+    return ret;
+}
+
+syserr_t run_queue_sysfs_ops_store(struct kobject *kobj, size_t attribute_idx,
+                                   const char *buf, size_t n)
+{
+    return -EINVAL;
+}
+
+struct sysfs_ops run_queue_sysfs_ops = {
+    .show = run_queue_sysfs_ops_show,
+    .store = run_queue_sysfs_ops_store,
+};
+
+const struct kobj_type run_queue_kobj_ktype = {
+    .release = NULL,
+    .sysfs_ops = &run_queue_sysfs_ops,
+    .attribute = run_queue_attributes,
+    .n_attributes =
+        sizeof(run_queue_attributes) / sizeof(run_queue_attributes[0])};
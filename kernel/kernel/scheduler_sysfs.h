@@ -0,0 +1,7 @@
+/* SPDX-License-Identifier: MIT */
+#pragma once
+
+#include <kernel/kernel.h>
+
+// /sys/sched/cpuN
+extern const struct kobj_type run_queue_kobj_ktype;
@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <kernel/proc.h>
+#include <kernel/process.h>
+#include <kernel/sleep_queue.h>
+
+struct sleep_queue g_sleep_queue;
+
+/// How many expired channels sleep_queue_expire() collects before it releases
+/// the queue lock to wake them up.
+#define SLEEP_QUEUE_EXPIRE_BATCH 16
+
+void sleep_queue_init()
+{
+    spin_lock_init(&g_sleep_queue.lock, "sleep_queue");
+    g_sleep_queue.size = 0;
+    g_sleep_queue.next_deadline = SLEEP_QUEUE_NO_DEADLINE;
+}
+
+static inline void heap_set(size_t idx, struct sleep_queue_entry *entry)
+{
+    g_sleep_queue.heap[idx] = *entry;
+    entry->proc->sleep_queue_idx = idx;
+}
+
+static void heap_sift_up(size_t idx)
+{
+    struct sleep_queue_entry entry = g_sleep_queue.heap[idx];
+    while (idx > 0)
+    {
+        size_t parent = (idx - 1) / 2;
+        if (g_sleep_queue.heap[parent].deadline <= entry.deadline) break;
+
+        heap_set(idx, &g_sleep_queue.heap[parent]);
+        idx = parent;
+    }
+    heap_set(idx, &entry);
+}
+
+static void heap_sift_down(size_t idx)
+{
+    struct sleep_queue_entry entry = g_sleep_queue.heap[idx];
+    size_t size = g_sleep_queue.size;
+    while (true)
+    {
+        size_t child = 2 * idx + 1;
+        if (child >= size) break;
+        if (child + 1 < size && g_sleep_queue.heap[child + 1].deadline <
+                                    g_sleep_queue.heap[child].deadline)
+        {
+            child++;
+        }
+        if (entry.deadline <= g_sleep_queue.heap[child].deadline) break;
+
+        heap_set(idx, &g_sleep_queue.heap[child]);
+        idx = child;
+    }
+    heap_set(idx, &entry);
+}
+
+/// @brief Removes entry idx from the heap. Caller holds the queue lock.
+static void heap_remove(size_t idx)
+{
+    struct sleep_queue *q = &g_sleep_queue;
+
+    q->heap[idx].proc->sleep_queue_idx = SLEEP_QUEUE_NOT_QUEUED;
+    q->size--;
+    if (idx != q->size)
+    {
+        // move last entry into the gap and restore the heap order
+        heap_set(idx, &q->heap[q->size]);
+        if (idx > 0 && q->heap[idx].deadline < q->heap[(idx - 1) / 2].deadline)
+        {
+            heap_sift_up(idx);
+        }
+        else
+        {
+            heap_sift_down(idx);
+        }
+    }
+}
+
+static inline void update_next_deadline()
+{
+    uint64_t next = (g_sleep_queue.size > 0) ? g_sleep_queue.heap[0].deadline
+                                             : SLEEP_QUEUE_NO_DEADLINE;
+#if defined(__ARCH_64BIT)
+    atomic_store(&g_sleep_queue.next_deadline, next);
+#else
+    g_sleep_queue.next_deadline = next;
+#endif
+}
+
+void sleep_queue_add(struct process *proc, uint64_t deadline, void *chan)
+{
+    struct sleep_queue *q = &g_sleep_queue;
+
+    spin_lock(&q->lock);
+    DEBUG_EXTRA_PANIC(proc->sleep_queue_idx == SLEEP_QUEUE_NOT_QUEUED,
+                      "sleep_queue_add: process already queued");
+    DEBUG_EXTRA_PANIC(q->size < MAX_PROCESSES, "sleep_queue_add: queue full");
+
+    struct sleep_queue_entry entry = {
+        .deadline = deadline, .chan = chan, .proc = proc};
+    heap_set(q->size, &entry);
+    q->size++;
+    heap_sift_up(q->size - 1);
+    update_next_deadline();
+    spin_unlock(&q->lock);
+}
+
+void sleep_queue_remove(struct process *proc)
+{
+    struct sleep_queue *q = &g_sleep_queue;
+
+    spin_lock(&q->lock);
+    if (proc->sleep_queue_idx != SLEEP_QUEUE_NOT_QUEUED)
+    {
+        heap_remove(proc->sleep_queue_idx);
+        update_next_deadline();
+    }
+    spin_unlock(&q->lock);
+}
+
+void sleep_queue_expire(uint64_t now)
+{
+    struct sleep_queue *q = &g_sleep_queue;
+
+    // fast path (without the lock on 64 bit): nothing expired
+    if (sleep_queue_next_deadline() > now) return;
+
+    bool more_expired = true;
+    while (more_expired)
+    {
+        void *expired[SLEEP_QUEUE_EXPIRE_BATCH];
+        size_t n = 0;
+
+        spin_lock(&q->lock);
+        while (n < SLEEP_QUEUE_EXPIRE_BATCH && q->size > 0 &&
+               q->heap[0].deadline <= now)
+        {
+            expired[n++] = q->heap[0].chan;
+            heap_remove(0);
+        }
+        update_next_deadline();
+        more_expired = (q->size > 0 && q->heap[0].deadline <= now);
+        spin_unlock(&q->lock);
+
+        // wakeup() locks the wait buckets and processes, don't hold the queue
+        // lock. The sleepers are already in their buckets when they are in
+        // the queue, so no wakeup can get lost.
+        for (size_t i = 0; i < n; ++i)
+        {
+            wakeup(expired[i]);
+        }
+    }
+}
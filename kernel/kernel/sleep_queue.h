@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: MIT */
+#pragma once
+
+#include <kernel/kernel.h>
+#include <kernel/spinlock.h>
+#include <kernel/stdatomic.h>
+
+struct process;
+
+/// Value of process->sleep_queue_idx if the process is not in the queue.
+#define SLEEP_QUEUE_NOT_QUEUED ((size_t)-1)
+
+/// Deadline which never expires.
+#define SLEEP_QUEUE_NO_DEADLINE ((uint64_t)-1)
+
+/// @brief A process waiting for a deadline.
+struct sleep_queue_entry
+{
+    uint64_t deadline;     ///< Absolute time in timer units, see get_time()
+    void *chan;            ///< Channel to wake up at the deadline
+    struct process *proc;  ///< Sleeping process
+};
+
+/// @brief Min-heap of all processes sleeping with a deadline, ordered by the
+/// deadline. Each process can be in the queue only once, so MAX_PROCESSES
+/// entries are enough.
+struct sleep_queue
+{
+    struct spinlock lock;  ///< Protects heap, size and all
+                           ///< process->sleep_queue_idx
+    size_t size;           ///< Entries in heap
+#if defined(__ARCH_64BIT)
+    atomic_uint64_t next_deadline;  ///< heap[0].deadline, can be read without
+                                    ///< lock to skip sleep_queue_expire()
+#else
+    uint64_t next_deadline;  ///< heap[0].deadline, no 64 bit atomics
+#endif
+    struct sleep_queue_entry heap[MAX_PROCESSES];
+};
+
+extern struct sleep_queue g_sleep_queue;
+
+void sleep_queue_init();
+
+/// @brief Add a process to the queue.
+/// @param proc Process which is not yet in the queue.
+/// @param deadline Absolute time in timer units.
+/// @param chan Channel to wake up at the deadline.
+void sleep_queue_add(struct process *proc, uint64_t deadline, void *chan);
+
+/// @brief Remove a process from the queue (if it is still in it).
+/// @param proc The process.
+void sleep_queue_remove(struct process *proc);
+
+/// @brief Returns the earliest deadline in the queue.
+/// @return Deadline or SLEEP_QUEUE_NO_DEADLINE if the queue is empty.
+static inline uint64_t sleep_queue_next_deadline()
+{
+#if defined(__ARCH_64BIT)
+    return atomic_load(&g_sleep_queue.next_deadline);
+#else
+    spin_lock(&g_sleep_queue.lock);
+    uint64_t next = g_sleep_queue.next_deadline;
+    spin_unlock(&g_sleep_queue.lock);
+    return next;
+#endif
+}
+
+/// @brief Wake up the channels of all entries with a deadline <= now.
+/// Called from the timer interrupt and the scheduler. Must be called without
+/// the proc->lock of a sleeping process.
+/// @param now Current time in timer units.
+void sleep_queue_expire(uint64_t now);
@@ -5,8 +5,10 @@
 #include <arch/trap.h>
 #include <arch/trapframe.h>
 #include <fs/sysfs/sys_kernel.h>
+#include <kernel/errno.h>
 #include <kernel/proc.h>
 #include <kernel/trap.h>
+#include <mm/page_table.h>
 #include <syscalls/syscall.h>
 
 void dump_exception_cause_and_kill_proc(struct process *proc,
@@ -109,10 +111,42 @@ void user_mode_interrupt_handler(size_t *stack)
         size_t sp = proc->trapframe->sp;
         size_t fault_addr = int_ctx_get_addr(&ctx);
 
+        // Writes to pages shared with a parent or child since fork() fault
+        // until the process gets its own copy. Heap pages get allocated on
+        // first access, text and read-only data get mapped from the page
+        // cache.
+        syserr_t resolved = -EFAULT;
+        spin_lock(&proc->pagetable->lock);
+        if (int_ctx_page_fault_is_store(&ctx))
+        {
+            resolved = page_table_copy_on_write(proc->pagetable, fault_addr);
+        }
+        if (resolved == -EFAULT)
+        {
+            resolved = page_table_populate(proc->pagetable, fault_addr);
+        }
+        spin_unlock(&proc->pagetable->lock);
+        if (resolved == -EFAULT)
+        {
+            // Reading the file might sleep: no page table lock and
+            // interrupts on, like for a system call. The fault registers are
+            // saved in ctx already.
+            cpu_enable_interrupts();
+            resolved = page_table_fault_file(proc->pagetable, fault_addr);
+        }
+
+        if (resolved == 0)
+        {
+            // resolved, retry the access
+        }
+        else if (resolved == -ENOMEM)
+        {
+            dump_exception_cause_and_kill_proc(proc, &ctx);
+        }
         // If the app tried to write between the stack pointer and its stack
         // -> stack overflow. Also test if the sp isn't more than one page away
         // from the current stack as we will provide only one additional page.
-        if ((sp <= fault_addr && fault_addr < proc->stack_low) &&
+        else if ((sp <= fault_addr && fault_addr < proc->stack_low) &&
             (sp >= (proc->stack_low - PAGE_SIZE)))
         {
             if (!proc_grow_stack(proc))
@@ -249,6 +283,12 @@ bool handle_ipi_interrupt()
                 yield_process = true;
                 break;
             }
+            case IPI_WAKEUP:
+            {
+                // the interrupt already ended wait_for_interrupt() in
+                // scheduler()
+                break;
+            }
             case IPI_SHUTDOWN:
             {
                 struct cpu *this_cpu = get_cpu();
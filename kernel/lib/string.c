@@ -3,35 +3,72 @@
 #include <kernel/kernel.h>
 #include <kernel/string.h>
 
+// The word loops access the byte buffers as size_t
+typedef size_t __attribute__((__may_alias__)) word_t;
+#define WORD_SIZE sizeof(word_t)
+#define WORD_MASK (WORD_SIZE - 1)
+
+/// true if a and b can get aligned to words at the same time
+#define SAME_WORD_ALIGNMENT(a, b) \
+    ((((size_t)(a) ^ (size_t)(b)) & WORD_MASK) == 0)
+
+/// 0x01 in every byte of a word
+#define WORD_ONES ((word_t)-1 / 0xFF)
+/// 0x80 in every byte of a word
+#define WORD_HIGHS (WORD_ONES * 0x80)
+/// non-zero if any byte of word w is 0
+#define WORD_HAS_ZERO_BYTE(w) (((w) - WORD_ONES) & ~(w) & WORD_HIGHS)
+
+// Note: the word-at-a-time string functions read the whole aligned word
+// containing the NUL terminator. An aligned word never crosses a page
+// boundary, so this never faults.
+
+#if defined(__ARCH_riscv) && defined(__RISCV_EXT_V)
+// __ARCH_riscv is only set for the kernel: large copies use the vector unit
+// if the CPU supports it
+#include <arch/riscv/vector.h>
+#endif
+
 void *memset(void *dst, int c, size_t n)
 {
-    // copy unaligned bytes:
-    char *pos = (char *)dst;
-    while ((size_t)pos % sizeof(size_t) != 0 && n > 0)
+#if defined(__ARCH_riscv) && defined(__RISCV_EXT_V)
+    if (n >= VECTOR_STRING_MIN_SIZE && vector_memset(dst, (uint8_t)c, n))
     {
-        *pos++ = (char)c;
+        return dst;
+    }
+#endif
+
+    // set unaligned bytes:
+    uint8_t *pos = (uint8_t *)dst;
+    while (((size_t)pos & WORD_MASK) != 0 && n > 0)
+    {
+        *pos++ = (uint8_t)c;
         n--;
     }
 
-    // copy as many as possible as aligned size_t memory accesses
-    size_t *dst_s = (size_t *)pos;
-    size_t n_word = n / sizeof(size_t);
-    size_t remaining_bytes = n % sizeof(size_t);
-    size_t value = 0;
-    for (size_t i = 0; i < sizeof(size_t); ++i)
+    // set as many as possible as aligned word memory accesses
+    word_t value = (uint8_t)c * ((word_t)-1 / 0xFF);
+    word_t *dst_w = (word_t *)pos;
+    while (n >= 4 * WORD_SIZE)
     {
-        value = value << 8 | (char)c;
+        dst_w[0] = value;
+        dst_w[1] = value;
+        dst_w[2] = value;
+        dst_w[3] = value;
+        dst_w += 4;
+        n -= 4 * WORD_SIZE;
     }
-    for (size_t i = 0; i < n_word; i++)
+    while (n >= WORD_SIZE)
     {
-        dst_s[i] = value;
+        *dst_w++ = value;
+        n -= WORD_SIZE;
     }
-    pos += n_word * sizeof(size_t);
 
     // trailing unaligned bytes:
-    for (size_t i = 0; i < remaining_bytes; i++)
+    pos = (uint8_t *)dst_w;
+    while (n-- > 0)
     {
-        *pos++ = (char)c;
+        *pos++ = (uint8_t)c;
     }
     return dst;
 }
@@ -40,6 +77,33 @@ int memcmp(const void *v1, const void *v2, size_t n)
 {
     const uint8_t *s1 = v1;
     const uint8_t *s2 = v2;
+
+    if (SAME_WORD_ALIGNMENT(s1, s2))
+    {
+        while (((size_t)s1 & WORD_MASK) != 0 && n > 0)
+        {
+            if (*s1 != *s2)
+            {
+                return (*s1 - *s2);
+            }
+            s1++;
+            s2++;
+            n--;
+        }
+
+        // skip equal words, the byte loop finds the difference in a word
+        const word_t *w1 = (const word_t *)s1;
+        const word_t *w2 = (const word_t *)s2;
+        while (n >= WORD_SIZE && *w1 == *w2)
+        {
+            w1++;
+            w2++;
+            n -= WORD_SIZE;
+        }
+        s1 = (const uint8_t *)w1;
+        s2 = (const uint8_t *)w2;
+    }
+
     while (n-- > 0)
     {
         if (*s1 != *s2)
@@ -54,35 +118,127 @@ int memcmp(const void *v1, const void *v2, size_t n)
     return 0;
 }
 
-void *memmove(void *dst, const void *src, size_t n)
+void *memcpy(void *dst, const void *src, size_t n)
 {
-    char *_dst;
-    const char *_src;
-
-    _dst = dst;
-    _src = src;
-    if (_src > _dst)
+#if defined(__ARCH_riscv) && defined(__RISCV_EXT_V)
+    if (n >= VECTOR_STRING_MIN_SIZE && vector_memcpy(dst, src, n))
     {
-        while (n-- > 0) *_dst++ = *_src++;
+        return dst;
     }
-    else
+#endif
+
+    // copies forward, memmove() relies on this for dst < src
+    uint8_t *_dst = dst;
+    const uint8_t *_src = src;
+    if (SAME_WORD_ALIGNMENT(_dst, _src))
     {
-        _dst += n;
-        _src += n;
-        while (n-- > 0) *--_dst = *--_src;
+        while (((size_t)_dst & WORD_MASK) != 0 && n > 0)
+        {
+            *_dst++ = *_src++;
+            n--;
+        }
+
+        word_t *dst_w = (word_t *)_dst;
+        const word_t *src_w = (const word_t *)_src;
+        while (n >= 4 * WORD_SIZE)
+        {
+            word_t w0 = src_w[0];
+            word_t w1 = src_w[1];
+            word_t w2 = src_w[2];
+            word_t w3 = src_w[3];
+            dst_w[0] = w0;
+            dst_w[1] = w1;
+            dst_w[2] = w2;
+            dst_w[3] = w3;
+            dst_w += 4;
+            src_w += 4;
+            n -= 4 * WORD_SIZE;
+        }
+        while (n >= WORD_SIZE)
+        {
+            *dst_w++ = *src_w++;
+            n -= WORD_SIZE;
+        }
+        _dst = (uint8_t *)dst_w;
+        _src = (const uint8_t *)src_w;
     }
+    // else: misaligned word accesses can trap or are emulated, copy bytes
+
+    while (n-- > 0) *_dst++ = *_src++;
 
     return dst;
 }
 
-void *memcpy(void *dst, const void *src, size_t n)
+void *memmove(void *dst, const void *src, size_t n)
 {
-    return memmove(dst, src, n);
+    uint8_t *_dst = dst;
+    const uint8_t *_src = src;
+
+    if (_dst <= _src || _dst >= _src + n)
+    {
+        // a forward copy never overwrites source bytes it still has to read
+        return memcpy(dst, src, n);
+    }
+
+    // overlapping with dst behind src: copy backwards
+    _dst += n;
+    _src += n;
+    if (SAME_WORD_ALIGNMENT(_dst, _src))
+    {
+        while (((size_t)_dst & WORD_MASK) != 0 && n > 0)
+        {
+            *--_dst = *--_src;
+            n--;
+        }
+
+        word_t *dst_w = (word_t *)_dst;
+        const word_t *src_w = (const word_t *)_src;
+        while (n >= 4 * WORD_SIZE)
+        {
+            dst_w -= 4;
+            src_w -= 4;
+            word_t w3 = src_w[3];
+            word_t w2 = src_w[2];
+            word_t w1 = src_w[1];
+            word_t w0 = src_w[0];
+            dst_w[3] = w3;
+            dst_w[2] = w2;
+            dst_w[1] = w1;
+            dst_w[0] = w0;
+            n -= 4 * WORD_SIZE;
+        }
+        while (n >= WORD_SIZE)
+        {
+            *--dst_w = *--src_w;
+            n -= WORD_SIZE;
+        }
+        _dst = (uint8_t *)dst_w;
+        _src = (const uint8_t *)src_w;
+    }
+
+    while (n-- > 0) *--_dst = *--_src;
+
+    return dst;
 }
 
 char *strchr(const char *str, char c)
 {
-    for (; *str; str++)
+    while (((size_t)str & WORD_MASK) != 0)
+    {
+        if (*str == 0) return NULL;
+        if (*str == c) return (char *)str;
+        str++;
+    }
+
+    // skip words without c and without the terminator
+    word_t pattern = (uint8_t)c * WORD_ONES;
+    const word_t *w = (const word_t *)str;
+    while (!WORD_HAS_ZERO_BYTE(*w) && !WORD_HAS_ZERO_BYTE(*w ^ pattern))
+    {
+        w++;
+    }
+
+    for (str = (const char *)w; *str; str++)
     {
         if (*str == c) return (char *)str;
     }
@@ -91,6 +247,30 @@ char *strchr(const char *str, char c)
 
 int strcmp(const char *s1, const char *s2)
 {
+    if (SAME_WORD_ALIGNMENT(s1, s2))
+    {
+        while (((size_t)s1 & WORD_MASK) != 0)
+        {
+            if (*s1 == 0 || *s1 != *s2)
+            {
+                return (uint8_t)*s1 - (uint8_t)*s2;
+            }
+            s1++;
+            s2++;
+        }
+
+        // skip equal words without the terminator
+        const word_t *w1 = (const word_t *)s1;
+        const word_t *w2 = (const word_t *)s2;
+        while (*w1 == *w2 && !WORD_HAS_ZERO_BYTE(*w1))
+        {
+            w1++;
+            w2++;
+        }
+        s1 = (const char *)w1;
+        s2 = (const char *)w2;
+    }
+
     while (*s1 && *s1 == *s2)
     {
         s1++;
@@ -157,13 +337,23 @@ char *safestrcpy(char *dst, const char *src, size_t n)
 
 size_t strlen(const char *str)
 {
-    size_t n;
+    const char *pos = str;
+    while (((size_t)pos & WORD_MASK) != 0)
+    {
+        if (*pos == 0) return pos - str;
+        pos++;
+    }
 
-    for (n = 0; str[n]; ++n)
+    const word_t *w = (const word_t *)pos;
+    while (!WORD_HAS_ZERO_BYTE(*w))
     {
-    };
+        w++;
+    }
 
-    return n;
+    for (pos = (const char *)w; *pos; pos++)
+    {
+    }
+    return pos - str;
 }
 
 size_t strnlen(const char *str, size_t maxlen)
@@ -183,7 +373,23 @@ void *memchr(const void *s, int c, size_t n)
     unsigned char target = (unsigned char)c;
     unsigned char *string = (unsigned char *)s;
 
-    for (size_t i = 0; i < n; ++i)
+    while (((size_t)string & WORD_MASK) != 0 && n > 0)
+    {
+        if (*string == target) return string;
+        string++;
+        n--;
+    }
+
+    // skip words without the target
+    word_t pattern = target * WORD_ONES;
+    const word_t *w = (const word_t *)string;
+    while (n >= WORD_SIZE && !WORD_HAS_ZERO_BYTE(*w ^ pattern))
+    {
+        w++;
+        n -= WORD_SIZE;
+    }
+
+    for (string = (unsigned char *)w; n > 0; --n)
     {
         if (*string == target) return string;
         string++;
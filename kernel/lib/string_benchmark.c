@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <arch/timer.h>
+#include <kernel/kernel.h>
+#include <kernel/param.h>
+#include <kernel/printk.h>
+#include <kernel/string.h>
+#include <lib/string_benchmark.h>
+#include <mm/kalloc.h>
+
+#if defined(CONFIG_STRING_BENCHMARK)
+
+#define BENCHMARK_ORDER 2  ///< each buffer is 4 pages
+#define BENCHMARK_BUFFER_SIZE (PAGE_SIZE << BENCHMARK_ORDER)
+#define BENCHMARK_BYTES (4 * 1024 * 1024)  ///< per function and size
+
+enum string_function
+{
+    BENCH_MEMCPY,
+    BENCH_MEMMOVE,
+    BENCH_MEMSET,
+    BENCH_MEMCMP
+};
+
+const char *string_function_names[] = {"memcpy", "memmove", "memset",
+                                       "memcmp"};
+
+// returns the cycles needed to process BENCHMARK_BYTES
+static uint64_t benchmark_run(enum string_function function, char *dst,
+                              char *src, size_t n)
+{
+    size_t runs = BENCHMARK_BYTES / n;
+    volatile int32_t result = 0;
+
+    uint64_t start = get_cycles();
+    for (size_t i = 0; i < runs; ++i)
+    {
+        switch (function)
+        {
+            case BENCH_MEMCPY: memcpy(dst, src, n); break;
+            case BENCH_MEMMOVE: memmove(dst, dst + 8, n); break;
+            case BENCH_MEMSET: memset(dst, (int32_t)i, n); break;
+            case BENCH_MEMCMP: result += memcmp(dst, src, n); break;
+        }
+    }
+    uint64_t end = get_cycles();
+    (void)result;
+
+    return end - start;
+}
+
+void string_benchmark()
+{
+    char *src = alloc_pages(ALLOC_FLAG_ZERO_MEMORY, BENCHMARK_ORDER);
+    char *dst = alloc_pages(ALLOC_FLAG_ZERO_MEMORY, BENCHMARK_ORDER);
+    if (src == NULL || dst == NULL)
+    {
+        printk("string benchmark: out of memory\n");
+        if (src) free_pages(src, BENCHMARK_ORDER);
+        if (dst) free_pages(dst, BENCHMARK_ORDER);
+        return;
+    }
+
+    const size_t sizes[] = {64, 1024, BENCHMARK_BUFFER_SIZE / 2};
+    printk("string benchmark: bytes per cycle (aligned / misaligned)\n");
+    for (size_t f = BENCH_MEMCPY; f <= BENCH_MEMCMP; ++f)
+    {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+        {
+            size_t n = sizes[s];
+            uint64_t aligned = benchmark_run(f, dst, src, n);
+            uint64_t misaligned = benchmark_run(f, dst + 1, src + 2, n);
+
+            // no floats in the kernel: print with two decimal places
+            uint64_t aligned_100 = (BENCHMARK_BYTES * 100ull) / (aligned + 1);
+            uint64_t misaligned_100 =
+                (BENCHMARK_BYTES * 100ull) / (misaligned + 1);
+            printk("%s %zd bytes: %zd.%02zd / %zd.%02zd\n",
+                   string_function_names[f], n, (size_t)(aligned_100 / 100),
+                   (size_t)(aligned_100 % 100),
+                   (size_t)(misaligned_100 / 100),
+                   (size_t)(misaligned_100 % 100));
+        }
+    }
+
+    free_pages(src, BENCHMARK_ORDER);
+    free_pages(dst, BENCHMARK_ORDER);
+}
+
+#else
+
+void string_benchmark() {}
+
+#endif  // CONFIG_STRING_BENCHMARK
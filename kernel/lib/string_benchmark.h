@@ -0,0 +1,7 @@
+/* SPDX-License-Identifier: MIT */
+#pragma once
+
+/// @brief Measures memcpy(), memmove(), memset() and memcmp() on aligned and
+/// misaligned buffers of a few sizes and prints the bytes per CPU cycle.
+/// Enabled by CONFIG_STRING_BENCHMARK.
+void string_benchmark();
@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <kernel/smp.h>
+#include <kernel/spinlock.h>
+#include <kernel/stdatomic.h>
+#include <mm/arch_vm.h>
+#include <mm/asid.h>
+#include <mm/vm.h>
+
+/// ASID 0 is reserved for the kernel page table
+#define ASID_FIRST_USER 1
+
+struct
+{
+    struct spinlock lock;       ///< Protects next and generation updates
+    uint32_t max;               ///< Highest supported ASID, 0 = unsupported
+    uint32_t next;              ///< Next free ASID in this generation
+    atomic_size_t generation;   ///< Current generation, starts at 1
+    atomic_size_t rollovers;    ///< Statistics for sysfs
+
+    /// Generation each CPU flushed its TLB for last. Only accessed by the CPU
+    /// itself with interrupts disabled.
+    size_t cpu_generation[MAX_CPUS];
+} g_asid;
+
+void asid_init()
+{
+    spin_lock_init(&g_asid.lock, "asid");
+    g_asid.max = mmu_get_max_asid();
+    g_asid.next = ASID_FIRST_USER;
+    atomic_init(&g_asid.generation, 1);
+    atomic_init(&g_asid.rollovers, 0);
+    for (size_t i = 0; i < MAX_CPUS; ++i)
+    {
+        g_asid.cpu_generation[i] = 1;
+    }
+
+    printk("MMU supports %d ASIDs\n", (int32_t)g_asid.max);
+}
+
+/// @brief Assign a new ASID to the page table, start a new generation if all
+/// are used up.
+/// @return The generation of the new ASID.
+static size_t asid_new(struct Page_Table *pagetable)
+{
+    spin_lock(&g_asid.lock);
+    size_t generation = atomic_load(&g_asid.generation);
+    if (pagetable->asid_generation != generation)
+    {
+        if (g_asid.next > g_asid.max)
+        {
+            // All ASIDs of this generation are in use (or belonged to page
+            // tables which are freed by now). Start over, every CPU will flush
+            // its TLB before it runs a page table of the new generation.
+            generation++;
+            atomic_store(&g_asid.generation, generation);
+            atomic_fetch_add(&g_asid.rollovers, 1);
+            g_asid.next = ASID_FIRST_USER;
+        }
+        pagetable->asid = g_asid.next++;
+        pagetable->asid_generation = generation;
+    }
+    spin_unlock(&g_asid.lock);
+
+    return generation;
+}
+
+uint32_t asid_activate(struct Page_Table *pagetable)
+{
+    size_t cpu_id = smp_processor_id();
+
+    if (g_asid.max == 0)
+    {
+        // no ASIDs: everything shares ASID 0, flush on each switch
+        mmu_flush_tlb_asid(0);
+        return 0;
+    }
+
+    size_t generation = atomic_load(&g_asid.generation);
+    if (pagetable->asid_generation != generation)
+    {
+        generation = asid_new(pagetable);
+    }
+
+    if (g_asid.cpu_generation[cpu_id] != generation)
+    {
+        // this CPU might still have entries of ASIDs from the old generation
+        // which are now used by different page tables
+        mmu_flush_tlb();
+        g_asid.cpu_generation[cpu_id] = generation;
+    }
+    else if (pagetable->asid_last_cpu != cpu_id)
+    {
+        // The page table was used (and maybe changed) on a different CPU, the
+        // entries from the last time it ran here might be stale.
+        mmu_flush_tlb_asid(pagetable->asid);
+    }
+    pagetable->asid_last_cpu = cpu_id;
+
+    return pagetable->asid;
+}
+
+void asid_flush_page(struct Page_Table *pagetable, size_t va)
+{
+    if (pagetable == g_kernel_pagetable)
+    {
+        mmu_flush_tlb_page(va);
+    }
+    else if (pagetable->asid_generation != 0)
+    {
+        mmu_flush_tlb_page_asid(va, pagetable->asid);
+    }
+    // else: page table was never active, nothing to flush
+}
+
+void asid_flush_all(struct Page_Table *pagetable)
+{
+    if (pagetable == g_kernel_pagetable)
+    {
+        mmu_flush_tlb();
+    }
+    else if (pagetable->asid_generation != 0)
+    {
+        mmu_flush_tlb_asid(pagetable->asid);
+    }
+}
+
+size_t asid_get_max() { return g_asid.max; }
+
+size_t asid_get_rollover_count() { return atomic_load(&g_asid.rollovers); }
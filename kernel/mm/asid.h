@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: MIT */
+#pragma once
+
+#include <kernel/kernel.h>
+#include <mm/page_table.h>
+
+/// Address Space IDs (ASIDs) tag TLB entries with the page table they belong
+/// to. ASID 0 is used by the kernel, each user page table gets its own ASID so
+/// switching between processes does not need to flush the TLB.
+/// ASIDs are handed out in generations: when all are used up, a new generation
+/// starts, all page tables of the old generation get a new ASID on their next
+/// activation and each CPU flushes its whole TLB once.
+
+/// @brief Probes how many ASIDs the MMU supports. Call on the boot CPU once the
+/// kernel page table is active.
+void asid_init();
+
+/// @brief Assigns an ASID of the current generation to the page table if
+/// needed and removes stale TLB entries of that ASID on this CPU. Call with
+/// interrupts disabled right before switching to the page table.
+/// @param pagetable The user page table to switch to.
+/// @return The ASID to use for the page table.
+uint32_t asid_activate(struct Page_Table *pagetable);
+
+/// @brief Flushes the TLB entries of one page of the page table on this CPU.
+/// Other CPUs flush when the page table gets activated there next.
+/// @param pagetable Page table which got changed, lock must be held.
+/// @param va Virtual address of the changed page.
+void asid_flush_page(struct Page_Table *pagetable, size_t va);
+
+/// @brief Flushes all TLB entries of the page table on this CPU.
+/// @param pagetable Page table which got changed, lock must be held.
+void asid_flush_all(struct Page_Table *pagetable);
+
+/// @brief Highest ASID supported by the MMU, 0 if ASIDs are not supported.
+size_t asid_get_max();
+
+/// @brief Number of times all ASIDs were used up and a new generation started.
+size_t asid_get_rollover_count();
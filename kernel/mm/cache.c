@@ -1,6 +1,9 @@
 /* SPDX-License-Identifier: MIT */
 
+#include <kernel/cpu.h>
+#include <kernel/smp.h>
 #include <kernel/string.h>
+#include <lib/minmax.h>
 #include <mm/cache.h>
 #include <mm/kalloc.h>
 #include <mm/kmem_sysfs.h>
@@ -9,96 +12,358 @@ void kmem_cache_check(struct kmem_cache *cache)
 {
     spin_lock(&cache->lock);
     struct list_head *pos;
-    list_for_each(pos, &cache->slab_list)
+    list_for_each(pos, &cache->slabs_partial)
     {
         struct kmem_slab *slab = kmem_slab_from_list(pos);
         kmem_slab_check(slab);
     }
+    list_for_each(pos, &cache->slabs_full)
+    {
+        struct kmem_slab *slab = kmem_slab_from_list(pos);
+        kmem_slab_check(slab);
+    }
+    list_for_each(pos, &cache->slabs_empty)
+    {
+        struct kmem_slab *slab = kmem_slab_from_list(pos);
+        DEBUG_EXTRA_PANIC(kmem_slab_is_empty(slab),
+                          "kmem_cache_check: used slab in empty list");
+    }
 
     spin_unlock(&cache->lock);
 }
 
-void kmem_cache_init(struct kmem_cache *new_cache, size_t size)
+void kmem_cache_init(struct kmem_cache *new_cache, const char *name,
+                     size_t size, size_t align, void (*ctor)(void *object))
 {
-    size = ROUND_TO_MIN_SLAB_SIZE(size);
+    align = max(align, MIN_SLAB_SIZE);
+    if ((align & (align - 1)) != 0)
+    {
+        panic("kmem_cache_init: alignment is not a power of 2");
+    }
+    size = ROUND_TO_SLAB_ALIGN(size, align);
     if (size > MAX_SLAB_SIZE)
     {
         panic("kmem_cache_init: unsupported slab size");
     }
 
     spin_lock_init(&new_cache->lock, "kmem_cache");
-    list_init(&(new_cache->slab_list));
+    list_init(&(new_cache->slabs_partial));
+    list_init(&(new_cache->slabs_full));
+    list_init(&(new_cache->slabs_empty));
+    list_init(&(new_cache->cache_list));
+    new_cache->slab_count = 0;
+    new_cache->slab_pages = 0;
+    new_cache->slab_order = kmem_slab_order_for_size(size, align);
+    new_cache->empty_count = 0;
+    new_cache->max_empty = KMEM_CACHE_MAX_EMPTY_SLABS;
     new_cache->object_size = size;
+    new_cache->align = align;
+    new_cache->ctor = ctor;
+    safestrcpy(new_cache->name, name, KMEM_CACHE_MAX_NAME_LEN);
+    for (size_t i = 0; i < MAX_CPUS; ++i)
+    {
+        struct kmem_magazine *magazine = &new_cache->magazine[i];
+        spin_lock_init(&magazine->lock, "kmem_magazine");
+        magazine->count = 0;
+        magazine->hits = 0;
+        magazine->misses = 0;
+        magazine->refills = 0;
+        magazine->flushes = 0;
+    }
     kobject_init(&new_cache->kobj, &kmem_cache_kobj_ktype);
 }
 
-void *kmem_cache_alloc(struct kmem_cache *cache, int32_t flags)
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+                                     size_t align, void (*ctor)(void *object))
 {
-    spin_lock(&cache->lock);
+    struct kmem_cache *cache =
+        kmalloc(sizeof(struct kmem_cache), ALLOC_FLAG_ZERO_MEMORY);
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+    kmem_cache_init(cache, name, size, align, ctor);
+    kalloc_register_cache(cache);
+    return cache;
+}
 
-    void *allocation = NULL;
+// cache lock must be held, returns NULL if the cache needs a new slab
+static void *kmem_cache_alloc_locked(struct kmem_cache *cache)
+{
+    if (list_empty(&cache->slabs_partial))
+    {
+        // nothing free in the cache...
+        if (list_empty(&cache->slabs_empty)) return NULL;
+
+        // reuse an empty slab
+        struct kmem_slab *new_slab =
+            kmem_slab_from_list(cache->slabs_empty.next);
+        list_del(&(new_slab->slab_list));
+        cache->empty_count--;
+        list_add(&(new_slab->slab_list), &(cache->slabs_partial));
+    }
 
-    struct list_head *slab;
-    list_for_each(slab, &cache->slab_list)
+    struct kmem_slab *slab = kmem_slab_from_list(cache->slabs_partial.next);
+    void *allocation = kmem_slab_alloc(slab, ALLOC_FLAG_NONE);
+    if (kmem_slab_is_full(slab))
     {
-        allocation = kmem_slab_alloc((struct kmem_slab *)slab, flags);
-        if (allocation) break;  // found space, break loop
+        list_del(&(slab->slab_list));
+        list_add(&(slab->slab_list), &(cache->slabs_full));
     }
+    return allocation;
+}
 
-    if (allocation == NULL)
+// cache lock must be held
+static void kmem_cache_free_locked(struct kmem_cache *cache, void *object)
+{
+    struct kmem_slab *slab = kmem_slab_infer_slab(object);
+    bool was_full = kmem_slab_is_full(slab);
+    kmem_slab_free(slab, object);
+
+    if (kmem_slab_is_empty(slab))
     {
-        // nothing free in the cache...
-        struct kmem_slab *new_slab = kmem_slab_create(cache->object_size);
-        if (new_slab)
+        list_del(&(slab->slab_list));
+        if (cache->empty_count < cache->max_empty)
+        {
+            list_add(&(slab->slab_list), &(cache->slabs_empty));
+            cache->empty_count++;
+        }
+        else
         {
-            list_add_tail(&(new_slab->slab_list), &(cache->slab_list));
-            new_slab->owning_cache = cache;
-            allocation = kmem_slab_alloc(new_slab, flags);
+            cache->slab_count--;
+            cache->slab_pages -= (1 << slab->order);
+            kmem_slab_delete(slab);
         }
     }
+    else if (was_full)
+    {
+        list_del(&(slab->slab_list));
+        list_add(&(slab->slab_list), &(cache->slabs_partial));
+    }
+}
 
+// magazine lock must be held, moves the oldest objects to the slabs
+static void kmem_magazine_flush(struct kmem_cache *cache,
+                                struct kmem_magazine *magazine, size_t count)
+{
+    // objects move between slabs and magazines with the cache lock held, see
+    // kmem_cache_get_object_count()
+    spin_lock(&cache->lock);
+    for (size_t i = 0; i < count; ++i)
+    {
+        kmem_cache_free_locked(cache, magazine->objects[i]);
+    }
+    magazine->count -= count;
+    memmove(&magazine->objects[0], &magazine->objects[count],
+            magazine->count * sizeof(void *));
     spin_unlock(&cache->lock);
+}
+
+// cache lock must be held, adds a slab created without the lock
+static void kmem_cache_add_slab_locked(struct kmem_cache *cache,
+                                       struct kmem_slab *slab)
+{
+    slab->owning_cache = cache;
+    cache->slab_count++;
+    cache->slab_pages += (1 << slab->order);
+
+    // another CPU might have added a slab in the meantime
+    if (list_empty(&cache->slabs_partial))
+    {
+        list_add(&(slab->slab_list), &(cache->slabs_partial));
+    }
+    else if (cache->empty_count < cache->max_empty)
+    {
+        list_add(&(slab->slab_list), &(cache->slabs_empty));
+        cache->empty_count++;
+    }
+    else
+    {
+        cache->slab_count--;
+        cache->slab_pages -= (1 << slab->order);
+        kmem_slab_delete(slab);
+    }
+}
+
+// takes an object from the magazine of this CPU and refills it from the slabs
+// if needed, returns NULL if the cache needs a new slab
+static void *kmem_cache_alloc_from_magazine(struct kmem_cache *cache)
+{
+    cpu_push_disable_device_interrupt_stack();
+    struct kmem_magazine *magazine = &cache->magazine[smp_processor_id()];
+    spin_lock(&magazine->lock);
+
+    if (magazine->count > 0)
+    {
+        magazine->hits++;
+    }
+    else
+    {
+        magazine->misses++;
+
+        // refill a batch with one lock of the cache
+        spin_lock(&cache->lock);
+        while (magazine->count < KMEM_MAGAZINE_BATCH)
+        {
+            void *object = kmem_cache_alloc_locked(cache);
+            if (object == NULL) break;
+            magazine->objects[magazine->count++] = object;
+        }
+        spin_unlock(&cache->lock);
+        if (magazine->count > 0) magazine->refills++;
+    }
+
+    void *allocation = NULL;
+    if (magazine->count > 0)
+    {
+        allocation = magazine->objects[--magazine->count];
+    }
+
+    spin_unlock(&magazine->lock);
+    cpu_pop_disable_device_interrupt_stack();
+    return allocation;
+}
+
+void *kmem_cache_alloc(struct kmem_cache *cache, int32_t flags)
+{
+    void *allocation = kmem_cache_alloc_from_magazine(cache);
+    while (allocation == NULL)
+    {
+        // create the slab without holding a lock of the cache: the page
+        // allocator might run the shrinkers, which shrink all caches
+        struct kmem_slab *new_slab = kmem_slab_create(
+            cache->object_size, cache->align, cache->slab_order, flags);
+        if (new_slab == NULL) return NULL;
+
+        spin_lock(&cache->lock);
+        kmem_cache_add_slab_locked(cache, new_slab);
+        spin_unlock(&cache->lock);
+
+        allocation = kmem_cache_alloc_from_magazine(cache);
+    }
+
+    if (flags & ALLOC_FLAG_ZERO_MEMORY)
+    {
+        memset(allocation, 0, cache->object_size);
+    }
+    if (cache->ctor != NULL)
+    {
+        cache->ctor(allocation);
+    }
     return allocation;
 }
 
 void kmem_cache_free(struct kmem_cache *cache, void *object)
 {
-    spin_lock(&cache->lock);
+#ifdef CONFIG_DEBUG_KALLOC_MEMSET_KALLOC_FREE
+    memset((char *)object, 2, cache->object_size);  // fill with junk
+#endif  // CONFIG_DEBUG_KALLOC_MEMSET_KALLOC_FREE
 
-    struct kmem_slab *slab = kmem_slab_infer_slab(object);
-    kmem_slab_free(slab, object);
+    cpu_push_disable_device_interrupt_stack();
+    struct kmem_magazine *magazine = &cache->magazine[smp_processor_id()];
+    spin_lock(&magazine->lock);
 
-    if (kmem_slab_is_empty(slab))
+    if (magazine->count == KMEM_MAGAZINE_SIZE)
+    {
+        kmem_magazine_flush(cache, magazine, KMEM_MAGAZINE_BATCH);
+        magazine->flushes++;
+    }
+    magazine->objects[magazine->count++] = object;
+
+    spin_unlock(&magazine->lock);
+    cpu_pop_disable_device_interrupt_stack();
+}
+
+void kmem_cache_drain_magazines(struct kmem_cache *cache)
+{
+    for (size_t i = 0; i < MAX_CPUS; ++i)
+    {
+        struct kmem_magazine *magazine = &cache->magazine[i];
+        spin_lock(&magazine->lock);
+        if (magazine->count > 0)
+        {
+            kmem_magazine_flush(cache, magazine, magazine->count);
+        }
+        spin_unlock(&magazine->lock);
+    }
+}
+
+// cache lock must be held, returns the number of freed pages
+static size_t kmem_cache_free_empty_slabs(struct kmem_cache *cache,
+                                          size_t keep)
+{
+    size_t freed = 0;
+    while (cache->empty_count > keep)
     {
+        struct kmem_slab *slab = kmem_slab_from_list(cache->slabs_empty.next);
         list_del(&(slab->slab_list));
+        cache->empty_count--;
+        cache->slab_count--;
+        cache->slab_pages -= (1 << slab->order);
+        freed += (1 << slab->order);
         kmem_slab_delete(slab);
     }
+    return freed;
+}
 
+size_t kmem_cache_get_empty_slab_count(struct kmem_cache *cache)
+{
+    spin_lock(&cache->lock);
+    size_t count = cache->empty_count;
     spin_unlock(&cache->lock);
+    return count;
 }
 
-static inline size_t kmem_cache_get_slab_count_locked(struct kmem_cache *cache)
+void kmem_cache_set_max_empty_slabs(struct kmem_cache *cache,
+                                    size_t max_empty)
 {
-    size_t count = 0;
-    struct list_head *slab;
-    list_for_each(slab, &cache->slab_list) { count++; }
-    return count;
+    spin_lock(&cache->lock);
+    cache->max_empty = max_empty;
+    kmem_cache_free_empty_slabs(cache, max_empty);
+    spin_unlock(&cache->lock);
+}
+
+size_t kmem_cache_shrink(struct kmem_cache *cache)
+{
+    kmem_cache_drain_magazines(cache);
+
+    spin_lock(&cache->lock);
+    size_t freed = kmem_cache_free_empty_slabs(cache, 0);
+    spin_unlock(&cache->lock);
+    return freed;
 }
 
 size_t kmem_cache_get_slab_count(struct kmem_cache *cache)
 {
     spin_lock(&cache->lock);
-    size_t count = kmem_cache_get_slab_count_locked(cache);
+    size_t count = cache->slab_count;
     spin_unlock(&cache->lock);
     return count;
 }
 
+size_t kmem_cache_get_slab_pages(struct kmem_cache *cache)
+{
+    spin_lock(&cache->lock);
+    size_t pages = cache->slab_pages;
+    spin_unlock(&cache->lock);
+    return pages;
+}
+
 size_t kmem_cache_get_max_objects(struct kmem_cache *cache)
 {
+    // slabs from early boot can have a smaller order than slab_order
+    size_t count = 0;
     spin_lock(&cache->lock);
-    struct kmem_slab *slab = kmem_slab_from_list(cache->slab_list.next);
-    size_t count = kmem_slab_get_max_objects(slab) *
-                   kmem_cache_get_slab_count_locked(cache);
+    struct list_head *lists[] = {&cache->slabs_partial, &cache->slabs_full,
+                                 &cache->slabs_empty};
+    for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); ++i)
+    {
+        struct list_head *pos;
+        list_for_each(pos, lists[i])
+        {
+            count += kmem_slab_get_max_objects(kmem_slab_from_list(pos));
+        }
+    }
     spin_unlock(&cache->lock);
     return count;
 }
@@ -114,12 +379,35 @@ size_t kmem_cache_get_object_count(struct kmem_cache *cache)
     size_t count = 0;
     spin_lock(&cache->lock);
     struct list_head *pos;
-    list_for_each(pos, &cache->slab_list)
+    list_for_each(pos, &cache->slabs_partial)
+    {
+        struct kmem_slab *slab = kmem_slab_from_list(pos);
+        count += kmem_slab_get_object_count(slab);
+    }
+    list_for_each(pos, &cache->slabs_full)
     {
         struct kmem_slab *slab = kmem_slab_from_list(pos);
         count += kmem_slab_get_object_count(slab);
     }
 
+    // objects in the magazines are free
+    count -= kmem_cache_get_magazine_stats(cache).objects;
     spin_unlock(&cache->lock);
     return count;
 }
+
+struct kmem_magazine_stats kmem_cache_get_magazine_stats(
+    struct kmem_cache *cache)
+{
+    struct kmem_magazine_stats stats = {0};
+    for (size_t i = 0; i < MAX_CPUS; ++i)
+    {
+        struct kmem_magazine *magazine = &cache->magazine[i];
+        stats.objects += magazine->count;
+        stats.hits += magazine->hits;
+        stats.misses += magazine->misses;
+        stats.refills += magazine->refills;
+        stats.flushes += magazine->flushes;
+    }
+    return stats;
+}
@@ -11,6 +11,30 @@
 
 #define KMEM_CACHE_MAX_NAME_LEN 16
 
+/// Default max number of empty slabs a cache keeps.
+#define KMEM_CACHE_MAX_EMPTY_SLABS 2
+
+/// Max number of free objects in a per-CPU magazine.
+#define KMEM_MAGAZINE_SIZE 16
+/// Objects moved between a magazine and the slabs at once.
+#define KMEM_MAGAZINE_BATCH (KMEM_MAGAZINE_SIZE / 2)
+
+/// @brief Free objects of a kmem_cache for one CPU. Allocations and frees are
+/// served from here without the lock of the cache, only an empty magazine gets
+/// refilled from the slabs and a full one gets flushed back in batches.
+struct kmem_magazine
+{
+    struct spinlock lock;  ///< only contended while draining all magazines
+    size_t count;          ///< number of objects
+    void *objects[KMEM_MAGAZINE_SIZE];  ///< last freed object at the end
+
+    // statistics
+    size_t hits;     ///< allocations served from the magazine
+    size_t misses;   ///< allocations which found the magazine empty
+    size_t refills;  ///< batches moved from the slabs to the magazine
+    size_t flushes;  ///< batches moved from the magazine to the slabs
+};
+
 /// @brief A cache of allocations of a certain type/size.
 /// kmalloc() is using kmem_cache objects for various allocation sizes.
 /// Grows and shrinks internal list of slabs.
@@ -22,21 +46,72 @@ struct kmem_cache
     // lock protecting this cache
     struct spinlock lock;
 
-    // double linked list of slabs providing the cache memory
-    struct list_head slab_list;
+    // slabs with free objects, new objects get allocated from the first one
+    struct list_head slabs_partial;
+
+    // slabs without free objects
+    struct list_head slabs_full;
+
+    // slabs without allocated objects, kept to avoid freeing and recreating
+    // slabs at the boundary of a slab
+    struct list_head slabs_empty;
+
+    // number of slabs in all lists
+    size_t slab_count;
 
-    // size of one object including padding to the SLAB_ALIGNMENT
+    // number of pages of all slabs
+    size_t slab_pages;
+
+    // new slabs span 2^slab_order pages, see kmem_slab_order_for_size()
+    size_t slab_order;
+
+    // number of slabs in slabs_empty
+    size_t empty_count;
+
+    // max number of slabs in slabs_empty, more get freed
+    size_t max_empty;
+
+    // size of one object including padding to the alignment
     size_t object_size;
 
-    // name for debugging
+    // alignment of the objects, power of 2 >= MIN_SLAB_SIZE
+    size_t align;
+
+    // optional, called for every allocated object
+    void (*ctor)(void *object);
+
+    // in g_kernel_memory.cache_list
+    struct list_head cache_list;
+
+    // name for debugging and sysfs
     char name[KMEM_CACHE_MAX_NAME_LEN];
+
+    // free objects per CPU, see kmem_magazine
+    struct kmem_magazine magazine[MAX_CPUS];
 };
 
 #define kmem_cache_from_kobj(ptr) container_of(ptr, struct kmem_cache, kobj)
 
 /// @brief Init a cache for objects of a given size.
+/// @param name Name of the cache, shown in /sys/kmem/<name> once added.
 /// @param size Size per object in bytes.
-void kmem_cache_init(struct kmem_cache *new_cache, size_t size);
+/// @param align Alignment of the objects (power of 2), 0 for the default of
+/// MIN_SLAB_SIZE.
+/// @param ctor Optional function to init each allocated object, called after
+/// zeroing it with ALLOC_FLAG_ZERO_MEMORY.
+void kmem_cache_init(struct kmem_cache *new_cache, const char *name,
+                     size_t size, size_t align, void (*ctor)(void *object));
+
+/// @brief Create a cache for objects of one type and register it under
+/// /sys/kmem/<name>. Objects can be freed with kmem_cache_free() or kfree().
+/// Caches can not be destroyed.
+/// @param name Name of the cache, max KMEM_CACHE_MAX_NAME_LEN-1 chars.
+/// @param size Size per object in bytes, max MAX_SLAB_SIZE.
+/// @param align Alignment of the objects (power of 2), 0 for the default.
+/// @param ctor Optional function to init each allocated object.
+/// @return The cache or NULL if out of memory.
+struct kmem_cache *kmem_cache_create(const char *name, size_t size,
+                                     size_t align, void (*ctor)(void *object));
 
 /// @brief Allocate an object from this cache.
 /// @param cache The cache to use.
@@ -51,9 +126,15 @@ void kmem_cache_free(struct kmem_cache *cache, void *object);
 
 /// @brief Get the number of slabs in this cache.
 /// @param cache The cache to query.
-/// @return Count of slabs, each slab is one page.
+/// @return Count of slabs, each slab is 2^slab_order pages (except for single
+/// page slabs from early boot).
 size_t kmem_cache_get_slab_count(struct kmem_cache *cache);
 
+/// @brief Get the number of pages used by the slabs of this cache.
+/// @param cache The cache to query.
+/// @return Count of pages.
+size_t kmem_cache_get_slab_pages(struct kmem_cache *cache);
+
 /// @brief How many objects can this cache manage in total currently.
 /// @param cache The cahce to query.
 /// @return Count of objects.
@@ -66,7 +147,49 @@ size_t kmem_cache_get_object_size(struct kmem_cache *cache);
 
 /// @brief Get the number of allocated objects in this cache.
 /// @param cache Cache to query.
-/// @return Count of allocated objects in all slabs of this cache.
+/// @return Count of allocated objects in all slabs of this cache, excluding
+/// the free objects in the magazines.
 size_t kmem_cache_get_object_count(struct kmem_cache *cache);
 
+/// @brief Statistics of the per-CPU magazines of a cache, summed over all
+/// CPUs.
+struct kmem_magazine_stats
+{
+    size_t objects;  ///< free objects in the magazines
+    size_t hits;
+    size_t misses;
+    size_t refills;
+    size_t flushes;
+};
+
+/// @brief Get the summed statistics of the magazines of this cache.
+/// @param cache Cache to query.
+/// @return A snapshot, the magazines change without the lock of the cache.
+struct kmem_magazine_stats kmem_cache_get_magazine_stats(
+    struct kmem_cache *cache);
+
+/// @brief Move all objects of the magazines back to the slabs. Can be called
+/// from any CPU.
+/// @param cache The cache.
+void kmem_cache_drain_magazines(struct kmem_cache *cache);
+
+/// @brief Get the number of empty slabs the cache keeps.
+/// @param cache Cache to query.
+/// @return Count of empty slabs.
+size_t kmem_cache_get_empty_slab_count(struct kmem_cache *cache);
+
+/// @brief Set the max number of empty slabs the cache keeps, frees empty
+/// slabs above the new limit.
+/// @param cache The cache.
+/// @param max_empty New limit.
+void kmem_cache_set_max_empty_slabs(struct kmem_cache *cache,
+                                    size_t max_empty);
+
+/// @brief Free the memory the cache does not need: drains the magazines and
+/// frees all empty slabs. Called if the system runs out of memory. Must not
+/// be called with a lock of the cache held.
+/// @param cache The cache.
+/// @return Number of freed pages.
+size_t kmem_cache_shrink(struct kmem_cache *cache);
+
 void kmem_cache_check(struct kmem_cache *cache);
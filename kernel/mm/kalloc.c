@@ -4,12 +4,17 @@
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
 
+#include <arch/timer.h>
 #include <init/main.h>
 #include <init/start.h>
+#include <kernel/cpu.h>
+#include <kernel/errno.h>
 #include <kernel/kernel.h>
 #include <kernel/kobject.h>
+#include <kernel/kticks.h>
 #include <kernel/list.h>
 #include <kernel/pgtable.h>
+#include <kernel/smp.h>
 #include <kernel/spinlock.h>
 #include <kernel/string.h>
 #include <lib/minmax.h>
@@ -17,10 +22,41 @@
 #include <mm/kalloc.h>
 #include <mm/kernel_memory.h>
 #include <mm/kmem_sysfs.h>
+#include <mm/shrinker.h>
 
 /// @brief central object to manage system memory
 struct kernel_memory g_kernel_memory = {0};
 
+struct page *page_from_kva(void *kva)
+{
+    size_t pa = virt_to_phys((size_t)kva);
+    size_t pfn = (pa - g_kernel_memory.memory_map->ram.start_pa) / PAGE_SIZE;
+    return &g_kernel_memory.pages[pfn];
+}
+
+// The free lists link the free blocks through their first page, the page
+// descriptor of that page knows the block is free and its order.
+static inline void add_free_block(void *kva, size_t order)
+{
+    list_add((struct list_head *)kva,
+             &g_kernel_memory.list_of_free_memory[order]);
+    if (g_kernel_memory.pages != NULL)
+    {
+        struct page *page = page_from_kva(kva);
+        page->order = order;
+        page->flags |= PAGE_FLAG_FREE;
+    }
+}
+
+static inline void remove_free_block(void *kva)
+{
+    list_del((struct list_head *)kva);
+    if (g_kernel_memory.pages != NULL)
+    {
+        page_from_kva(kva)->flags &= ~PAGE_FLAG_FREE;
+    }
+}
+
 // helper which assumes g_kernel_memory.lock is held
 // most of the time better call alloc_pages()
 void *__alloc_pages(int32_t flags, size_t order)
@@ -31,10 +67,8 @@ void *__alloc_pages(int32_t flags, size_t order)
     if (!list_empty(&g_kernel_memory.list_of_free_memory[order]))
     {
         // memory in the right size available
-        struct list_head *memory_block =
-            g_kernel_memory.list_of_free_memory[order].next;
-        list_del(memory_block);
-        pages = (void *)memory_block;
+        pages = (void *)g_kernel_memory.list_of_free_memory[order].next;
+        remove_free_block(pages);
     }
     else
     {
@@ -45,8 +79,7 @@ void *__alloc_pages(int32_t flags, size_t order)
             // return left half, add right half to empty list
             pages = (void *)double_alloc;
             double_alloc += (1 << order) * PAGE_SIZE;
-            list_add((struct list_head *)double_alloc,
-                     &g_kernel_memory.list_of_free_memory[order]);
+            add_free_block(double_alloc, order);
         }
     }
     return pages;
@@ -72,16 +105,278 @@ void zero_pages(void *addr, size_t page_count)
     }
 }
 
-void *alloc_pages(int32_t flags, size_t order)
+void __free_pages(void *pa, size_t order);
+
+// The per-CPU page caches are used once the page descriptors exist, the
+// descriptors mark the pages in the caches.
+static inline bool cpu_page_cache_enabled()
+{
+    return (g_kernel_memory.pages != NULL) &&
+           (g_kernel_memory.cpu_cache_high > 0);
+}
+
+// cache lock and g_kernel_memory.lock must be held
+static void cpu_page_cache_drain_locked(struct cpu_page_cache *cache,
+                                        size_t keep)
+{
+    while (cache->count > keep)
+    {
+        // the coldest pages are at the end
+        struct list_head *page = cache->list.prev;
+        list_del(page);
+        cache->count--;
+        page_from_kva(page)->flags &= ~PAGE_FLAG_CPU_CACHE;
+        __free_pages(page, 0);
+    }
+}
+
+static void *cpu_page_cache_alloc()
+{
+    cpu_push_disable_device_interrupt_stack();
+    struct cpu_page_cache *cache =
+        &g_kernel_memory.cpu_cache[smp_processor_id()];
+    spin_lock(&cache->lock);
+
+    if (cache->count == 0)
+    {
+        // refill a batch with one lock of the buddy allocator
+        size_t batch = max(g_kernel_memory.cpu_cache_low, 1);
+        spin_lock(&g_kernel_memory.lock);
+        while (cache->count < batch)
+        {
+            void *page = __alloc_pages(ALLOC_FLAG_NONE, 0);
+            if (page == NULL) break;
+            page_from_kva(page)->flags |= PAGE_FLAG_CPU_CACHE;
+            list_add_tail((struct list_head *)page, &cache->list);
+            cache->count++;
+        }
+        spin_unlock(&g_kernel_memory.lock);
+    }
+
+    void *page = NULL;
+    if (cache->count > 0)
+    {
+        page = (void *)cache->list.next;
+        list_del((struct list_head *)page);
+        cache->count--;
+        page_from_kva(page)->flags &= ~PAGE_FLAG_CPU_CACHE;
+    }
+
+    spin_unlock(&cache->lock);
+    cpu_pop_disable_device_interrupt_stack();
+    return page;
+}
+
+static void cpu_page_cache_free(void *page)
+{
+    DEBUG_EXTRA_PANIC(!(page_from_kva(page)->flags & PAGE_FLAG_CPU_CACHE),
+                      "cpu_page_cache_free: double free");
+#ifdef CONFIG_DEBUG_KALLOC_MEMSET_KALLOC_FREE
+    // Fill with junk to catch dangling refs.
+    memset(page, 1, PAGE_SIZE);
+#endif  // CONFIG_DEBUG_KALLOC_MEMSET_KALLOC_FREE
+
+    cpu_push_disable_device_interrupt_stack();
+    struct cpu_page_cache *cache =
+        &g_kernel_memory.cpu_cache[smp_processor_id()];
+    spin_lock(&cache->lock);
+
+    // hot pages first, they are likely still in the CPU caches
+    page_from_kva(page)->flags |= PAGE_FLAG_CPU_CACHE;
+    list_add((struct list_head *)page, &cache->list);
+    cache->count++;
+
+    if (cache->count > g_kernel_memory.cpu_cache_high)
+    {
+        spin_lock(&g_kernel_memory.lock);
+        cpu_page_cache_drain_locked(cache, g_kernel_memory.cpu_cache_low);
+        spin_unlock(&g_kernel_memory.lock);
+    }
+
+    spin_unlock(&cache->lock);
+    cpu_pop_disable_device_interrupt_stack();
+}
+
+size_t kalloc_drain_cpu_caches()
+{
+    size_t drained = 0;
+    for (size_t i = 0; i < MAX_CPUS; ++i)
+    {
+        struct cpu_page_cache *cache = &g_kernel_memory.cpu_cache[i];
+        spin_lock(&cache->lock);
+        if (cache->count > 0)
+        {
+            drained += cache->count;
+            spin_lock(&g_kernel_memory.lock);
+            cpu_page_cache_drain_locked(cache, 0);
+            spin_unlock(&g_kernel_memory.lock);
+        }
+        spin_unlock(&cache->lock);
+    }
+    return drained;
+}
+
+// returns a zeroed page from the pool or NULL if it is empty
+static void *zero_pool_alloc()
+{
+    struct zero_page_pool *pool = &g_kernel_memory.zero_pool;
+    void *page = NULL;
+
+    spin_lock(&pool->lock);
+    if (pool->count > 0)
+    {
+        page = pool->list.next;
+        list_del((struct list_head *)page);
+        pool->count--;
+        pool->hits++;
+    }
+    else
+    {
+        pool->misses++;
+    }
+    spin_unlock(&pool->lock);
+
+    if (page != NULL)
+    {
+        page_from_kva(page)->flags &= ~PAGE_FLAG_ZERO_POOL;
+        memset(page, 0, sizeof(struct list_head));
+    }
+    return page;
+}
+
+size_t kalloc_drain_zero_pool(size_t keep)
 {
+    struct zero_page_pool *pool = &g_kernel_memory.zero_pool;
+    struct list_head drained;
+    list_init(&drained);
+    size_t count = 0;
+
+    spin_lock(&pool->lock);
+    while (pool->count > keep)
+    {
+        struct list_head *page = pool->list.next;
+        list_del(page);
+        list_add(page, &drained);
+        pool->count--;
+        count++;
+    }
+    spin_unlock(&pool->lock);
+
+    // the pages are free memory already, so bypass the accounting of
+    // free_pages()
     spin_lock(&g_kernel_memory.lock);
+    while (!list_empty(&drained))
+    {
+        struct list_head *page = drained.next;
+        list_del(page);
+        page_from_kva(page)->flags &= ~PAGE_FLAG_ZERO_POOL;
+        __free_pages(page, 0);
+    }
+    spin_unlock(&g_kernel_memory.lock);
+
+    return count;
+}
+
+bool kalloc_zero_pool_refill(size_t max_pages)
+{
+    struct zero_page_pool *pool = &g_kernel_memory.zero_pool;
+    if (g_kernel_memory.pages == NULL) return false;
+
+    size_t refilled = 0;
+    while (refilled < max_pages)
+    {
+        // only a snapshot, but worst case the pool gets one page too many
+        // or the allocations which are low on memory drain it again
+        if (pool->count >= pool->target) break;
+        if (kalloc_get_free_pages() <= g_kernel_memory.shrink_low + pool->count)
+        {
+            // keep the free memory for real allocations
+            break;
+        }
+
+        void *page = alloc_pages(ALLOC_FLAG_NO_RECLAIM, 0);
+        if (page == NULL) break;
+        zero_pages(page, 1);
+
+        spin_lock(&pool->lock);
+        bool added = (pool->count < pool->target);
+        if (added)
+        {
+            page_from_kva(page)->flags |= PAGE_FLAG_ZERO_POOL;
+            list_add((struct list_head *)page, &pool->list);
+            pool->count++;
+        }
+        spin_unlock(&pool->lock);
+
+        if (!added)
+        {
+            free_page(page);
+            break;
+        }
+        // pages in the pool are free memory
+        atomic_fetch_sub(&g_kernel_memory.pages_allocated, 1);
+        refilled++;
+    }
+    return (refilled > 0);
+}
 
-    void *pages = __alloc_pages(flags, order);
+void *alloc_pages(int32_t flags, size_t order)
+{
+    void *pages = NULL;
+    bool zeroed = false;
+    if ((order == 0) && (flags & ALLOC_FLAG_ZERO_MEMORY) &&
+        (g_kernel_memory.pages != NULL))
+    {
+        pages = zero_pool_alloc();
+        zeroed = (pages != NULL);
+    }
+
+    if (pages == NULL)
+    {
+        if ((order == 0) && cpu_page_cache_enabled())
+        {
+            pages = cpu_page_cache_alloc();
+        }
+        else
+        {
+            spin_lock(&g_kernel_memory.lock);
+            pages = __alloc_pages(flags, order);
+            spin_unlock(&g_kernel_memory.lock);
+        }
+    }
+
+    if (pages == NULL)
+    {
+        // run the shrinkers (the freed pages go to the CPU caches) and free
+        // the pages in the caches of the CPUs and of the zero page pool
+        size_t freed = 0;
+        if (!(flags & ALLOC_FLAG_NO_RECLAIM))
+        {
+            freed += shrink_memory(1 << order);
+        }
+        freed += kalloc_drain_cpu_caches();
+        freed += kalloc_drain_zero_pool(0);
+        if (freed > 0)
+        {
+            spin_lock(&g_kernel_memory.lock);
+            pages = __alloc_pages(flags, order);
+            spin_unlock(&g_kernel_memory.lock);
+        }
+    }
 
     if (pages)
     {
-        if (flags & ALLOC_FLAG_ZERO_MEMORY)
+        if (g_kernel_memory.pages != NULL)
+        {
+            struct page *page = page_from_kva(pages);
+            for (size_t i = 0; i < (1 << order); ++i)
+            {
+                atomic_store(&page[i].ref, 1);
+            }
+        }
+        if ((flags & ALLOC_FLAG_ZERO_MEMORY) && !zeroed)
         {
+            // outside of all locks
             zero_pages(pages, (1 << order));
         }
         else
@@ -92,14 +387,18 @@ void *alloc_pages(int32_t flags, size_t order)
 #endif  // CONFIG_DEBUG_KALLOC_MEMSET_KALLOC_FREE
         }
         atomic_fetch_add(&g_kernel_memory.pages_allocated, (1 << order));
-    }
 
-    spin_unlock(&g_kernel_memory.lock);
+        if (!(flags & ALLOC_FLAG_NO_RECLAIM))
+        {
+            shrink_check_low_watermark();
+        }
+    }
 
     return pages;
 }
 
-// helper for merging blocks of memory
+// helper for merging blocks of memory during early boot, before the page
+// descriptors exist: linear search of the free list
 void *get_specific_page(size_t pa, size_t order)
 {
     if (order > PAGE_ALLOC_MAX_ORDER) return NULL;
@@ -118,10 +417,35 @@ void *get_specific_page(size_t pa, size_t order)
     return NULL;
 }
 
+// returns the buddy if it is a free block of the same order, the buddy is
+// then removed from its free list
+static void *take_free_buddy(size_t buddy_address, size_t order)
+{
+    if (g_kernel_memory.pages == NULL)
+    {
+        return get_specific_page(buddy_address, order);
+    }
+
+    // the buddy can be outside of RAM or reserved (e.g. the kernel), then its
+    // descriptor never gets marked as free
+    if (!addr_is_in_ram_kva(buddy_address)) return NULL;
+    struct page *buddy = page_from_kva((void *)buddy_address);
+    if (!(buddy->flags & PAGE_FLAG_FREE) || (buddy->order != order))
+    {
+        return NULL;
+    }
+    remove_free_block((void *)buddy_address);
+    return (void *)buddy_address;
+}
+
 // helper which assumes g_kernel_memory.lock is held
 // most of the time better call free_pages()
 void __free_pages(void *pa, size_t order)
 {
+    DEBUG_EXTRA_PANIC((g_kernel_memory.pages == NULL) ||
+                          !(page_from_kva(pa)->flags & PAGE_FLAG_FREE),
+                      "__free_pages: double free");
+
     void *buddy = NULL;
     if (order < PAGE_ALLOC_MAX_ORDER)
     {
@@ -129,7 +453,7 @@ void __free_pages(void *pa, size_t order)
         size_t bit_pos = PAGE_SHIFT + order;
         size_t mask = (1 << bit_pos);
         size_t buddy_address = (size_t)pa ^ mask;  // flip lowest address bit
-        buddy = get_specific_page(buddy_address, order);
+        buddy = take_free_buddy(buddy_address, order);
     }
 
     if (buddy)
@@ -143,8 +467,7 @@ void __free_pages(void *pa, size_t order)
         // Fill with junk to catch dangling refs.
         memset(pa, 1, PAGE_SIZE * (1 << order));
 #endif  // CONFIG_DEBUG_KALLOC_MEMSET_KALLOC_FREE
-        list_add((struct list_head *)pa,
-                 &g_kernel_memory.list_of_free_memory[order]);
+        add_free_block(pa, order);
     }
 }
 
@@ -155,27 +478,60 @@ void free_pages(void *kva, size_t order)
         panic("free_pages: invalid order");
     }
 
-    spin_lock(&g_kernel_memory.lock);
-
-    __free_pages(kva, order);
-
     atomic_fetch_add(&g_kernel_memory.pages_allocated, -(1 << order));
 
+    if ((order == 0) && cpu_page_cache_enabled())
+    {
+        cpu_page_cache_free(kva);
+        return;
+    }
+
+    spin_lock(&g_kernel_memory.lock);
+    __free_pages(kva, order);
     spin_unlock(&g_kernel_memory.lock);
 }
 
 void free_pages_range(void *kva, size_t page_count)
 {
+    atomic_fetch_add(&g_kernel_memory.pages_allocated,
+                     -1 * (ssize_t)page_count);
+
+    if (cpu_page_cache_enabled())
+    {
+        for (size_t i = 0; i < page_count; ++i)
+        {
+            cpu_page_cache_free((void *)((size_t)kva + i * PAGE_SIZE));
+        }
+        return;
+    }
+
     spin_lock(&g_kernel_memory.lock);
     for (size_t i = 0; i < page_count; ++i)
     {
         __free_pages((void *)((size_t)kva + i * PAGE_SIZE), 0);
     }
-    atomic_fetch_add(&g_kernel_memory.pages_allocated,
-                     -1 * (ssize_t)page_count);
     spin_unlock(&g_kernel_memory.lock);
 }
 
+void page_ref_inc(void *kva) { atomic_fetch_add(&page_from_kva(kva)->ref, 1); }
+
+size_t page_ref_count(void *kva)
+{
+    return atomic_load(&page_from_kva(kva)->ref);
+}
+
+void put_pages_range(void *kva, size_t page_count)
+{
+    for (size_t i = 0; i < page_count; ++i)
+    {
+        void *page = (void *)((size_t)kva + i * PAGE_SIZE);
+        if (atomic_fetch_sub(&page_from_kva(page)->ref, 1) == 1)
+        {
+            free_pages(page, 0);
+        }
+    }
+}
+
 void kalloc_init_memory_region(size_t mem_start, size_t mem_end)
 {
     size_t addr = mem_start;
@@ -197,6 +553,7 @@ void kalloc_init_memory_region(size_t mem_start, size_t mem_end)
             // pool so counter the decrement in free_pages() by incrementing
             // here
             atomic_fetch_add(&g_kernel_memory.pages_allocated, (1 << order));
+            g_kernel_memory.pages_total += (1 << order);
             free_pages((void *)addr, order);
             addr += (PAGE_SIZE * (1 << order));
         }
@@ -206,6 +563,7 @@ void kalloc_init_memory_region(size_t mem_start, size_t mem_end)
             // pool so counter the decrement in free_pages() by incrementing
             // here
             atomic_fetch_add(&g_kernel_memory.pages_allocated, 1);
+            g_kernel_memory.pages_total += 1;
             free_pages((void *)addr, 0);
             addr += PAGE_SIZE;
         }
@@ -218,10 +576,9 @@ void kalloc_init_memory(struct Memory_Map *memory_map, enum MM_Region_Type type)
     g_kernel_memory.end_of_physical_memory =
         (char *)memory_map->ram.start_pa + memory_map->ram.size;
 
-    struct list_head *pos;
-    list_for_each(pos, &memory_map->region_list)
+    for (size_t i = 0; i < memory_map->region_count; ++i)
     {
-        struct MM_Region *region = region_from_list(pos);
+        struct MM_Region *region = &memory_map->regions[i];
         if (region->type == type)
         {
             size_t region_start = region->start_va;
@@ -230,20 +587,81 @@ void kalloc_init_memory(struct Memory_Map *memory_map, enum MM_Region_Type type)
             kalloc_init_memory_region(region_start, region_end);
         }
     }
+
+    // page descriptors for all of RAM
+    size_t pages_size = (memory_map->ram.size / PAGE_SIZE) * sizeof(struct page);
+    size_t order = 0;
+    while ((PAGE_SIZE << order) < pages_size) order++;
+    struct page *pages = alloc_pages(ALLOC_FLAG_ZERO_MEMORY, order);
+    if (pages == NULL)
+    {
+        panic("kalloc_init_memory: no memory for page descriptors");
+    }
+
+    // pages allocated so far belong to the kernel and don't get shared, only
+    // the free blocks need to be marked
+    spin_lock(&g_kernel_memory.lock);
+    g_kernel_memory.pages = pages;
+    for (size_t i = 0; i <= PAGE_ALLOC_MAX_ORDER; ++i)
+    {
+        struct list_head *block;
+        list_for_each(block, &g_kernel_memory.list_of_free_memory[i])
+        {
+            struct page *page = page_from_kva(block);
+            page->order = i;
+            page->flags |= PAGE_FLAG_FREE;
+        }
+    }
+    spin_unlock(&g_kernel_memory.lock);
 }
 
 void kalloc_init_caches()
 {
-    // caches for power of 2 sizes up to 1024 bytes
+    char name[KMEM_CACHE_MAX_NAME_LEN];
+
+    // caches for power of 2 sizes up to PAGE_SIZE/2 plus an extra cache for
+    // 1280 byte objects (useful for buffer IO caches), kmalloc() needs them
+    // ordered by size
+    size_t extra_size = 1280;
+    size_t index = 0;
     for (size_t i = 0; i < OBJECT_CACHES_POT; ++i)
     {
         size_t size = (1 << i) * MIN_SLAB_SIZE;
+        if (size > extra_size && index == i)
+        {
+            kmem_cache_init(&g_kernel_memory.object_cache[index++],
+                            "kmalloc_1280", extra_size, 0, NULL);
+        }
 
-        kmem_cache_init(&g_kernel_memory.object_cache[i], size);
+        snprintf(name, sizeof(name), "kmalloc_%zd", size);
+        kmem_cache_init(&g_kernel_memory.object_cache[index++], name, size, 0,
+                        NULL);
     }
+}
 
-    // extra cache for 1280 byte objects (useful for buffer IO caches)
-    kmem_cache_init(&g_kernel_memory.object_cache[OBJECT_CACHES - 1], 1280);
+size_t kalloc_shrink_caches()
+{
+    size_t freed = 0;
+    spin_lock(&g_kernel_memory.cache_list_lock);
+    struct list_head *pos;
+    list_for_each(pos, &g_kernel_memory.cache_list)
+    {
+        freed +=
+            kmem_cache_shrink(container_of(pos, struct kmem_cache, cache_list));
+    }
+    spin_unlock(&g_kernel_memory.cache_list_lock);
+    return freed;
+}
+
+void kalloc_register_cache(struct kmem_cache *cache)
+{
+    spin_lock(&g_kernel_memory.cache_list_lock);
+    list_add_tail(&cache->cache_list, &g_kernel_memory.cache_list);
+    spin_unlock(&g_kernel_memory.cache_list_lock);
+
+    // no check on success, as kobject_add claims to fail before it can use
+    // kmalloc() -> which is what is prepared here...
+    kobject_add(&cache->kobj, &g_kernel_memory.kobj, "%s", cache->name);
 }
 
 void kalloc_init(struct MM_Region *region)
@@ -254,12 +672,30 @@ void kalloc_init(struct MM_Region *region)
     g_kernel_memory.memory_map = NULL;
 
     spin_lock_init(&g_kernel_memory.lock, "kmem");
+    spin_lock_init(&g_kernel_memory.cache_list_lock, "kmem_cache_list");
+    list_init(&g_kernel_memory.cache_list);
+    spin_lock_init(&g_kernel_memory.shrinker_lock, "kmem_shrinker");
+    list_init(&g_kernel_memory.shrinker_list);
+    g_kernel_memory.shrink_low = SHRINK_LOW_PAGES;
 
     for (size_t i = 0; i <= PAGE_ALLOC_MAX_ORDER; ++i)
     {
         list_init(&g_kernel_memory.list_of_free_memory[i]);
     }
 
+    for (size_t i = 0; i < MAX_CPUS; ++i)
+    {
+        spin_lock_init(&g_kernel_memory.cpu_cache[i].lock, "kmem_cpu");
+        list_init(&g_kernel_memory.cpu_cache[i].list);
+        g_kernel_memory.cpu_cache[i].count = 0;
+    }
+    g_kernel_memory.cpu_cache_low = CPU_PAGE_CACHE_LOW;
+    g_kernel_memory.cpu_cache_high = CPU_PAGE_CACHE_HIGH;
+
+    spin_lock_init(&g_kernel_memory.zero_pool.lock, "kmem_zero_pool");
+    list_init(&g_kernel_memory.zero_pool.list);
+    g_kernel_memory.zero_pool.target = ZERO_POOL_PAGES;
+
     size_t region_start = region->start_va;
     size_t region_end = region->start_va + region->size;
     kalloc_init_memory_region(region_start, region_end);
@@ -273,11 +709,7 @@ void kalloc_init(struct MM_Region *region)
 
     for (size_t i = 0; i < OBJECT_CACHES; ++i)
     {
-        size_t size = g_kernel_memory.object_cache[i].object_size;
-        // no check on success, as kobject_add claims to fail before it can use
-        // kmalloc() -> which is what is prepared here...
-        kobject_add(&g_kernel_memory.object_cache[i].kobj,
-                    &g_kernel_memory.kobj, "kmalloc_%zd", size);
+        kalloc_register_cache(&g_kernel_memory.object_cache[i]);
     }
 }
 
@@ -291,7 +723,23 @@ void kfree(void *kva)
         panic("kfree: out of range");
     }
 
-    if (((size_t)kva % PAGE_SIZE) == 0)
+    struct page *page = NULL;
+    if (g_kernel_memory.pages != NULL)
+    {
+        page = page_from_kva(kva);
+        if (page->flags & PAGE_FLAG_KMALLOC)
+        {
+            // allocation larger than MAX_SLAB_SIZE
+            size_t order = page->order;
+            page->flags &= ~PAGE_FLAG_KMALLOC;
+            free_pages(kva, order);
+            return;
+        }
+    }
+
+    // objects in slabs of more than one page can be page aligned
+    if ((page == NULL || !(page->flags & PAGE_FLAG_SLAB)) &&
+        ((size_t)kva % PAGE_SIZE) == 0)
     {
         // page aligned
         free_pages(kva, 0);
@@ -332,14 +780,9 @@ void *kmalloc(size_t size, int32_t flags)
 {
     DEBUG_EXTRA_PANIC(g_kernel_init_status >= KERNEL_INIT_KMALLOC_READY,
                       "kfree called before kalloc_init()");
-    if (size > PAGE_SIZE)
-    {
-        printk("kmalloc: requested size %zd too big\n", size);
-        panic("too much memory to allocate for kmalloc()");
-    }
 
     // note: object caches are ordered by size, smallest first
-    // so walk the list from the end to find the smallest fitting cache
+    // so the first fitting cache is the smallest
     for (size_t i = 0; i < OBJECT_CACHES; ++i)
     {
         if (size <= g_kernel_memory.object_cache[i].object_size)
@@ -348,9 +791,31 @@ void *kmalloc(size_t size, int32_t flags)
         }
     }
 
-    // too big for any cache, but still less than a page
-    // -> allocate a full page
-    return alloc_pages(flags, 0);
+    // too big for any cache -> allocate whole pages
+    size_t order = 0;
+    while ((PAGE_SIZE << order) < size)
+    {
+        order++;
+    }
+    if (order > PAGE_ALLOC_MAX_ORDER)
+    {
+        printk("kmalloc: requested size %zd too big\n", size);
+        return NULL;
+    }
+    if (g_kernel_memory.pages == NULL && order > 0)
+    {
+        // kfree() needs the page descriptor to know the order
+        panic("kmalloc: multi page allocation before kalloc_init_memory()");
+    }
+
+    void *kva = alloc_pages(flags, order);
+    if (kva != NULL && g_kernel_memory.pages != NULL)
+    {
+        struct page *page = page_from_kva(kva);
+        page->order = order;
+        page->flags |= PAGE_FLAG_KMALLOC;
+    }
+    return kva;
 }
 
 size_t kalloc_get_allocation_count()
@@ -361,27 +826,22 @@ size_t kalloc_get_allocation_count()
 size_t kalloc_get_memory_allocated()
 {
     // total memory allocated - slab management + slab content
-    spin_lock(&g_kernel_memory.lock);
     size_t allocated =
         atomic_load(&g_kernel_memory.pages_allocated) * PAGE_SIZE;
 
-    for (size_t i = 0; i < OBJECT_CACHES; ++i)
+    spin_lock(&g_kernel_memory.cache_list_lock);
+    struct list_head *pos;
+    list_for_each(pos, &g_kernel_memory.cache_list)
     {
-        size_t object_size = g_kernel_memory.object_cache[i].object_size;
-        size_t object_count = 0;
-        size_t slab_count = 0;
-        struct list_head *slab_head;
-        list_for_each(slab_head, &g_kernel_memory.object_cache[i].slab_list)
-        {
-            struct kmem_slab *slab = kmem_slab_from_list(slab_head);
-            object_count += slab->objects_allocated;
-            slab_count++;
-        }
-        allocated -= slab_count * PAGE_SIZE;      // memory used for slabs
-        allocated += object_count * object_size;  // net memory used in slabs
+        struct kmem_cache *cache =
+            container_of(pos, struct kmem_cache, cache_list);
+        // memory used for slabs
+        allocated -= kmem_cache_get_slab_pages(cache) * PAGE_SIZE;
+        // net memory used in slabs, free objects in the magazines don't count
+        allocated += kmem_cache_get_object_count(cache) * cache->object_size;
     }
+    spin_unlock(&g_kernel_memory.cache_list_lock);
 
-    spin_unlock(&g_kernel_memory.lock);
     return allocated;
 }
 
@@ -406,7 +866,99 @@ size_t kalloc_get_free_memory()
 
     spin_unlock(&g_kernel_memory.lock);
 
-    return pages * PAGE_SIZE;
+    return (pages + kalloc_get_cpu_cache_pages() +
+            g_kernel_memory.zero_pool.count) *
+           PAGE_SIZE;
+}
+
+size_t kalloc_get_free_pages()
+{
+    // only a snapshot, pages_allocated changes without the global lock
+    size_t allocated = atomic_load(&g_kernel_memory.pages_allocated);
+    if (allocated > g_kernel_memory.pages_total) return 0;
+    return g_kernel_memory.pages_total - allocated;
+}
+
+size_t kalloc_get_cpu_cache_pages()
+{
+    // only a snapshot, the caches change without the global lock
+    size_t pages = 0;
+    for (size_t i = 0; i < MAX_CPUS; ++i)
+    {
+        pages += g_kernel_memory.cpu_cache[i].count;
+    }
+    return pages;
+}
+
+syserr_t kalloc_set_cpu_cache_watermarks(size_t low, size_t high)
+{
+    if ((low > high) || (high > CPU_PAGE_CACHE_MAX))
+    {
+        return -EINVAL;
+    }
+
+    g_kernel_memory.cpu_cache_low = low;
+    g_kernel_memory.cpu_cache_high = high;
+
+    // start with empty caches instead of draining on the next free of each CPU
+    kalloc_drain_cpu_caches();
+    return 0;
+}
+
+syserr_t kalloc_set_zero_pool_target(size_t target)
+{
+    if (target > ZERO_POOL_MAX)
+    {
+        return -EINVAL;
+    }
+
+    g_kernel_memory.zero_pool.target = target;
+    kalloc_drain_zero_pool(target);
+    return 0;
+}
+
+syserr_t kalloc_benchmark(size_t pages)
+{
+    if (pages == 0) return -EINVAL;
+
+    // the allocated pages form a list through their first word
+    uint64_t start = get_time();
+    void *list = NULL;
+    size_t allocated = 0;
+    for (; allocated < pages; ++allocated)
+    {
+        void **page = alloc_page(ALLOC_FLAG_NONE);
+        if (page == NULL) break;
+        *page = list;
+        list = page;
+    }
+    uint64_t alloc_time = get_time() - start;
+
+    // free every other page first, so the second pass merges buddies
+    start = get_time();
+    for (void **page = list; (page != NULL) && (*page != NULL); page = *page)
+    {
+        void **next = *page;
+        *page = *next;
+        free_page(next);
+    }
+    while (list != NULL)
+    {
+        void **page = list;
+        list = *page;
+        free_page(page);
+    }
+    uint64_t free_time = get_time() - start;
+
+    struct timespec alloc_ts = timer_to_timespec(alloc_time);
+    struct timespec free_ts = timer_to_timespec(free_time);
+    g_kernel_memory.bench_pages = allocated;
+    g_kernel_memory.bench_alloc_ns =
+        alloc_ts.tv_sec * 1000000000ull + alloc_ts.tv_nsec;
+    g_kernel_memory.bench_free_ns =
+        free_ts.tv_sec * 1000000000ull + free_ts.tv_nsec;
+
+    return (allocated == pages) ? 0 : -ENOMEM;
 }
 
 void kalloc_dump_free_memory()
@@ -427,8 +979,11 @@ void kalloc_dump_free_memory()
 
 void kalloc_debug_check_caches()
 {
-    for (size_t i = 0; i < OBJECT_CACHES; ++i)
+    spin_lock(&g_kernel_memory.cache_list_lock);
+    struct list_head *pos;
+    list_for_each(pos, &g_kernel_memory.cache_list)
     {
-        kmem_cache_check(&g_kernel_memory.object_cache[i]);
+        kmem_cache_check(container_of(pos, struct kmem_cache, cache_list));
     }
+    spin_unlock(&g_kernel_memory.cache_list_lock);
 }
@@ -6,6 +6,10 @@
 
 #define ALLOC_FLAG_NONE 0
 #define ALLOC_FLAG_ZERO_MEMORY 1
+/// Don't run the shrinkers or shrink the kmem_caches if out of memory, for
+/// allocations with a lock held which a shrinker takes (e.g. a bio shard
+/// lock).
+#define ALLOC_FLAG_NO_RECLAIM 2
 
 /// @brief Allocate a power of two number of pages
 /// @param flags Returns zeroes memory if ALLOC_FLAG_ZERO_MEMORY is set.
@@ -34,10 +38,35 @@ void free_pages_range(void *kva, size_t page_count);
 /// @param kva Address of page to free
 static inline void free_page(void *kva) { free_pages(kva, 0); }
 
-/// @brief Allocate up to one page of physical memory.
-/// Use alloc_pages() when more is needed.
-/// Returns a pointer that the kernel can use.
-/// @param size Number of bytes to allocate, must be > 0 and <= PAGE_SIZE
+/// @brief Take an additional reference to a page, e.g. when it gets shared
+/// copy-on-write. Every page starts with one reference from alloc_pages().
+/// @param kva Address of the page
+void page_ref_inc(void *kva);
+
+/// @brief Returns the number of references to a page.
+/// @param kva Address of the page
+/// @return Reference count, 1 if the page is not shared.
+size_t page_ref_count(void *kva);
+
+/// @brief Drop one reference to each page in a range. Pages without
+/// references left are freed. Used for pages which might be shared.
+/// @param kva Start address
+/// @param page_count Number of pages
+void put_pages_range(void *kva, size_t page_count);
+
+struct page;
+
+/// @brief Descriptor of a page of RAM. Only valid after kalloc_init_memory().
+/// @param kva Address of the page or of any byte in it.
+/// @return The descriptor.
+struct page *page_from_kva(void *kva);
+
+/// @brief Allocate physical memory. Returns a pointer that the kernel can
+/// use. Sizes up to MAX_SLAB_SIZE come from the object caches, larger sizes
+/// get 2^order whole pages from alloc_pages(). Allocations of more than one
+/// page are only possible after kalloc_init_memory().
+/// @param size Number of bytes to allocate, must be > 0 and <=
+/// PAGE_SIZE << PAGE_ALLOC_MAX_ORDER
 /// @param flags Allocation flags, see ALLOC_FLAG_...
 /// @return NULL if the memory cannot be allocated.
 void *kmalloc(size_t size, int32_t flags);
@@ -58,6 +87,18 @@ void kalloc_init(struct MM_Region *region);
 void kalloc_init_memory(struct Memory_Map *memory_map,
                         enum MM_Region_Type type);
 
+struct kmem_cache;
+
+/// @brief Add a cache to the list of all caches (for the memory statistics)
+/// and to sysfs, see kmem_cache_create().
+/// @param cache An initialized cache.
+void kalloc_register_cache(struct kmem_cache *cache);
+
+/// @brief Shrink all kmem_caches, see kmem_cache_shrink(). Called by
+/// shrink_memory() after the shrinkers.
+/// @return Number of freed pages.
+size_t kalloc_shrink_caches();
+
 /// Returns the number of 4K allocations currently used.
 size_t kalloc_get_allocation_count();
 
@@ -73,6 +114,51 @@ size_t kalloc_get_total_memory();
 /// @brief Returns free memory in bytes
 size_t kalloc_get_free_memory();
 
+/// @brief Returns the number of free pages including the per-CPU page caches.
+/// Cheaper than kalloc_get_free_memory() as it uses the allocation counter.
+size_t kalloc_get_free_pages();
+
+/// @brief Returns the number of free pages in the per-CPU page caches.
+size_t kalloc_get_cpu_cache_pages();
+
+/// @brief Move all pages of the per-CPU page caches back to the buddy
+/// allocator. Can be called from any CPU.
+/// @return Number of pages moved.
+size_t kalloc_drain_cpu_caches();
+
+/// @brief Set the watermarks of the per-CPU page caches, see struct
+/// cpu_page_cache. Drains all caches.
+/// @param low Pages in a cache after a refill or drain.
+/// @param high Max pages in a cache, 0 disables the caches.
+/// @return 0 on success, -EINVAL if low > high or high > CPU_PAGE_CACHE_MAX.
+syserr_t kalloc_set_cpu_cache_watermarks(size_t low, size_t high);
+
+/// @brief Zero free pages and add them to the zero page pool till it holds
+/// zero_pool.target pages. Called by idle CPUs from scheduler().
+/// @param max_pages Max number of pages to zero in this call.
+/// @return True if pages were added, false if the pool is full (or the
+/// system is low on memory).
+bool kalloc_zero_pool_refill(size_t max_pages);
+
+/// @brief Move pages of the zero page pool back to the buddy allocator.
+/// @param keep Number of pages to keep in the pool.
+/// @return Number of pages moved.
+size_t kalloc_drain_zero_pool(size_t keep);
+
+/// @brief Set the number of pages idle CPUs keep zeroed in the pool, drains
+/// pages above the new target.
+/// @param target Pages in the pool, 0 disables the pool.
+/// @return 0 on success, -EINVAL if target > ZERO_POOL_MAX.
+syserr_t kalloc_set_zero_pool_target(size_t target);
+
+/// @brief Measures the page allocator: allocates pages one by one, then
+/// frees every other page and the rest afterwards (so the second half of the
+/// frees merges buddies). The results are stored in g_kernel_memory and shown
+/// in /sys/kmem/bench_alloc.
+/// @param pages Number of pages to allocate.
+/// @return 0 on success, -ENOMEM if fewer pages could be allocated.
+syserr_t kalloc_benchmark(size_t pages);
+
 void kalloc_dump_free_memory();
 
 void kalloc_debug_check_caches();
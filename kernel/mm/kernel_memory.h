@@ -17,12 +17,81 @@
 #define PAGE_ALLOC_MAX_ORDER 9
 
 // Number of Slab Allocator caches to provide allocations from
-// MIN_SLAB_SIZE_ORDER to PAGE_SIZE/4
-#define OBJECT_CACHES_POT ((PAGE_SHIFT - MIN_SLAB_SIZE_ORDER - 1))
+// MIN_SLAB_SIZE_ORDER to PAGE_SIZE/2
+#define OBJECT_CACHES_POT ((PAGE_SHIFT - MIN_SLAB_SIZE_ORDER))
 
 // +1 to include 1280 byte cache (useful for buffer IO caches)
 #define OBJECT_CACHES (OBJECT_CACHES_POT + 1)
 
+/// @brief Descriptor of one page of RAM, see page_from_kva().
+struct page
+{
+    /// References to the page. Pages shared copy-on-write between processes
+    /// or mapped from the page cache have more than one. 0 for free pages
+    /// and for pages allocated during early boot (which are never shared).
+    atomic_uint32_t ref;
+    /// order of the free block if PAGE_FLAG_FREE, of the allocation if
+    /// PAGE_FLAG_KMALLOC
+    uint8_t order;
+    uint8_t flags;  ///< PAGE_FLAG_*
+    struct kmem_slab *slab;  ///< slab containing the page if PAGE_FLAG_SLAB
+};
+
+/// The page is the first page of a free block in list_of_free_memory[order].
+#define PAGE_FLAG_FREE 0x01
+/// The page is free in the cache of a CPU, see struct cpu_page_cache.
+#define PAGE_FLAG_CPU_CACHE 0x02
+/// The page belongs to a slab, see kmem_slab_infer_slab().
+#define PAGE_FLAG_SLAB 0x04
+/// The page is the first page of a kmalloc() allocation larger than
+/// MAX_SLAB_SIZE.
+#define PAGE_FLAG_KMALLOC 0x08
+/// The page is free and zeroed in the zero page pool, see struct
+/// zero_page_pool.
+#define PAGE_FLAG_ZERO_POOL 0x10
+
+/// Default of kernel_memory.cpu_cache_low.
+#define CPU_PAGE_CACHE_LOW 16
+/// Default of kernel_memory.cpu_cache_high.
+#define CPU_PAGE_CACHE_HIGH 48
+/// Max value of kernel_memory.cpu_cache_high.
+#define CPU_PAGE_CACHE_MAX 1024
+
+/// @brief Free order-0 pages of one CPU. Single pages get allocated from and
+/// freed to the cache of the current CPU, so most calls don't need the global
+/// allocator lock. An empty cache gets refilled from the buddy lists with
+/// cpu_cache_low pages, a cache with more than cpu_cache_high pages gets
+/// drained to cpu_cache_low pages.
+struct cpu_page_cache
+{
+    struct spinlock lock;   ///< only contended while draining all caches
+    struct list_head list;  ///< free pages, linked through their first bytes
+    size_t count;           ///< pages in list
+};
+
+/// Default of zero_page_pool.target.
+#define ZERO_POOL_PAGES 128
+/// Max value of zero_page_pool.target.
+#define ZERO_POOL_MAX 4096
+/// Pages an idle CPU zeroes before it checks for runnable processes again.
+#define ZERO_POOL_BATCH 8
+
+/// @brief Free pages which are zeroed already. Idle CPUs fill the pool (see
+/// kalloc_zero_pool_refill()), so alloc_page(ALLOC_FLAG_ZERO_MEMORY) does not
+/// need to zero the page. The pages count as free memory.
+struct zero_page_pool
+{
+    struct spinlock lock;   ///< protects everything below
+    struct list_head list;  ///< linked through the first bytes of the pages,
+                            ///< which get cleared on allocation
+    size_t count;           ///< pages in list
+    size_t target;          ///< idle CPUs fill up to this, 0 disables the pool
+
+    // statistics
+    size_t hits;    ///< zeroed allocations served from the pool
+    size_t misses;  ///< zeroed allocations which found the pool empty
+};
+
 struct kernel_memory
 {
     struct kobject kobj;
@@ -34,8 +103,37 @@ struct kernel_memory
 
     struct kmem_cache object_cache[OBJECT_CACHES];
 
+    /// All caches: object_cache and the ones from kmem_cache_create().
+    struct list_head cache_list;
+    struct spinlock cache_list_lock;  ///< protects cache_list
+
     atomic_size_t pages_allocated;
+    size_t pages_total;  ///< pages added to the allocator, see pages_allocated
     struct Memory_Map *memory_map;
+
+    /// Registered shrinkers, see struct shrinker.
+    struct list_head shrinker_list;
+    struct spinlock shrinker_lock;  ///< protects shrinker_list and the stats
+    size_t shrink_low;  ///< run the shrinkers if fewer pages are free
+    bool shrink_exhausted;  ///< nothing to shrink since below shrink_low
+    size_t shrink_runs;         ///< calls of shrink_memory()
+    size_t shrink_freed_pages;  ///< pages freed by shrink_memory()
+
+    struct cpu_page_cache cpu_cache[MAX_CPUS];
+    size_t cpu_cache_low;   ///< pages after a refill or drain
+    size_t cpu_cache_high;  ///< max pages per CPU, 0 disables the caches
+
+    struct zero_page_pool zero_pool;
+
+    /// One descriptor per page of RAM, indexed by page number relative to the
+    /// start of RAM. Lets the buddy allocator check and remove a free buddy in
+    /// O(1). NULL during early boot.
+    struct page *pages;
+
+    // result of the last kalloc_benchmark()
+    size_t bench_pages;       ///< pages allocated and freed
+    uint64_t bench_alloc_ns;  ///< time for all allocations
+    uint64_t bench_free_ns;   ///< time for all frees
 };
 
 #define kernel_memory_from_kobj(kobj_ptr) \
@@ -62,3 +160,4 @@ static inline bool addr_is_in_ram_kva(size_t kva)
     size_t ram_end = map->ram.start_va + map->ram.size;
     return (kva >= ram_start && kva < ram_end);
 }
+
@@ -3,11 +3,14 @@
 #include <init/start.h>  // __start_bss, __end_bss
 #include <kernel/errno.h>
 #include <kernel/kernel.h>
+#include <fs/sysfs/sysfs_helper.h>
 #include <kernel/kobject.h>
+#include <mm/asid.h>
 #include <mm/cache.h>
 #include <mm/kalloc.h>
 #include <mm/kernel_memory.h>
 #include <mm/kmem_sysfs.h>
+#include <mm/shrinker.h>
 
 // /sys/kmem
 
@@ -26,7 +29,21 @@ enum KM_ATTRIBUTE_INDEX
     KM_INITRD_START,
     KM_INITRD_END,
     KM_DTB_START,
-    KM_DTB_END
+    KM_DTB_END,
+    KM_ASID_MAX,
+    KM_ASID_ROLLOVERS,
+    KM_BENCH_ALLOC,
+    KM_CPU_CACHE_PAGES,
+    KM_CPU_CACHE_LOW,
+    KM_CPU_CACHE_HIGH,
+    KM_SHRINK_LOW,
+    KM_SHRINK_RUNS,
+    KM_SHRINK_FREED,
+    KM_SHRINK_NOW,
+    KM_ZERO_POOL_PAGES,
+    KM_ZERO_POOL_TARGET,
+    KM_ZERO_POOL_HITS,
+    KM_ZERO_POOL_MISSES
 };
 
 struct sysfs_attribute kmem_attributes[] = {
@@ -43,7 +60,21 @@ struct sysfs_attribute kmem_attributes[] = {
     [KM_INITRD_START] = {.name = "initrd_start", .mode = 0444},
     [KM_INITRD_END] = {.name = "initrd_end", .mode = 0444},
     [KM_DTB_START] = {.name = "dtb_start", .mode = 0444},
-    [KM_DTB_END] = {.name = "dtb_end", .mode = 0444}};
+    [KM_DTB_END] = {.name = "dtb_end", .mode = 0444},
+    [KM_ASID_MAX] = {.name = "asid_max", .mode = 0444},
+    [KM_ASID_ROLLOVERS] = {.name = "asid_rollovers", .mode = 0444},
+    [KM_BENCH_ALLOC] = {.name = "bench_alloc", .mode = 0644},
+    [KM_CPU_CACHE_PAGES] = {.name = "cpu_cache_pages", .mode = 0444},
+    [KM_CPU_CACHE_LOW] = {.name = "cpu_cache_low", .mode = 0644},
+    [KM_CPU_CACHE_HIGH] = {.name = "cpu_cache_high", .mode = 0644},
+    [KM_SHRINK_LOW] = {.name = "shrink_low", .mode = 0644},
+    [KM_SHRINK_RUNS] = {.name = "shrink_runs", .mode = 0444},
+    [KM_SHRINK_FREED] = {.name = "shrink_freed", .mode = 0444},
+    [KM_SHRINK_NOW] = {.name = "shrink", .mode = 0600},
+    [KM_ZERO_POOL_PAGES] = {.name = "zero_pool_pages", .mode = 0444},
+    [KM_ZERO_POOL_TARGET] = {.name = "zero_pool_target", .mode = 0644},
+    [KM_ZERO_POOL_HITS] = {.name = "zero_pool_hits", .mode = 0444},
+    [KM_ZERO_POOL_MISSES] = {.name = "zero_pool_misses", .mode = 0444}};
 
 ssize_t km_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx, char *buf,
                           size_t n)
@@ -97,6 +128,49 @@ ssize_t km_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx, char *buf,
         case KM_DTB_END:
             ret = snprintf(buf, n, "%zu\n", (size_t)0);  // map->dtb_file_end);
             break;
+        case KM_ASID_MAX:
+            ret = snprintf(buf, n, "%zu\n", asid_get_max());
+            break;
+        case KM_ASID_ROLLOVERS:
+            ret = snprintf(buf, n, "%zu\n", asid_get_rollover_count());
+            break;
+        case KM_BENCH_ALLOC:
+            // pages, ns to allocate them, ns to free them
+            ret = snprintf(buf, n, "%zu %llu %llu\n", kmem->bench_pages,
+                           (unsigned long long)kmem->bench_alloc_ns,
+                           (unsigned long long)kmem->bench_free_ns);
+            break;
+        case KM_CPU_CACHE_PAGES:
+            ret = snprintf(buf, n, "%zu\n", kalloc_get_cpu_cache_pages());
+            break;
+        case KM_CPU_CACHE_LOW:
+            ret = snprintf(buf, n, "%zu\n", kmem->cpu_cache_low);
+            break;
+        case KM_CPU_CACHE_HIGH:
+            ret = snprintf(buf, n, "%zu\n", kmem->cpu_cache_high);
+            break;
+        case KM_SHRINK_LOW:
+            ret = snprintf(buf, n, "%zu\n", kmem->shrink_low);
+            break;
+        case KM_SHRINK_RUNS:
+            ret = snprintf(buf, n, "%zu\n", kmem->shrink_runs);
+            break;
+        case KM_SHRINK_FREED:
+            ret = snprintf(buf, n, "%zu\n", kmem->shrink_freed_pages);
+            break;
+        case KM_SHRINK_NOW: ret = -EINVAL; break;
+        case KM_ZERO_POOL_PAGES:
+            ret = snprintf(buf, n, "%zu\n", kmem->zero_pool.count);
+            break;
+        case KM_ZERO_POOL_TARGET:
+            ret = snprintf(buf, n, "%zu\n", kmem->zero_pool.target);
+            break;
+        case KM_ZERO_POOL_HITS:
+            ret = snprintf(buf, n, "%zu\n", kmem->zero_pool.hits);
+            break;
+        case KM_ZERO_POOL_MISSES:
+            ret = snprintf(buf, n, "%zu\n", kmem->zero_pool.misses);
+            break;
         default: ret = -ENOENT; break;
     }
 
@@ -112,7 +186,48 @@ ssize_t km_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx, char *buf,
 ssize_t km_sysfs_ops_store(struct kobject *kobj, size_t attribute_idx,
                            const char *buf, size_t n)
 {
-    return -1;
+    struct kernel_memory *kmem = kernel_memory_from_kobj(kobj);
+
+    bool ok;
+    int32_t value = store_param_to_int(buf, n, &ok);
+    if (!ok || value < 0)
+    {
+        return -EINVAL;
+    }
+
+    syserr_t ret = 0;
+    switch (attribute_idx)
+    {
+        case KM_BENCH_ALLOC: ret = kalloc_benchmark((size_t)value); break;
+        case KM_CPU_CACHE_LOW:
+            ret = kalloc_set_cpu_cache_watermarks((size_t)value,
+                                                  kmem->cpu_cache_high);
+            break;
+        case KM_CPU_CACHE_HIGH:
+            ret = kalloc_set_cpu_cache_watermarks(kmem->cpu_cache_low,
+                                                  (size_t)value);
+            break;
+        case KM_SHRINK_LOW:
+            kmem->shrink_low = (size_t)value;
+            kmem->shrink_exhausted = false;
+            break;
+        case KM_SHRINK_NOW:
+            // run the shrinkers to free value pages
+            shrink_memory((size_t)value);
+            break;
+        case KM_ZERO_POOL_TARGET:
+            ret = kalloc_set_zero_pool_target((size_t)value);
+            break;
+        default: ret = -EINVAL; break;
+    }
+
+    if (ret == 0)
+    {
+        // no error, signal all bytes have been written
+        return n;
+    }
+
+    return ret;
 }
 
 struct sysfs_ops kmem_sysfs_ops = {
@@ -133,19 +248,40 @@ enum KMEM_CACHE_ATTRIBUTE_INDEX
     KM_SLAB_COUNT = 0,
     KM_OBJ_SIZE,
     KM_OBJ_COUNT,
-    KM_OBJ_MAX
+    KM_OBJ_MAX,
+    KM_MAG_OBJECTS,
+    KM_MAG_HITS,
+    KM_MAG_MISSES,
+    KM_MAG_REFILLS,
+    KM_MAG_FLUSHES,
+    KM_MAG_DRAIN,
+    KM_EMPTY_SLABS,
+    KM_MAX_EMPTY,
+    KM_SHRINK,
+    KM_SLAB_ORDER
 };
 
 struct sysfs_attribute kmem_cache_attributes[] = {
     [KM_SLAB_COUNT] = {.name = "slab_count", .mode = 0444},
     [KM_OBJ_SIZE] = {.name = "obj_size", .mode = 0444},
     [KM_OBJ_COUNT] = {.name = "obj_count", .mode = 0444},
-    [KM_OBJ_MAX] = {.name = "obj_max", .mode = 0444}};
+    [KM_OBJ_MAX] = {.name = "obj_max", .mode = 0444},
+    [KM_MAG_OBJECTS] = {.name = "mag_objects", .mode = 0444},
+    [KM_MAG_HITS] = {.name = "mag_hits", .mode = 0444},
+    [KM_MAG_MISSES] = {.name = "mag_misses", .mode = 0444},
+    [KM_MAG_REFILLS] = {.name = "mag_refills", .mode = 0444},
+    [KM_MAG_FLUSHES] = {.name = "mag_flushes", .mode = 0444},
+    [KM_MAG_DRAIN] = {.name = "mag_drain", .mode = 0600},
+    [KM_EMPTY_SLABS] = {.name = "empty_slabs", .mode = 0444},
+    [KM_MAX_EMPTY] = {.name = "max_empty", .mode = 0644},
+    [KM_SHRINK] = {.name = "shrink", .mode = 0600},
+    [KM_SLAB_ORDER] = {.name = "slab_order", .mode = 0444}};
 
 syserr_t kmem_cache_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx,
                                    char *buf, size_t n)
 {
     struct kmem_cache *cache = kmem_cache_from_kobj(kobj);
+    struct kmem_magazine_stats stats = kmem_cache_get_magazine_stats(cache);
 
     syserr_t ret = 0;
     switch (attribute_idx)
@@ -162,6 +298,31 @@ syserr_t kmem_cache_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx,
         case KM_OBJ_MAX:
             ret = snprintf(buf, n, "%zu\n", kmem_cache_get_max_objects(cache));
             break;
+        case KM_MAG_OBJECTS:
+            ret = snprintf(buf, n, "%zu\n", stats.objects);
+            break;
+        case KM_MAG_HITS: ret = snprintf(buf, n, "%zu\n", stats.hits); break;
+        case KM_MAG_MISSES:
+            ret = snprintf(buf, n, "%zu\n", stats.misses);
+            break;
+        case KM_MAG_REFILLS:
+            ret = snprintf(buf, n, "%zu\n", stats.refills);
+            break;
+        case KM_MAG_FLUSHES:
+            ret = snprintf(buf, n, "%zu\n", stats.flushes);
+            break;
+        case KM_MAG_DRAIN: ret = -EINVAL; break;
+        case KM_EMPTY_SLABS:
+            ret = snprintf(buf, n, "%zu\n",
+                           kmem_cache_get_empty_slab_count(cache));
+            break;
+        case KM_MAX_EMPTY:
+            ret = snprintf(buf, n, "%zu\n", cache->max_empty);
+            break;
+        case KM_SHRINK: ret = -EINVAL; break;
+        case KM_SLAB_ORDER:
+            ret = snprintf(buf, n, "%zu\n", cache->slab_order);
+            break;
         default: ret = -ENOENT; break;
     }
 
@@ -177,7 +338,50 @@ syserr_t kmem_cache_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx,
 syserr_t kmem_cache_sysfs_ops_store(struct kobject *kobj, size_t attribute_idx,
                                     const char *buf, size_t n)
 {
-    return -EINVAL;
+    struct kmem_cache *cache = kmem_cache_from_kobj(kobj);
+
+    bool ok;
+    int32_t value = store_param_to_int(buf, n, &ok);
+    if (!ok)
+    {
+        return -EINVAL;
+    }
+
+    syserr_t ret = 0;
+    switch (attribute_idx)
+    {
+        case KM_MAG_DRAIN:
+            // moves the free objects of all CPUs back to the slabs
+            if (value != 0)
+            {
+                kmem_cache_drain_magazines(cache);
+            }
+            break;
+        case KM_MAX_EMPTY:
+            if (value < 0)
+            {
+                ret = -EINVAL;
+                break;
+            }
+            kmem_cache_set_max_empty_slabs(cache, (size_t)value);
+            break;
+        case KM_SHRINK:
+            // frees the empty slabs and the objects in the magazines
+            if (value != 0)
+            {
+                kmem_cache_shrink(cache);
+            }
+            break;
+        default: ret = -EINVAL; break;
+    }
+
+    if (ret == 0)
+    {
+        // no error, signal all bytes have been written
+        return n;
+    }
+
+    return ret;
 }
 
 struct sysfs_ops kmem_cache_sysfs_ops = {
@@ -4,9 +4,11 @@
 #include <drivers/devices_list.h>
 #include <init/early_pgtable.h>
 #include <init/start.h>
+#include <kernel/errno.h>
 #include <kernel/pgtable.h>
 #include <kernel/string.h>
 #include <lib/minmax.h>
+#include <mm/cache.h>
 #include <mm/kalloc.h>
 #include <mm/memlayout.h>
 #include <mm/memory_map.h>
@@ -97,6 +99,9 @@ struct MM_Region_Attributes g_region_attributes[] = {
                                    .free_pages = false,
                                    .copy_on_fork = false}};
 
+/// Initial number of regions of a memory map, enough for most processes.
+#define MEMORY_MAP_MIN_CAPACITY 8
+
 void mm_region_init(struct MM_Region *region, size_t start_pa, size_t start_va,
                     size_t size, enum MM_Region_Type type)
 {
@@ -109,28 +114,23 @@ void mm_region_init(struct MM_Region *region, size_t start_pa, size_t start_va,
             ? MM_REGION_NEVER_MAP
             : MM_REGION_MARKED_FOR_MAPPING;
     region->free_on_unmap = g_region_attributes[type].free_pages;
+    region->anonymous = false;
 
     DEBUG_EXTRA_PANIC(region->start_pa % PAGE_SIZE == 0, "unaligned region");
     DEBUG_EXTRA_PANIC(region->start_va % PAGE_SIZE == 0, "unaligned region");
     DEBUG_EXTRA_PANIC(region->size % PAGE_SIZE == 0, "unaligned size");
-
-    list_init(&region->list);
 }
 
-struct MM_Region *mm_region_alloc_init(size_t start_pa, size_t start_va,
-                                       size_t size, enum MM_Region_Type type)
+// last address of the region, start_va + size can overflow at the top of the
+// address space
+static inline size_t mm_region_last_va(const struct MM_Region *region)
 {
-    struct MM_Region *region =
-        kmalloc(sizeof(struct MM_Region), ALLOC_FLAG_NONE);
-    if (region == NULL)
-    {
-        return NULL;
-    }
-    mm_region_init(region, start_pa, start_va, size, type);
-    return region;
+    return region->start_va + region->size - 1;
 }
 
-bool mm_regions_can_be_merged(struct MM_Region *a, struct MM_Region *b)
+// true if b directly follows a and both can be one region
+static bool mm_regions_can_be_merged(const struct MM_Region *a,
+                                     const struct MM_Region *b)
 {
     if (a->type != b->type) return false;
 
@@ -138,45 +138,135 @@ bool mm_regions_can_be_merged(struct MM_Region *a, struct MM_Region *b)
     if (a->type == MM_REGION_MMIO) return false;
 
     if (a->mapped != b->mapped) return false;
+    if (a->free_on_unmap != b->free_on_unmap) return false;
+    if (a->anonymous != b->anonymous) return false;
+
+    if (mm_region_last_va(a) + 1 != b->start_va) return false;
+
+    // the PTEs know the pages of anonymous regions
+    return a->anonymous || (a->start_pa + a->size == b->start_pa);
+}
+
+// Arrays of MEMORY_MAP_MIN_CAPACITY regions (enough for most processes) come
+// from their own cache, larger ones from kmalloc() up to a page and from
+// alloc_pages() above.
+static struct kmem_cache *g_mm_regions_cache = NULL;
+
+void memory_map_init_cache()
+{
+    g_mm_regions_cache = kmem_cache_create(
+        "mm_regions", MEMORY_MAP_MIN_CAPACITY * sizeof(struct MM_Region), 0,
+        NULL);
+    if (g_mm_regions_cache == NULL)
+    {
+        panic("memory_map_init_cache: out of memory");
+    }
+}
+
+static size_t memory_map_array_order(size_t capacity)
+{
+    size_t bytes = capacity * sizeof(struct MM_Region);
+    size_t order = 0;
+    while ((PAGE_SIZE << order) < bytes) order++;
+    return order;
+}
+
+static struct MM_Region *memory_map_alloc_array(size_t capacity)
+{
+    if (capacity == MEMORY_MAP_MIN_CAPACITY)
+    {
+        return kmem_cache_alloc(g_mm_regions_cache, ALLOC_FLAG_NONE);
+    }
+    if (capacity * sizeof(struct MM_Region) <= PAGE_SIZE)
+    {
+        return kmalloc(capacity * sizeof(struct MM_Region), ALLOC_FLAG_NONE);
+    }
+    return alloc_pages(ALLOC_FLAG_NONE, memory_map_array_order(capacity));
+}
+
+static void memory_map_free_array(struct MM_Region *regions, size_t capacity)
+{
+    if (regions == NULL) return;
+
+    if (capacity == MEMORY_MAP_MIN_CAPACITY)
+    {
+        kmem_cache_free(g_mm_regions_cache, regions);
+    }
+    else if (capacity * sizeof(struct MM_Region) <= PAGE_SIZE)
+    {
+        kfree(regions);
+    }
+    else
+    {
+        free_pages(regions, memory_map_array_order(capacity));
+    }
+}
+
+syserr_t memory_map_reserve(struct Memory_Map *map, size_t count)
+{
+    size_t needed = map->region_count + count;
+    if (needed <= map->region_capacity) return 0;
+
+    size_t capacity = max(map->region_capacity * 2, MEMORY_MAP_MIN_CAPACITY);
+    while (capacity < needed) capacity *= 2;
+
+    struct MM_Region *regions = memory_map_alloc_array(capacity);
+    if (regions == NULL)
+    {
+        return -ENOMEM;
+    }
+    if (map->region_count > 0)
+    {
+        memcpy(regions, map->regions,
+               map->region_count * sizeof(struct MM_Region));
+    }
+    memory_map_free_array(map->regions, map->region_capacity);
 
-    bool a_before_b_va = (a->start_va + a->size == b->start_va);
-    bool b_before_a_va = (b->start_va + b->size == a->start_va);
-    bool a_before_b_pa = (a->start_pa + a->size == b->start_pa);
-    bool b_before_a_pa = (b->start_pa + b->size == a->start_pa);
+    map->regions = regions;
+    map->region_capacity = capacity;
+    return 0;
+}
 
-    bool regions_touch =
-        ((a_before_b_va && a_before_b_pa) || (b_before_a_va && b_before_a_pa));
-    return regions_touch;
+// space must be reserved
+static void memory_map_insert_at(struct Memory_Map *map, size_t index,
+                                 const struct MM_Region *region)
+{
+    DEBUG_EXTRA_PANIC(map->region_count < map->region_capacity,
+                      "memory_map_insert_at: no space reserved");
+
+    memmove(&map->regions[index + 1], &map->regions[index],
+            (map->region_count - index) * sizeof(struct MM_Region));
+    map->regions[index] = *region;
+    map->region_count++;
 }
 
-// true if a fits before b in virtual address space, and they don't overlap
-static inline bool mm_region_fits_before(struct MM_Region *a,
-                                         struct MM_Region *b)
+static void memory_map_remove_at(struct Memory_Map *map, size_t index)
 {
-    size_t a_end_va = a->start_va + a->size - 1;
-    return (a_end_va < b->start_va);
+    map->region_count--;
+    memmove(&map->regions[index], &map->regions[index + 1],
+            (map->region_count - index) * sizeof(struct MM_Region));
 }
 
-static inline void mm_regions_merge(struct MM_Region *a, struct MM_Region *b)
+// the pages of anonymous regions get freed by the page table
+static void mm_region_put_pages(struct MM_Region *region, size_t start_va,
+                                size_t size)
 {
-    size_t merged_start_va = min(a->start_va, b->start_va);
-    size_t merged_start_pa = min(a->start_pa, b->start_pa);
-    size_t merged_end_va = max(a->start_va + a->size, b->start_va + b->size);
-    a->start_va = merged_start_va;
-    a->start_pa = merged_start_pa;
-    a->size = merged_end_va - merged_start_va;
-
-    kfree(b);
+    if (!region->free_on_unmap || region->anonymous) return;
+
+    // pages might be shared copy-on-write with other processes
+    size_t pa = region->start_pa + (start_va - region->start_va);
+    put_pages_range((void *)phys_to_virt(pa), size / PAGE_SIZE);
 }
 
 void memory_map_free(struct Memory_Map *map)
 {
-    struct list_head *pos, *tmp;
-    list_for_each_safe(pos, tmp, &map->region_list)
+    for (size_t i = 0; i < map->region_count; ++i)
     {
-        struct MM_Region *region = region_from_list(pos);
-        mm_region_remove(region);
+        struct MM_Region *region = &map->regions[i];
+        mm_region_put_pages(region, region->start_va, region->size);
     }
+    memory_map_free_array(map->regions, map->region_capacity);
+    memory_map_init(map);
 }
 
 void memory_map_set_ram(struct Memory_Map *map, size_t start_pa,
@@ -206,40 +296,27 @@ void memory_map_copy_from_early_memory_map(struct Memory_Map *map,
     }
 }
 
-void memory_map_add_single_region(struct Memory_Map *map,
-                                  struct MM_Region *new_region)
+size_t memory_map_find_index(struct Memory_Map *map, size_t va)
 {
-    DEBUG_ASSERT_CPU_HOLDS_LOCK(map->parent_lock);
-    DEBUG_EXTRA_PANIC(new_region->start_pa % PAGE_SIZE == 0,
-                      "unaligned region");
-    DEBUG_EXTRA_PANIC(new_region->start_va % PAGE_SIZE == 0,
-                      "unaligned region");
-    DEBUG_EXTRA_PANIC(new_region->size % PAGE_SIZE == 0, "unaligned size");
-
-    struct list_head *pos;
-    list_for_each(pos, &map->region_list)
+    size_t low = 0;
+    size_t high = map->region_count;
+    while (low < high)
     {
-        struct MM_Region *region = region_from_list(pos);
-
-        if (mm_regions_can_be_merged(region, new_region))
+        size_t mid = low + (high - low) / 2;
+        if (mm_region_last_va(&map->regions[mid]) < va)
         {
-            // merge regions by resizing old region to include new region and
-            // deleting new region
-            mm_regions_merge(region, new_region);
-            return;
+            low = mid + 1;
         }
-        // new region fits before region -> add before
-        if (mm_region_fits_before(new_region, region))
+        else
         {
-            list_add(&new_region->list, pos->prev);
-            return;
+            high = mid;
         }
     }
-    list_add_tail(&new_region->list, &map->region_list);
+    return low;
 }
 
-void memory_map_add_single_region_and_split(struct Memory_Map *map,
-                                            struct MM_Region *new_region)
+syserr_t memory_map_add_region(struct Memory_Map *map,
+                               const struct MM_Region *new_region)
 {
     DEBUG_ASSERT_CPU_HOLDS_LOCK(map->parent_lock);
     DEBUG_EXTRA_PANIC(new_region->start_pa % PAGE_SIZE == 0,
@@ -248,90 +325,107 @@ void memory_map_add_single_region_and_split(struct Memory_Map *map,
                       "unaligned region");
     DEBUG_EXTRA_PANIC(new_region->size % PAGE_SIZE == 0, "unaligned size");
 
-    struct list_head *pos;
-    list_for_each(pos, &map->region_list)
+    if (memory_map_reserve(map, 1) < 0)
     {
-        struct MM_Region *region = region_from_list(pos);
+        return -ENOMEM;
+    }
+
+    size_t index = memory_map_find_index(map, new_region->start_va);
+    DEBUG_EXTRA_PANIC((index == map->region_count) ||
+                          (map->regions[index].start_va >
+                           mm_region_last_va(new_region)),
+                      "memory_map_add_region: overlapping regions");
+
+    struct MM_Region *prev = (index > 0) ? &map->regions[index - 1] : NULL;
+    struct MM_Region *next =
+        (index < map->region_count) ? &map->regions[index] : NULL;
+    bool merge_prev = (prev != NULL) && mm_regions_can_be_merged(prev, new_region);
+    bool merge_next = (next != NULL) && mm_regions_can_be_merged(new_region, next);
+
+    if (merge_prev && merge_next)
+    {
+        // new region closes the gap between two regions
+        prev->size += new_region->size + next->size;
+        memory_map_remove_at(map, index);
+    }
+    else if (merge_prev)
+    {
+        prev->size += new_region->size;
+    }
+    else if (merge_next)
+    {
+        next->start_va = new_region->start_va;
+        next->start_pa = new_region->start_pa;
+        next->size += new_region->size;
+    }
+    else
+    {
+        memory_map_insert_at(map, index, new_region);
+    }
+    return 0;
+}
+
+// remove all regions in the range, optionally put the pages
+static void memory_map_cut(struct Memory_Map *map, size_t start_va,
+                           size_t size, bool put_pages)
+{
+    if (size == 0) return;
 
-        size_t new_region_end = new_region->start_va + new_region->size - 1;
-        size_t region_end = region->start_va + region->size - 1;
+    size_t last_va = start_va + size - 1;
+    size_t index = memory_map_find_index(map, start_va);
+    while (index < map->region_count)
+    {
+        struct MM_Region *region = &map->regions[index];
+        if (region->start_va > last_va) break;
 
-        if (mm_regions_can_be_merged(region, new_region))
+        size_t region_last_va = mm_region_last_va(region);
+        size_t from = max(region->start_va, start_va);
+        size_t to_last = min(region_last_va, last_va);
+        if (put_pages)
         {
-            // merge regions by resizing old region to include new region and
-            // deleting new region
-            mm_regions_merge(region, new_region);
-            return;
+            mm_region_put_pages(region, from, to_last - from + 1);
         }
 
-        // new region replaces old one
-        if ((new_region->start_va == region->start_va) &&
-            (new_region->size == region->size))
+        if ((from == region->start_va) && (to_last == region_last_va))
         {
-            list_add(&new_region->list, pos->prev);
-            list_del(&region->list);
-            kfree(region);
-            return;
+            // fits completely in range
+            memory_map_remove_at(map, index);
+            continue;
         }
 
-        // new region fits before region -> add before
-        if (mm_region_fits_before(new_region, region))
+        if (from == region->start_va)
         {
-            list_add(&new_region->list, pos->prev);
-            return;
+            // overlaps with the start of the region -> resize
+            size_t offset = to_last + 1 - region->start_va;
+            region->start_va += offset;
+            if (!region->anonymous) region->start_pa += offset;
+            region->size -= offset;
         }
-
-        // new region fits inside of region, starts at region start -> add new
-        // and resize old region
-        if ((new_region->start_va == region->start_va) &&
-            (new_region_end < region_end))
+        else if (to_last == region_last_va)
         {
-            list_add(&new_region->list, pos->prev);
-            // resize old region:
-            region->start_va = new_region_end + 1;
-            region->start_pa += new_region->size;
-            region->size -= new_region->size;
-            return;
+            // overlaps with the end of the region -> resize
+            region->size = from - region->start_va;
         }
-
-        // new region fits inside of region -> add new and split old region
-        if ((new_region->start_va > region->start_va) &&
-            (new_region_end < region_end))
+        else
         {
-            // inserted behind region:
-            struct MM_Region *split_region =
-                kmalloc(sizeof(struct MM_Region), ALLOC_FLAG_NONE);
-            if (split_region == NULL)
+            // range is inside of the region -> split
+            struct MM_Region tail = *region;
+            size_t offset = to_last + 1 - region->start_va;
+            tail.start_va += offset;
+            if (!tail.anonymous) tail.start_pa += offset;
+            tail.size -= offset;
+            region->size = from - region->start_va;
+
+            // might move the array, region is invalid afterwards
+            if (memory_map_reserve(map, 1) < 0)
             {
-                panic("memory_map_add_single_region_and_split: out of memory");
+                panic("memory_map_remove_regions: out of memory");
             }
-            *split_region = *region;  // copy old region to split region
-
-            // resize old region:
-            region->size = new_region->start_va - region->start_va;
-            DEBUG_EXTRA_PANIC(region->size % PAGE_SIZE == 0, "unaligned size");
-
-            // add new region:
-            list_add(&new_region->list, pos);
-
-            // prepare split region:
-            size_t offset = (new_region->size + region->size);
-            split_region->start_va += offset;
-            split_region->start_pa += offset;
-            split_region->size -= offset;
-            // add split region:
-            if (split_region->size > 0)
-            {
-                list_add(&split_region->list, &new_region->list);
-            }
-            else
-            {
-                kfree(split_region);
-            }
-            return;
+            memory_map_insert_at(map, index + 1, &tail);
+            index++;
         }
+        index++;
     }
-    list_add_tail(&new_region->list, &map->region_list);
 }
 
 void memory_map_add_region_and_split(struct Memory_Map *map, size_t start_pa,
@@ -344,14 +438,15 @@ void memory_map_add_region_and_split(struct Memory_Map *map, size_t start_pa,
         return;
     }
 
-    struct MM_Region *region =
-        mm_region_alloc_init(start_pa, start_va, size, type);
-    if (region == NULL)
+    struct MM_Region region;
+    mm_region_init(&region, start_pa, start_va, size, type);
+
+    // new region replaces the parts of existing regions it overlaps with
+    memory_map_cut(map, start_va, size, false);
+    if (memory_map_add_region(map, &region) < 0)
     {
         panic("memory_map_add_region_and_split: out of memory");
     }
-
-    memory_map_add_single_region_and_split(map, region);
 }
 
 void memory_map_add_device_mmio(struct Memory_Map *map,
@@ -380,62 +475,28 @@ void memory_map_add_device_mmio(struct Memory_Map *map,
                 dev->init_parameters.mem[i].start_va =
                     dev->init_parameters.mem[i].start_pa + offset;
 
-                struct MM_Region *region =
-                    mm_region_alloc_init(map_start_pa, map_start_pa + offset,
-                                         map_size, MM_REGION_MMIO);
-                if (region == NULL)
+                struct MM_Region region;
+                mm_region_init(&region, map_start_pa, map_start_pa + offset,
+                               map_size, MM_REGION_MMIO);
+                if (memory_map_add_region(map, &region) < 0)
                 {
                     panic("memory_map_add_device_mmio: out of memory");
                 }
-
-                memory_map_add_single_region(map, region);
             }
         }
     }
 }
 
-void mm_region_remove(struct MM_Region *region)
+struct MM_Region *memory_map_get_region(struct Memory_Map *map, size_t va)
 {
-    if (region->free_on_unmap)
-    {
-        free_pages_range((void *)phys_to_virt(region->start_pa),
-                         region->size / PAGE_SIZE);
-    }
-    list_del(&region->list);
-    kfree(region);
-}
-
-void mm_region_resize(struct MM_Region *region, size_t new_start_va,
-                      size_t new_size)
-{
-    if (new_size == 0)
-    {
-        mm_region_remove(region);
-        return;
-    }
-
-    ssize_t start_offset = new_start_va - region->start_va;
-    ssize_t end_offset =
-        (new_start_va + new_size) - (region->start_va + region->size);
+    DEBUG_ASSERT_CPU_HOLDS_LOCK(map->parent_lock);
 
-    if (region->free_on_unmap)
+    size_t index = memory_map_find_index(map, va);
+    if ((index < map->region_count) && (map->regions[index].start_va <= va))
     {
-        if (start_offset > 0)
-        {
-            free_pages_range((void *)phys_to_virt(region->start_pa),
-                             start_offset / PAGE_SIZE);
-        }
-        if (end_offset < 0)
-        {
-            free_pages_range((void *)phys_to_virt(region->start_pa +
-                                                  region->size + end_offset),
-                             -end_offset / PAGE_SIZE);
-        }
+        return &map->regions[index];
     }
-
-    region->start_va = new_start_va;
-    region->start_pa += start_offset;
-    region->size = new_size;
+    return NULL;
 }
 
 void memory_map_remove_regions(struct Memory_Map *map, size_t start_va,
@@ -445,43 +506,7 @@ void memory_map_remove_regions(struct Memory_Map *map, size_t start_va,
     DEBUG_EXTRA_PANIC(start_va % PAGE_SIZE == 0, "unaligned start_va");
     DEBUG_EXTRA_PANIC(size % PAGE_SIZE == 0, "unaligned size");
 
-    size_t end_va = start_va + size - 1;
-    struct list_head *pos, *tmp;
-    list_for_each_safe(pos, tmp, &map->region_list)
-    {
-        struct MM_Region *region = region_from_list(pos);
-        size_t region_end_va = region->start_va + region->size - 1;
-
-        // fits completely in delete range
-        if ((region->start_va >= start_va) && (region_end_va <= end_va))
-        {
-            mm_region_remove(region);
-        }
-        // overlaps with delete range, but starts before delete range -> resize
-        else if ((region->start_va < start_va) && (region_end_va > start_va) &&
-                 (region_end_va <= end_va))
-        {
-            mm_region_resize(region, region->start_va,
-                             start_va - region->start_va);
-        }
-        // overlaps with delete range, but ends after delete range -> resize
-        else if ((region->start_va >= start_va) &&
-                 (region->start_va < end_va) && (region_end_va >= end_va))
-        {
-            size_t offset = end_va - region->start_va + 1;
-            mm_region_resize(region, region->start_va + offset,
-                             region->size - offset);
-        }
-        // overlaps with delete range, but starts before and ends after delete
-        // range -> split
-        // we can assume this wont happen
-        else if ((region->start_va < start_va) && (region_end_va > end_va))
-        {
-            panic(
-                "memory_map_remove_regions: cannot handle splitting a region, "
-                "not implemented");
-        }
-    }
+    memory_map_cut(map, start_va, size, true);
 }
 
 void debug_print_mm_region(struct MM_Region *region)
@@ -503,6 +528,7 @@ void debug_print_mm_region(struct MM_Region *region)
             printk(", marked for unmapping");
             break;
     }
+    if (region->anonymous) printk(", anonymous");
     printk("\n");
 }
 
@@ -520,10 +546,8 @@ void debug_print_memory_map(struct Memory_Map *map)
         debug_print_mm_region(&map->kernel);
     }
 
-    struct list_head *pos;
-    list_for_each(pos, &map->region_list)
+    for (size_t i = 0; i < map->region_count; ++i)
     {
-        struct MM_Region *region = region_from_list(pos);
-        debug_print_mm_region(region);
+        debug_print_mm_region(&map->regions[i]);
     }
 }
@@ -2,9 +2,8 @@
 #pragma once
 
 #include <asm/pgtable-bits.h>
-#include <kernel/container_of.h>
+#include <kernel/errno.h>
 #include <kernel/kernel.h>
-#include <kernel/list.h>
 #include <kernel/spinlock.h>
 
 enum MM_Region_Type
@@ -53,20 +52,26 @@ enum MM_Region_Mapped
 
 struct MM_Region
 {
-    struct list_head list;
-    size_t start_pa;
+    size_t start_pa;  ///< unused for anonymous regions
     size_t start_va;
     size_t size;
     enum MM_Region_Type type;
     enum MM_Region_Mapped mapped;
     bool free_on_unmap;
+    /// The pages are not physically contiguous, the PTEs of the page table
+    /// know the physical address of each page. Always MM_REGION_MAPPED.
+    /// Freeing the pages is up to the page table (see page_table_unmap_range()).
+    bool anonymous;
 };
 
-#define region_from_list(list_ptr) \
-    container_of(list_ptr, struct MM_Region, list)
-
-struct MM_Region *mm_region_alloc_init(size_t start_pa, size_t start_va,
-                                       size_t size, enum MM_Region_Type type);
+/// @brief Init a (physically contiguous) region.
+/// @param region Region to init.
+/// @param start_pa Physical address of the first page.
+/// @param start_va Virtual address of the first page.
+/// @param size Size in bytes.
+/// @param type Type of the memory region.
+void mm_region_init(struct MM_Region *region, size_t start_pa, size_t start_va,
+                    size_t size, enum MM_Region_Type type);
 
 /// @brief Returns how the regions should get mapped based on its type.
 /// @param region The region to get the pte flags for.
@@ -76,19 +81,20 @@ static inline pte_t mm_region_get_pte(struct MM_Region *region)
     return g_region_attributes[region->type].pte_flags;
 }
 
-/// @brief Removes a region from the memory map and frees the region.
-/// @param region The region to remove and free.
-void mm_region_remove(struct MM_Region *region);
-
 void debug_print_mm_region(struct MM_Region *region);
 
 /// @brief Central struct for the Page_Table to track the known memory regions.
+/// The regions are kept in an array sorted by start_va which gets searched
+/// binary. Neighbouring regions of the same kind get merged, so a process has
+/// only a few regions no matter how large its heap or stack are.
 struct Memory_Map
 {
     struct MM_Region ram;     // unsplit copy
     struct MM_Region kernel;  // unsplit copy
 
-    struct list_head region_list;
+    struct MM_Region *regions;  ///< sorted by start_va, no overlaps
+    size_t region_count;
+    size_t region_capacity;  ///< size of the regions array
 
 #ifdef CONFIG_DEBUG_SPINLOCK
     struct spinlock *parent_lock;
@@ -97,11 +103,26 @@ struct Memory_Map
 
 static inline void memory_map_init(struct Memory_Map *map)
 {
-    list_init(&map->region_list);
+    map->regions = NULL;
+    map->region_count = 0;
+    map->region_capacity = 0;
 }
 
+/// @brief Creates the cache for the region arrays of memory maps. Called once
+/// during boot after kalloc_init() and before the first region gets added.
+void memory_map_init_cache();
+
+/// @brief Removes all regions and frees the pages of the non-anonymous ones
+/// which have free_on_unmap set.
+/// @param map Memory map to clear.
 void memory_map_free(struct Memory_Map *map);
 
+/// @brief Make sure count more regions can be added without allocating memory.
+/// @param map Memory map.
+/// @param count Number of regions to reserve space for.
+/// @return 0 on success, -ENOMEM if the region array could not grow.
+syserr_t memory_map_reserve(struct Memory_Map *map, size_t count);
+
 /// @brief Only relevant for the kernel page table.
 /// @param map Kernel page table.
 /// @param start_pa Physical address of the start of the RAM.
@@ -131,12 +152,14 @@ void memory_map_add_region_and_split(struct Memory_Map *map, size_t start_pa,
                                      size_t start_va, size_t size,
                                      enum MM_Region_Type type);
 
-/// @brief Add a new region to the map. Might merge with existing regions but
+/// @brief Add a new region to the map. Might merge with its neighbours but
 /// otherwise assumes there is space.
 /// @param map Memory map.
-/// @param new_region Region to add, memory map will take ownership.
-void memory_map_add_single_region(struct Memory_Map *map,
-                                  struct MM_Region *new_region);
+/// @param new_region Region to add, gets copied into the map.
+/// @return 0 on success, -ENOMEM if the region array could not grow. Can't
+/// fail if space was reserved with memory_map_reserve().
+syserr_t memory_map_add_region(struct Memory_Map *map,
+                               const struct MM_Region *new_region);
 
 struct Devices_List;
 /// @brief Helper during early init to add MMIO regions for all found devices.
@@ -146,7 +169,8 @@ void memory_map_add_device_mmio(struct Memory_Map *map,
                                 struct Devices_List *dev_list);
 
 /// @brief Remove all memory regions in a given address range. Might resize
-/// existing ones.
+/// existing ones. Splitting a region needs one free slot, panics if none could
+/// be reserved (see memory_map_reserve()).
 /// @param map Memory map to remove regions from.
 /// @param start_va Start virtual address of the range to remove regions from.
 /// @param size Size of the range to remove regions from in bytes (but assumed
@@ -154,6 +178,19 @@ void memory_map_add_device_mmio(struct Memory_Map *map,
 void memory_map_remove_regions(struct Memory_Map *map, size_t start_va,
                                size_t size);
 
+/// @brief Index of the first region which ends after va.
+/// @param map Memory map to search.
+/// @param va Virtual address.
+/// @return Index into map->regions, region_count if there is none.
+size_t memory_map_find_index(struct Memory_Map *map, size_t va);
+
+/// @brief Find the region containing a virtual address.
+/// @param map Memory map to search.
+/// @param va Virtual address.
+/// @return The region or NULL if va is not part of any region. Only valid
+/// until the next change of the map.
+struct MM_Region *memory_map_get_region(struct Memory_Map *map, size_t va);
+
 /// @brief Debug dump.
 /// @param map Memory map to print.
 void debug_print_memory_map(struct Memory_Map *map);
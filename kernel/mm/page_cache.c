@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <kernel/errno.h>
+#include <kernel/fs.h>
+#include <kernel/kernel.h>
+#include <lib/minmax.h>
+#include <mm/kalloc.h>
+#include <mm/kernel_memory.h>
+#include <mm/page_cache.h>
+#include <mm/page_cache_sysfs.h>
+#include <mm/shrinker.h>
+
+struct page_cache g_page_cache;
+
+static size_t page_cache_shrink(size_t bytes)
+{
+    size_t pages = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+    return page_cache_drop_unused(pages) * PAGE_SIZE;
+}
+
+static struct shrinker g_page_cache_shrinker = {.name = "page_cache",
+                                                .shrink = page_cache_shrink};
+
+#define entry_from_hash_list(ptr) \
+    container_of(ptr, struct page_cache_entry, hash_list)
+#define entry_from_lru_list(ptr) \
+    container_of(ptr, struct page_cache_entry, lru_list)
+#define entry_from_inode_list(ptr) \
+    container_of(ptr, struct page_cache_entry, inode_list)
+
+static inline size_t page_cache_hash(struct inode *ip, size_t index)
+{
+    // same multiplicative hash as the wait channels
+    size_t hash = (((size_t)ip >> 3) + index) * 0x9E3779B1u;
+    return (hash >> 8) % PAGE_CACHE_TABLE_SIZE;
+}
+
+void page_cache_init()
+{
+    spin_lock_init(&g_page_cache.lock, "page_cache");
+    for (size_t i = 0; i < PAGE_CACHE_TABLE_SIZE; i++)
+    {
+        list_init(&g_page_cache.table[i]);
+    }
+    list_init(&g_page_cache.free_list);
+    list_init(&g_page_cache.lru_list);
+    for (size_t i = 0; i < PAGE_CACHE_MAX_PAGES; i++)
+    {
+        struct page_cache_entry *entry = &g_page_cache.entries[i];
+        list_init(&entry->lru_list);
+        list_init(&entry->inode_list);
+        list_add_tail(&entry->hash_list, &g_page_cache.free_list);
+    }
+    g_page_cache.pages = 0;
+    g_page_cache.hits = 0;
+    g_page_cache.misses = 0;
+
+    kobject_init(&g_page_cache.kobj, &page_cache_kobj_ktype);
+    kobject_add(&g_page_cache.kobj, &g_kernel_memory.kobj, "page_cache");
+
+    register_shrinker(&g_page_cache_shrinker);
+}
+
+// lock must be held
+static struct page_cache_entry *page_cache_find(struct inode *ip, size_t index)
+{
+    struct list_head *bucket = &g_page_cache.table[page_cache_hash(ip, index)];
+    struct list_head *pos;
+    list_for_each(pos, bucket)
+    {
+        struct page_cache_entry *entry = entry_from_hash_list(pos);
+        if (entry->ip == ip && entry->index == index)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// lock must be held, returns the page for the caller to put
+static void *page_cache_remove_entry(struct page_cache_entry *entry)
+{
+    void *page = entry->page;
+    list_del(&entry->lru_list);
+    list_del(&entry->inode_list);
+    list_del(&entry->hash_list);
+    list_add(&entry->hash_list, &g_page_cache.free_list);
+    entry->ip = NULL;
+    entry->page = NULL;
+    g_page_cache.pages--;
+    return page;
+}
+
+// lock must be held, returns a free entry or NULL if all pages are mapped
+static struct page_cache_entry *page_cache_alloc_entry(void **evicted_page)
+{
+    *evicted_page = NULL;
+    if (!list_empty(&g_page_cache.free_list))
+    {
+        struct page_cache_entry *entry =
+            entry_from_hash_list(g_page_cache.free_list.next);
+        list_del(&entry->hash_list);
+        return entry;
+    }
+
+    // evict the least recently used page no process maps
+    struct list_head *pos;
+    list_for_each(pos, &g_page_cache.lru_list)
+    {
+        struct page_cache_entry *entry = entry_from_lru_list(pos);
+        if (page_ref_count(entry->page) == 1)
+        {
+            *evicted_page = page_cache_remove_entry(entry);
+            list_del(&entry->hash_list);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void *page_cache_get_page(struct inode *ip, size_t index)
+{
+    spin_lock(&g_page_cache.lock);
+    struct page_cache_entry *entry = page_cache_find(ip, index);
+    if (entry != NULL)
+    {
+        void *page = entry->page;
+        page_ref_inc(page);
+        list_del(&entry->lru_list);
+        list_add_tail(&entry->lru_list, &g_page_cache.lru_list);
+        g_page_cache.hits++;
+        spin_unlock(&g_page_cache.lock);
+        return page;
+    }
+    spin_unlock(&g_page_cache.lock);
+
+    // miss: read the page from the file (if out of memory, alloc_page() drops
+    // unused pages of the cache via the shrinker)
+    void *page = alloc_page(ALLOC_FLAG_ZERO_MEMORY);
+    if (page == NULL)
+    {
+        return NULL;
+    }
+
+    // Writes and truncates drop the cached pages with the inode locked, so
+    // holding the lock till the page is in the cache prevents caching stale
+    // data.
+    inode_lock(ip);
+    size_t offset = index * PAGE_SIZE;
+    size_t n = (offset < ip->size) ? min(ip->size - offset, PAGE_SIZE) : 0;
+    if (n > 0 && VFS_INODE_READ_KERNEL(ip, offset, (size_t)page, n) != n)
+    {
+        inode_unlock(ip);
+        free_page(page);
+        return NULL;
+    }
+
+    void *evicted_page = NULL;
+    spin_lock(&g_page_cache.lock);
+    g_page_cache.misses++;
+    entry = page_cache_find(ip, index);
+    if (entry != NULL)
+    {
+        // another process read the same page in the meantime
+        void *cached_page = entry->page;
+        page_ref_inc(cached_page);
+        spin_unlock(&g_page_cache.lock);
+        inode_unlock(ip);
+        free_page(page);
+        return cached_page;
+    }
+
+    entry = page_cache_alloc_entry(&evicted_page);
+    if (entry != NULL)
+    {
+        entry->ip = ip;
+        entry->index = index;
+        entry->page = page;
+        page_ref_inc(page);  // reference of the cache
+        list_add(&entry->hash_list,
+                 &g_page_cache.table[page_cache_hash(ip, index)]);
+        list_add_tail(&entry->lru_list, &g_page_cache.lru_list);
+        list_add_tail(&entry->inode_list, &ip->i_page_cache);
+        g_page_cache.pages++;
+    }
+    // else: all cached pages are mapped, the caller gets an uncached page
+    spin_unlock(&g_page_cache.lock);
+    inode_unlock(ip);
+
+    if (evicted_page != NULL)
+    {
+        put_pages_range(evicted_page, 1);
+    }
+    return page;
+}
+
+void page_cache_drop_inode(struct inode *ip)
+{
+    // no new pages can get added while the inode is locked or unreferenced
+    if (list_empty(&ip->i_page_cache)) return;
+
+    spin_lock(&g_page_cache.lock);
+    while (!list_empty(&ip->i_page_cache))
+    {
+        struct page_cache_entry *entry =
+            entry_from_inode_list(ip->i_page_cache.next);
+        void *page = page_cache_remove_entry(entry);
+        put_pages_range(page, 1);
+    }
+    spin_unlock(&g_page_cache.lock);
+}
+
+size_t page_cache_drop_unused(size_t max_pages)
+{
+    size_t freed = 0;
+
+    spin_lock(&g_page_cache.lock);
+    struct list_head *pos;
+    struct list_head *n;
+    list_for_each_safe(pos, n, &g_page_cache.lru_list)
+    {
+        if (freed >= max_pages) break;
+
+        struct page_cache_entry *entry = entry_from_lru_list(pos);
+        if (page_ref_count(entry->page) == 1)
+        {
+            put_pages_range(page_cache_remove_entry(entry), 1);
+            freed++;
+        }
+    }
+    spin_unlock(&g_page_cache.lock);
+
+    return freed;
+}
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: MIT */
+#pragma once
+
+#include <kernel/container_of.h>
+#include <kernel/kernel.h>
+#include <kernel/kobject.h>
+#include <kernel/list.h>
+#include <kernel/spinlock.h>
+
+struct inode;
+
+/// Max number of file pages the page cache holds.
+#define PAGE_CACHE_MAX_PAGES 256
+
+/// Number of hash buckets of the page cache.
+#define PAGE_CACHE_TABLE_SIZE 64
+
+/// @brief One cached page of a file.
+struct page_cache_entry
+{
+    struct list_head hash_list;   ///< in a hash bucket or in the free list
+    struct list_head lru_list;    ///< least recently used first
+    struct list_head inode_list;  ///< all cached pages of ip
+    struct inode *ip;  ///< no reference, inode_del() drops the pages first
+    size_t index;      ///< offset in the file / PAGE_SIZE
+    void *page;        ///< the cache holds one reference
+};
+
+/// @brief Cache of file pages. Program text and read-only data get mapped from
+/// here on first access (see page_table_fault_file()), so all processes running
+/// the same binary share those pages.
+/// The cache holds one reference to each page, pages which are mapped by
+/// processes have more. Only pages without mappings get evicted.
+struct page_cache
+{
+    struct kobject kobj;  ///< /sys/kmem/page_cache
+    struct spinlock lock;  ///< protects everything below
+
+    struct list_head table[PAGE_CACHE_TABLE_SIZE];  ///< hashed by inode+index
+    struct list_head free_list;  ///< unused entries, linked via hash_list
+    struct list_head lru_list;   ///< used entries, least recently used first
+
+    size_t pages;   ///< Number of cached pages.
+    size_t hits;    ///< Lookups served from the cache.
+    size_t misses;  ///< Lookups which had to read the file.
+
+    struct page_cache_entry entries[PAGE_CACHE_MAX_PAGES];
+};
+
+#define page_cache_from_kobj(ptr) container_of(ptr, struct page_cache, kobj)
+
+extern struct page_cache g_page_cache;
+
+/// @brief Init the page cache and register it in sysfs. Needs kmalloc().
+void page_cache_init();
+
+/// @brief Get a page of a file, read from the file on a cache miss. Bytes
+/// past the end of the file are zero. Might sleep.
+/// @param ip Inode of the file, must be held but not locked.
+/// @param index Page index in the file (offset / PAGE_SIZE).
+/// @return The page with one reference for the caller (put it with
+/// put_pages_range()), or NULL if out of memory or the read failed.
+void *page_cache_get_page(struct inode *ip, size_t index);
+
+/// @brief Drop all cached pages of a file. Pages mapped by processes stay
+/// valid for them. Called when the file content changes or the inode gets
+/// deleted.
+/// @param ip The inode, must be locked or no longer referenced.
+void page_cache_drop_inode(struct inode *ip);
+
+/// @brief Drop cached pages which are not mapped by any process, least
+/// recently used first.
+/// @param max_pages Max number of pages to drop.
+/// @return Number of pages freed.
+size_t page_cache_drop_unused(size_t max_pages);
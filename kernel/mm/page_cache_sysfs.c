@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <fs/sysfs/sysfs_helper.h>
+#include <kernel/errno.h>
+#include <kernel/kobject.h>
+#include <mm/page_cache.h>
+#include <mm/page_cache_sysfs.h>
+
+// /sys/kmem/page_cache
+
+enum PAGE_CACHE_ATTRIBUTE_INDEX
+{
+    PC_PAGES = 0,
+    PC_MAX_PAGES,
+    PC_HITS,
+    PC_MISSES,
+    PC_DROP
+};
+
+struct sysfs_attribute page_cache_attributes[] = {
+    [PC_PAGES] = {.name = "pages", .mode = 0444},
+    [PC_MAX_PAGES] = {.name = "max_pages", .mode = 0444},
+    [PC_HITS] = {.name = "hits", .mode = 0444},
+    [PC_MISSES] = {.name = "misses", .mode = 0444},
+    [PC_DROP] = {.name = "drop", .mode = 0600}};
+
+syserr_t page_cache_sysfs_ops_show(struct kobject *kobj, size_t attribute_idx,
+                                   char *buf, size_t n)
+{
+    struct page_cache *cache = page_cache_from_kobj(kobj);
+
+    syserr_t ret = 0;
+
+    spin_lock(&cache->lock);
+    switch (attribute_idx)
+    {
+        case PC_PAGES: ret = snprintf(buf, n, "%zu\n", cache->pages); break;
+        case PC_MAX_PAGES:
+            ret = snprintf(buf, n, "%zu\n", (size_t)PAGE_CACHE_MAX_PAGES);
+            break;
+        case PC_HITS: ret = snprintf(buf, n, "%zu\n", cache->hits); break;
+        case PC_MISSES: ret = snprintf(buf, n, "%zu\n", cache->misses); break;
+        case PC_DROP: ret = -EINVAL; break;
+        default: ret = -ENOENT; break;
+    }
+    spin_unlock(&cache->lock);
+
+    if (ret == -1)
+    {
+        // snprintf error
+        ret = -EOTHER;
+    }
+
+    return ret;
+}
+
+syserr_t page_cache_sysfs_ops_store(struct kobject *kobj, size_t attribute_idx,
+                                    const char *buf, size_t n)
+{
+    bool ok;
+    int32_t value = store_param_to_int(buf, n, &ok);
+    if (!ok)
+    {
+        return -EINVAL;
+    }
+
+    syserr_t ret = 0;
+    switch (attribute_idx)
+    {
+        case PC_PAGES: ret = -EINVAL; break;
+        case PC_MAX_PAGES: ret = -EINVAL; break;
+        case PC_HITS: ret = -EINVAL; break;
+        case PC_MISSES: ret = -EINVAL; break;
+        case PC_DROP:
+            // drops the pages no process maps
+            if (value != 0)
+            {
+                page_cache_drop_unused(PAGE_CACHE_MAX_PAGES);
+            }
+            break;
+        default: ret = -ENOENT; break;
+    }
+
+    if (ret == 0)
+    {
+        // no error, signal all bytes have been written
+        return n;
+    }
+
+    return ret;
+}
+
+struct sysfs_ops page_cache_sysfs_ops = {
+    .show = page_cache_sysfs_ops_show,
+    .store = page_cache_sysfs_ops_store,
+};
+
+const struct kobj_type page_cache_kobj_ktype = {
+    .release = NULL,
+    .sysfs_ops = &page_cache_sysfs_ops,
+    .attribute = page_cache_attributes,
+    .n_attributes =
+        sizeof(page_cache_attributes) / sizeof(page_cache_attributes[0])};
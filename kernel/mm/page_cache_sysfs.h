@@ -0,0 +1,7 @@
+/* SPDX-License-Identifier: MIT */
+#pragma once
+
+#include <kernel/kernel.h>
+
+// /sys/kmem/page_cache
+extern const struct kobj_type page_cache_kobj_ktype;
@@ -1,17 +1,29 @@
 /* SPDX-License-Identifier: MIT */
 
+#include <kernel/fs.h>
 #include <kernel/pgtable.h>
 #include <kernel/string.h>
+#include <lib/minmax.h>
+#include <mm/asid.h>
 #include <mm/kalloc.h>
+#include <mm/page_cache.h>
 #include <mm/page_table.h>
 #include <mm/vm.h>
 
 struct Page_Table *g_kernel_pagetable = NULL;
 size_t g_kernel_pagetable_register_value;
 
-syserr_t page_table_copy_from_region(struct Page_Table *dst_pagetable,
-                                     struct Page_Table *src_pagetable,
-                                     struct MM_Region *src_region);
+/// @brief Helper for fork: map the pages of src_region in dst_pagetable as
+/// well and add the range to its memory map. Takes a reference to each page,
+/// writeable pages get mapped read-only in both page tables.
+static syserr_t page_table_share_region(struct Page_Table *dst_pagetable,
+                                        struct Page_Table *src_pagetable,
+                                        struct MM_Region *src_region);
+
+/// @brief Drop the references to all pages of an anonymous region without
+/// changing the PTEs, used when the whole page table gets freed.
+static void page_table_put_anonymous_pages(struct Page_Table *pagetable,
+                                           struct MM_Region *region);
 
 struct Page_Table *page_table_alloc_init()
 {
@@ -28,6 +40,7 @@ struct Page_Table *page_table_alloc_init()
         kfree(pagetable);
         return NULL;
     }
+    pagetable->asid_last_cpu = MAX_CPUS;  // asid and asid_generation are 0
     spin_lock_init(&pagetable->lock, "pagetable_lock");
     spin_lock(&pagetable->lock);
     memory_map_init(&pagetable->memory_map);
@@ -42,7 +55,23 @@ struct Page_Table *page_table_alloc_init()
 
 void page_table_free(struct Page_Table *pagetable)
 {
-    memory_map_free(&pagetable->memory_map);
+    DEBUG_EXTRA_PANIC(pagetable->file_mapping_count == 0,
+                      "page_table_free: file mappings not released");
+
+    struct Memory_Map *memory_map = &pagetable->memory_map;
+    if (pagetable->root != NULL)
+    {
+        // only the PTEs know the pages of anonymous regions
+        for (size_t i = 0; i < memory_map->region_count; ++i)
+        {
+            struct MM_Region *region = &memory_map->regions[i];
+            if (region->anonymous && region->free_on_unmap)
+            {
+                page_table_put_anonymous_pages(pagetable, region);
+            }
+        }
+    }
+    memory_map_free(memory_map);
     if (pagetable->root != NULL)
     {
         vm_free_pgtable(pagetable->root);
@@ -79,10 +108,9 @@ syserr_t page_table_apply_mapping(struct Page_Table *pagetable)
     struct Memory_Map *memory_map = &pagetable->memory_map;
 
     syserr_t err = 0;
-    struct list_head *pos;
-    list_for_each(pos, &memory_map->region_list)
+    for (size_t i = 0; i < memory_map->region_count; ++i)
     {
-        struct MM_Region *region = region_from_list(pos);
+        struct MM_Region *region = &memory_map->regions[i];
         if (region->mapped == MM_REGION_MARKED_FOR_MAPPING)
         {
             err = page_table_map_region(pagetable, region);
@@ -92,9 +120,9 @@ syserr_t page_table_apply_mapping(struct Page_Table *pagetable)
     if (err >= 0)
     {
         // finalize mappings
-        list_for_each(pos, &memory_map->region_list)
+        for (size_t i = 0; i < memory_map->region_count; ++i)
         {
-            struct MM_Region *region = region_from_list(pos);
+            struct MM_Region *region = &memory_map->regions[i];
             if (region->mapped == MM_REGION_PARTIAL_MAPPED)
             {
                 region->mapped = MM_REGION_MAPPED;
@@ -117,43 +145,214 @@ syserr_t page_table_unmap_partial_mappings(struct Page_Table *pagetable)
 
     struct Memory_Map *memory_map = &pagetable->memory_map;
 
-    struct list_head *pos, *n;
-    list_for_each_safe(pos, n, &memory_map->region_list)
+    size_t i = 0;
+    while (i < memory_map->region_count)
     {
-        struct MM_Region *region = region_from_list(pos);
-        if (region->mapped == MM_REGION_PARTIAL_MAPPED)
+        struct MM_Region *region = &memory_map->regions[i];
+        if ((region->mapped != MM_REGION_PARTIAL_MAPPED) &&
+            (region->mapped != MM_REGION_MARKED_FOR_MAPPING))
         {
-            page_table_unmap_region(pagetable, region);
-            mm_region_remove(region);
+            i++;
+            continue;
         }
-        else if (region->mapped == MM_REGION_MARKED_FOR_MAPPING)
+
+        if (region->mapped == MM_REGION_PARTIAL_MAPPED)
         {
-            mm_region_remove(region);
+            vm_unmap(pagetable, region->start_va, region->size / PAGE_SIZE,
+                     false);
         }
+        // removes regions[i], never splits
+        memory_map_remove_regions(memory_map, region->start_va, region->size);
     }
     return 0;
 }
 
-syserr_t page_table_unmap_range(struct Page_Table *pagetable, size_t start_va,
-                                size_t size)
+syserr_t page_table_add_file_mapping(struct Page_Table *pagetable,
+                                     const struct File_Mapping *mapping)
 {
     DEBUG_ASSERT_CPU_HOLDS_LOCK(&pagetable->lock);
+    DEBUG_EXTRA_PANIC(mapping->start_va % PAGE_SIZE == 0, "unaligned mapping");
+    DEBUG_EXTRA_PANIC(mapping->size % PAGE_SIZE == 0, "unaligned size");
+    DEBUG_EXTRA_PANIC(mapping->file_offset % PAGE_SIZE == 0,
+                      "unaligned file offset");
 
-    // note: unmap of 0 pages is fine!
-    vm_unmap(pagetable, start_va, size / PAGE_SIZE, false);
+    if (pagetable->file_mapping_count == PAGE_TABLE_MAX_FILE_MAPPINGS)
+    {
+        return -ENOMEM;
+    }
+
+    struct File_Mapping *new_mapping =
+        &pagetable->file_mappings[pagetable->file_mapping_count++];
+    *new_mapping = *mapping;
+    inode_get(new_mapping->ip);
+    atomic_fetch_add(&new_mapping->ip->i_file_mappings, 1);
+    return 0;
+}
+
+void page_table_put_files(struct Page_Table *pagetable)
+{
+    // no lock: only the owning process changes its file mappings
+    while (pagetable->file_mapping_count > 0)
+    {
+        pagetable->file_mapping_count--;
+        struct File_Mapping *mapping =
+            &pagetable->file_mappings[pagetable->file_mapping_count];
+        atomic_fetch_sub(&mapping->ip->i_file_mappings, 1);
+        inode_put(mapping->ip);
+        mapping->ip = NULL;
+    }
+}
+
+static struct File_Mapping *page_table_get_file_mapping(
+    struct Page_Table *pagetable, size_t va)
+{
+    for (size_t i = 0; i < pagetable->file_mapping_count; ++i)
+    {
+        struct File_Mapping *mapping = &pagetable->file_mappings[i];
+        if ((va >= mapping->start_va) &&
+            (va - mapping->start_va < mapping->size))
+        {
+            return mapping;
+        }
+    }
+    return NULL;
+}
+
+syserr_t page_table_fault_file(struct Page_Table *pagetable, size_t va)
+{
+    va = PAGE_ROUND_DOWN(va);
+
+    spin_lock(&pagetable->lock);
+    struct File_Mapping *mapping = page_table_get_file_mapping(pagetable, va);
+    if ((mapping == NULL) ||
+        (memory_map_get_region(&pagetable->memory_map, va) != NULL))
+    {
+        spin_unlock(&pagetable->lock);
+        return -EFAULT;
+    }
+    // the mapping stays valid while the lock is dropped, the page table keeps
+    // the inode reference till the process exits or execs
+    struct File_Mapping file = *mapping;
+    spin_unlock(&pagetable->lock);
+
+    size_t offset = va - file.start_va;
+    void *page = NULL;
+    if (offset >= file.file_size)
+    {
+        // past the file data, e.g. the end of a segment with memsz > filesz
+        page = alloc_page(ALLOC_FLAG_ZERO_MEMORY);
+    }
+    else
+    {
+        void *cached_page =
+            page_cache_get_page(file.ip, (file.file_offset + offset) / PAGE_SIZE);
+        if ((cached_page != NULL) && (file.file_size - offset < PAGE_SIZE))
+        {
+            // The last page of the range contains the next part of the file
+            // in the cache, but must read as zeros after file_size.
+            page = alloc_page(ALLOC_FLAG_NONE);
+            if (page != NULL)
+            {
+                size_t n = file.file_size - offset;
+                memcpy(page, cached_page, n);
+                memset((char *)page + n, 0, PAGE_SIZE - n);
+            }
+            put_pages_range(cached_page, 1);
+        }
+        else
+        {
+            page = cached_page;
+        }
+    }
+    if (page == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    spin_lock(&pagetable->lock);
+    syserr_t err = 0;
+    if (memory_map_get_region(&pagetable->memory_map, va) == NULL)
+    {
+        err = page_table_map_page(pagetable, va, page, file.type);
+    }
+    else
+    {
+        // got mapped while the lock was dropped
+        put_pages_range(page, 1);
+    }
+    spin_unlock(&pagetable->lock);
 
-    memory_map_remove_regions(&pagetable->memory_map, start_va, size);
+    if (err < 0)
+    {
+        put_pages_range(page, 1);
+    }
+    return err;
+}
+
+syserr_t page_table_map_page(struct Page_Table *pagetable, size_t va,
+                             void *page, enum MM_Region_Type type)
+{
+    DEBUG_ASSERT_CPU_HOLDS_LOCK(&pagetable->lock);
+
+    struct MM_Region region;
+    mm_region_init(&region, 0, va, PAGE_SIZE, type);
+    region.anonymous = true;
+    region.mapped = MM_REGION_MAPPED;
+
+    // reserve first: once the page is mapped, adding the region can't fail
+    if (memory_map_reserve(&pagetable->memory_map, 1) < 0)
+    {
+        return -ENOMEM;
+    }
+    if (vm_map(pagetable, va, virt_to_phys((size_t)page), PAGE_SIZE,
+               mm_region_get_pte(&region), false) != 0)
+    {
+        return -ENOMEM;
+    }
+    memory_map_add_region(&pagetable->memory_map, &region);
     return 0;
 }
 
-syserr_t page_table_unmap_region(struct Page_Table *pagetable,
-                                 struct MM_Region *region)
+syserr_t page_table_unmap_range(struct Page_Table *pagetable, size_t start_va,
+                                size_t size)
 {
     DEBUG_ASSERT_CPU_HOLDS_LOCK(&pagetable->lock);
 
-    vm_unmap(pagetable, region->start_va, region->size / PAGE_SIZE, false);
+    // note: unmap of 0 pages is fine!
+    if (size == 0) return 0;
+
+    struct Memory_Map *memory_map = &pagetable->memory_map;
+    size_t last_va = start_va + size - 1;
+    size_t first = memory_map_find_index(memory_map, start_va);
+
+    // only unmapping the middle of a region splits it and needs a free slot
+    if (first < memory_map->region_count)
+    {
+        struct MM_Region *region = &memory_map->regions[first];
+        if (region->start_va < start_va &&
+            region->start_va + region->size - 1 > last_va &&
+            memory_map_reserve(memory_map, 1) < 0)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    for (size_t i = first; i < memory_map->region_count; ++i)
+    {
+        struct MM_Region *region = &memory_map->regions[i];
+        if (region->start_va > last_va) break;  // sorted by start_va
+        if (region->mapped != MM_REGION_MAPPED) continue;
+
+        size_t from = max(region->start_va, start_va);
+        size_t to_last = min(region->start_va + region->size - 1, last_va);
+
+        // the pages of anonymous regions are only known to the PTEs, all
+        // others get released by the memory map
+        vm_unmap(pagetable, from, (to_last - from) / PAGE_SIZE + 1,
+                 region->anonymous && region->free_on_unmap);
+    }
 
-    mm_region_remove(region);
+    memory_map_remove_regions(memory_map, start_va, size);
     return 0;
 }
 
@@ -162,90 +361,171 @@ syserr_t page_table_copy_on_fork(struct Page_Table *dst, struct Page_Table *src)
     spin_lock(&dst->lock);
     spin_lock(&src->lock);
 
+    // not yet mapped file pages stay lazy in both
+    for (size_t i = 0; i < src->file_mapping_count; ++i)
+    {
+        page_table_add_file_mapping(dst, &src->file_mappings[i]);
+    }
+
     syserr_t err = 0;
-    struct list_head *pos;
-    list_for_each(pos, &src->memory_map.region_list)
+    for (size_t i = 0; i < src->memory_map.region_count; ++i)
     {
-        struct MM_Region *region = region_from_list(pos);
+        struct MM_Region *region = &src->memory_map.regions[i];
         if (region->mapped != MM_REGION_MAPPED) continue;
         if (g_region_attributes[region->type].copy_on_fork == false) continue;
 
-        err = page_table_copy_from_region(dst, src, region);
+        err = page_table_share_region(dst, src, region);
         if (err < 0) break;
     }
 
-    if (err < 0)
+    // from now on writes of both processes fault and get a private copy, dst
+    // has no ASID yet and nothing to flush
+    asid_flush_all(src);
+
+    if (err == 0)
     {
-        // free any regions we may have copied before the failure
-        memory_map_free(&dst->memory_map);
-        spin_unlock(&dst->lock);
-        spin_unlock(&src->lock);
-        return err;
+        // not yet populated pages stay lazy in both
+        dst->demand_start = src->demand_start;
+        dst->demand_end = src->demand_end;
     }
-
-    err = page_table_apply_mapping(dst);
     spin_unlock(&dst->lock);
     spin_unlock(&src->lock);
     return err;
 }
 
-size_t page_table_get_kvm_addr(struct Page_Table *pagetable, size_t va)
+syserr_t page_table_copy_on_write(struct Page_Table *pagetable, size_t va)
 {
     DEBUG_ASSERT_CPU_HOLDS_LOCK(&pagetable->lock);
 
+    va = PAGE_ROUND_DOWN(va);
+    struct MM_Region *region =
+        memory_map_get_region(&pagetable->memory_map, va);
+    if ((region == NULL) || !region->anonymous ||
+        !PTE_IS_WRITEABLE(mm_region_get_pte(region)))
+    {
+        // not a copy-on-write page but a real access violation
+        return -EFAULT;
+    }
+
     pte_t *pte = vm_walk(pagetable, va, false);
-    if (pte == NULL)
+    if ((pte == NULL) || !PTE_IS_VALID_USER(*pte))
+    {
+        return -EFAULT;
+    }
+    if (PTE_IS_WRITEABLE(*pte))
+    {
+        return 0;  // nothing to do
+    }
+
+    void *old_page = (void *)phys_to_virt(PTE_GET_PA(*pte));
+    if (page_ref_count(old_page) == 1)
+    {
+        // all other processes sharing this page are gone: reuse it
+        *pte = pte_set_writeable(*pte);
+        asid_flush_page(pagetable, va);
+        return 0;
+    }
+
+    char *mem = alloc_page(ALLOC_FLAG_NONE);
+    if (mem == NULL)
+    {
+        return -ENOMEM;
+    }
+    memcpy(mem, old_page, PAGE_SIZE);
+
+    // the region is anonymous, only the PTE needs to know the new page
+    *pte = pte_set_writeable(
+        PTE_BUILD(virt_to_phys((size_t)mem), PTE_FLAGS(*pte)));
+    asid_flush_page(pagetable, va);
+
+    // drop the reference of the old page
+    put_pages_range(old_page, 1);
+
+    return 0;
+}
+
+syserr_t page_table_populate(struct Page_Table *pagetable, size_t va)
+{
+    DEBUG_ASSERT_CPU_HOLDS_LOCK(&pagetable->lock);
+
+    va = PAGE_ROUND_DOWN(va);
+    if ((va < pagetable->demand_start) || (va >= pagetable->demand_end) ||
+        (memory_map_get_region(&pagetable->memory_map, va) != NULL))
     {
-        panic("get_kvm_addr: pte should exist");
+        return -EFAULT;
     }
-    if (PTE_IS_VALID_NODE(*pte) == false)
+
+    // All memory that the kernel makes availabe to user apps gets cleared.
+    char *mem = alloc_page(ALLOC_FLAG_ZERO_MEMORY);
+    if (mem == NULL)
     {
-        panic("get_kvm_addr: page not present");
+        return -ENOMEM;
     }
-    pte_t pa = PTE_GET_PA(*pte);
-    return phys_to_virt(pa);
+
+    // grows the heap region instead of adding a region per page
+    syserr_t err = page_table_map_page(pagetable, va, mem, MM_REGION_USER_DATA);
+    if (err < 0)
+    {
+        free_page(mem);
+    }
+    return err;
 }
 
-syserr_t page_table_copy_from_region(struct Page_Table *dst_pagetable,
-                                     struct Page_Table *src_pagetable,
-                                     struct MM_Region *src_region)
+static syserr_t page_table_share_region(struct Page_Table *dst_pagetable,
+                                        struct Page_Table *src_pagetable,
+                                        struct MM_Region *src_region)
 {
-    DEBUG_ASSERT_CPU_HOLDS_LOCK(&src_pagetable->lock);
+    // copy-on-write replaces pages, from now on only the PTEs know them
+    src_region->anonymous = true;
+
+    // reserve first: dst gets the region once the pages are mapped
+    if (memory_map_reserve(&dst_pagetable->memory_map, 1) < 0)
+    {
+        return -ENOMEM;
+    }
 
-    struct Memory_Map *map = &dst_pagetable->memory_map;
     syserr_t err = 0;
     size_t offset = 0;
     for (; offset < src_region->size; offset += PAGE_SIZE)
     {
-        char *mem = alloc_page(ALLOC_FLAG_ZERO_MEMORY);
-        if (mem == NULL)
+        size_t va = src_region->start_va + offset;
+        pte_t *src_pte = vm_walk(src_pagetable, va, false);
+        if ((src_pte == NULL) || !PTE_IS_VALID_NODE(*src_pte))
         {
-            err = -ENOMEM;
-            break;
+            panic("page_table_share_region: not mapped");
         }
-
-        size_t va = src_region->start_va + offset;
-
-        // copy page content from old region to new page
-        size_t kvm_addr = page_table_get_kvm_addr(src_pagetable, va);
-        memcpy(mem, (void *)kvm_addr, PAGE_SIZE);
-
-        struct MM_Region *new_region = mm_region_alloc_init(
-            virt_to_phys((size_t)mem), va, PAGE_SIZE, src_region->type);
-        if (new_region == NULL)
+        pte_t *dst_pte = vm_walk(dst_pagetable, va, true);
+        if (dst_pte == NULL)
         {
-            free_page(mem);
             err = -ENOMEM;
             break;
         }
-        memory_map_add_single_region(map, new_region);
+
+        // each process sharing the page holds one reference
+        page_ref_inc((void *)phys_to_virt(PTE_GET_PA(*src_pte)));
+        *src_pte = pte_unset_writeable(*src_pte);
+        *dst_pte = *src_pte;
     }
 
-    if (err < 0)
+    if (offset > 0)
     {
-        // clean up any copied pages if we failed partway through
-        memory_map_remove_regions(map, src_region->start_va, offset);
+        // also after a failure: dst must release the pages shared so far
+        struct MM_Region new_region = *src_region;
+        new_region.size = offset;
+        memory_map_add_region(&dst_pagetable->memory_map, &new_region);
     }
-
     return err;
 }
+
+static void page_table_put_anonymous_pages(struct Page_Table *pagetable,
+                                           struct MM_Region *region)
+{
+    for (size_t offset = 0; offset < region->size; offset += PAGE_SIZE)
+    {
+        pte_t *pte = vm_walk(pagetable, region->start_va + offset, false);
+        if ((pte != NULL) && PTE_IS_VALID_NODE(*pte))
+        {
+            put_pages_range((void *)phys_to_virt(PTE_GET_PA(*pte)), 1);
+        }
+    }
+}
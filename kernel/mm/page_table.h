@@ -6,6 +6,24 @@
 #include <kernel/spinlock.h>
 #include <mm/memory_map.h>
 
+struct inode;
+
+/// Max number of file ranges a page table can map lazily, enough for the
+/// read-only segments of an ELF file.
+#define PAGE_TABLE_MAX_FILE_MAPPINGS 4
+
+/// @brief A range of virtual addresses backed by a file. The pages get mapped
+/// from the page cache on first access by page_table_fault_file().
+struct File_Mapping
+{
+    size_t start_va;     ///< page aligned
+    size_t size;         ///< page aligned
+    size_t file_offset;  ///< offset of start_va in the file, page aligned
+    size_t file_size;    ///< bytes from the file, the rest reads as zeros
+    enum MM_Region_Type type;
+    struct inode *ip;  ///< holds a reference
+};
+
 /// @brief A page table, both the pgtable tree read by the MMU and
 /// the Memory_Map struct which logs all mapped regions.
 /// The same struct manages the kernels page table and user process page tables.
@@ -14,6 +32,25 @@ struct Page_Table
     pagetable_t root;
     struct spinlock lock;
     struct Memory_Map memory_map;
+
+    // TLB tagging, see mm/asid.h. Only changed by asid_activate() on the CPU
+    // switching to this page table.
+    uint32_t asid;           ///< Address Space ID, valid in asid_generation
+    size_t asid_generation;  ///< 0 if no ASID was assigned yet
+    size_t asid_last_cpu;    ///< CPU which used the ASID last
+
+    // Demand paged range (the heap): pages in [demand_start, demand_end)
+    // which are not in the memory map get allocated on first access by
+    // page_table_populate().
+    size_t demand_start;
+    size_t demand_end;
+
+    // File backed ranges (program text and read-only data): not yet mapped
+    // pages in these get mapped from the page cache on first access. The
+    // inode references must be dropped with page_table_put_files() before
+    // the page table gets freed.
+    struct File_Mapping file_mappings[PAGE_TABLE_MAX_FILE_MAPPINGS];
+    size_t file_mapping_count;
 };
 
 /// @brief The one global kernel page table shared by all CPUs.
@@ -29,10 +66,35 @@ extern size_t g_kernel_pagetable_register_value;
 struct Page_Table *page_table_alloc_init();
 
 /// @brief Frees a page table by freeing the memory map (which might free mapped
-/// pages) and then free the pgtable tree.
+/// pages) and then free the pgtable tree. The file mappings must have been
+/// released with page_table_put_files().
 /// @param pagetable Page table to free.
 void page_table_free(struct Page_Table *pagetable);
 
+/// @brief Adds a lazily mapped file range. Takes a reference to the inode and
+/// counts the mapping in ip->i_file_mappings, so the file can't be changed.
+/// @param pagetable Page table, lock must be held.
+/// @param mapping The range, gets copied.
+/// @return 0 on success, -ENOMEM if all file mapping slots are used.
+syserr_t page_table_add_file_mapping(struct Page_Table *pagetable,
+                                     const struct File_Mapping *mapping);
+
+/// @brief Drops the inode references of all file mappings. Might sleep, so
+/// this can't be done in page_table_free() which gets called with spinlocks
+/// held. Pages already mapped stay mapped.
+/// @param pagetable Page table, lock must not be held.
+void page_table_put_files(struct Page_Table *pagetable);
+
+/// @brief Resolves an access to a not yet mapped page of a file mapping: the
+/// page gets read through the page cache and mapped. Full pages of the file
+/// are shared with all processes mapping them, a partial last page gets a
+/// private copy. Might sleep.
+/// @param pagetable Page table of the process, lock must not be held.
+/// @param va Virtual address accessed.
+/// @return 0 on success, -EFAULT if va is not in a file mapping or already
+/// mapped, -ENOMEM if the page could not be read or mapped.
+syserr_t page_table_fault_file(struct Page_Table *pagetable, size_t va);
+
 /// @brief If new regions were added to the memory map, map them now. On failure
 /// it will clear out all regions which were already mapped in this transaction
 /// or marked to be mapped.
@@ -47,26 +109,53 @@ syserr_t page_table_apply_mapping(struct Page_Table *pagetable);
 /// @return 0 on success, or a negative error code on failure.
 syserr_t page_table_unmap_partial_mappings(struct Page_Table *pagetable);
 
-/// @brief Unmaps a range of virtual addresses and removes the area from the
-/// memory map.
-/// @param pagetable Page table to unmap from.
-/// @param start_va Starting virtual address of the range to unmap.
-/// @param size Size of the range to unmap in bytes.
-/// @return 0 on success, or a negative error code on failure.
+/// @brief Maps one page and adds it to the memory map as an anonymous region.
+/// It gets merged with neighbouring anonymous regions of the same type, so
+/// e.g. the heap stays one region no matter how many pages it has.
+/// @param pagetable Page table to map the page in, lock must be held.
+/// @param va Virtual address to map the page to, must not be mapped yet.
+/// @param page The page, on success the page table owns the reference.
+/// @param type Type of the region.
+/// @return 0 on success, -ENOMEM on failure.
+syserr_t page_table_map_page(struct Page_Table *pagetable, size_t va,
+                             void *page, enum MM_Region_Type type);
+
+/// @brief Unmaps all mapped pages in a range of virtual addresses and removes
+/// the area from the memory map. The range can contain holes, e.g. not yet
+/// populated pages of the demand paged range. Regions overlapping the range
+/// get resized or split.
+/// @param pagetable Page table to unmap from, lock must be held.
+/// @param start_va Starting virtual address of the range, page aligned.
+/// @param size Size of the range to unmap in bytes, page aligned.
+/// @return 0 on success, -ENOMEM if a needed split of a region failed (nothing
+/// got unmapped then).
 syserr_t page_table_unmap_range(struct Page_Table *pagetable, size_t start_va,
                                 size_t size);
 
-/// @brief Unmaps a region and removes it from the memory map.
-/// @param pagetable Page table to unmap from.
-/// @param region Region to unmap.
-/// @return 0 on success, or a negative error code on failure.
-syserr_t page_table_unmap_region(struct Page_Table *pagetable,
-                                 struct MM_Region *region);
-
-/// @brief Helper for fork: copy all mapped regions from src to dst which have
-/// the copy_on_fork attribute, and apply the mapping.
+/// @brief Helper for fork: share all mapped regions of src which have the
+/// copy_on_fork attribute with dst, one range at a time. Writeable pages get
+/// mapped read-only in both page tables, the first write to one gets resolved
+/// by page_table_copy_on_write(). File mappings get copied as well.
 /// @param dst Destination page table.
 /// @param src Source page table.
-/// @return 0 on success, or a negative error code on failure.
+/// @return 0 on success, or a negative error code on failure. dst then holds
+/// the pages and files shared so far and must be freed with
+/// page_table_put_files() and page_table_free().
 syserr_t page_table_copy_on_fork(struct Page_Table *dst,
                                  struct Page_Table *src);
+
+/// @brief Resolves a write to a page shared by page_table_copy_on_fork(): the
+/// page gets copied (or just made writeable if no longer shared).
+/// @param pagetable Page table of the writing process, lock must be held.
+/// @param va Virtual address written to.
+/// @return 0 on success, -EFAULT if va is not a copy-on-write page, -ENOMEM if
+/// the copy failed.
+syserr_t page_table_copy_on_write(struct Page_Table *pagetable, size_t va);
+
+/// @brief Resolves an access to a not yet allocated page of the demand paged
+/// range: maps a new zeroed page.
+/// @param pagetable Page table of the process, lock must be held.
+/// @param va Virtual address accessed.
+/// @return 0 on success, -EFAULT if va is outside of the demand paged range or
+/// already mapped, -ENOMEM if the allocation failed.
+syserr_t page_table_populate(struct Page_Table *pagetable, size_t va);
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <kernel/spinlock.h>
+#include <lib/minmax.h>
+#include <mm/kalloc.h>
+#include <mm/kernel_memory.h>
+#include <mm/shrinker.h>
+
+void register_shrinker(struct shrinker *shrinker)
+{
+    shrinker->freed = 0;
+    spin_lock(&g_kernel_memory.shrinker_lock);
+    list_add_tail(&shrinker->list, &g_kernel_memory.shrinker_list);
+    spin_unlock(&g_kernel_memory.shrinker_lock);
+}
+
+// shrinker lock must be held
+static size_t shrink_memory_locked(size_t pages)
+{
+    size_t free_start = kalloc_get_free_pages();
+    g_kernel_memory.shrink_runs++;
+
+    size_t bytes = min(pages, g_kernel_memory.pages_total) * PAGE_SIZE;
+    size_t freed = 0;
+    struct list_head *pos;
+    list_for_each(pos, &g_kernel_memory.shrinker_list)
+    {
+        if (freed >= bytes) break;
+
+        struct shrinker *shrinker = shrinker_from_list(pos);
+        size_t shrinker_freed = shrinker->shrink(bytes - freed);
+        shrinker->freed += shrinker_freed;
+        freed += shrinker_freed;
+    }
+
+    // the freed objects are in the magazines and slabs of their caches
+    kalloc_shrink_caches();
+
+    size_t free_end = kalloc_get_free_pages();
+    size_t freed_pages = (free_end > free_start) ? (free_end - free_start) : 0;
+    g_kernel_memory.shrink_freed_pages += freed_pages;
+    return freed_pages;
+}
+
+size_t shrink_memory(size_t pages)
+{
+    if (!spin_trylock(&g_kernel_memory.shrinker_lock))
+    {
+        // another CPU is shrinking already: wait till it is done and let the
+        // caller retry with the pages it freed instead of shrinking again
+        size_t free_start = kalloc_get_free_pages();
+        spin_lock(&g_kernel_memory.shrinker_lock);
+        spin_unlock(&g_kernel_memory.shrinker_lock);
+        size_t free_end = kalloc_get_free_pages();
+        return (free_end > free_start) ? (free_end - free_start) : 0;
+    }
+    size_t freed_pages = shrink_memory_locked(pages);
+    spin_unlock(&g_kernel_memory.shrinker_lock);
+    return freed_pages;
+}
+
+void shrink_check_low_watermark()
+{
+    size_t free_pages = kalloc_get_free_pages();
+    if (free_pages >= g_kernel_memory.shrink_low)
+    {
+        g_kernel_memory.shrink_exhausted = false;
+        return;
+    }
+    if (g_kernel_memory.shrink_exhausted) return;
+
+    // a second CPU below the watermark would only wait for the first one
+    if (!spin_trylock(&g_kernel_memory.shrinker_lock)) return;
+    size_t freed_pages =
+        shrink_memory_locked(g_kernel_memory.shrink_low - free_pages);
+    spin_unlock(&g_kernel_memory.shrinker_lock);
+
+    if (freed_pages == 0)
+    {
+        g_kernel_memory.shrink_exhausted = true;
+    }
+}
@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: MIT */
+#pragma once
+
+#include <kernel/container_of.h>
+#include <kernel/kernel.h>
+#include <kernel/list.h>
+
+/// Default of kernel_memory.shrink_low in pages.
+#define SHRINK_LOW_PAGES 64
+
+/// @brief A cache which gives memory back when the system runs low on free
+/// pages. Caches can grow to use free RAM and get shrunk by alloc_pages() on
+/// demand, see shrink_memory().
+struct shrinker
+{
+    struct list_head list;  ///< in g_kernel_memory.shrinker_list
+    const char *name;       ///< for debugging
+
+    /// @brief Free unused objects worth about bytes bytes. Called from
+    /// alloc_pages(), so it must not sleep or allocate memory. Allocations
+    /// done with a lock held which the shrinker takes must use
+    /// ALLOC_FLAG_NO_RECLAIM.
+    /// @return Number of bytes freed.
+    size_t (*shrink)(size_t bytes);
+
+    size_t freed;  ///< bytes freed in total, for statistics
+};
+
+#define shrinker_from_list(ptr) container_of(ptr, struct shrinker, list)
+
+/// @brief Register a shrinker. Shrinkers run in the order of registration.
+/// @param shrinker The shrinker, must stay valid forever.
+void register_shrinker(struct shrinker *shrinker);
+
+/// @brief Run the shrinkers till they freed about pages pages, then shrink
+/// the kmem_caches (which get the objects freed by the shrinkers back).
+/// If another CPU is shrinking already, waits for it instead.
+/// @param pages Number of pages to free.
+/// @return Number of pages which got free (also by the other CPU).
+size_t shrink_memory(size_t pages);
+
+/// @brief Called by alloc_pages() after an allocation: runs the shrinkers if
+/// fewer than kernel_memory.shrink_low pages are free. Gives up till the free
+/// pages raise above the watermark again if nothing could be freed.
+void shrink_check_low_watermark();
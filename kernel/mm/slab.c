@@ -3,31 +3,66 @@
 #include <kernel/string.h>
 #include <lib/minmax.h>
 #include <mm/kalloc.h>
+#include <mm/kernel_memory.h>
 #include <mm/kmem_sysfs.h>
 #include <mm/slab.h>
 
-struct kmem_slab *kmem_slab_create(size_t size)
+size_t kmem_slab_order_for_size(size_t size, size_t align)
 {
-    struct kmem_slab *slab = alloc_page(ALLOC_FLAG_ZERO_MEMORY);
-    if (!slab) return NULL;
-    size = ROUND_TO_MIN_SLAB_SIZE(size);
-    if (size > MAX_SLAB_SIZE)
+    size_t offset_objects = ROUND_TO_SLAB_ALIGN(sizeof(struct kmem_slab), align);
+    size_t order = 0;
+    for (; order < KMEM_SLAB_MAX_ORDER; ++order)
+    {
+        size_t slab_size = PAGE_SIZE << order;
+        size_t objects = kmem_slab_objects_per_slab(size, align, order);
+        size_t waste = slab_size - offset_objects - objects * size;
+        if (objects > 0 && waste * 8 <= slab_size) break;
+    }
+    return order;
+}
+
+struct kmem_slab *kmem_slab_create(size_t size, size_t align, size_t order,
+                                   int32_t flags)
+{
+    size = ROUND_TO_SLAB_ALIGN(size, align);
+    if (size > MAX_SLAB_SIZE || order > KMEM_SLAB_MAX_ORDER)
     {
         panic("kmem_slab_create: unsupported slab size");
     }
+    if (g_kernel_memory.pages == NULL)
+    {
+        // objects can only be mapped to their slab via the page descriptors
+        order = 0;
+    }
+
+    struct kmem_slab *slab = alloc_pages(
+        ALLOC_FLAG_ZERO_MEMORY | (flags & ALLOC_FLAG_NO_RECLAIM), order);
+    if (!slab) return NULL;
+
+    // calculate offset of first object
+    size_t offset_objects = ROUND_TO_SLAB_ALIGN(sizeof(struct kmem_slab), align);
 
     list_init(&(slab->slab_list));
     slab->object_size = size;
+    slab->object_offset = offset_objects;
     slab->free_list = NULL;
     slab->objects_allocated = 0;
+    slab->order = order;
     slab->owning_cache = NULL;
 
-    // calculate offset of first object
-    size_t offset_objects = ROUND_TO_MIN_SLAB_SIZE(sizeof(struct kmem_slab));
+    if (g_kernel_memory.pages != NULL)
+    {
+        for (size_t i = 0; i < (1 << order); ++i)
+        {
+            struct page *page = page_from_kva((char *)slab + i * PAGE_SIZE);
+            page->slab = slab;
+            page->flags |= PAGE_FLAG_SLAB;
+        }
+    }
 
     // create free list
     size_t next_object = offset_objects;
-    while ((next_object + size) <= PAGE_SIZE)
+    while ((next_object + size) <= (PAGE_SIZE << order))
     {
         size_t *object = (size_t *)((size_t)slab + next_object);
         *object = (size_t)slab->free_list;
@@ -39,6 +74,39 @@ struct kmem_slab *kmem_slab_create(size_t size)
     return slab;
 }
 
+void kmem_slab_delete(struct kmem_slab *slab)
+{
+    DEBUG_EXTRA_ASSERT(kmem_slab_is_empty(slab),
+                       "deleting non empty slab container!");
+
+    size_t order = slab->order;
+    if (g_kernel_memory.pages != NULL)
+    {
+        for (size_t i = 0; i < (1 << order); ++i)
+        {
+            struct page *page = page_from_kva((char *)slab + i * PAGE_SIZE);
+            page->slab = NULL;
+            page->flags &= ~PAGE_FLAG_SLAB;
+        }
+    }
+    free_pages(slab, order);
+}
+
+struct kmem_slab *kmem_slab_infer_slab(void *object)
+{
+    if (g_kernel_memory.pages != NULL)
+    {
+        struct page *page = page_from_kva(object);
+        if (page->flags & PAGE_FLAG_SLAB)
+        {
+            return page->slab;
+        }
+    }
+
+    // single page slab from early boot
+    return (struct kmem_slab *)PAGE_ROUND_DOWN((size_t)object);
+}
+
 void *kmem_slab_alloc(struct kmem_slab *slab, int32_t flags)
 {
     if (slab->free_list == NULL) return NULL;
@@ -57,15 +125,15 @@ void *kmem_slab_alloc(struct kmem_slab *slab, int32_t flags)
 void kmem_slab_free(struct kmem_slab *slab, void *object)
 {
     DEBUG_EXTRA_PANIC(
-        (PAGE_ROUND_DOWN((size_t)object) == (size_t)slab),
+        ((size_t)object > (size_t)slab) &&
+            ((size_t)object < (size_t)slab + (PAGE_SIZE << slab->order)),
         "kmem_slab_free called for object not belonging to this slab");
     DEBUG_EXTRA_PANIC((slab->owning_cache != NULL),
                       "kmem_slab_free slab not owned by a cache");
 
     // try to cache free() calls with wrong pointers
     DEBUG_EXTRA_PANIC(
-        (((size_t)object % PAGE_SIZE -
-          ROUND_TO_MIN_SLAB_SIZE(sizeof(struct kmem_slab))) %
+        (((size_t)object - (size_t)slab - slab->object_offset) %
          slab->object_size) == 0,
         "kmem_slab_free not a pointer returned by kmem_slab_alloc()");
 
@@ -94,14 +162,8 @@ int isprint(int arg) { return (arg >= 32 && arg <= 126); }
 
 void debug_kmem_slab_dump_objects(struct kmem_slab *slab)
 {
-    size_t max_objects =
-        (PAGE_SIZE - sizeof(struct kmem_slab)) / slab->object_size;
-
-    size_t offset_objects = slab->object_size;
-    while (offset_objects < sizeof(struct kmem_slab))
-    {
-        offset_objects += slab->object_size;
-    }
+    size_t max_objects = kmem_slab_get_max_objects(slab);
+    size_t offset_objects = slab->object_offset;
 
     for (size_t i = 0; i < max_objects; i++)
     {
@@ -110,7 +172,7 @@ void debug_kmem_slab_dump_objects(struct kmem_slab *slab)
         bool print = false;
         size_t first_word = *(size_t *)obj_offset;
         if (first_word > (size_t)slab &&
-            first_word < ((size_t)slab + PAGE_SIZE))
+            first_word < ((size_t)slab + (PAGE_SIZE << slab->order)))
         {
             // pointer to somewhere in this slab, don't print
             continue;
@@ -149,7 +211,8 @@ void debug_kmem_slab_dump_objects(struct kmem_slab *slab)
 
 size_t kmem_slab_get_max_objects(struct kmem_slab *slab)
 {
-    return (PAGE_SIZE - sizeof(struct kmem_slab)) / slab->object_size;
+    return ((PAGE_SIZE << slab->order) - slab->object_offset) /
+           slab->object_size;
 }
 
 void kmem_slab_check(struct kmem_slab *slab)
@@ -19,18 +19,25 @@ _Static_assert((sizeof(size_t) <= MIN_SLAB_SIZE),
                "an object can not be smaller than a size_t");
 
 // maximal size of objects managed by the slab allocator
-// a full slab is stored in one page, data and metadata.
-// Minus the slab struct only three 1280 byte objects fit into
-// one 4KB page, this is still useful. However only one object of half the
-// PAGE_SIZE would fit, so for everything larger 1280 bytes kmalloc
-// will use a full page from alloc_page() instead.
-#define MAX_SLAB_SIZE (1280)
+// a slab is stored in 2^order pages, data and metadata (the slab struct is at
+// the start of the first page). Minus the slab struct only one object of half
+// the PAGE_SIZE fits into one page, but seven into four pages. Larger
+// kmalloc() allocations get whole pages from alloc_pages() instead.
+#define MAX_SLAB_SIZE (PAGE_SIZE / 2)
+
+// max order of the pages of one slab
+#define KMEM_SLAB_MAX_ORDER 3
 
 // round up an allocation size to the next multiple of the MIN_SLAB_SIZE
 #define ROUND_TO_MIN_SLAB_SIZE(size) \
     (((size + MIN_SLAB_SIZE - 1) / MIN_SLAB_SIZE) * MIN_SLAB_SIZE)
 
-/// @brief  A slab allocator managing one page of memory, used by kmem_cache.
+// round up to a multiple of align, which must be a power of 2
+#define ROUND_TO_SLAB_ALIGN(size, align) \
+    (((size) + (align) - 1) & ~((size_t)(align) - 1))
+
+/// @brief  A slab allocator managing 2^order pages of memory, used by
+/// kmem_cache.
 /// Access must be synced externally. Don't use directly, use a kmem_cache
 /// object.
 struct kmem_slab
@@ -40,10 +47,14 @@ struct kmem_slab
     struct list_head slab_list;
     // free objects in this slab
     void *free_list;
-    // size of one object including padding to the SLAB_ALIGNMENT
+    // size of one object including padding to the alignment
     size_t object_size;
+    // offset of the first object from the start of the slab
+    size_t object_offset;
     // number of allocated objects, used to detect when a slab is empty
     size_t objects_allocated;
+    // the slab spans 2^order pages
+    size_t order;
 
     // if the slab is managed by a cache, this points to it
     // can be NULL if the slab is used standalone
@@ -53,7 +64,31 @@ struct kmem_slab
 #define kmem_slab_from_list(ptr) container_of(ptr, struct kmem_slab, slab_list)
 
 /// @brief Construct a new slab object.
-struct kmem_slab *kmem_slab_create(size_t size);
+/// @param size Size of the objects, a multiple of align.
+/// @param align Alignment of the objects, a power of 2 >= MIN_SLAB_SIZE.
+/// @param order The slab spans 2^order pages. Before the page descriptors
+/// exist (early boot) only single page slabs get created, see
+/// kmem_slab_infer_slab().
+/// @param flags ALLOC_FLAG_NO_RECLAIM if the shrinkers must not run, all
+/// other flags are ignored.
+struct kmem_slab *kmem_slab_create(size_t size, size_t align, size_t order,
+                                   int32_t flags);
+
+/// @brief Number of objects of a slab created with kmem_slab_create().
+static inline size_t kmem_slab_objects_per_slab(size_t size, size_t align,
+                                                size_t order)
+{
+    return ((PAGE_SIZE << order) -
+            ROUND_TO_SLAB_ALIGN(sizeof(struct kmem_slab), align)) /
+           size;
+}
+
+/// @brief Smallest slab order which wastes at most 1/8 of the slab, capped at
+/// KMEM_SLAB_MAX_ORDER.
+/// @param size Size of the objects, a multiple of align.
+/// @param align Alignment of the objects.
+/// @return Order to pass to kmem_slab_create().
+size_t kmem_slab_order_for_size(size_t size, size_t align);
 
 /// @brief True if no objects are managed by this slab.
 /// @param slab The slab to test.
@@ -65,12 +100,7 @@ static inline bool kmem_slab_is_empty(struct kmem_slab *slab)
 
 /// @brief Delete a slab
 /// @param The slab created by kmem_slab_create()
-static inline void kmem_slab_delete(struct kmem_slab *slab)
-{
-    DEBUG_EXTRA_ASSERT(kmem_slab_is_empty(slab),
-                       "deleting non empty slab container!");
-    free_page(slab);
-}
+void kmem_slab_delete(struct kmem_slab *slab);
 
 /// @brief Allocate a new object from this slab.
 /// @param slab Slab to get an object from, size is implicit by the chosen slab.
@@ -78,12 +108,10 @@ static inline void kmem_slab_delete(struct kmem_slab *slab)
 void *kmem_slab_alloc(struct kmem_slab *slab, int32_t flags);
 
 /// @brief If we know that an object was allocated by some slab, we can infer
-/// the slab as its struct is stored at the beginning of the same page.
-/// Only works as long as slab allocators only manage one page each.
-static inline struct kmem_slab *kmem_slab_infer_slab(void *object)
-{
-    return (struct kmem_slab *)PAGE_ROUND_DOWN((size_t)object);
-}
+/// the slab: the page descriptors of all pages of a slab point to it. Slabs
+/// from early boot (before the descriptors exist) span one page and store
+/// their struct at the beginning of it.
+struct kmem_slab *kmem_slab_infer_slab(void *object);
 
 /// @brief Free an object. Use kmem_slab_infer_slab() if the slab used was not
 /// stored explicitly.
@@ -9,6 +9,7 @@
 #include <kernel/proc.h>
 #include <kernel/string.h>
 #include <mm/arch_vm.h>
+#include <mm/asid.h>
 #include <mm/kalloc.h>
 #include <mm/kernel_memory.h>
 #include <mm/memlayout.h>
@@ -20,6 +21,9 @@ size_t mmu_set_page_table(pagetable_t pgtable, uint32_t asid)
 {
     size_t reg_value = mmu_make_page_table_reg((size_t)pgtable, asid);
     mmu_set_page_table_reg_value(reg_value);
+    // only used for the kernel page table which might have changed: flush
+    // all entries
+    mmu_flush_tlb();
     return reg_value;
 }
 
@@ -33,6 +37,26 @@ syserr_t kvm_apply_mapping(struct Page_Table *kpagetable)
     return 0;
 }
 
+/// Changes to more pages than this flush all TLB entries of the page table
+/// instead of one sfence per page.
+#define VM_FLUSH_PAGE_LIMIT 32
+
+/// @brief Remove stale TLB entries after PTEs of a page table changed.
+static void vm_flush_range(struct Page_Table *pagetable, size_t va,
+                           size_t npages)
+{
+    if (npages > VM_FLUSH_PAGE_LIMIT)
+    {
+        asid_flush_all(pagetable);
+        return;
+    }
+
+    for (size_t page = 0; page < npages; ++page)
+    {
+        asid_flush_page(pagetable, va + page * PAGE_SIZE);
+    }
+}
+
 #if defined(__ARCH_32BIT)
 const size_t MAX_PTES_PER_PAGE_TABLE = 1024;
 #else
@@ -244,6 +268,10 @@ int32_t vm_map(struct Page_Table *pagetable, size_t va, size_t pa, size_t size,
         current_pa += bytes_mapped;
         remaining_size -= bytes_mapped;
     }
+    // also needed for new mappings to order the PTE writes before the page
+    // table walks
+    vm_flush_range(pagetable, va, size / PAGE_SIZE);
+
     return 0;
 }
 
@@ -273,11 +301,51 @@ void vm_unmap(struct Page_Table *pagetable, size_t va, size_t npages,
         }
         if (do_free)
         {
+            // the page might be shared copy-on-write
             size_t pa = PTE_GET_PA(*pte);
-            free_page((void *)phys_to_virt(pa));
+            put_pages_range((void *)phys_to_virt(pa), 1);
         }
         *pte = 0;
     }
+    vm_flush_range(pagetable, va, npages);
+}
+
+void vm_write_protect(struct Page_Table *pagetable, size_t va, size_t npages)
+{
+    for (size_t page = 0; page < npages; ++page)
+    {
+        pte_t *pte = vm_walk(pagetable, va + page * PAGE_SIZE, false);
+        if (pte == NULL || !PTE_IS_VALID_NODE(*pte) || !PTE_IS_LEAF(*pte))
+        {
+            panic("vm_write_protect: not mapped");
+        }
+        *pte = pte_unset_writeable(*pte);
+    }
+    vm_flush_range(pagetable, va, npages);
+}
+
+bool uvm_reserve_heap(struct Page_Table *pagetable, size_t end_va,
+                      size_t alloc_size)
+{
+    size_t new_end_va = end_va + alloc_size;
+    if ((new_end_va < end_va) || !VA_IS_IN_RANGE_FOR_USER(new_end_va))
+    {
+        return false;
+    }
+
+    // Refuse reservations which could never be backed by memory, so obvious
+    // overallocations fail at sbrk() and not at the first access.
+    size_t new_pages =
+        (PAGE_ROUND_UP(new_end_va) - PAGE_ROUND_UP(end_va)) / PAGE_SIZE;
+    if (new_pages > kalloc_get_free_memory() / PAGE_SIZE)
+    {
+        return false;
+    }
+
+    spin_lock(&pagetable->lock);
+    pagetable->demand_end = PAGE_ROUND_UP(new_end_va);
+    spin_unlock(&pagetable->lock);
+    return true;
 }
 
 size_t uvm_alloc_heap(struct Page_Table *pagetable, size_t start_va,
@@ -301,32 +369,25 @@ size_t uvm_alloc_heap(struct Page_Table *pagetable, size_t start_va,
             break;
         }
 
-        struct MM_Region *region = mm_region_alloc_init(
-            virt_to_phys((size_t)mem), va, PAGE_SIZE, map_type);
-        if (region == NULL)
+        // consecutive pages of one type end up in one region
+        if (page_table_map_page(pagetable, va, mem, map_type) < 0)
         {
-            kfree(mem);
+            free_page(mem);
             break;
         }
-        memory_map_add_single_region(&pagetable->memory_map, region);
     }
     if (va < end_va)
     {
-        // out of memory: clean up and return failure
-        // we can assume no allocations from the va loop, but
-        // must leanup everything from the earlier loops
-        page_table_unmap_partial_mappings(pagetable);
+        // out of memory: clean up the pages of this call and return failure,
+        // they are at the end of the heap so no region gets split
+        if (page_table_unmap_range(pagetable, start_va, va - start_va) < 0)
+        {
+            panic("uvm_alloc_heap: can't unmap pages");
+        }
         spin_unlock(&pagetable->lock);
         return 0;
     }
-
-    // apply mapping, failure will clean up in memory map
-    syserr_t err = page_table_apply_mapping(pagetable);
     spin_unlock(&pagetable->lock);
-    if (err < 0)
-    {
-        return 0;
-    }
 
     return alloc_size;
 }
@@ -346,12 +407,19 @@ size_t uvm_dealloc_heap(struct Page_Table *pagetable, size_t end_va,
 
     size_t npages = (PAGE_ROUND_UP(end_va) - start_dealloc_va) / PAGE_SIZE;
 
+    spin_lock(&pagetable->lock);
     if (npages > 0)
     {
-        spin_lock(&pagetable->lock);
-        page_table_unmap_range(pagetable, start_dealloc_va, npages * PAGE_SIZE);
-        spin_unlock(&pagetable->lock);
+        // not all pages of the heap might have been touched yet
+        if (page_table_unmap_range(pagetable, start_dealloc_va,
+                                   npages * PAGE_SIZE) < 0)
+        {
+            spin_unlock(&pagetable->lock);
+            return 0;
+        }
     }
+    pagetable->demand_end = start_dealloc_va;
+    spin_unlock(&pagetable->lock);
 
     return dealloc_size;
 }
@@ -425,20 +493,13 @@ size_t uvm_grow_stack(struct Page_Table *pagetable, size_t stack_low)
 
     size_t new_stack_low = stack_low - PAGE_SIZE;
 
-    struct MM_Region *region =
-        mm_region_alloc_init(virt_to_phys((size_t)mem), new_stack_low,
-                             PAGE_SIZE, MM_REGION_USER_STACK);
-    if (region == NULL)
-    {
-        free_page(mem);
-        return 0;
-    }
     spin_lock(&pagetable->lock);
-    memory_map_add_single_region(&pagetable->memory_map, region);
-
-    if (page_table_apply_mapping(pagetable) != 0)
+    // grows the stack region
+    if (page_table_map_page(pagetable, new_stack_low, mem,
+                            MM_REGION_USER_STACK) < 0)
     {
         spin_unlock(&pagetable->lock);
+        free_page(mem);
         return 0;
     }
 
@@ -495,6 +556,39 @@ void vm_free_pgtable(pagetable_t pgtable)
     free_page((void *)pgtable);
 }
 
+// Map a not yet loaded page of a file mapping, see page_table_fault_file().
+// The page table lock gets dropped while the file is read. That is only
+// possible if the caller holds no other spinlock, callers which do (e.g. a pipe
+// write) must use uvm_prefault() before taking their lock.
+static bool uvm_fault_file_page(struct Page_Table *pagetable, size_t va)
+{
+    DEBUG_ASSERT_CPU_HOLDS_LOCK(&pagetable->lock);
+
+    if (get_cpu()->disable_dev_int_stack_depth != 1)
+    {
+        return false;  // can't sleep
+    }
+
+    spin_unlock(&pagetable->lock);
+    syserr_t err = page_table_fault_file(pagetable, va);
+    spin_lock(&pagetable->lock);
+
+    return (err == 0);
+}
+
+void uvm_prefault(struct Page_Table *pagetable, size_t va, size_t len)
+{
+    if ((len == 0) || (va + len < va)) return;
+
+    for (size_t page_va = PAGE_ROUND_DOWN(va); page_va < va + len;
+         page_va += PAGE_SIZE)
+    {
+        // fails for all pages which are not in a file mapping or mapped
+        // already, the access later handles those
+        page_table_fault_file(pagetable, page_va);
+    }
+}
+
 int32_t uvm_copy_out(struct Page_Table *pagetable, size_t dst_va, char *src_pa,
                      size_t len)
 {
@@ -509,6 +603,21 @@ int32_t uvm_copy_out(struct Page_Table *pagetable, size_t dst_va, char *src_pa,
         size_t dst_pa_page_start = uvm_get_physical_paddr(
             pagetable, dst_va_page_start, &dst_page_is_writeable);
 
+        if (dst_pa_page_start != 0 && !dst_page_is_writeable &&
+            page_table_copy_on_write(pagetable, dst_va_page_start) == 0)
+        {
+            // page was shared copy-on-write, now it's a private copy
+            dst_pa_page_start = uvm_get_physical_paddr(
+                pagetable, dst_va_page_start, &dst_page_is_writeable);
+        }
+        else if (dst_pa_page_start == 0 &&
+                 page_table_populate(pagetable, dst_va_page_start) == 0)
+        {
+            // first access to a heap page
+            dst_pa_page_start = uvm_get_physical_paddr(
+                pagetable, dst_va_page_start, &dst_page_is_writeable);
+        }
+
         if (dst_pa_page_start == 0 || !dst_page_is_writeable)
         {
             // page not mapped or read-only
@@ -545,6 +654,14 @@ int32_t uvm_copy_in(struct Page_Table *pagetable, char *dst_pa, size_t src_va,
         size_t src_va_page_start = PAGE_ROUND_DOWN(src_va);
         size_t src_pa_page_start =
             uvm_get_physical_paddr(pagetable, src_va_page_start, NULL);
+        if (src_pa_page_start == 0 &&
+            (page_table_populate(pagetable, src_va_page_start) == 0 ||
+             uvm_fault_file_page(pagetable, src_va_page_start)))
+        {
+            // first access to a heap page or a page of the program file
+            src_pa_page_start =
+                uvm_get_physical_paddr(pagetable, src_va_page_start, NULL);
+        }
         if (src_pa_page_start == 0)
         {
             spin_unlock(&pagetable->lock);
@@ -581,6 +698,18 @@ int32_t uvm_copy_in_str(struct Page_Table *pagetable, char *dst_pa,
         size_t src_pa_page_start =
             uvm_get_physical_paddr(pagetable, src_va_page_start, NULL);
         if (src_pa_page_start == 0)
+        {
+            // first access to a heap page or a page of the program file
+            spin_lock(&pagetable->lock);
+            if (page_table_populate(pagetable, src_va_page_start) == 0 ||
+                uvm_fault_file_page(pagetable, src_va_page_start))
+            {
+                src_pa_page_start =
+                    uvm_get_physical_paddr(pagetable, src_va_page_start, NULL);
+            }
+            spin_unlock(&pagetable->lock);
+        }
+        if (src_pa_page_start == 0)
         {
             return -1;
         }
@@ -662,6 +791,9 @@ bool vm_trim_pagetable(struct Page_Table *pagetable, size_t va_removed)
 
     kfree(parent_of_va_removed);
     *pte_of_parent_of_va_removed = 0;
+    // sfence with an address only covers leaf entries, flush the cached
+    // non-leaf entry as well
+    asid_flush_all(pagetable);
 
     return true;
 }
@@ -54,6 +54,11 @@ size_t mmu_get_page_table_address(size_t reg_value);
 /// @return ASID
 size_t mmu_get_page_table_asid(size_t reg_value);
 
+/// @brief Probes the highest ASID the MMU supports. Must be called with the
+/// kernel page table active.
+/// @return Highest usable ASID, 0 if ASIDs are not supported.
+uint32_t mmu_get_max_asid();
+
 /// Initialize the given page table with its memory map
 syserr_t kvm_apply_mapping(struct Page_Table *kpagetable);
 
@@ -77,8 +82,18 @@ size_t kvm_get_physical_paddr(size_t va);
 int32_t vm_map(struct Page_Table *pagetable, size_t va, size_t pa, size_t size,
                pte_t perm, bool allow_super_pages);
 
-/// @brief Allocate PTEs and physical memory to grow the process heap (and text,
-/// data, bss segments at load/execv).
+/// @brief Grow the demand paged heap range of a page table. No memory gets
+/// allocated, pages are populated on first access (see page_table_populate()).
+/// @param pagetable page table
+/// @param end_va current end of heap
+/// @param alloc_size bytes to grow the heap by
+/// @return true on success, false if the range is invalid or more than the free
+/// memory.
+bool uvm_reserve_heap(struct Page_Table *pagetable, size_t end_va,
+                      size_t alloc_size);
+
+/// @brief Allocate PTEs and physical memory right away, used for the text,
+/// data, bss segments at load/execv.
 /// [round_up(start_va) to end_va] gets mapped. start_va is round up to the next
 /// page (no change if it was page aligned).
 /// @param pagetable page table
@@ -128,6 +143,13 @@ void vm_free_pgtable(pagetable_t pgtable);
 void vm_unmap(struct Page_Table *pagetable, size_t va, size_t npages,
               bool do_free);
 
+/// @brief Remove the write permission of npages of mappings starting from va.
+/// The mappings must exist.
+/// @param pagetable Pagetable to modify.
+/// @param va Virtual address of start, must be page-aligned.
+/// @param npages Number of pages.
+void vm_write_protect(struct Page_Table *pagetable, size_t va, size_t npages);
+
 /// @brief Return PTE in pagetable which maps the given address va. Optionally
 /// create any required page-table pages.
 /// @param pagetable The page table to look-up in or extend (see alloc)
@@ -170,6 +192,15 @@ size_t uvm_get_physical_addr(struct Page_Table *pagetable, size_t va,
 size_t uvm_get_physical_paddr(struct Page_Table *pagetable, size_t va,
                               bool *is_writeable);
 
+/// @brief Map the not yet loaded file pages (program text and read-only data)
+/// of a user range. For callers which have to copy from user space while
+/// holding a spinlock, as that copy can't read the pages from the file. Might
+/// sleep.
+/// @param pagetable Pagetable of the process, lock must not be held.
+/// @param va Start of the user range.
+/// @param len Length of the range in bytes.
+void uvm_prefault(struct Page_Table *pagetable, size_t va, size_t len);
+
 /// @brief Copy from kernel to user.
 /// Copy len bytes from src_pa to dst_va in a given page table.
 /// @param pagetable Pagetable for address translation.
@@ -7,6 +7,7 @@
 #include <kernel/kticks.h>
 #include <kernel/limits.h>
 #include <kernel/proc.h>
+#include <kernel/spawn.h>
 #include <kernel/spinlock.h>
 #include <kernel/string.h>
 #include <mm/kalloc.h>
@@ -60,16 +61,13 @@ syserr_t sys_ms_sleep()
 
     if (milli_seconds < 0) milli_seconds = 0;
 
-    size_t kernel_ticks = milli_seconds * TIMER_INTERRUPTS_PER_SECOND / 1000;
+    struct timespec duration = {.tv_sec = milli_seconds / 1000,
+                                .tv_nsec = (milli_seconds % 1000) * 1000000};
+    uint64_t deadline = get_time() + timer_from_timespec(&duration);
 
-    size_t ticks0 = atomic_load(&g_ticks);
-    while (atomic_load(&g_ticks) - ticks0 < kernel_ticks)
+    if (proc_sleep_until(deadline) < 0)
     {
-        if (proc_is_killed(get_current()))
-        {
-            return -ESRCH;
-        }
-        sleep(&g_ticks, NULL);
+        return -ESRCH;
     }
     return 0;
 }
@@ -87,62 +85,144 @@ syserr_t sys_kill()
     return proc_send_signal(pid, signal);
 }
 
-syserr_t sys_execv()
+/// @brief Copies a NULL terminated user argv array into kernel pages.
+/// @param uargv User address of the array.
+/// @param argv Array of MAX_EXEC_ARGS to fill, must be zeroed. Must be freed
+/// with free_argv() also on failure.
+/// @return 0 on success, -errno on failure.
+static syserr_t fetch_argv(size_t uargv, char **argv)
 {
-    // parameter 0: char *pathname
-    char path[PATH_MAX];
-    if (argstr(0, path, PATH_MAX) < 0)
-    {
-        return -EFAULT;
-    }
-
-    // parameter 1: char *argv[]
-    char *argv[MAX_EXEC_ARGS];
-    memset(argv, 0, sizeof(argv));
-
-    size_t uargv, uarg;
-    argaddr(1, &uargv);
-
-    syserr_t error_code = 0;
+    size_t uarg;
     for (size_t i = 0;; i++)
     {
-        if (i >= NELEM(argv))
+        if (i >= MAX_EXEC_ARGS)
         {
-            error_code = -E2BIG;
-            break;
+            return -E2BIG;
         }
         if (fetchaddr(uargv + sizeof(size_t) * i, (size_t *)&uarg) < 0)
         {
-            error_code = -EFAULT;
-            break;
+            return -EFAULT;
         }
         if (uarg == 0)
         {
             argv[i] = 0;
-            break;
+            return 0;
         }
         argv[i] = alloc_page(ALLOC_FLAG_ZERO_MEMORY);
         if (argv[i] == NULL)
         {
-            error_code = -ENOMEM;
-            break;
+            return -ENOMEM;
         }
         if (fetchstr(uarg, argv[i], PAGE_SIZE) < 0)
         {
-            error_code = -EFAULT;
-            break;
+            return -EFAULT;
         }
     }
+}
+
+/// @brief Frees the pages of an argv array from fetch_argv().
+static void free_argv(char **argv)
+{
+    for (size_t i = 0; i < MAX_EXEC_ARGS && argv[i] != NULL; i++)
+    {
+        free_page(argv[i]);
+    }
+}
+
+syserr_t sys_execv()
+{
+    // parameter 0: char *pathname
+    char path[PATH_MAX];
+    if (argstr(0, path, PATH_MAX) < 0)
+    {
+        return -EFAULT;
+    }
+
+    // parameter 1: char *argv[]
+    char *argv[MAX_EXEC_ARGS];
+    memset(argv, 0, sizeof(argv));
+
+    size_t uargv;
+    argaddr(1, &uargv);
 
+    syserr_t error_code = fetch_argv(uargv, argv);
     if (error_code == 0)
     {
         error_code = do_execv(path, argv);
     }
     // cleanup on error and success:
-    for (size_t i = 0; i < NELEM(argv) && argv[i] != NULL; i++)
+    free_argv(argv);
+    return error_code;
+}
+
+syserr_t sys_spawn()
+{
+    // parameter 0: char *pathname
+    char path[PATH_MAX];
+    if (argstr(0, path, PATH_MAX) < 0)
     {
-        free_page(argv[i]);
+        return -EFAULT;
+    }
+
+    // parameter 2: const struct spawn_action *actions
+    size_t uactions;
+    argaddr(2, &uactions);
+
+    // parameter 3: int32_t n_actions
+    int32_t n_actions;
+    argint(3, &n_actions);
+    if (n_actions < 0 || n_actions > SPAWN_MAX_ACTIONS)
+    {
+        return -EINVAL;
+    }
+
+    // The kernel stack is small: the actions followed by the paths of all
+    // open actions go into one page.
+    _Static_assert(SPAWN_MAX_ACTIONS * (sizeof(struct spawn_action) +
+                                        PATH_MAX) <= PAGE_SIZE,
+                   "spawn actions don't fit into a page");
+    char *action_page = alloc_page(ALLOC_FLAG_ZERO_MEMORY);
+    if (action_page == NULL)
+    {
+        return -ENOMEM;
+    }
+    struct spawn_action *actions = (struct spawn_action *)action_page;
+    char *paths = action_page + SPAWN_MAX_ACTIONS * sizeof(struct spawn_action);
+
+    struct process *proc = get_current();
+    if (uvm_copy_in(proc->pagetable, (char *)actions, uactions,
+                    n_actions * sizeof(struct spawn_action)) < 0)
+    {
+        free_page(action_page);
+        return -EFAULT;
+    }
+    for (size_t i = 0; i < n_actions; i++)
+    {
+        if (actions[i].type != SPAWN_ACTION_OPEN) continue;
+
+        char *kpath = paths + i * PATH_MAX;
+        if (fetchstr((size_t)actions[i].path, kpath, PATH_MAX) < 0)
+        {
+            free_page(action_page);
+            return -EFAULT;
+        }
+        actions[i].path = kpath;
+    }
+
+    // parameter 1: char *argv[]
+    char *argv[MAX_EXEC_ARGS];
+    memset(argv, 0, sizeof(argv));
+
+    size_t uargv;
+    argaddr(1, &uargv);
+
+    syserr_t error_code = fetch_argv(uargv, argv);
+    if (error_code == 0)
+    {
+        error_code = do_spawn(path, argv, actions, n_actions);
     }
+    free_argv(argv);
+    free_page(action_page);
     return error_code;
 }
 
@@ -4,6 +4,7 @@
 // System Information system calls.
 //
 
+#include <arch/timer.h>
 #include <arch/trap.h>
 #include <drivers/rtc.h>
 #include <kernel/kernel.h>
@@ -89,6 +90,87 @@ syserr_t get_time_to_user(clockid_t clockid, size_t timespec_va)
     return (res < 0) ? -ENOMEM : 0;
 }
 
+/// @brief a - b, clamped to 0.
+static struct timespec timespec_sub(struct timespec a, struct timespec b)
+{
+    struct timespec result = {.tv_sec = 0, .tv_nsec = 0};
+    if (a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec <= b.tv_nsec))
+    {
+        return result;
+    }
+    result.tv_sec = a.tv_sec - b.tv_sec;
+    result.tv_nsec = a.tv_nsec - b.tv_nsec;
+    if (result.tv_nsec < 0)
+    {
+        result.tv_sec--;
+        result.tv_nsec += 1000000000;
+    }
+    return result;
+}
+
+syserr_t sys_clock_nanosleep()
+{
+    // parameter 0: clockid
+    clockid_t clock;
+    argint(0, &clock);
+
+    // parameter 1: flags
+    int32_t flags;
+    argint(1, &flags);
+
+    // parameter 2: const struct timespec *request
+    size_t request_va;
+    argaddr(2, &request_va);
+
+    // parameter 3: struct timespec *remain (can be NULL)
+    size_t remain_va;
+    argaddr(3, &remain_va);
+
+    if (clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC)
+    {
+        return -EINVAL;
+    }
+
+    struct process *proc = get_current();
+    struct timespec request;
+    if (uvm_copy_in(proc->pagetable, (char *)&request, request_va,
+                    sizeof(struct timespec)) < 0)
+    {
+        return -EFAULT;
+    }
+    if (request.tv_sec < 0 || request.tv_nsec < 0 ||
+        request.tv_nsec >= 1000000000)
+    {
+        return -EINVAL;
+    }
+
+    if (flags & TIMER_ABSTIME)
+    {
+        // both clocks are based on rtc_get_time()
+        request = timespec_sub(request, rtc_get_time());
+    }
+
+    uint64_t deadline = get_time() + timer_from_timespec(&request);
+    if (proc_sleep_until(deadline) == 0)
+    {
+        return 0;
+    }
+
+    // interrupted, report the remaining time for relative sleeps
+    if (remain_va != 0 && !(flags & TIMER_ABSTIME))
+    {
+        uint64_t now = get_time();
+        struct timespec remain =
+            timer_to_timespec((deadline > now) ? (deadline - now) : 0);
+        if (uvm_copy_out(proc->pagetable, remain_va, (char *)&remain,
+                         sizeof(struct timespec)) < 0)
+        {
+            return -EFAULT;
+        }
+    }
+    return -EINTR;
+}
+
 syserr_t sys_clock_gettime()
 {
     // parameter 0: cklockid
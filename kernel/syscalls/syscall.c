@@ -179,6 +179,8 @@ static syserr_t (*syscalls[])() = {
     [SYS_setgroups] sys_setgroups,
     [SYS_getgroups] sys_getgroups,
     [SYS_umask] sys_umask,
+    [SYS_clock_nanosleep] sys_clock_nanosleep,
+    [SYS_spawn] sys_spawn,
 };
 // clang-format on
 
@@ -259,6 +261,8 @@ static const char *g_syscall_names[] = {
     [SYS_setgroups] "setgroups",
     [SYS_getgroups] "getgroups",
     [SYS_umask] "umask",
+    [SYS_clock_nanosleep] "clock_nanosleep",
+    [SYS_spawn] "spawn",
 };
 // clang-format on
 
@@ -25,6 +25,11 @@ syserr_t sys_fork();
 /// @return Does not return on success, -ERRNO on error.
 syserr_t sys_execv();
 
+/// @brief Syscall "pid_t spawn(const char *pathname, char *argv[], const
+/// struct spawn_action *actions, int32_t n_actions)" from spawn.h.
+/// @return Child PID, -ERRNO on error.
+syserr_t sys_spawn();
+
 /// @brief  Syscall "void exit(int32_t status)" from unistd.h.
 /// @return Does not return.
 syserr_t sys_exit();
@@ -154,7 +159,7 @@ syserr_t sys_umask();
 //
 
 /// @brief Syscall "int32_t uptime()" from unistd.h.
-/// @return how many clock tick interrupts have occurred
+/// @return time since boot in ticks (1/TIMER_INTERRUPTS_PER_SECOND seconds)
 syserr_t sys_uptime();
 
 /// @brief Syscall "ssize_t reboot(int32_t cmd)" from reboot.h
@@ -166,6 +171,12 @@ syserr_t sys_reboot();
 /// @return 0 on success, -ERRNO on error
 syserr_t sys_clock_gettime();
 
+/// @brief Syscall "int clock_nanosleep(clockid_t clockid, int flags, const
+/// struct timespec *request, struct timespec *remain);" from time.h (also
+/// used by nanosleep())
+/// @return 0 on success, -ERRNO on error
+syserr_t sys_clock_nanosleep();
+
 /// @brief Syscall "int mount(const char *source, const char *target, const char
 /// *filesystemtype, unsigned long mountflags, const void *data);" from mount.h
 /// @return 0 on success, -ERRNO on error
@@ -8,11 +8,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 #include <vimixutils/time.h>
 
-#define BUFSZ (32 * 1024)
+#define BUFSZ (128 * 1024)
 char buf[BUFSZ];
 
 const size_t file_sizes[] = {
@@ -25,7 +26,8 @@ const size_t file_sizes[] = {
 const size_t num_fs_sizes = sizeof(file_sizes) / sizeof(file_sizes[0]);
 
 // const size_t bytes_per_run[] = {1, 4, 16, 64, 256, 1024, 4096, 16 * 1024};
-const size_t bytes_per_run[] = {1024, 4096, 16 * 1024, 32 * 1024};
+const size_t bytes_per_run[] = {1024, 4096, 16 * 1024, 32 * 1024,
+                                128 * 1024};
 const size_t num_bytes_per_run =
     sizeof(bytes_per_run) / sizeof(bytes_per_run[0]);
 
@@ -117,6 +119,103 @@ uint64_t bench_file_read(struct test *test)
     return t1 - t0;
 }
 
+#define PARALLEL_FILE_SIZE (64 * 1024)
+#define PARALLEL_READS 32  ///< each process reads its file this often
+
+void parallel_file_name(char *name, size_t n, size_t i)
+{
+    snprintf(name, n, "parallel%zu.dat", i);
+}
+
+void read_file_repeatedly(const char *name)
+{
+    for (size_t r = 0; r < PARALLEL_READS; r++)
+    {
+        int fd = open(name, O_RDONLY);
+        if (fd < 0)
+        {
+            printf("cannot open %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+        while (read(fd, buf, BUFSZ) > 0)
+        {
+        }
+        close(fd);
+    }
+}
+
+/// Each process reads its own file, after the first read all blocks are in
+/// the block IO cache: the processes only compete for the cache.
+/// @return Time in ms till all processes are done.
+uint64_t bench_parallel_read(size_t processes)
+{
+    char name[64];
+    for (size_t i = 0; i < processes; i++)
+    {
+        parallel_file_name(name, sizeof(name), i);
+        int fd = open(name, O_CREAT | O_RDWR | O_TRUNC, 0755);
+        if (fd < 0)
+        {
+            printf("cannot create %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+        for (size_t total = 0; total < PARALLEL_FILE_SIZE; total += BUFSZ)
+        {
+            if (write(fd, buf, BUFSZ) != BUFSZ)
+            {
+                printf("write %s failed: %s\n", name, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+        }
+        close(fd);
+    }
+
+    fflush(stdout);  // the children would print the buffered output again
+    uint64_t t0 = get_time_ms();
+    for (size_t i = 0; i < processes; i++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            printf("fork failed\n");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0)
+        {
+            parallel_file_name(name, sizeof(name), i);
+            read_file_repeatedly(name);
+            exit(EXIT_SUCCESS);
+        }
+    }
+    for (size_t i = 0; i < processes; i++)
+    {
+        wait(NULL);
+    }
+    uint64_t t1 = get_time_ms();
+
+    for (size_t i = 0; i < processes; i++)
+    {
+        parallel_file_name(name, sizeof(name), i);
+        unlink(name);
+    }
+    return t1 - t0;
+}
+
+void parallel_read_benchmark(size_t max_processes)
+{
+    printf("parallel read of %d KB per process (%d times):\n",
+           PARALLEL_FILE_SIZE / 1024, PARALLEL_READS);
+    printf("processes\t    ms\t  KB/s\n");
+    for (size_t processes = 1; processes <= max_processes; processes *= 2)
+    {
+        uint64_t ms = bench_parallel_read(processes);
+        uint64_t kb = (uint64_t)processes * PARALLEL_READS *
+                      (PARALLEL_FILE_SIZE / 1024);
+        printf("%9zu\t%6llu\t%6llu\n", processes, (unsigned long long)ms,
+               (unsigned long long)(kb * 1000 / (ms + 1)));
+    }
+}
+
 void print_results(struct test tests[num_bytes_per_run][num_fs_sizes])
 {
     printf("bytes:");
@@ -147,6 +246,17 @@ void print_results(struct test tests[num_bytes_per_run][num_fs_sizes])
 
 int main(int argc, char *argv[])
 {
+    if (argc == 3 && strcmp(argv[1], "-p") == 0)
+    {
+        parallel_read_benchmark(atoi(argv[2]));
+        return 0;
+    }
+    else if (argc != 1)
+    {
+        printf("usage: fsbench [-p max_processes]\n");
+        return 1;
+    }
+
     struct test bench_write[num_bytes_per_run][num_fs_sizes];
     struct test bench_read[num_bytes_per_run][num_fs_sizes];
 
@@ -4,6 +4,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <spawn.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -71,9 +72,14 @@ struct backcmd
 
 int fork1();  // Fork but panics on failure.
 void sh_panic(char *);
+void syntax_error(char *);
 struct cmd *parsecmd(char *);
+void freecmd(struct cmd *);
 void runcmd(struct cmd *) __attribute__((noreturn));
 
+// set by syntax_error() while parsing
+bool g_syntax_error = false;
+
 void execute_command(struct execcmd *ecmd)
 {
     if (ecmd->argv[0] == NULL) exit(1);
@@ -167,6 +173,256 @@ void runcmd(struct cmd *cmd)
     exit(EXIT_SUCCESS);
 }
 
+// File descriptor setup of a spawned command, collected while walking down
+// the command tree. Applied in order, so outer redirections come first like
+// in runcmd().
+#define FD_ACTION_OPEN 1
+#define FD_ACTION_DUP2 2
+#define FD_ACTION_CLOSE 3
+
+#define MAX_FD_ACTIONS 16
+#define MAX_SPAWNED_CMDS 16
+
+struct fd_action
+{
+    int type;
+    int fd;
+    int new_fd;
+    char *file;
+    int mode;
+};
+
+/// @brief Commands and pipelines of commands (with redirections) can be
+/// started with posix_spawn() directly from the shell. Blocks like (a; b)
+/// need a forked shell to run them.
+bool is_spawnable(struct cmd *cmd)
+{
+    switch (cmd->type)
+    {
+        case EXEC: return ((struct execcmd *)cmd)->argv[0] != NULL;
+        case REDIR: return is_spawnable(((struct redircmd *)cmd)->cmd);
+        case PIPE:
+            return is_spawnable(((struct pipecmd *)cmd)->left) &&
+                   is_spawnable(((struct pipecmd *)cmd)->right);
+        default: return false;
+    }
+}
+
+/// @brief Spawns one command with the given file descriptor setup.
+/// @return PID of the child or -1 on failure.
+pid_t spawn_command(struct execcmd *ecmd, struct fd_action *actions,
+                    int n_actions)
+{
+    // open the redirection targets first like runcmd(), posix_spawn() can't
+    // tell which file failed
+    for (int i = 0; i < n_actions; i++)
+    {
+        if (actions[i].type != FD_ACTION_OPEN) continue;
+
+        int fd = open(actions[i].file, actions[i].mode, 0644);
+        if (fd < 0)
+        {
+            fprintf(stderr, "open %s failed, %s\n", actions[i].file,
+                    strerror(errno));
+            return -1;
+        }
+        close(fd);
+    }
+
+    const char *full_path = find_program_in_path(ecmd->argv[0]);
+    if (full_path == NULL)
+    {
+        fprintf(stderr, "exec %s failed (%s)\n", ecmd->argv[0],
+                strerror(errno));
+        return -1;
+    }
+
+    posix_spawn_file_actions_t file_actions;
+    posix_spawn_file_actions_init(&file_actions);
+    int err = 0;
+    for (int i = 0; i < n_actions && err == 0; i++)
+    {
+        struct fd_action *a = &actions[i];
+        switch (a->type)
+        {
+            case FD_ACTION_OPEN:
+                err = posix_spawn_file_actions_addopen(&file_actions, a->fd,
+                                                       a->file, a->mode, 0644);
+                break;
+            case FD_ACTION_DUP2:
+                err = posix_spawn_file_actions_adddup2(&file_actions, a->fd,
+                                                       a->new_fd);
+                break;
+            case FD_ACTION_CLOSE:
+                err = posix_spawn_file_actions_addclose(&file_actions, a->fd);
+                break;
+        }
+    }
+
+    pid_t pid = -1;
+    if (err == 0)
+    {
+        err = posix_spawn(&pid, full_path, &file_actions, NULL, ecmd->argv,
+                          NULL);
+    }
+    posix_spawn_file_actions_destroy(&file_actions);
+    if (err != 0)
+    {
+        fprintf(stderr, "exec %s failed (%s)\n", ecmd->argv[0], strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+/// @brief Spawns all commands of a spawnable command tree.
+/// @param cmd Command tree, is_spawnable() must be true.
+/// @param actions Collected file descriptor setup, entries after n_actions
+/// are used as scratch space.
+/// @param n_actions Valid entries in actions.
+/// @param pids Returns the PIDs of the children in command line order, -1 for
+/// commands which failed to start.
+/// @param n_pids In/out: valid entries in pids.
+void spawn_tree(struct cmd *cmd, struct fd_action *actions, int n_actions,
+                pid_t *pids, int *n_pids)
+{
+    struct pipecmd *pcmd;
+    struct redircmd *rcmd;
+    int p[2];
+
+    switch (cmd->type)
+    {
+        case EXEC:
+            if (*n_pids >= MAX_SPAWNED_CMDS)
+            {
+                fprintf(stderr, "too many commands\n");
+                return;
+            }
+            pids[(*n_pids)++] =
+                spawn_command((struct execcmd *)cmd, actions, n_actions);
+            break;
+
+        case REDIR:
+            rcmd = (struct redircmd *)cmd;
+            if (n_actions + 1 > MAX_FD_ACTIONS)
+            {
+                fprintf(stderr, "too many redirections\n");
+                return;
+            }
+            actions[n_actions] = (struct fd_action){.type = FD_ACTION_OPEN,
+                                                    .fd = rcmd->fd,
+                                                    .file = rcmd->file,
+                                                    .mode = rcmd->mode};
+            spawn_tree(rcmd->cmd, actions, n_actions + 1, pids, n_pids);
+            break;
+
+        case PIPE:
+            pcmd = (struct pipecmd *)cmd;
+            if (n_actions + 3 > MAX_FD_ACTIONS)
+            {
+                fprintf(stderr, "too many redirections\n");
+                return;
+            }
+            if (pipe(p) < 0) sh_panic("pipe");
+
+            // left: stdout into the pipe, right: stdin from the pipe, neither
+            // keeps the original pipe fds open
+            actions[n_actions + 1] =
+                (struct fd_action){.type = FD_ACTION_CLOSE, .fd = p[0]};
+            actions[n_actions + 2] =
+                (struct fd_action){.type = FD_ACTION_CLOSE, .fd = p[1]};
+
+            actions[n_actions] = (struct fd_action){
+                .type = FD_ACTION_DUP2, .fd = p[1], .new_fd = STDOUT_FILENO};
+            spawn_tree(pcmd->left, actions, n_actions + 3, pids, n_pids);
+
+            actions[n_actions + 1] =
+                (struct fd_action){.type = FD_ACTION_CLOSE, .fd = p[0]};
+            actions[n_actions + 2] =
+                (struct fd_action){.type = FD_ACTION_CLOSE, .fd = p[1]};
+            actions[n_actions] = (struct fd_action){
+                .type = FD_ACTION_DUP2, .fd = p[0], .new_fd = STDIN_FILENO};
+            spawn_tree(pcmd->right, actions, n_actions + 3, pids, n_pids);
+
+            close(p[0]);
+            close(p[1]);
+            break;
+
+        default: sh_panic("spawn_tree");
+    }
+}
+
+/// @brief Waits for the given children. Other children which exit in the
+/// meantime (background commands) are reaped silently.
+/// @return Exit status of the last child.
+int wait_for_children(pid_t *pids, int n_pids)
+{
+    int status = (n_pids > 0 && pids[n_pids - 1] < 0) ? 1 : 0;
+
+    int remaining = 0;
+    for (int i = 0; i < n_pids; i++)
+    {
+        if (pids[i] >= 0) remaining++;
+    }
+
+    while (remaining > 0)
+    {
+        int wstatus;
+        pid_t pid = wait(&wstatus);
+        if (pid < 0) break;
+
+        for (int i = 0; i < n_pids; i++)
+        {
+            if (pids[i] != pid) continue;
+
+            remaining--;
+            if (i == n_pids - 1)
+            {
+                status = WEXITSTATUS(wstatus);
+            }
+        }
+    }
+    return status;
+}
+
+/// @brief Runs cmd from the shell process: Commands and pipelines get
+/// spawned without copying the shell with fork(), lists run one after
+/// another. Everything else is run by a forked shell.
+/// @return Exit status of the (last) command.
+int shellcmd(struct cmd *cmd)
+{
+    struct fd_action actions[MAX_FD_ACTIONS];
+    pid_t pids[MAX_SPAWNED_CMDS];
+    int n_pids = 0;
+
+    if (cmd->type == LIST)
+    {
+        struct listcmd *lcmd = (struct listcmd *)cmd;
+        shellcmd(lcmd->left);
+        return shellcmd(lcmd->right);
+    }
+
+    if (cmd->type == BACK && is_spawnable(((struct backcmd *)cmd)->cmd))
+    {
+        // don't wait, the children get reaped by a later wait
+        spawn_tree(((struct backcmd *)cmd)->cmd, actions, 0, pids, &n_pids);
+        return 0;
+    }
+
+    if (is_spawnable(cmd))
+    {
+        spawn_tree(cmd, actions, 0, pids, &n_pids);
+    }
+    else
+    {
+        pids[n_pids++] = fork1();
+        if (pids[0] == 0)
+        {
+            runcmd(cmd);
+        }
+    }
+    return wait_for_children(pids, n_pids);
+}
+
 int getcmd(char *buf, int nbuf, bool print_prompt)
 {
     if (print_prompt)
@@ -256,13 +512,15 @@ int main(int argc, const char *argv[])
             // ignore blank lines and don't fork just to return
             continue;
         }
-        if (fork1() == 0)
+
+        struct cmd *cmd = parsecmd(buf);
+        if (cmd == NULL)
         {
-            runcmd(parsecmd(buf));
+            status = 1;
+            continue;
         }
-
-        wait(&status);
-        status = WEXITSTATUS(status);
+        status = shellcmd(cmd);
+        freecmd(cmd);
     }
     return -1;
 }
@@ -273,6 +531,17 @@ void sh_panic(char *s)
     exit(1);
 }
 
+/// @brief Reports a syntax error. Parsing continues, but parsecmd() will
+/// discard the command (the shell itself parses, so it must not exit).
+void syntax_error(char *s)
+{
+    if (!g_syntax_error)
+    {
+        fprintf(stderr, "%s\n", s);
+    }
+    g_syntax_error = true;
+}
+
 int fork1()
 {
     pid_t pid = fork();
@@ -405,13 +674,19 @@ struct cmd *parsecmd(char *s)
     char *es;
     struct cmd *cmd;
 
+    g_syntax_error = false;
     es = s + strlen(s);
     cmd = parseline(&s, es);
     peek(&s, es, "");
-    if (s != es)
+    if (s != es && !g_syntax_error)
     {
         fprintf(stderr, "leftovers: %s\n", s);
-        sh_panic("syntax");
+        syntax_error("syntax");
+    }
+    if (g_syntax_error)
+    {
+        freecmd(cmd);
+        return NULL;
     }
     nulterminate(cmd);
     return cmd;
@@ -457,7 +732,10 @@ struct cmd *parseredirs(struct cmd *cmd, char **ps, char *es)
     {
         tok = gettoken(ps, es, 0, 0);
         if (gettoken(ps, es, &q, &eq) != 'a')
-            sh_panic("missing file for redirection");
+        {
+            syntax_error("missing file for redirection");
+            break;
+        }
         switch (tok)
         {
             case '<': cmd = redircmd(cmd, q, eq, O_RDONLY, 0); break;
@@ -479,7 +757,7 @@ struct cmd *parseblock(char **ps, char *es)
     if (!peek(ps, es, "(")) sh_panic("parseblock");
     gettoken(ps, es, 0, 0);
     cmd = parseline(ps, es);
-    if (!peek(ps, es, ")")) sh_panic("syntax - missing )");
+    if (!peek(ps, es, ")")) syntax_error("syntax - missing )");
     gettoken(ps, es, 0, 0);
     cmd = parseredirs(cmd, ps, es);
     return cmd;
@@ -502,11 +780,19 @@ struct cmd *parseexec(char **ps, char *es)
     while (!peek(ps, es, "|)&;"))
     {
         if ((tok = gettoken(ps, es, &q, &eq)) == 0) break;
-        if (tok != 'a') sh_panic("syntax");
+        if (tok != 'a')
+        {
+            syntax_error("syntax");
+            break;
+        }
+        if (argc >= MAX_EXEC_ARGSS - 1)
+        {
+            syntax_error("too many args");
+            break;
+        }
         cmd->argv[argc] = q;
         cmd->eargv[argc] = eq;
         argc++;
-        if (argc >= MAX_EXEC_ARGSS) sh_panic("too many args");
         ret = parseredirs(ret, ps, es);
     }
     cmd->argv[argc] = 0;
@@ -558,3 +844,24 @@ struct cmd *nulterminate(struct cmd *cmd)
     }
     return cmd;
 }
+
+/// Free a parsed command tree, the strings point into the input buffer.
+void freecmd(struct cmd *cmd)
+{
+    if (cmd == 0) return;
+
+    switch (cmd->type)
+    {
+        case REDIR: freecmd(((struct redircmd *)cmd)->cmd); break;
+        case PIPE:
+            freecmd(((struct pipecmd *)cmd)->left);
+            freecmd(((struct pipecmd *)cmd)->right);
+            break;
+        case LIST:
+            freecmd(((struct listcmd *)cmd)->left);
+            freecmd(((struct listcmd *)cmd)->right);
+            break;
+        case BACK: freecmd(((struct backcmd *)cmd)->cmd); break;
+    }
+    free(cmd);
+}
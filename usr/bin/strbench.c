@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vimixutils/time.h>
+
+// Measures the string and memory functions of the libc. Can be compiled for
+// the host as well to compare with the host libc.
+
+#define BUFSZ (64 * 1024)
+#define BYTES_PER_TEST (64 * 1024 * 1024)
+
+char src[BUFSZ + 64];
+char dst[BUFSZ + 64];
+
+const size_t sizes[] = {16, 256, 4096, BUFSZ};
+const size_t num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+enum function
+{
+    F_STRLEN,
+    F_STRCHR,
+    F_MEMCHR,
+    F_MEMCPY,
+    F_MEMSET,
+    F_STRCMP,
+    F_COUNT
+};
+
+const char *function_names[F_COUNT] = {"strlen", "strchr", "memchr",
+                                       "memcpy", "memset", "strcmp"};
+
+// the compiler must not optimize the calls away
+volatile size_t g_sink;
+
+/// @brief Run function on n bytes at src + src_offset and dst + dst_offset
+/// until BYTES_PER_TEST are done.
+/// @return Time in ms.
+uint64_t bench(enum function f, size_t n, size_t src_offset, size_t dst_offset)
+{
+    // strings of length n - 1 in src and dst, search for a char not in there
+    char *s = src + src_offset;
+    char *d = dst + dst_offset;
+    memset(s, 'a', n - 1);
+    s[n - 1] = 0;
+    memset(d, 'a', n - 1);
+    d[n - 1] = 0;
+
+    size_t runs = BYTES_PER_TEST / n;
+    uint64_t t0 = get_time_ms();
+    for (size_t i = 0; i < runs; ++i)
+    {
+        switch (f)
+        {
+            case F_STRLEN: g_sink += strlen(s); break;
+            case F_STRCHR: g_sink += (size_t)strchr(s, 'x'); break;
+            case F_MEMCHR: g_sink += (size_t)memchr(s, 'x', n); break;
+            case F_MEMCPY: g_sink += (size_t)memcpy(d, s, n); break;
+            case F_MEMSET: g_sink += (size_t)memset(d, 'a', n - 1); break;
+            case F_STRCMP: g_sink += strcmp(s, d); break;
+            default: break;
+        }
+    }
+    return get_time_ms() - t0;
+}
+
+void print_mb_per_s(uint64_t ms)
+{
+    if (ms == 0)
+    {
+        printf("\t   n/a");
+        return;
+    }
+    printf("\t%6llu", (unsigned long long)((BYTES_PER_TEST / 1024) * 1000 /
+                                           1024 / ms));
+}
+
+int main(int argc, char *argv[])
+{
+    printf("MB/s for aligned (a) and misaligned (m) buffers\n");
+    printf("bytes: ");
+    for (size_t i = 0; i < num_sizes; ++i)
+    {
+        printf("\t%6zu a\t%6zu m", sizes[i], sizes[i]);
+    }
+    printf("\n");
+
+    for (size_t f = 0; f < F_COUNT; ++f)
+    {
+        printf("%s", function_names[f]);
+        for (size_t i = 0; i < num_sizes; ++i)
+        {
+            print_mb_per_s(bench(f, sizes[i], 0, 0));
+            // different offsets: no word loop after aligning one pointer
+            print_mb_per_s(bench(f, sizes[i], 1, 3));
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -1171,6 +1171,44 @@ void qsort_test(char *s)
     }
 }
 
+void nanosleep_test(char *s)
+{
+    // relative sleep
+    struct timespec start;
+    struct timespec end;
+    struct timespec request = {.tv_sec = 0, .tv_nsec = 50 * 1000 * 1000};
+    assert_no_error(clock_gettime(CLOCK_MONOTONIC, &start));
+    assert_no_error(nanosleep(&request, NULL));
+    assert_no_error(clock_gettime(CLOCK_MONOTONIC, &end));
+
+    int64_t elapsed_ms = (end.tv_sec - start.tv_sec) * 1000 +
+                         (end.tv_nsec - start.tv_nsec) / (1000 * 1000);
+    if (elapsed_ms < 40)
+    {
+        printf("%s: error: slept only %d ms instead of 50 ms\n", s,
+               (int)elapsed_ms);
+        exit(1);
+    }
+
+    // absolute sleep with a deadline in the past returns at once
+    assert_no_error(
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &start, NULL));
+
+    // zero length sleep
+    request.tv_nsec = 0;
+    assert_no_error(nanosleep(&request, NULL));
+
+    // invalid requests
+    request.tv_nsec = 1000 * 1000 * 1000;
+    assert_error(nanosleep(&request, NULL));
+    assert_errno(EINVAL);
+
+    request.tv_sec = -1;
+    request.tv_nsec = 0;
+    assert_error(nanosleep(&request, NULL));
+    assert_errno(EINVAL);
+}
+
 struct test tests_common[] = {
     {dev_null, "dev_null", TEST_MASK_NONE},
     {dev_zero, "dev_zero", TEST_MASK_NONE},
@@ -1186,6 +1224,7 @@ struct test tests_common[] = {
     {file_access, "file_access", TEST_MASK_NONE},
     {qsort_test, "qsort", TEST_MASK_NONE},
     {truncate_test, "truncate", TEST_MASK_FILESYSTEM},
+    {nanosleep_test, "nanosleep", TEST_MASK_NONE},
 
     {0, 0, 0},
 };
@@ -4,6 +4,7 @@
 
 #include <dirent.h>
 #include <mm/mm.h>  // for USER_VA_END
+#include <spawn.h>
 #include <sys/statvfs.h>
 #include <vimixutils/minmax.h>
 #include <vimixutils/sysfs.h>
@@ -109,12 +110,25 @@ static inline void let_init_free_children(size_t expected_proc_count)
     }
 }
 
+// start and end of the usertests image, from the linker
+extern char __executable_start[];
+extern char end[];
+
 void prepare_test_environment()
 {
     // make memory usage more predictable
     set_sysfs("/sys/kmem/bio/min", 256);
     set_sysfs("/sys/kmem/bio/max_free", 0);
     set_sysfs("/sys/kernel/app_crash_v", 0);
+
+    // Text and read-only data get loaded on first access. Load all now, so
+    // the memory usage of the test runner does not change between tests.
+    long page_size = sysconf(_SC_PAGE_SIZE);
+    for (volatile char *addr = __executable_start; addr < end;
+         addr += page_size)
+    {
+        (void)*addr;
+    }
 }
 
 void reset_test_environment()
@@ -126,6 +140,9 @@ void reset_test_environment()
 size_t memory_allocated()
 {
     set_sysfs("/sys/kmem/dcache/clear_lru", 1);
+    set_sysfs("/sys/kmem/page_cache/drop", 1);
+    // the shrinkers run on low memory, so always start from shrunk caches
+    set_sysfs("/sys/kmem/shrink", 1024 * 1024);
     return get_from_sysfs("/sys/kmem/mem_alloc");
 }
 
@@ -2678,6 +2695,668 @@ void forktest(char *s)
     }
 }
 
+// fork() shares memory copy-on-write: writes of parent and child, directly
+// and by the kernel (read() into a shared page), must stay private.
+int32_t g_cow_global = 1;
+
+void cowtest(char *s)
+{
+    const size_t size = 16 * 4096;
+    uint8_t *buf = malloc(size);
+    if (buf == NULL)
+    {
+        printf("%s: malloc failed\n", s);
+        exit(1);
+    }
+    for (size_t i = 0; i < size; ++i) buf[i] = (uint8_t)i;
+
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        printf("%s: pipe() failed\n", s);
+        exit(1);
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        printf("%s: fork failed\n", s);
+        exit(1);
+    }
+    if (pid == 0)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (buf[i] != (uint8_t)i)
+            {
+                printf("%s: child sees wrong data\n", s);
+                exit(1);
+            }
+        }
+        memset(buf, 'c', size / 2);
+        g_cow_global = 2;
+
+        // kernel writes into a still shared page
+        close(fds[1]);
+        if (read(fds[0], buf + size - 8, 4) != 4)
+        {
+            printf("%s: read failed\n", s);
+            exit(1);
+        }
+        bool ok = (buf[0] == 'c') && (buf[size - 8] == 'p') &&
+                  (buf[size - 9] == (uint8_t)(size - 9)) && g_cow_global == 2;
+        exit(ok ? 0 : 1);
+    }
+
+    close(fds[0]);
+    if (write(fds[1], "pipe", 4) != 4)
+    {
+        printf("%s: write failed\n", s);
+        exit(1);
+    }
+    close(fds[1]);
+
+    int32_t xstatus;
+    wait(&xstatus);
+    if (WEXITSTATUS(xstatus) != 0)
+    {
+        printf("%s: child failed\n", s);
+        exit(1);
+    }
+
+    // the writes of the child must not be visible here
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (buf[i] != (uint8_t)i)
+        {
+            printf("%s: parent sees data written by child\n", s);
+            exit(1);
+        }
+    }
+    if (g_cow_global != 1)
+    {
+        printf("%s: parent sees global written by child\n", s);
+        exit(1);
+    }
+
+    // no longer shared, write must work without a copy
+    memset(buf, 'p', size);
+    free(buf);
+}
+
+/// @brief posix_spawn() with file actions: echo into a pipe (dup2) and into a
+/// file (open), failing spawns must report an error to the caller.
+void spawntest(char *s)
+{
+    const char *file_name = "spawn_out";
+    char *args[] = {"echo", "spawned", 0};
+
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        printf("%s: pipe() failed\n", s);
+        exit(1);
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+    pid_t pid;
+    int err = posix_spawn(&pid, bin_echo, &actions, NULL, args, NULL);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0)
+    {
+        printf("%s: posix_spawn failed (%s)\n", s, strerror(err));
+        exit(1);
+    }
+    close(fds[1]);
+
+    char result[16] = {0};
+    ssize_t n = read(fds[0], result, sizeof(result) - 1);
+    close(fds[0]);
+    int32_t xstatus;
+    if (wait(&xstatus) != pid || WEXITSTATUS(xstatus) != 0)
+    {
+        printf("%s: wait for spawned child failed\n", s);
+        exit(1);
+    }
+    if (n != 8 || strcmp(result, "spawned\n") != 0)
+    {
+        printf("%s: read wrong data from spawned child\n", s);
+        exit(1);
+    }
+
+    // redirect to a file
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, file_name,
+                                     O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    err = posix_spawn(&pid, bin_echo, &actions, NULL, args, NULL);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0 || wait(&xstatus) != pid)
+    {
+        printf("%s: posix_spawn with open failed\n", s);
+        exit(1);
+    }
+    int fd = open(file_name, O_RDONLY);
+    memset(result, 0, sizeof(result));
+    if (fd < 0 || read(fd, result, sizeof(result) - 1) != 8 ||
+        strcmp(result, "spawned\n") != 0)
+    {
+        printf("%s: spawned child did not write to file\n", s);
+        exit(1);
+    }
+    close(fd);
+    unlink(file_name);
+
+    // errors
+    err = posix_spawn(&pid, "/nonexisting", NULL, NULL, args, NULL);
+    if (err != ENOENT)
+    {
+        printf("%s: spawn of missing binary returned %d\n", s, err);
+        exit(1);
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, 12, STDOUT_FILENO);
+    err = posix_spawn(&pid, bin_echo, &actions, NULL, args, NULL);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != EBADF)
+    {
+        printf("%s: dup2 of closed fd returned %d\n", s, err);
+        exit(1);
+    }
+}
+
+// fork and exec echo without output, returns the exit status
+static int32_t run_echo_silent()
+{
+    char *args[] = {"echo", "pagecache", 0};
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        return -1;
+    }
+    if (pid == 0)
+    {
+        close(STDOUT_FILENO);
+        execv(bin_echo, args);
+        exit(1);
+    }
+
+    int32_t xstatus;
+    if (wait(&xstatus) != pid)
+    {
+        return -1;
+    }
+    return WEXITSTATUS(xstatus);
+}
+
+void pagecache(char *s)
+{
+    // start with no cached pages
+    set_sysfs("/sys/kmem/dcache/clear_lru", 1);
+    set_sysfs("/sys/kmem/page_cache/drop", 1);
+
+    size_t misses_start = get_from_sysfs("/sys/kmem/page_cache/misses");
+    if (run_echo_silent() != 0)
+    {
+        printf("%s: first echo failed\n", s);
+        exit(1);
+    }
+    size_t misses_first = get_from_sysfs("/sys/kmem/page_cache/misses");
+    size_t hits_first = get_from_sysfs("/sys/kmem/page_cache/hits");
+    if (misses_first == misses_start)
+    {
+        printf("%s: first exec did not read text through the cache\n", s);
+        exit(1);
+    }
+    if (get_from_sysfs("/sys/kmem/page_cache/pages") == 0)
+    {
+        printf("%s: no pages cached after exec\n", s);
+        exit(1);
+    }
+
+    // second run maps the same pages from the cache
+    if (run_echo_silent() != 0)
+    {
+        printf("%s: second echo failed\n", s);
+        exit(1);
+    }
+    size_t misses_second = get_from_sysfs("/sys/kmem/page_cache/misses");
+    size_t hits_second = get_from_sysfs("/sys/kmem/page_cache/hits");
+    if (misses_second != misses_first || hits_second == hits_first)
+    {
+        printf("%s: second exec read the binary again (%zu misses)\n", s,
+               misses_second - misses_first);
+        exit(1);
+    }
+
+    // no process maps the pages anymore
+    set_sysfs("/sys/kmem/page_cache/drop", 1);
+    size_t pages = get_from_sysfs("/sys/kmem/page_cache/pages");
+    if (run_echo_silent() != 0 ||
+        get_from_sysfs("/sys/kmem/page_cache/misses") == misses_second)
+    {
+        printf("%s: exec after dropping the cache failed (%zu pages left)\n",
+               s, pages);
+        exit(1);
+    }
+}
+
+// a running program maps its text from the page cache, so its binary must not
+// change till it exited
+void textbusy(char *s)
+{
+    const char *file = "textbusy";
+    static char buf[4096];
+    int src = open("/usr/bin/cat", O_RDONLY);
+    int fd = open(file, O_CREAT | O_WRONLY, 0755);
+    if (src < 0 || fd < 0)
+    {
+        printf("%s: open failed\n", s);
+        exit(1);
+    }
+    ssize_t n;
+    while ((n = read(src, buf, sizeof(buf))) > 0)
+    {
+        if (write(fd, buf, n) != n)
+        {
+            printf("%s: copy failed\n", s);
+            exit(1);
+        }
+    }
+    close(src);
+    close(fd);
+
+    // the copy of cat is running once it returned the first byte
+    int to_cat[2];
+    int from_cat[2];
+    if (pipe(to_cat) < 0 || pipe(from_cat) < 0)
+    {
+        printf("%s: pipe failed\n", s);
+        exit(1);
+    }
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        printf("%s: fork failed\n", s);
+        exit(1);
+    }
+    if (pid == 0)
+    {
+        close(STDIN_FILENO);
+        dup(to_cat[0]);
+        close(STDOUT_FILENO);
+        dup(from_cat[1]);
+        close(to_cat[0]);
+        close(to_cat[1]);
+        close(from_cat[0]);
+        close(from_cat[1]);
+        char *args[] = {"cat", 0};
+        execv(file, args);
+        exit(1);
+    }
+    close(to_cat[0]);
+    close(from_cat[1]);
+    char c = 'x';
+    if (write(to_cat[1], &c, 1) != 1 || read(from_cat[0], &c, 1) != 1)
+    {
+        printf("%s: program did not start\n", s);
+        exit(1);
+    }
+
+    // writing the same bytes would not even harm the running program
+    fd = open(file, O_RDWR);
+    if (fd < 0 || read(fd, buf, 64) != 64 || lseek(fd, 0, SEEK_SET) != 0)
+    {
+        printf("%s: read of the running binary failed\n", s);
+        exit(1);
+    }
+    assert_error(write(fd, buf, 64));
+    assert_errno(ETXTBSY);
+    close(fd);
+    assert_error(open(file, O_WRONLY | O_TRUNC));
+    assert_errno(ETXTBSY);
+    assert_error(truncate(file, 0));
+    assert_errno(ETXTBSY);
+
+    // after the program exited the binary can change again
+    close(to_cat[1]);
+    int32_t xstatus;
+    if (wait(&xstatus) != pid || WEXITSTATUS(xstatus) != 0)
+    {
+        printf("%s: program failed\n", s);
+        exit(1);
+    }
+    close(from_cat[0]);
+    fd = open(file, O_WRONLY | O_TRUNC);
+    if (fd < 0)
+    {
+        printf("%s: truncate after exit failed\n", s);
+        exit(1);
+    }
+    close(fd);
+    unlink(file);
+}
+
+// the kernel allocates and frees pages one by one, which must merge all
+// buddies again
+void kallocbench(char *s)
+{
+    const size_t PAGES = 1024;
+    size_t free_start = get_from_sysfs("/sys/kmem/mem_free");
+    if (!set_sysfs("/sys/kmem/bench_alloc", PAGES))
+    {
+        printf("%s: benchmark failed\n", s);
+        exit(1);
+    }
+    size_t pages = get_from_sysfs("/sys/kmem/bench_alloc");
+    size_t free_end = get_from_sysfs("/sys/kmem/mem_free");
+    if (pages != PAGES || free_end != free_start)
+    {
+        printf("%s: %zu of %zu pages, free memory %zu -> %zu\n", s, pages,
+               PAGES, free_start, free_end);
+        exit(1);
+    }
+}
+
+void cpupagecache(char *s)
+{
+    size_t low = get_from_sysfs("/sys/kmem/cpu_cache_low");
+    size_t high = get_from_sysfs("/sys/kmem/cpu_cache_high");
+
+    // pages freed by this test are in the cache of this CPU
+    char *mem = sbrk(4 * 4096);
+    if (mem == (char *)-1)
+    {
+        printf("%s: sbrk failed\n", s);
+        exit(1);
+    }
+    for (size_t i = 0; i < 4; ++i) mem[i * 4096] = 1;
+    sbrk(-4 * 4096);
+
+    // disabling the caches drains all pages back to the buddy allocator
+    size_t free_start = get_from_sysfs("/sys/kmem/mem_free");
+    set_sysfs("/sys/kmem/cpu_cache_high", 0);
+    if (get_from_sysfs("/sys/kmem/cpu_cache_pages") != 0 ||
+        get_from_sysfs("/sys/kmem/mem_free") != free_start)
+    {
+        printf("%s: caches not drained\n", s);
+        exit(1);
+    }
+
+    // low watermark above the high watermark is rejected
+    int fd = open("/sys/kmem/cpu_cache_low", O_WRONLY);
+    if (fd < 0)
+    {
+        printf("%s: open cpu_cache_low failed\n", s);
+        exit(1);
+    }
+    if (write(fd, "1", 1) != -1)
+    {
+        printf("%s: low > high accepted\n", s);
+        exit(1);
+    }
+    close(fd);
+
+    set_sysfs("/sys/kmem/cpu_cache_high", high);
+    set_sysfs("/sys/kmem/cpu_cache_low", low);
+    if (get_from_sysfs("/sys/kmem/cpu_cache_low") != low ||
+        get_from_sysfs("/sys/kmem/cpu_cache_high") != high)
+    {
+        printf("%s: watermarks not restored\n", s);
+        exit(1);
+    }
+}
+
+// empty slabs of the file cache are kept up to max_empty and freed by shrink
+void slabshrink(char *s)
+{
+    const size_t FILES = 16;
+    int fds[FILES];
+    for (size_t i = 0; i < FILES; ++i)
+    {
+        fds[i] = open("/", O_RDONLY);
+        if (fds[i] < 0)
+        {
+            // out of file descriptors, enough to test
+            fds[i] = -1;
+            break;
+        }
+    }
+    for (size_t i = 0; i < FILES && fds[i] >= 0; ++i)
+    {
+        close(fds[i]);
+    }
+
+    size_t max_empty = get_from_sysfs("/sys/kmem/file/max_empty");
+    set_sysfs("/sys/kmem/file/mag_drain", 1);
+    size_t empty = get_from_sysfs("/sys/kmem/file/empty_slabs");
+    if (empty > max_empty)
+    {
+        printf("%s: %zu empty slabs kept, max %zu\n", s, empty, max_empty);
+        exit(1);
+    }
+
+    set_sysfs("/sys/kmem/file/shrink", 1);
+    if (get_from_sysfs("/sys/kmem/file/empty_slabs") != 0)
+    {
+        printf("%s: empty slabs left after shrink\n", s);
+        exit(1);
+    }
+}
+
+// the shrinkers evict unused dentries and free buffers
+void shrinkers(char *s)
+{
+    // fill the dentry LRU list and the block IO cache
+    for (size_t i = 0; i < 4; ++i)
+    {
+        struct stat st;
+        stat("/usr/bin", &st);
+        stat("/dev/null", &st);
+    }
+
+    size_t runs = get_from_sysfs("/sys/kmem/shrink_runs");
+    set_sysfs("/sys/kmem/shrink", 1024 * 1024);
+    if (get_from_sysfs("/sys/kmem/shrink_runs") != runs + 1)
+    {
+        printf("%s: shrinkers did not run\n", s);
+        exit(1);
+    }
+
+    size_t lru = get_from_sysfs("/sys/kmem/dcache/lru_size");
+    size_t buffers = get_from_sysfs("/sys/kmem/bio/num");
+    size_t min_buffers = get_from_sysfs("/sys/kmem/bio/min");
+    if (lru != 0 || buffers > min_buffers)
+    {
+        printf("%s: %zu dentries in the LRU list, %zu buffers (min %zu)\n", s,
+               lru, buffers, min_buffers);
+        exit(1);
+    }
+}
+
+// idle CPUs fill the zero page pool, zeroed allocations take from it
+void zeropool(char *s)
+{
+    size_t target = get_from_sysfs("/sys/kmem/zero_pool_target");
+    if (target == 0)
+    {
+        // pool disabled, nothing to test
+        return;
+    }
+
+    // sleeping leaves the CPUs idle
+    usleep(SHORT_SLEEP_MS * 1000);
+    if (get_from_sysfs("/sys/kmem/zero_pool_pages") == 0)
+    {
+        printf("%s: pool not filled\n", s);
+        exit(1);
+    }
+
+    size_t hits = get_from_sysfs("/sys/kmem/zero_pool_hits");
+    char *mem = sbrk(4 * 4096);
+    if (mem == (char *)-1)
+    {
+        printf("%s: sbrk failed\n", s);
+        exit(1);
+    }
+    for (size_t i = 0; i < 4 * 4096; i += 512)
+    {
+        if (mem[i] != 0)
+        {
+            printf("%s: heap not zeroed\n", s);
+            exit(1);
+        }
+    }
+    sbrk(-4 * 4096);
+    if (get_from_sysfs("/sys/kmem/zero_pool_hits") == hits)
+    {
+        printf("%s: no allocation from the pool\n", s);
+        exit(1);
+    }
+
+    set_sysfs("/sys/kmem/zero_pool_target", 0);
+    if (get_from_sysfs("/sys/kmem/zero_pool_pages") != 0)
+    {
+        printf("%s: pool not drained\n", s);
+        exit(1);
+    }
+    set_sysfs("/sys/kmem/zero_pool_target", target);
+}
+
+// sysfs reads kmalloc() a buffer of the requested size: 2 KiB objects come
+// from multi page slabs, larger buffers from whole pages
+void kmalloclarge(char *s)
+{
+    if (get_from_sysfs("/sys/kmem/kmalloc_2048/slab_order") == 0)
+    {
+        printf("%s: 2048 byte objects in single page slabs\n", s);
+        exit(1);
+    }
+
+    const size_t SIZES[] = {2000, 3 * 4096, 8 * 4096};
+    static char buf[8 * 4096];
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); ++i)
+    {
+        int fd = open("/sys/kmem/kmalloc_2048/obj_size", O_RDONLY);
+        if (fd < 0)
+        {
+            printf("%s: open failed\n", s);
+            exit(1);
+        }
+        ssize_t n = read(fd, buf, SIZES[i]);
+        close(fd);
+        if (n != 5 || strncmp(buf, "2048\n", 5) != 0)
+        {
+            printf("%s: read of %zu bytes failed\n", s, SIZES[i]);
+            exit(1);
+        }
+    }
+}
+
+// reading a file again finds its blocks in the block IO cache
+void biocache(char *s)
+{
+    const char *file = "biocache";
+    static char buf[4 * 1024];
+    int fd = open(file, O_CREAT | O_RDWR, 0755);
+    if (fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf))
+    {
+        printf("%s: create failed\n", s);
+        exit(1);
+    }
+    close(fd);
+
+    size_t hits = get_from_sysfs("/sys/kmem/bio/hits");
+    for (size_t i = 0; i < 2; ++i)
+    {
+        fd = open(file, O_RDONLY);
+        if (fd < 0 || read(fd, buf, sizeof(buf)) != sizeof(buf))
+        {
+            printf("%s: read failed\n", s);
+            exit(1);
+        }
+        close(fd);
+    }
+    unlink(file);
+
+    // the file has 4 data blocks
+    if (get_from_sysfs("/sys/kmem/bio/hits") < hits + 4)
+    {
+        printf("%s: blocks not found in the cache\n", s);
+        exit(1);
+    }
+}
+
+void readahead(char *s)
+{
+    const char *file = "readahead";
+    static char buf[64 * 1024];
+    for (size_t i = 0; i < sizeof(buf); ++i)
+    {
+        buf[i] = (char)(i % 251);
+    }
+    int fd = open(file, O_CREAT | O_RDWR, 0755);
+    if (fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf))
+    {
+        printf("%s: create failed\n", s);
+        exit(1);
+    }
+    close(fd);
+
+    // drop the cached blocks of the file (max_free is 0 during the tests)
+    size_t min = get_from_sysfs("/sys/kmem/bio/min");
+    set_sysfs("/sys/kmem/bio/min", 16);
+    set_sysfs("/sys/kmem/bio/min", min);
+
+    size_t read_ahead = get_from_sysfs("/sys/kmem/bio/readahead");
+    size_t hits = get_from_sysfs("/sys/kmem/bio/hits");
+    size_t misses = get_from_sysfs("/sys/kmem/bio/misses");
+    fd = open(file, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("%s: open failed\n", s);
+        exit(1);
+    }
+    char block[1024];
+    for (size_t off = 0; off < sizeof(buf); off += sizeof(block))
+    {
+        if (read(fd, block, sizeof(block)) != sizeof(block) ||
+            memcmp(block, buf + off, sizeof(block)) != 0)
+        {
+            printf("%s: wrong data at %zu\n", s, off);
+            exit(1);
+        }
+    }
+    close(fd);
+    size_t blocks = sizeof(buf) / sizeof(block);
+    size_t new_hits = get_from_sysfs("/sys/kmem/bio/hits") - hits;
+    size_t new_misses = get_from_sysfs("/sys/kmem/bio/misses") - misses;
+    unlink(file);
+
+    if (get_from_sysfs("/sys/kmem/bio/readahead") == read_ahead)
+    {
+        printf("%s: no blocks read ahead\n", s);
+        exit(1);
+    }
+    // all reads but the first find their block read ahead
+    if (new_hits < blocks - 1)
+    {
+        printf("%s: only %zu cache hits\n", s, new_hits);
+        exit(1);
+    }
+    // each block misses once (+ a few for the inode, directory and indirect
+    // block), blocks read ahead must not get dropped before they are read
+    if (new_misses > blocks + 8)
+    {
+        printf("%s: %zu cache misses for %zu blocks\n", s, new_misses, blocks);
+        exit(1);
+    }
+}
+
 void sbrkbasic(char *s)
 {
 #ifdef __ARCH_32BIT
@@ -3088,6 +3767,57 @@ void sbrkarg(char *s)
     }
 }
 
+/// @brief sbrk() only reserves address space, pages get allocated (zeroed) on
+/// first access.
+void sbrklazy(char *s)
+{
+    long page_size = sysconf(_SC_PAGE_SIZE);
+    const size_t pages = 64;
+
+    size_t free_before = get_from_sysfs("/sys/kmem/mem_free");
+    char *a = sbrk(pages * page_size);
+    if (a == (char *)-1)
+    {
+        printf("%s: sbrk failed\n", s);
+        exit(1);
+    }
+    size_t free_reserved = get_from_sysfs("/sys/kmem/mem_free");
+    if (free_before - free_reserved > (pages / 4) * page_size)
+    {
+        printf("%s: sbrk allocated memory before first access\n", s);
+        exit(1);
+    }
+
+    // loads and stores
+    for (size_t i = 0; i < pages; i += 2)
+    {
+        if (a[i * page_size] != 0)
+        {
+            printf("%s: new heap page not zeroed\n", s);
+            exit(1);
+        }
+        a[(i + 1) * page_size + 1] = 'x';
+    }
+    size_t free_touched = get_from_sysfs("/sys/kmem/mem_free");
+    if (free_reserved - free_touched < (pages / 2) * page_size)
+    {
+        printf("%s: touched pages are not backed by memory\n", s);
+        exit(1);
+    }
+
+    // shrinking over populated and not populated pages
+    if (sbrk(-(pages * page_size)) == (char *)-1)
+    {
+        printf("%s: sbrk shrink failed\n", s);
+        exit(1);
+    }
+    if (get_from_sysfs("/sys/kmem/mem_free") < free_touched)
+    {
+        printf("%s: shrinking did not free memory\n", s);
+        exit(1);
+    }
+}
+
 void validatetest(char *s)
 {
     size_t hi = 1100 * 1024;
@@ -3816,12 +4546,25 @@ struct test tests_vimix[] = {
     {dirfile, "dirfile", TEST_MASK_FILESYSTEM},
     {iref, "iref", TEST_MASK_FILESYSTEM},
     {forktest, "forktest", TEST_MASK_CORE_COUNT},
+    {cowtest, "cowtest", TEST_MASK_NONE},
+    {spawntest, "spawntest", TEST_MASK_FILESYSTEM},
+    {pagecache, "pagecache", TEST_MASK_NONE},
+    {textbusy, "textbusy", TEST_MASK_FILESYSTEM},
+    {kallocbench, "kallocbench", TEST_MASK_NONE},
+    {cpupagecache, "cpupagecache", TEST_MASK_NONE},
+    {slabshrink, "slabshrink", TEST_MASK_NONE},
+    {kmalloclarge, "kmalloclarge", TEST_MASK_NONE},
+    {shrinkers, "shrinkers", TEST_MASK_NONE},
+    {zeropool, "zeropool", TEST_MASK_NONE},
+    {biocache, "biocache", TEST_MASK_FILESYSTEM},
+    {readahead, "readahead", TEST_MASK_FILESYSTEM},
     {sbrkbasic, "sbrkbasic", TEST_MASK_MEMORY_SIZE},
     {sbrkmuch, "sbrkmuch", TEST_MASK_MEMORY_SIZE},
     {kernmem, "kernmem", TEST_MASK_NONE},
     {USER_VA_ENDplus, "USER_VA_ENDplus", TEST_MASK_NONE},
     {sbrkfail, "sbrkfail", TEST_MASK_MEMORY_SIZE},
     {sbrkarg, "sbrkarg", TEST_MASK_NONE},
+    {sbrklazy, "sbrklazy", TEST_MASK_NONE},
     {validatetest, "validatetest", TEST_MASK_NONE},
     {bsstest, "bsstest", TEST_MASK_NONE},
     {bigargtest, "bigargtest", TEST_MASK_NONE},
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: MIT */
+#pragma once
+
+#include <kernel/spawn.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/// @brief File actions to apply in the child of posix_spawn() before the
+/// program starts.
+typedef struct
+{
+    int32_t count;  ///< used entries in actions
+    struct spawn_action actions[SPAWN_MAX_ACTIONS];
+} posix_spawn_file_actions_t;
+
+/// @brief Spawn attributes, none are supported.
+typedef struct
+{
+    int32_t flags;
+} posix_spawnattr_t;
+
+/// @brief System call: Creates a new process running the program at pathname
+/// without copying the callers memory. The child inherits the file
+/// descriptors after actions were applied.
+/// @param pathname Program to execute.
+/// @param argv NULL terminated argument list.
+/// @param actions Array of n_actions file actions or NULL.
+/// @param n_actions Number of actions, max SPAWN_MAX_ACTIONS.
+/// @return PID of the child or -1 on failure with errno set.
+extern pid_t spawn(const char *pathname, char *const argv[],
+                   const struct spawn_action *actions, int32_t n_actions);
+
+/// @brief Creates a new process running the program at path.
+/// @param pid Returns the PID of the child if not NULL.
+/// @param path Program to execute (no PATH search).
+/// @param file_actions NULL or actions to apply to the childs file descriptors.
+/// @param attrp Ignored.
+/// @param argv NULL terminated argument list.
+/// @param envp Ignored, there is no environment.
+/// @return 0 on success, an error number on failure.
+int posix_spawn(pid_t *pid, const char *path,
+                const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp, char *const argv[],
+                char *const envp[]);
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *file_actions);
+
+/// @brief Frees the paths of all open actions.
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *file_actions);
+
+/// @brief Adds a close(fd) to the actions.
+/// @return 0 on success, an error number on failure.
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *file_actions,
+                                      int fd);
+
+/// @brief Adds a dup2(fd, new_fd) to the actions.
+/// @return 0 on success, an error number on failure.
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *file_actions,
+                                     int fd, int new_fd);
+
+/// @brief Adds an open(path, oflag, mode) as fd to the actions.
+/// @return 0 on success, an error number on failure.
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *file_actions,
+                                     int fd, const char *path, int oflag,
+                                     mode_t mode);
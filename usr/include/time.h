@@ -32,3 +32,16 @@ time_t time(time_t *tloc);
 struct tm *localtime(const time_t *timer);
 
 int clock_gettime(clockid_t clockid, struct timespec *tp);
+
+/// @brief Suspends the calling process until the time in request passed.
+/// @param clockid CLOCK_REALTIME or CLOCK_MONOTONIC
+/// @param flags 0 for a relative request or TIMER_ABSTIME
+/// @param request Time to sleep (or wake up at with TIMER_ABSTIME).
+/// @param remain If not NULL and interrupted, the remaining time of a
+/// relative sleep.
+/// @return 0 on success, -1 on error with errno set.
+int clock_nanosleep(clockid_t clockid, int flags,
+                    const struct timespec *request, struct timespec *remain);
+
+/// @brief Relative sleep on CLOCK_MONOTONIC, see clock_nanosleep().
+int nanosleep(const struct timespec *request, struct timespec *remain);
@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <errno.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+
+int posix_spawn(pid_t *pid, const char *path,
+                const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp, char *const argv[],
+                char *const envp[])
+{
+    const struct spawn_action *actions = NULL;
+    int32_t n_actions = 0;
+    if (file_actions != NULL)
+    {
+        actions = file_actions->actions;
+        n_actions = file_actions->count;
+    }
+
+    pid_t child = spawn(path, argv, actions, n_actions);
+    if (child < 0)
+    {
+        return errno;
+    }
+    if (pid != NULL)
+    {
+        *pid = child;
+    }
+    return 0;
+}
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *file_actions)
+{
+    file_actions->count = 0;
+    return 0;
+}
+
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *file_actions)
+{
+    for (int32_t i = 0; i < file_actions->count; i++)
+    {
+        if (file_actions->actions[i].type == SPAWN_ACTION_OPEN)
+        {
+            free((char *)file_actions->actions[i].path);
+        }
+    }
+    file_actions->count = 0;
+    return 0;
+}
+
+/// @brief Returns the next free action or NULL if all are used.
+static struct spawn_action *next_action(posix_spawn_file_actions_t *fa)
+{
+    if (fa->count >= SPAWN_MAX_ACTIONS)
+    {
+        return NULL;
+    }
+    struct spawn_action *action = &fa->actions[fa->count];
+    memset(action, 0, sizeof(struct spawn_action));
+    return action;
+}
+
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *file_actions,
+                                      int fd)
+{
+    if (fd < 0) return EBADF;
+    struct spawn_action *action = next_action(file_actions);
+    if (action == NULL) return ENOMEM;
+
+    action->type = SPAWN_ACTION_CLOSE;
+    action->fd = fd;
+    file_actions->count++;
+    return 0;
+}
+
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *file_actions,
+                                     int fd, int new_fd)
+{
+    if (fd < 0 || new_fd < 0) return EBADF;
+    struct spawn_action *action = next_action(file_actions);
+    if (action == NULL) return ENOMEM;
+
+    action->type = SPAWN_ACTION_DUP2;
+    action->fd = fd;
+    action->new_fd = new_fd;
+    file_actions->count++;
+    return 0;
+}
+
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *file_actions,
+                                     int fd, const char *path, int oflag,
+                                     mode_t mode)
+{
+    if (fd < 0) return EBADF;
+    struct spawn_action *action = next_action(file_actions);
+    if (action == NULL) return ENOMEM;
+
+    char *path_copy = strdup(path);
+    if (path_copy == NULL) return ENOMEM;
+
+    action->type = SPAWN_ACTION_OPEN;
+    action->fd = fd;
+    action->flags = oflag;
+    action->mode = mode;
+    action->path = path_copy;
+    file_actions->count++;
+    return 0;
+}
@@ -47,6 +47,11 @@ time_t time(time_t *tloc)
     return time;
 }
 
+int nanosleep(const struct timespec *request, struct timespec *remain)
+{
+    return clock_nanosleep(CLOCK_MONOTONIC, 0, request, remain);
+}
+
 #define SECONDS_PER_MINUTE (60)
 #define MINUTES_PER_HOUR (60)
 #define HOURS_PER_DAY (24)
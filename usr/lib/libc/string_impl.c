@@ -19,6 +19,7 @@ char *strerror(int errnum)
         CODE_STRING(EPERM, "Operation not permitted");
         CODE_STRING(ENOENT, "No such file or directory");
         CODE_STRING(ESRCH, "No such process");
+        CODE_STRING(EINTR, "Interrupted system call");
         CODE_STRING(EIO, "I/O error");
         CODE_STRING(E2BIG, "Argument list too long");
         CODE_STRING(ENOEXEC, "Exec format error");
@@ -35,6 +36,7 @@ char *strerror(int errnum)
         CODE_STRING(EINVAL, "Invalid argument");
         CODE_STRING(EMFILE, "Too many open files for this process");
         CODE_STRING(ENOTTY, "Not a TTY device file");
+        CODE_STRING(ETXTBSY, "Text file busy");
         CODE_STRING(EFBIG, "File too large");
         CODE_STRING(ENOSPC, "No space left on device");
         CODE_STRING(ESPIPE, "Illegal seek, fd is a pipe");
@@ -82,3 +82,5 @@ entry("fchmod");
 entry("setgroups");
 entry("getgroups");
 entry("umask");
+entry("clock_nanosleep");
+entry("spawn");